@@ -97,6 +97,13 @@ int rtcap_xmit_hook(struct rtskb *rtskb, struct rtnet_device *rtdev)
     rtdm_lockctx_t      context;
 
 
+    /* fragments may be reused by their owner before the capture is
+       processed, and they would keep the sender waiting for Linux */
+    if (unlikely(rtskb->nr_frags > 0) && (rtskb_linearize(rtskb) < 0)) {
+        tap_dev->tap_dev_stats.rx_dropped++;
+        return tap_dev->orig_xmit(rtskb, rtdev);
+    }
+
     if ((rtskb->cap_comp_skb = rtskb_dequeue(&cap_pool)) == 0) {
         tap_dev->tap_dev_stats.rx_dropped++;
         return tap_dev->orig_xmit(rtskb, rtdev);
@@ -156,7 +163,7 @@ void rtcap_kfree_rtskb(struct rtskb *rtskb)
 
         rtdm_lock_put_irqrestore(&rtcap_lock, context);
 
-        rtskb_queue_tail(comp_skb->pool, comp_skb);
+        rtskb_pool_queue_tail(comp_skb->pool, comp_skb);
 #ifdef CONFIG_RTNET_CHECKED
         comp_skb->pool->pool_balance++;
 #endif
@@ -167,7 +174,7 @@ void rtcap_kfree_rtskb(struct rtskb *rtskb)
     rtdm_lock_put_irqrestore(&rtcap_lock, context);
 
     rtskb->chain_end = rtskb;
-    rtskb_queue_tail(rtskb->pool, rtskb);
+    rtskb_pool_queue_tail(rtskb->pool, rtskb);
 #ifdef CONFIG_RTNET_CHECKED
     rtskb->pool->pool_balance++;
 #endif
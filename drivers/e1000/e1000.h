@@ -88,6 +88,7 @@
 
 // RTNET
 #include <rtnet_port.h>
+#include <rtvlan.h>
 
 
 #define BAR_0		0
@@ -139,6 +140,9 @@ struct e1000_adapter;
 #define E1000_RXBUFFER_8192  8192
 #define E1000_RXBUFFER_16384 16384
 
+/* largest MTU, limited by the 16K RX buffers of jumbo class rtskbs */
+#define E1000_MAX_JUMBO_MTU  9000
+
 /* SmartSpeed delimiters */
 #define E1000_SMARTSPEED_DOWNSHIFT 3
 #define E1000_SMARTSPEED_MAX       15
@@ -158,6 +162,7 @@ struct e1000_adapter;
 #define E1000_TX_QUEUE_WAKE	16
 /* How many Rx Buffers do we bundle into one write to the hardware ? */
 #define E1000_RX_BUFFER_WRITE	16	/* Must be power of 2 */
+#define E1000_RX_BATCH		16	/* rtskbs passed to the stack at once */
 
 #define AUTO_ALL_MODES            0
 #define E1000_EEPROM_82544_APM    0x0004
@@ -254,6 +254,11 @@ static int cards[MAX_UNITS] = { [0 ... (MAX_UNITS-1)] = 1 };
 compat_module_int_param_array(cards, MAX_UNITS);
 MODULE_PARM_DESC(cards, "array of cards to be supported (eg. 1,0,1)");
 
+static int mtu[MAX_UNITS] = { [0 ... (MAX_UNITS-1)] = ETH_DATA_LEN };
+compat_module_int_param_array(mtu, MAX_UNITS);
+MODULE_PARM_DESC(mtu, "array of MTUs, values above 1500 enable jumbo frames "
+		 "(max. " __MODULE_STRING(E1000_MAX_JUMBO_MTU) ")");
+
 
 #define kmalloc(a,b) rtdm_malloc(a)
 #define vmalloc(a) rtdm_malloc(a)
@@ -633,6 +638,13 @@ e1000_reset(struct e1000_adapter *adapter)
 		DPRINTK(PROBE, ERR, "Hardware Error\n");
 	/* Enable h/w to recognize an 802.1Q VLAN Ethernet packet */
 	E1000_WRITE_REG(&adapter->hw, VET, ETHERNET_IEEE_VLAN_TYPE);
+#ifdef CONFIG_RTNET_VLAN
+	/* strip received tags into the descriptor, insert those of VLAN
+	 * devices on transmission */
+	if (adapter->hw.mac_type >= e1000_82543)
+		E1000_WRITE_REG(&adapter->hw, CTRL,
+		                E1000_READ_REG(&adapter->hw, CTRL) | E1000_CTRL_VME);
+#endif
 
         E1000_WRITE_REG(&adapter->hw, AIT, 0);  // Set adaptive interframe spacing to zero
 
@@ -742,6 +754,10 @@ static int e1000_probe(struct pci_dev *pdev,
 	adapter->hw.back = adapter;
 	adapter->msg_enable = (1 << debug) - 1;
 
+	if ((mtu[cards_found - 1] >= ETH_ZLEN) &&
+	    (mtu[cards_found - 1] <= E1000_MAX_JUMBO_MTU))
+		netdev->mtu = mtu[cards_found - 1];
+
 	mmio_start = pci_resource_start(pdev, BAR_0);
 	mmio_len = pci_resource_len(pdev, BAR_0);
 
@@ -764,7 +780,7 @@ static int e1000_probe(struct pci_dev *pdev,
 	netdev->stop = &e1000_close;
 	netdev->hard_start_xmit = &e1000_xmit_frame;
 	// netdev->get_stats = &e1000_get_stats;
-	// netdev->set_multicast_list = &e1000_set_multi;
+	netdev->set_multicast_list = &e1000_set_multi;
 	// netdev->set_mac_address = &e1000_set_mac;
 	// netdev->change_mtu = &e1000_change_mtu;
 	// netdev->do_ioctl = &e1000_ioctl;
@@ -808,6 +824,12 @@ static int e1000_probe(struct pci_dev *pdev,
 		e1000_ksp3_port_a = 0;
 
 	netdev->features |= NETIF_F_LLTX;
+	/* rtskb fragments are mapped by e1000_tx_map */
+	netdev->features |= NETIF_F_SG;
+#ifdef CONFIG_RTNET_VLAN
+	if (adapter->hw.mac_type >= e1000_82543)
+		netdev->features |= RTNETIF_F_HW_VLAN_TX;
+#endif
 
 	adapter->en_mng_pt = e1000_enable_mng_pass_thru(&adapter->hw);
 
@@ -1073,6 +1095,20 @@ static int e1000_sw_init(struct e1000_adapter *adapter)
 		break;
 	}
 
+	/* Jumbo frames are received into jumbo class rtskbs */
+	if (netdev->mtu > ETH_DATA_LEN) {
+		if ((hw->mac_type == e1000_82542_rev2_0) ||
+		    (hw->mac_type == e1000_82542_rev2_1) ||
+		    (hw->mac_type == e1000_82573) ||
+		    (hw->mac_type == e1000_ich8lan)) {
+			DPRINTK(PROBE, ERR, "Jumbo Frames not supported.\n");
+			netdev->mtu = ETH_DATA_LEN;
+		} else
+			adapter->rx_buffer_len = E1000_RXBUFFER_16384;
+		hw->max_frame_size = netdev->mtu +
+				     ENET_HEADER_SIZE + ETHERNET_FCS_SIZE;
+	}
+
 	e1000_set_media_type(hw);
 
 	hw->wait_autoneg_complete = FALSE;
@@ -1091,7 +1127,9 @@ static int e1000_sw_init(struct e1000_adapter *adapter)
 	adapter->num_rx_queues = 1;
 
 
-        if (rtskb_pool_init(&adapter->skb_pool, 16) < 16)
+        if (rtskb_pool_init_ex(&adapter->skb_pool, 16,
+                               (netdev->mtu > ETH_DATA_LEN) ?
+                               RTSKB_POOL_JUMBO : 0) < 16)
         {
             rtskb_pool_release(&adapter->skb_pool);
             return -ENOMEM;
@@ -2051,6 +2089,7 @@ e1000_set_multi(struct rtnet_device *netdev)
 	struct e1000_adapter *adapter = netdev->priv;
 	struct e1000_hw *hw = &adapter->hw;
 	uint32_t rctl;
+	unsigned int mc = 0;
 	int i, rar_entries = E1000_RAR_ENTRIES;
 	int mta_reg_count = (hw->mac_type == e1000_ich8lan) ?
 				E1000_NUM_MTA_REGISTERS_ICH8LAN :
@@ -2090,10 +2129,14 @@ e1000_set_multi(struct rtnet_device *netdev)
 	 */
 
 	for (i = 1; i < rar_entries; i++) {
-		E1000_WRITE_REG_ARRAY(hw, RA, i << 1, 0);
-		E1000_WRITE_FLUSH(hw);
-		E1000_WRITE_REG_ARRAY(hw, RA, (i << 1) + 1, 0);
-		E1000_WRITE_FLUSH(hw);
+		if (mc < netdev->mc_count) {
+			e1000_rar_set(hw, netdev->mc_list[mc++], i);
+		} else {
+			E1000_WRITE_REG_ARRAY(hw, RA, i << 1, 0);
+			E1000_WRITE_FLUSH(hw);
+			E1000_WRITE_REG_ARRAY(hw, RA, (i << 1) + 1, 0);
+			E1000_WRITE_FLUSH(hw);
+		}
 	}
 
 	/* clear the old settings from the multicast hash table */
@@ -2103,6 +2146,11 @@ e1000_set_multi(struct rtnet_device *netdev)
 		E1000_WRITE_FLUSH(hw);
 	}
 
+	/* load any remaining addresses into the hash table */
+
+	for (; mc < netdev->mc_count; mc++)
+		e1000_mta_set(hw, e1000_hash_mc_addr(hw, netdev->mc_list[mc]));
+
 	if (hw->mac_type == e1000_82542_rev2_0)
 		e1000_leave_82542_rst(adapter);
 }
@@ -2365,8 +2413,9 @@ e1000_tx_map(struct e1000_adapter *adapter, struct e1000_tx_ring *tx_ring,
              unsigned int nr_frags, unsigned int mss)
 {
 	struct e1000_buffer *buffer_info;
-	unsigned int len = skb->len;
+	unsigned int len = rtskb_headlen(skb);
 	unsigned int offset = 0, size, count = 0, i;
+	unsigned int f;
 
 	i = tx_ring->next_to_use;
 
@@ -2403,6 +2452,36 @@ e1000_tx_map(struct e1000_adapter *adapter, struct e1000_tx_ring *tx_ring,
 		if (unlikely(++i == tx_ring->count)) i = 0;
 	}
 
+	for (f = 0; f < nr_frags; f++) {
+		struct rtskb_frag *frag = &skb->frags[f];
+
+		len = frag->len;
+		offset = 0;
+
+		while (len) {
+			buffer_info = &tx_ring->buffer_info[i];
+			size = min(len, max_per_txd);
+			/* Workaround for potential 82544 hang in PCI-X.  Avoid
+			 * terminating buffers within evenly-aligned dwords. */
+			if (unlikely(adapter->pcix_82544 &&
+			   !((unsigned long)(frag->addr + offset + size - 1) & 4) &&
+			   size > 4))
+				size -= 4;
+
+			buffer_info->length = size;
+			buffer_info->dma =
+				pci_map_single(adapter->pdev,
+					frag->addr + offset,
+					size,
+					PCI_DMA_TODEVICE);
+			buffer_info->time_stamp = jiffies;
+
+			len -= size;
+			offset += size;
+			count++;
+			if (unlikely(++i == tx_ring->count)) i = 0;
+		}
+	}
 
 	i = (i == 0) ? tx_ring->count - 1 : i - 1;
 	tx_ring->buffer_info[i].skb = skb;
@@ -2426,6 +2505,11 @@ e1000_tx_queue(struct e1000_adapter *adapter, struct e1000_tx_ring *tx_ring,
 		txd_upper |= E1000_TXD_POPTS_TXSM << 8;
 	}
 
+	if (unlikely(tx_flags & E1000_TX_FLAGS_VLAN)) {
+		txd_lower |= E1000_TXD_CMD_VLE;
+		txd_upper |= (tx_flags & E1000_TX_FLAGS_VLAN_MASK);
+	}
+
 	i = tx_ring->next_to_use;
 
 	while (count--) {
@@ -2529,11 +2613,12 @@ e1000_xmit_frame(struct rtskb *skb, struct rtnet_device *netdev)
 	unsigned int first, max_per_txd = E1000_MAX_DATA_PER_TXD;
 	unsigned int max_txd_pwr = E1000_MAX_TXD_PWR;
 	unsigned int tx_flags = 0;
-	unsigned int len = skb->len;
+	unsigned int len = rtskb_headlen(skb);
 	rtdm_lockctx_t context;
-	unsigned int nr_frags = 0;
+	unsigned int nr_frags = skb->nr_frags;
 	unsigned int mss = 0;
 	int count = 0;
+	unsigned int f;
 
 	/* This goes back to the question of how to logically map a tx queue
 	 * to a flow.  Right now, performance is impacted slightly negatively
@@ -2555,6 +2640,11 @@ e1000_xmit_frame(struct rtskb *skb, struct rtnet_device *netdev)
 	if (adapter->pcix_82544)
 		count++;
 
+	for (f = 0; f < nr_frags; f++)
+		count += TXD_USE_COUNT(skb->frags[f].len, max_txd_pwr);
+	if (adapter->pcix_82544)
+		count += nr_frags;
+
 	/* work-around for errata 10 and it applies to all controllers
 	 * in PCI-X mode, so add one more descriptor to the count
 	 */
@@ -2563,8 +2653,9 @@ e1000_xmit_frame(struct rtskb *skb, struct rtnet_device *netdev)
 		count++;
 
 
+	/* the DHCP payload has to be linear */
 	if (adapter->hw.tx_pkt_filtering &&
-	    (adapter->hw.mac_type == e1000_82573))
+	    (adapter->hw.mac_type == e1000_82573) && (nr_frags == 0))
 		e1000_transfer_dhcp_info(adapter, skb);
 
 	rtdm_lock_get_irqsave(&tx_ring->tx_lock, context);
@@ -2596,6 +2687,11 @@ e1000_xmit_frame(struct rtskb *skb, struct rtnet_device *netdev)
 	if (likely(e1000_tx_csum(adapter, tx_ring, skb)))
 		tx_flags |= E1000_TX_FLAGS_CSUM;
 
+	if (rt_vlan_tag_present(skb)) {
+		tx_flags |= E1000_TX_FLAGS_VLAN;
+		tx_flags |= (rt_vlan_tag_get(skb) << E1000_TX_FLAGS_VLAN_SHIFT);
+	}
+
 	e1000_tx_queue(adapter, tx_ring, tx_flags,
 	               e1000_tx_map(adapter, tx_ring, skb, first,
 	                            max_per_txd, nr_frags, mss),
@@ -2829,6 +2925,8 @@ e1000_clean_rx_irq(struct e1000_adapter *adapter,
 	struct pci_dev *pdev = adapter->pdev;
 	struct e1000_rx_desc *rx_desc, *next_rxd;
 	struct e1000_buffer *buffer_info, *next_buffer;
+	struct rtskb *rx_batch[E1000_RX_BATCH];
+	unsigned int batched = 0;
 	uint32_t length;
 	uint8_t last_byte;
 	unsigned int i;
@@ -2918,9 +3016,17 @@ e1000_clean_rx_irq(struct e1000_adapter *adapter,
 				  ((uint32_t)(rx_desc->errors) << 24),
 				  le16_to_cpu(rx_desc->csum), skb);
 
+		/* tag stripped by the hardware, see E1000_CTRL_VME */
+		if (status & E1000_RXD_STAT_VP)
+			rt_vlan_put_tag(skb, le16_to_cpu(rx_desc->special));
+
 		skb->protocol = rt_eth_type_trans(skb, netdev);
 		skb->time_stamp = *time_stamp;
-		rtnetif_rx(skb);
+		rx_batch[batched++] = skb;
+		if (batched == E1000_RX_BATCH) {
+			rtnetif_rx_bulk(rx_batch, batched);
+			batched = 0;
+		}
 		adapter->data_received = 1; // Set flag for the main interrupt routine
 
 next_desc:
@@ -2938,6 +3044,9 @@ next_desc:
 	}
 	rx_ring->next_to_clean = i;
 
+	if (batched)
+		rtnetif_rx_bulk(rx_batch, batched);
+
 	cleaned_count = E1000_DESC_UNUSED(rx_ring);
 	if (cleaned_count)
 		adapter->alloc_rx_buf(adapter, rx_ring, cleaned_count);
@@ -2202,7 +2202,7 @@ static void e1000_set_multi(struct rtnet_device *netdev)
 
 	ew32(RCTL, rctl);
 
-	e1000_update_mc_addr_list(hw, NULL, 0);
+	e1000_update_mc_addr_list(hw, netdev->mc_list[0], netdev->mc_count);
 
 	if (netdev->features & NETIF_F_HW_VLAN_CTAG_RX)
 		e1000e_vlan_strip_enable(adapter);
@@ -3910,7 +3910,7 @@ static dma_addr_t e1000_map_rtskb(struct rtnet_device *netdev,
 	struct device *dev = &adapter->pdev->dev;
 	dma_addr_t addr;
 
-	addr = dma_map_single(dev, skb->buf_start, RTSKB_SIZE,
+	addr = dma_map_single(dev, skb->buf_start, skb->buf_len,
 			      DMA_BIDIRECTIONAL);
 	if (dma_mapping_error(dev, addr)) {
 		dev_err(dev, "DMA map failed\n");
@@ -3925,7 +3925,7 @@ static void e1000_unmap_rtskb(struct rtnet_device *netdev,
 	struct e1000_adapter *adapter = netdev->priv;
 	struct device *dev = &adapter->pdev->dev;
 
-	dma_unmap_single(dev, skb->buf_dma_addr, RTSKB_SIZE,
+	dma_unmap_single(dev, skb->buf_dma_addr, skb->buf_len,
 			 DMA_BIDIRECTIONAL);
 }
 
@@ -4057,6 +4057,7 @@ static int e1000_probe(struct pci_dev *pdev,
 	netdev->open = e1000_open;
 	netdev->stop = e1000_close;
 	netdev->hard_start_xmit = e1000_xmit_frame;
+	netdev->set_multicast_list = e1000_set_multi;
         //netdev->get_stats = e1000_get_stats;
 	netdev->map_rtskb = e1000_map_rtskb;
 	netdev->unmap_rtskb = e1000_unmap_rtskb;
@@ -4101,8 +4102,7 @@ static int e1000_probe(struct pci_dev *pdev,
 		e_info("PHY reset is blocked due to SOL/IDER session.\n");
 
 	/* Set initial default active device features */
-	netdev->features = (NETIF_F_SG |
-			    NETIF_F_HW_VLAN_CTAG_RX |
+	netdev->features = (NETIF_F_HW_VLAN_CTAG_RX |
 			    NETIF_F_HW_VLAN_CTAG_TX |
 			    NETIF_F_TSO |
 			    NETIF_F_TSO6 |
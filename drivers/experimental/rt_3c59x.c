@@ -1386,8 +1386,7 @@ static int vortex_probe1(struct pci_dev *pdev,
 	rtdev->open = vortex_open;
 	if (vp->full_bus_master_tx) {
 		rtdev->hard_start_xmit = boomerang_start_xmit;
-		/* Actually, it still should work with iommu. */
-		rtdev->features |= NETIF_F_SG;
+		/* No NETIF_F_SG, fragmented rtskbs are not supported. */
 		if (((hw_checksums[card_idx] == -1) && (vp->drv_flags & HAS_HWCKSM)) ||
 					(hw_checksums[card_idx] == 1)) {
 				rtdev->features |= NETIF_F_IP_CSUM;
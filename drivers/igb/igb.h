@@ -100,6 +100,9 @@ struct igb_adapter;
 #define IGB_RXBUFFER_8192  8192
 #define IGB_RXBUFFER_16384 16384
 
+/* largest MTU supported with jumbo class rtskbs */
+#define IGB_MAX_JUMBO_MTU  9000
+
 /* Packet Buffer allocations */
 
 
@@ -129,6 +132,7 @@ struct igb_buffer {
 			unsigned long time_stamp;
 			u16 length;
 			u16 next_to_watch;
+			u16 mapped;	/* dma of an rtskb fragment */
 		};
 		/* RX */
 		struct {
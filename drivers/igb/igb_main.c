@@ -136,6 +136,11 @@ static int cards[MAX_UNITS] = { [0 ... (MAX_UNITS-1)] = 1 };
 compat_module_int_param_array(cards, MAX_UNITS);
 MODULE_PARM_DESC(cards, "array of cards to be supported (eg. 1,0,1)");
 
+static int mtu[MAX_UNITS] = { [0 ... (MAX_UNITS-1)] = ETH_DATA_LEN };
+compat_module_int_param_array(mtu, MAX_UNITS);
+MODULE_PARM_DESC(mtu, "array of MTUs, values above 1500 enable jumbo frames "
+		 "(max. " __MODULE_STRING(IGB_MAX_JUMBO_MTU) ")");
+
 static struct pci_device_id igb_pci_tbl[] = {
 	{ PCI_VDEVICE(INTEL, E1000_DEV_ID_82576), board_82575 },
 	{ PCI_VDEVICE(INTEL, E1000_DEV_ID_82576_FIBER), board_82575 },
@@ -1088,7 +1093,7 @@ static dma_addr_t igb_map_rtskb(struct rtnet_device *netdev,
 	struct device *dev = &adapter->pdev->dev;
 	dma_addr_t addr;
 
-	addr = dma_map_single(dev, skb->buf_start, RTSKB_SIZE,
+	addr = dma_map_single(dev, skb->buf_start, skb->buf_len,
 			      DMA_BIDIRECTIONAL);
 	if (dma_mapping_error(dev, addr)) {
 		dev_err(dev, "DMA map failed\n");
@@ -1103,7 +1108,7 @@ static void igb_unmap_rtskb(struct rtnet_device *netdev,
 	struct igb_adapter *adapter = netdev->priv;
 	struct device *dev = &adapter->pdev->dev;
 
-	dma_unmap_single(dev, skb->buf_dma_addr, RTSKB_SIZE,
+	dma_unmap_single(dev, skb->buf_dma_addr, skb->buf_len,
 			 DMA_BIDIRECTIONAL);
 }
 
@@ -1218,9 +1223,9 @@ static int igb_probe(struct pci_dev *pdev,
 	netdev->get_stats = igb_get_stats;
 	netdev->map_rtskb = igb_map_rtskb;
 	netdev->unmap_rtskb = igb_unmap_rtskb;
+	netdev->set_multicast_list = igb_set_multi;
 #if 0
 	netdev->do_ioctl = igb_ioctl;
-	netdev->set_multicast_list = igb_set_multi;
 	netdev->set_mac_address = igb_set_mac;
 	netdev->change_mtu = igb_change_mtu;
 
@@ -1257,6 +1262,10 @@ static int igb_probe(struct pci_dev *pdev,
 	if (err)
 		goto err_hw_init;
 
+	if ((mtu[board_idx] >= ETH_ZLEN) &&
+	    (mtu[board_idx] <= IGB_MAX_JUMBO_MTU))
+		netdev->mtu = mtu[board_idx];
+
 	err = igb_sw_init(adapter);
 	if (err)
 		goto err_sw_init;
@@ -1287,6 +1296,7 @@ static int igb_probe(struct pci_dev *pdev,
 		dev_info(&pdev->dev,
 			"PHY reset is blocked due to SOL/IDER session.\n");
 
+	/* rtskb fragments are mapped by igb_tx_map_adv */
 	netdev->features = NETIF_F_SG | NETIF_F_HW_CSUM;
 	// no TSO support for now
 	/*
@@ -1570,12 +1580,19 @@ static int igb_sw_init(struct igb_adapter *adapter)
 	adapter->max_frame_size = netdev->mtu + ETH_HLEN + ETH_FCS_LEN;
 	adapter->min_frame_size = ETH_ZLEN + ETH_FCS_LEN;
 
+	/* Jumbo frames are received into jumbo class rtskbs, RLPML keeps
+	 * longer frames out of them */
+	if (netdev->mtu > ETH_DATA_LEN)
+		adapter->rx_buffer_len = ALIGN(adapter->max_frame_size, 1024);
+
 	/* Number of supported queues. */
 	/* Having more queues than CPUs doesn't make sense. */
 	adapter->num_rx_queues = min_t(u32, IGB_MAX_RX_QUEUES, num_online_cpus());
 	adapter->num_tx_queues = min_t(u32, IGB_MAX_TX_QUEUES, num_online_cpus());
 
-        if (rtskb_pool_init(&adapter->skb_pool, 16) < 16)
+        if (rtskb_pool_init_ex(&adapter->skb_pool, 16,
+                               (netdev->mtu > ETH_DATA_LEN) ?
+                               RTSKB_POOL_JUMBO : 0) < 16)
         {
             rtskb_pool_release(&adapter->skb_pool);
             return -ENOMEM;
@@ -1980,17 +1997,10 @@ static void igb_setup_rctl(struct igb_adapter *adapter)
 	 * followed by the page buffers.  Therefore, skb->data is
 	 * sized to hold the largest protocol header.
 	 */
-	/* allocations using alloc_page take too long for regular MTU
-	 * so only enable packet split for jumbo frames */
-	if (adapter->netdev->mtu > ETH_DATA_LEN) {
-		adapter->rx_ps_hdr_size = IGB_RXBUFFER_128;
-		srrctl |= adapter->rx_ps_hdr_size <<
-			 E1000_SRRCTL_BSIZEHDRSIZE_SHIFT;
-		srrctl |= E1000_SRRCTL_DESCTYPE_HDR_SPLIT_ALWAYS;
-	} else {
-		adapter->rx_ps_hdr_size = 0;
-		srrctl |= E1000_SRRCTL_DESCTYPE_ADV_ONEBUF;
-	}
+	/* rtskbs cannot carry page fragments, jumbo frames are received
+	 * into jumbo class rtskbs instead of using packet split */
+	adapter->rx_ps_hdr_size = 0;
+	srrctl |= E1000_SRRCTL_DESCTYPE_ADV_ONEBUF;
 
 	for (i = 0; i < adapter->num_rx_queues; i++) {
 		j = adapter->rx_ring[i].reg_idx;
@@ -2165,6 +2175,13 @@ static void igb_free_all_tx_resources(struct igb_adapter *adapter)
 static void igb_unmap_and_free_tx_resource(struct igb_adapter *adapter,
 					   struct igb_buffer *buffer_info)
 {
+	if (buffer_info->mapped) {
+		pci_unmap_single(adapter->pdev,
+				 buffer_info->dma,
+				 buffer_info->length,
+				 PCI_DMA_TODEVICE);
+		buffer_info->mapped = 0;
+	}
 	buffer_info->dma = 0;
 	if (buffer_info->skb) {
 	        kfree_rtskb(buffer_info->skb);
@@ -2377,8 +2394,9 @@ static void igb_set_multi(struct rtnet_device *netdev)
 	}
 	wr32(E1000_RCTL, rctl);
 
-	/* nothing to program, so clear mc list */
-	igb_update_mc_addr_list_82575(hw, NULL, 0, 1, mac->rar_entry_count);
+	/* RAR 0 holds the station address */
+	igb_update_mc_addr_list_82575(hw, netdev->mc_list[0], netdev->mc_count,
+				      1, mac->rar_entry_count);
 }
 
 /* Need to wait a few seconds after link up to get diagnostic information from
@@ -2853,11 +2871,9 @@ static int igb_tx_map_adv(struct igb_adapter *adapter, struct igb_ring *tx_ring,
 			  struct rtskb *skb, unsigned int first)
 {
 	struct igb_buffer *buffer_info;
-	unsigned int len = skb->len;
+	unsigned int len = rtskb_headlen(skb);
 	unsigned int count = 0, i;
-#ifdef IGB_FRAMES_SUPPORT
 	unsigned int f;
-#endif
 
 	i = tx_ring->next_to_use;
 
@@ -2868,37 +2884,34 @@ static int igb_tx_map_adv(struct igb_adapter *adapter, struct igb_ring *tx_ring,
 	buffer_info->time_stamp = jiffies;
 	buffer_info->next_to_watch = i;
 	buffer_info->dma = rtskb_data_dma_addr(skb, 0);
+	buffer_info->mapped = 0;
 	count++;
 	i++;
 	if (i == tx_ring->count)
 		i = 0;
 
-	/* No frames in RTNet on driver level */
-#ifdef IGB_FRAMES_SUPPORT
-	//for (f = 0; f < skb_shinfo(skb)->nr_frags; f++) {
-	for (f = 0; f < MAX_SKB_FRAGS; f++) {
-		struct skb_frag_struct *frag;
+	/* rtskb fragments are not pre-mapped like the rtskb buffer */
+	for (f = 0; f < skb->nr_frags; f++) {
+		struct rtskb_frag *frag = &skb->frags[f];
 
-		frag = &skb_shinfo(skb)->frags[f];
-		len = frag->size;
+		len = frag->len;
 
 		buffer_info = &tx_ring->buffer_info[i];
 		BUG_ON(len >= IGB_MAX_DATA_PER_TXD);
 		buffer_info->length = len;
 		buffer_info->time_stamp = jiffies;
 		buffer_info->next_to_watch = i;
-		buffer_info->dma = pci_map_page(adapter->pdev,
-						frag->page,
-						frag->page_offset,
-						len,
-						PCI_DMA_TODEVICE);
+		buffer_info->dma = pci_map_single(adapter->pdev,
+						  frag->addr,
+						  len,
+						  PCI_DMA_TODEVICE);
+		buffer_info->mapped = 1;
 
 		count++;
 		i++;
 		if (i == tx_ring->count)
 			i = 0;
 	}
-#endif
 
 	i = ((i == 0) ? tx_ring->count - 1 : i - 1);
 	tx_ring->buffer_info[i].skb = skb;
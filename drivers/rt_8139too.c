@@ -832,7 +832,7 @@ static int rtl8139_init_one (struct pci_dev *pdev,
         rtdev->get_stats = rtl8139_get_stats;
 
         /*rtdev->set_multicast_list = rtl8139_set_rx_mode; */
-        rtdev->features |= NETIF_F_SG|NETIF_F_HW_CSUM;
+        rtdev->features |= NETIF_F_HW_CSUM;
 
         rtdev->irq = pdev->irq;
 
@@ -91,6 +91,14 @@ static int rt_loopback_xmit(struct rtskb *rtskb, struct rtnet_device *rtdev)
 }
 
 
+/***
+ *  rt_loopback_set_multicast_list - all transmitted frames are received
+ */
+static void rt_loopback_set_multicast_list(struct rtnet_device *rtdev)
+{
+}
+
+
 /***
  *  loopback_init
  */
@@ -113,6 +121,7 @@ static int __init loopback_init(void)
     rtdev->open = &rt_loopback_open;
     rtdev->stop = &rt_loopback_close;
     rtdev->hard_start_xmit = &rt_loopback_xmit;
+    rtdev->set_multicast_list = &rt_loopback_set_multicast_list;
     rtdev->flags |= IFF_LOOPBACK;
     rtdev->flags &= ~IFF_BROADCAST;
     rtdev->features |= NETIF_F_LLTX;
@@ -815,7 +815,7 @@ static int via_rhine_init_one (struct pci_dev *pdev,
 	dev->watchdog_timeo = TX_TIMEOUT;
  *** RTnet ***/
 	if (np->drv_flags & ReqTxAlign)
-		dev->features |= NETIF_F_SG|NETIF_F_HW_CSUM;
+		dev->features |= NETIF_F_HW_CSUM;
 
 	/* dev->name not defined before register_netdev()! */
 /*** RTnet ***/
@@ -0,0 +1,170 @@
+/***
+ *
+ *  examples/xenomai/native/kernel/csum-bench.c
+ *
+ *  compares the separate checksum and copy passes over a UDP payload with
+ *  the fused copy-and-checksum used by the transmission path
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/timex.h>
+#include <asm/div64.h>
+#include <net/checksum.h>
+
+#include <rtnet_iovec.h>
+
+#define MAX_SIZE    65507   /* maximum UDP payload */
+#define MAX_SEGS    8
+
+static unsigned int loops = 10000;
+static unsigned int segs = 1;
+
+module_param(loops, uint, 0444);
+module_param(segs, uint, 0444);
+MODULE_PARM_DESC(loops, "iterations per payload size (default: 10000)");
+MODULE_PARM_DESC(segs, "iovec entries the payload is split into (default: 1)");
+
+MODULE_LICENSE("GPL");
+
+static unsigned int sizes[] = { 64, 256, 512, 1024, 1472, 8192, MAX_SIZE };
+
+static unsigned char *src_buf;
+static unsigned char *dst_buf;
+
+
+static void bench_setup_iov(struct iovec *iov, unsigned int size)
+{
+    /* even entry sizes, the former code did not handle odd ones correctly */
+    unsigned int seg_len = (size / segs) & ~1;
+    unsigned int i;
+
+    for (i = 0; i < segs; i++) {
+        iov[i].iov_base = src_buf + i * seg_len;
+        iov[i].iov_len  = seg_len;
+    }
+    iov[segs - 1].iov_len += size - segs * seg_len;
+}
+
+
+/* former rt_udp_getfrag: checksum all entries, then copy */
+static unsigned int bench_two_pass(unsigned int size)
+{
+    struct iovec    iov[MAX_SEGS];
+    unsigned int    csum = 0;
+    unsigned int    i;
+
+    bench_setup_iov(iov, size);
+    for (i = 0; i < segs; i++)
+        csum = csum_partial(iov[i].iov_base, iov[i].iov_len, csum);
+    rt_memcpy_fromkerneliovec(dst_buf, iov, size);
+
+    return csum;
+}
+
+
+static unsigned int bench_fused(unsigned int size)
+{
+    struct iovec    iov[MAX_SEGS];
+
+    bench_setup_iov(iov, size);
+    return rt_csum_copy_fromkerneliovec(dst_buf, iov, size, 0);
+}
+
+
+static cycles_t bench_run(unsigned int (*func)(unsigned int),
+                          unsigned int size, unsigned int *csum)
+{
+    cycles_t        start, total = 0;
+    unsigned long   flags;
+    unsigned int    i;
+
+    for (i = 0; i < loops; i++) {
+        local_irq_save(flags);
+        start = get_cycles();
+        *csum = func(size);
+        total += get_cycles() - start;
+        local_irq_restore(flags);
+    }
+    return total;
+}
+
+
+/* cycles per byte in 1/100 */
+static unsigned long bench_per_byte(cycles_t cycles, unsigned int size)
+{
+    u64 val = (u64)cycles * 100;
+
+    do_div(val, loops);
+    do_div(val, size);
+    return (unsigned long)val;
+}
+
+
+int init_module(void)
+{
+    cycles_t        two_pass, fused;
+    unsigned int    csum1, csum2;
+    unsigned long   cpb1, cpb2;
+    unsigned int    i;
+
+
+    if ((loops == 0) || (segs == 0) || (segs > MAX_SEGS)) {
+        printk("csum-bench: invalid parameters\n");
+        return -EINVAL;
+    }
+
+    src_buf = kmalloc(MAX_SIZE, GFP_KERNEL);
+    dst_buf = kmalloc(MAX_SIZE, GFP_KERNEL);
+    if ((src_buf == NULL) || (dst_buf == NULL)) {
+        kfree(src_buf);
+        kfree(dst_buf);
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < MAX_SIZE; i++)
+        src_buf[i] = i * 7;
+
+    printk("csum-bench: %u loops, %u iovec entries, cycles/byte x100\n",
+           loops, segs);
+
+    for (i = 0; i < ARRAY_SIZE(sizes); i++) {
+        two_pass = bench_run(bench_two_pass, sizes[i], &csum1);
+        fused    = bench_run(bench_fused, sizes[i], &csum2);
+
+        cpb1 = bench_per_byte(two_pass, sizes[i]);
+        cpb2 = bench_per_byte(fused, sizes[i]);
+
+        printk("csum-bench: %5u bytes: two-pass %4lu, fused %4lu, "
+               "saved %4ld%s\n", sizes[i], cpb1, cpb2,
+               (long)cpb1 - (long)cpb2,
+               (csum_fold(csum1) != csum_fold(csum2)) ?
+                   " (CHECKSUM MISMATCH)" : "");
+    }
+
+    kfree(src_buf);
+    kfree(dst_buf);
+
+    return 0;
+}
+
+
+void cleanup_module(void)
+{
+}
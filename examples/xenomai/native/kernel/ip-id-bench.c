@@ -0,0 +1,197 @@
+/***
+ *
+ *  examples/xenomai/native/kernel/ip-id-bench.c
+ *
+ *  measures how IP identification generation scales with concurrent senders,
+ *  comparing a single locked counter against the hashed per-peer counters of
+ *  the stack and the unsynchronised per-socket counter used for DF datagrams
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/cpumask.h>
+#include <linux/in.h>
+#include <asm/div64.h>
+
+#include <rtdm/rtdm_driver.h>
+#include <ipv4/ip_output.h>
+
+#define MAX_TASKS   16
+
+static unsigned int tasks = 4;
+static unsigned int loops = 1000000;
+static int prio = 90;
+
+module_param(tasks, uint, 0444);
+module_param(loops, uint, 0444);
+module_param(prio, int, 0444);
+MODULE_PARM_DESC(tasks, "number of concurrent sender tasks (default: 4)");
+MODULE_PARM_DESC(loops, "IDs generated per task (default: 1000000)");
+MODULE_PARM_DESC(prio, "priority of the bench tasks (default: 90)");
+
+MODULE_LICENSE("GPL");
+
+enum bench_mode {
+    MODE_LOCKED,        /* former global rt_ip_id_lock/rt_ip_id_count */
+    MODE_SAME_PEER,     /* rt_ip_id_reserve, all tasks send to one peer */
+    MODE_OWN_PEER,      /* rt_ip_id_reserve, one peer per task */
+    MODE_SOCKET         /* per-socket counter of DF datagrams */
+};
+
+struct bench_task {
+    rtdm_task_t         task;
+    int                 cpu;
+    u32                 daddr;
+    u16                 ip_id;      /* stands in for the socket counter */
+    nanosecs_rel_t      duration;
+} ____cacheline_aligned_in_smp;
+
+static struct bench_task    bench_tasks[MAX_TASKS];
+static enum bench_mode      bench_mode;
+
+static rtdm_lock_t          bench_id_lock = RTDM_LOCK_UNLOCKED;
+static u16                  bench_id_count;
+
+/* keeps the compiler from dropping the generated IDs */
+static volatile u16         bench_sink;
+
+
+static inline u16 bench_locked_id(void)
+{
+    rtdm_lockctx_t  context;
+    u16             id;
+
+
+    rtdm_lock_get_irqsave(&bench_id_lock, context);
+    id = bench_id_count++;
+    rtdm_lock_put_irqrestore(&bench_id_lock, context);
+
+    return id;
+}
+
+
+static void bench_task_proc(void *arg)
+{
+    struct bench_task   *ctx = arg;
+    nanosecs_abs_t      start;
+    unsigned int        i;
+    u16                 id = 0;
+
+
+    rtos_task_migrate(ctx->cpu);
+
+    start = rtdm_clock_read();
+
+    switch (bench_mode) {
+        case MODE_LOCKED:
+            for (i = 0; i < loops; i++)
+                id += bench_locked_id();
+            break;
+
+        case MODE_SAME_PEER:
+        case MODE_OWN_PEER:
+            for (i = 0; i < loops; i++)
+                id += rt_ip_id_reserve(ctx->daddr, IPPROTO_UDP);
+            break;
+
+        case MODE_SOCKET:
+            for (i = 0; i < loops; i++)
+                id += ctx->ip_id++;
+            break;
+    }
+
+    ctx->duration = rtdm_clock_read() - start;
+    bench_sink = id;
+}
+
+
+static int bench_run(enum bench_mode mode, const char *name)
+{
+    nanosecs_rel_t      max = 0;
+    u64                 per_id, total;
+    unsigned int        i;
+    int                 ret = 0;
+
+
+    bench_mode = mode;
+    memset(bench_tasks, 0, sizeof(bench_tasks));
+
+    for (i = 0; i < tasks; i++) {
+        /* spread the tasks over all online CPUs */
+        bench_tasks[i].cpu   = i % num_online_cpus();
+        bench_tasks[i].daddr = htonl(0x0a000001 +
+                                     ((mode == MODE_OWN_PEER) ? i : 0));
+
+        ret = rtdm_task_init(&bench_tasks[i].task, "ip-id-bench",
+                             bench_task_proc, &bench_tasks[i], prio, 0);
+        if (ret < 0) {
+            tasks = i;
+            break;
+        }
+    }
+
+    for (i = 0; i < tasks; i++) {
+        rtdm_task_join_nrt(&bench_tasks[i].task, 100);
+
+        if (bench_tasks[i].duration > max)
+            max = bench_tasks[i].duration;
+    }
+
+    /* the slowest task determines the aggregate rate */
+    per_id = (u64)max * 1000;
+    do_div(per_id, loops);
+    total = max;
+    do_div(total, 1000000);
+
+    printk("ip-id-bench: %-10s %lu.%03lu ns per ID and task, "
+           "%lu ms total\n", name,
+           (unsigned long)per_id / 1000, (unsigned long)per_id % 1000,
+           (unsigned long)total);
+
+    return ret;
+}
+
+
+int init_module(void)
+{
+    int ret;
+
+
+    if ((tasks == 0) || (tasks > MAX_TASKS) || (loops == 0)) {
+        printk("ip-id-bench: invalid parameters\n");
+        return -EINVAL;
+    }
+
+    printk("ip-id-bench: %u tasks on %u CPUs, %u IDs per task\n",
+           tasks, num_online_cpus(), loops);
+
+    ret = bench_run(MODE_LOCKED, "locked");
+    if (ret == 0)
+        ret = bench_run(MODE_SAME_PEER, "same-peer");
+    if (ret == 0)
+        ret = bench_run(MODE_OWN_PEER, "own-peer");
+    if (ret == 0)
+        ret = bench_run(MODE_SOCKET, "socket");
+
+    return ret;
+}
+
+
+void cleanup_module(void)
+{
+}
@@ -0,0 +1,366 @@
+/***
+ *
+ *  examples/xenomai/native/kernel/route-bench.c
+ *
+ *  measures output route lookups through rt_ip_route_output from concurrent
+ *  sender tasks, once serialised on a global lock as the lookups formerly
+ *  were, once lockless. With network routing, the table holds nested
+ *  prefixes of mixed lengths and every result is checked against a linear
+ *  longest-prefix search.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/cpumask.h>
+#include <linux/in.h>
+#include <linux/slab.h>
+#include <asm/div64.h>
+
+#include <rtdm/rtdm_driver.h>
+#include <rtdev.h>
+#include <ipv4/route.h>
+
+#define MAX_TASKS       16
+#define GATEWAYS        4
+#define GATEWAY_NET     0x0afffe00  /* 10.255.254.0, gateways have host routes */
+#define LOOKUPS         1024        /* destinations, reused by every loop */
+
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+static unsigned int routes = CONFIG_RTNET_RTIPV4_NET_ROUTES;
+module_param(routes, uint, 0444);
+MODULE_PARM_DESC(routes, "network routes to install (default: all available)");
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+
+static unsigned int tasks = 4;
+static unsigned int loops = 1000;
+static int prio = 90;
+
+module_param(tasks, uint, 0444);
+module_param(loops, uint, 0444);
+module_param(prio, int, 0444);
+MODULE_PARM_DESC(tasks, "number of concurrent sender tasks (default: 4)");
+MODULE_PARM_DESC(loops, "passes over the destination set (default: 1000)");
+MODULE_PARM_DESC(prio, "priority of the bench tasks (default: 90)");
+
+MODULE_LICENSE("GPL");
+
+enum bench_mode {
+    MODE_LOCKED,        /* lookups serialised as under the former table locks */
+    MODE_LOCKLESS       /* plain rt_ip_route_output */
+};
+
+struct bench_route {
+    u32                 addr;       /* host order */
+    u32                 mask;
+    unsigned int        gw;
+};
+
+struct bench_lookup {
+    u32                 daddr;      /* network order */
+    int                 gw;         /* expected gateway, -1: no route */
+};
+
+struct bench_task {
+    rtdm_task_t         task;
+    int                 cpu;
+    nanosecs_rel_t      max;
+    u64                 total;
+    unsigned long       errors;
+} ____cacheline_aligned_in_smp;
+
+static struct bench_task    bench_tasks[MAX_TASKS];
+static enum bench_mode      bench_mode;
+
+static struct bench_route   *bench_routes;
+static struct bench_lookup  *bench_lookups;
+static unsigned int         bench_installed;
+
+static rtdm_lock_t          bench_lock = RTDM_LOCK_UNLOCKED;
+
+static u32                  bench_seed = 0x2545f491;
+
+
+static u32 bench_random(void)
+{
+    bench_seed ^= bench_seed << 13;
+    bench_seed ^= bench_seed >> 17;
+    bench_seed ^= bench_seed << 5;
+    return bench_seed;
+}
+
+
+/* linear reference search */
+static int bench_expected(u32 daddr)
+{
+    unsigned int    i;
+    u32             best_mask = 0;
+    int             gw = -1;
+
+
+    if ((daddr > GATEWAY_NET) && (daddr <= GATEWAY_NET + GATEWAYS))
+        return daddr - GATEWAY_NET - 1;
+
+    for (i = 0; i < bench_installed; i++)
+        if (((daddr & bench_routes[i].mask) == bench_routes[i].addr) &&
+            ((gw < 0) || (bench_routes[i].mask > best_mask))) {
+            best_mask = bench_routes[i].mask;
+            gw        = bench_routes[i].gw;
+        }
+
+    return gw;
+}
+
+
+static inline int bench_lookup(struct dest_route *rt, u32 daddr)
+{
+    rtdm_lockctx_t  context;
+    int             ret;
+
+
+    if (bench_mode == MODE_LOCKLESS)
+        return rt_ip_route_output(rt, daddr, INADDR_ANY);
+
+    rtdm_lock_get_irqsave(&bench_lock, context);
+    ret = rt_ip_route_output(rt, daddr, INADDR_ANY);
+    rtdm_lock_put_irqrestore(&bench_lock, context);
+
+    return ret;
+}
+
+
+static void bench_task_proc(void *arg)
+{
+    struct bench_task   *ctx = arg;
+    struct dest_route   rt;
+    nanosecs_abs_t      start;
+    nanosecs_rel_t      delta;
+    unsigned int        loop, i;
+    int                 gw;
+
+
+    rtos_task_migrate(ctx->cpu);
+
+    for (loop = 0; loop < loops; loop++)
+        for (i = 0; i < LOOKUPS; i++) {
+            start = rtdm_clock_read();
+            gw = (bench_lookup(&rt, bench_lookups[i].daddr) < 0) ? -1 : 0;
+            delta = rtdm_clock_read() - start;
+
+            if (gw == 0) {
+                gw = rt.dev_addr[5];
+                rtdev_dereference(rt.rtdev);
+            }
+            if (gw != bench_lookups[i].gw)
+                ctx->errors++;
+
+            if (delta > ctx->max)
+                ctx->max = delta;
+            ctx->total += delta;
+        }
+}
+
+
+static int bench_run(enum bench_mode mode, const char *name)
+{
+    nanosecs_rel_t      max = 0;
+    u64                 avg = 0;
+    unsigned long       errors = 0;
+    unsigned int        i;
+    int                 ret = 0;
+
+
+    bench_mode = mode;
+    memset(bench_tasks, 0, sizeof(bench_tasks));
+
+    for (i = 0; i < tasks; i++) {
+        /* spread the tasks over all online CPUs */
+        bench_tasks[i].cpu = i % num_online_cpus();
+
+        ret = rtdm_task_init(&bench_tasks[i].task, "route-bench",
+                             bench_task_proc, &bench_tasks[i], prio, 0);
+        if (ret < 0) {
+            tasks = i;
+            break;
+        }
+    }
+
+    for (i = 0; i < tasks; i++) {
+        rtdm_task_join_nrt(&bench_tasks[i].task, 100);
+
+        if (bench_tasks[i].max > max)
+            max = bench_tasks[i].max;
+        avg    += bench_tasks[i].total;
+        errors += bench_tasks[i].errors;
+    }
+
+    if (tasks > 0) {
+        do_div(avg, tasks);
+        do_div(avg, loops);
+        do_div(avg, LOOKUPS);
+    }
+
+    printk("route-bench: %-9s avg %lu ns, max %lu ns, %lu wrong\n", name,
+           (unsigned long)avg, (unsigned long)max, errors);
+
+    return ret;
+}
+
+
+static void bench_cleanup(struct rtnet_device *rtdev)
+{
+    unsigned int    i;
+
+
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+    for (i = 0; i < bench_installed; i++)
+        rt_ip_route_del_net(htonl(bench_routes[i].addr),
+                            htonl(bench_routes[i].mask));
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+
+    for (i = 0; i < GATEWAYS; i++)
+        rt_ip_route_del_host(htonl(GATEWAY_NET + i + 1), rtdev);
+
+    kfree(bench_routes);
+    kfree(bench_lookups);
+}
+
+
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+/* prefixes of 8 to 30 bits below 10/8 and 172.16/12, many of them nested,
+ * so that most destinations match several routes */
+static int bench_add_net_routes(void)
+{
+    unsigned int    i, j, len;
+    int             ret;
+
+
+    bench_routes = kmalloc(routes * sizeof(struct bench_route), GFP_KERNEL);
+    if (bench_routes == NULL)
+        return -ENOMEM;
+
+    for (i = 0; i < routes; i++) {
+        len = 8 + bench_random() % 23;
+
+        bench_routes[i].mask = ~0U << (32 - len);
+        bench_routes[i].addr = (((i & 1) ? 0x0a000000 : 0xac100000) |
+                                (bench_random() & 0x000f0f0f)) &
+                               bench_routes[i].mask;
+        bench_routes[i].gw   = i % GATEWAYS;
+
+        ret = rt_ip_route_add_net(htonl(bench_routes[i].addr),
+                                  htonl(bench_routes[i].mask),
+                                  htonl(GATEWAY_NET + bench_routes[i].gw + 1));
+        if (ret < 0)
+            return ret;
+        bench_installed++;
+    }
+
+    /* duplicate prefixes only update the gateway of the first entry */
+    for (i = 0; i < bench_installed; i++)
+        for (j = i + 1; j < bench_installed; j++)
+            if ((bench_routes[j].addr == bench_routes[i].addr) &&
+                (bench_routes[j].mask == bench_routes[i].mask)) {
+                bench_routes[i].gw = bench_routes[j].gw;
+                bench_routes[j].mask = 0;
+                bench_routes[j].addr = 0xffffffff;  /* never matches */
+            }
+
+    return 0;
+}
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+
+
+int init_module(void)
+{
+    struct rtnet_device *rtdev;
+    unsigned char       dev_addr[MAX_ADDR_LEN];
+    unsigned int        i;
+    u32                 daddr;
+    int                 ret;
+
+
+    if ((tasks == 0) || (tasks > MAX_TASKS) || (loops == 0)) {
+        printk("route-bench: invalid parameters\n");
+        return -EINVAL;
+    }
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+    if ((routes == 0) || (routes > CONFIG_RTNET_RTIPV4_NET_ROUTES)) {
+        printk("route-bench: invalid parameters\n");
+        return -EINVAL;
+    }
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+
+    rtdev = rtdev_get_loopback();
+    if (rtdev == NULL) {
+        printk("route-bench: loopback device required\n");
+        return -ENODEV;
+    }
+
+    bench_lookups = kmalloc(LOOKUPS * sizeof(struct bench_lookup), GFP_KERNEL);
+    if (bench_lookups == NULL) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    /* gateways are told apart by the last byte of their device address */
+    memset(dev_addr, 0, sizeof(dev_addr));
+    for (i = 0; i < GATEWAYS; i++) {
+        dev_addr[5] = i;
+        ret = rt_ip_route_add_host(htonl(GATEWAY_NET + i + 1), dev_addr,
+                                   rtdev);
+        if (ret < 0)
+            goto out;
+    }
+
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+    ret = bench_add_net_routes();
+    if (ret < 0)
+        goto out;
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+
+    for (i = 0; i < LOOKUPS; i++) {
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+        daddr = ((i & 1) ? 0x0a000000 : 0xac100000) |
+                (bench_random() & 0x000f0f0f);
+#else /* !CONFIG_RTNET_RTIPV4_NETROUTING */
+        daddr = GATEWAY_NET + 1 + (bench_random() % GATEWAYS);
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+
+        bench_lookups[i].daddr = htonl(daddr);
+        bench_lookups[i].gw    = bench_expected(daddr);
+    }
+
+    printk("route-bench: %u tasks on %u CPUs, %u network routes, "
+           "%u lookups per task\n", tasks, num_online_cpus(),
+           bench_installed, loops * LOOKUPS);
+
+    ret = bench_run(MODE_LOCKED, "locked");
+    if (ret == 0)
+        ret = bench_run(MODE_LOCKLESS, "lockless");
+
+  out:
+    bench_cleanup(rtdev);
+    rtdev_dereference(rtdev);
+
+    return ret;
+}
+
+
+void cleanup_module(void)
+{
+}
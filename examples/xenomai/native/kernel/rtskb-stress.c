@@ -0,0 +1,289 @@
+/***
+ *
+ *  examples/xenomai/native/kernel/rtskb-stress.c
+ *
+ *  stresses rtskb pools with concurrent producer/consumer tasks and compares
+ *  the spinlock-protected queue against the lock-free ring
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/cpumask.h>
+#include <asm/div64.h>
+
+#include <rtdm/rtdm_driver.h>
+#include <rtskb.h>
+
+#define MAX_TASKS   16
+#define MAX_BURST   64
+
+static unsigned int tasks = 4;
+static unsigned int loops = 100000;
+static unsigned int burst = 8;
+static unsigned int pool_size = 256;
+static int prio = 90;
+
+module_param(tasks, uint, 0444);
+module_param(loops, uint, 0444);
+module_param(burst, uint, 0444);
+module_param(pool_size, uint, 0444);
+module_param(prio, int, 0444);
+MODULE_PARM_DESC(tasks, "number of producer/consumer tasks (default: 4)");
+MODULE_PARM_DESC(loops, "iterations per task (default: 100000)");
+MODULE_PARM_DESC(burst, "rtskbs allocated per iteration (default: 8)");
+MODULE_PARM_DESC(pool_size, "rtskbs in the tested pool (default: 256)");
+MODULE_PARM_DESC(prio, "priority of the stress tasks (default: 90)");
+
+MODULE_LICENSE("GPL");
+
+enum stress_mode {
+    MODE_QUEUE,         /* alloc_rtskb/kfree_rtskb on a locked pool */
+    MODE_QUEUE_LOCK,    /* instrumented queue operations (lock hold time) */
+    MODE_LOCKFREE       /* alloc_rtskb/kfree_rtskb on a lock-free pool */
+};
+
+struct stress_stats {
+    nanosecs_rel_t      max;
+    u64                 sum;
+    unsigned long       count;
+};
+
+struct stress_task {
+    rtdm_task_t         task;
+    int                 cpu;
+    struct stress_stats alloc;
+    struct stress_stats free;
+    struct stress_stats hold;
+    unsigned long       failed;
+};
+
+static struct stress_task   stress_tasks[MAX_TASKS];
+static struct rtskb_queue   stress_pool;
+static enum stress_mode     stress_mode;
+
+
+static inline void stress_account(struct stress_stats *stats,
+                                  nanosecs_abs_t start, nanosecs_abs_t end)
+{
+    nanosecs_rel_t delta = end - start;
+
+    if (delta > stats->max)
+        stats->max = delta;
+    stats->sum += delta;
+    stats->count++;
+}
+
+
+static struct rtskb *stress_get(struct stress_task *ctx)
+{
+    struct rtskb        *skb;
+    rtdm_lockctx_t      context;
+    nanosecs_abs_t      locked;
+
+
+    if (stress_mode != MODE_QUEUE_LOCK)
+        return alloc_rtskb(RTSKB_SIZE, &stress_pool);
+
+    rtdm_lock_get_irqsave(&stress_pool.lock, context);
+    locked = rtdm_clock_read();
+    skb = __rtskb_dequeue(&stress_pool);
+    stress_account(&ctx->hold, locked, rtdm_clock_read());
+    rtdm_lock_put_irqrestore(&stress_pool.lock, context);
+
+    /* keep the pool balance consistent with alloc_rtskb */
+#ifdef CONFIG_RTNET_CHECKED
+    if (skb)
+        stress_pool.pool_balance--;
+#endif
+    return skb;
+}
+
+
+static void stress_put(struct stress_task *ctx, struct rtskb *skb)
+{
+    rtdm_lockctx_t      context;
+    nanosecs_abs_t      locked;
+
+
+    if (stress_mode != MODE_QUEUE_LOCK) {
+        kfree_rtskb(skb);
+        return;
+    }
+
+    rtdm_lock_get_irqsave(&stress_pool.lock, context);
+    locked = rtdm_clock_read();
+    __rtskb_queue_tail(&stress_pool, skb);
+    stress_account(&ctx->hold, locked, rtdm_clock_read());
+    rtdm_lock_put_irqrestore(&stress_pool.lock, context);
+
+#ifdef CONFIG_RTNET_CHECKED
+    stress_pool.pool_balance++;
+#endif
+}
+
+
+static void stress_task_proc(void *arg)
+{
+    struct stress_task  *ctx = arg;
+    struct rtskb        *skbs[MAX_BURST];
+    nanosecs_abs_t      start;
+    unsigned int        loop, i, n;
+
+
+    rtos_task_migrate(ctx->cpu);
+
+    for (loop = 0; loop < loops; loop++) {
+        for (n = 0, i = 0; i < burst; i++) {
+            start = rtdm_clock_read();
+            skbs[n] = stress_get(ctx);
+            stress_account(&ctx->alloc, start, rtdm_clock_read());
+
+            if (skbs[n] != NULL)
+                n++;
+            else
+                ctx->failed++;
+        }
+
+        for (i = 0; i < n; i++) {
+            start = rtdm_clock_read();
+            stress_put(ctx, skbs[i]);
+            stress_account(&ctx->free, start, rtdm_clock_read());
+        }
+    }
+}
+
+
+static void stress_merge(struct stress_stats *total, struct stress_stats *stats)
+{
+    if (stats->max > total->max)
+        total->max = stats->max;
+    total->sum   += stats->sum;
+    total->count += stats->count;
+}
+
+
+static unsigned long stress_avg(struct stress_stats *stats)
+{
+    u64 avg = stats->sum;
+
+    if (stats->count == 0)
+        return 0;
+    do_div(avg, stats->count);
+    return (unsigned long)avg;
+}
+
+
+static int stress_run(enum stress_mode mode, unsigned int flags,
+                      const char *name)
+{
+    struct stress_stats alloc, free, hold;
+    unsigned long       failed = 0;
+    unsigned int        i;
+    int                 ret = 0;
+
+
+    stress_mode = mode;
+    memset(stress_tasks, 0, sizeof(stress_tasks));
+    memset(&alloc, 0, sizeof(alloc));
+    memset(&free, 0, sizeof(free));
+    memset(&hold, 0, sizeof(hold));
+
+    if (rtskb_pool_init_ex(&stress_pool, pool_size, flags) < pool_size) {
+        printk("rtskb-stress: %s: could not allocate %u rtskbs\n",
+               name, pool_size);
+        rtskb_pool_release(&stress_pool);
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < tasks; i++) {
+        /* spread the tasks over all online CPUs */
+        stress_tasks[i].cpu = i % num_online_cpus();
+
+        ret = rtdm_task_init(&stress_tasks[i].task, "rtskb-stress",
+                             stress_task_proc, &stress_tasks[i], prio, 0);
+        if (ret < 0) {
+            tasks = i;
+            break;
+        }
+    }
+
+    for (i = 0; i < tasks; i++) {
+        rtdm_task_join_nrt(&stress_tasks[i].task, 100);
+
+        stress_merge(&alloc, &stress_tasks[i].alloc);
+        stress_merge(&free, &stress_tasks[i].free);
+        stress_merge(&hold, &stress_tasks[i].hold);
+        failed += stress_tasks[i].failed;
+    }
+
+    printk("rtskb-stress: %-10s alloc max %lu ns avg %lu ns, "
+           "free max %lu ns avg %lu ns, %lu failed\n", name,
+           (unsigned long)alloc.max, stress_avg(&alloc),
+           (unsigned long)free.max, stress_avg(&free), failed);
+    if (hold.count > 0)
+        printk("rtskb-stress: %-10s lock hold max %lu ns avg %lu ns\n",
+               name, (unsigned long)hold.max, stress_avg(&hold));
+
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+    if (mode == MODE_LOCKFREE) {
+        unsigned int    size, capacity;
+        unsigned long   retries;
+
+        rtskb_lockfree_stats(&stress_pool, &size, &capacity, &retries);
+        printk("rtskb-stress: %-10s %lu cmpxchg retries\n", name, retries);
+    }
+#endif
+
+    rtskb_pool_release(&stress_pool);
+
+    return ret;
+}
+
+
+int init_module(void)
+{
+    int ret;
+
+
+    if ((tasks == 0) || (tasks > MAX_TASKS) ||
+        (burst == 0) || (burst > MAX_BURST)) {
+        printk("rtskb-stress: invalid parameters\n");
+        return -EINVAL;
+    }
+
+    printk("rtskb-stress: %u tasks, %u loops, burst %u, pool size %u\n",
+           tasks, loops, burst, pool_size);
+
+    ret = stress_run(MODE_QUEUE, 0, "queue");
+    if (ret == 0)
+        ret = stress_run(MODE_QUEUE_LOCK, 0, "queue-lock");
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+    if (ret == 0)
+        ret = stress_run(MODE_LOCKFREE, RTSKB_POOL_LOCKFREE, "lock-free");
+#else
+    printk("rtskb-stress: lock-free pools not enabled "
+           "(CONFIG_RTNET_RTSKB_LOCKFREE)\n");
+#endif
+
+    return ret;
+}
+
+
+void cleanup_module(void)
+{
+}
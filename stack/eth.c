@@ -26,6 +26,7 @@
 
 #include <rtdev.h>
 #include <rtnet_internal.h>
+#include <rtvlan.h>
 
 
 /*
@@ -86,6 +87,7 @@ unsigned short rt_eth_type_trans(struct rtskb *skb, struct rtnet_device *rtdev)
 {
     struct ethhdr *eth;
     unsigned char *rawp;
+    unsigned short proto;
 
 
     rtcap_mark_incoming(skb);
@@ -116,8 +118,16 @@ unsigned short rt_eth_type_trans(struct rtskb *skb, struct rtnet_device *rtdev)
             skb->pkt_type = PACKET_OTHERHOST;
     }
 
-    if (ntohs(eth->h_proto) >= 1536)
-        return eth->h_proto;
+    proto = eth->h_proto;
+
+#ifdef CONFIG_RTNET_VLAN
+    /* in-band tag, the stack manager passes the packet to the VLAN device */
+    if ((proto == htons(ETH_P_8021Q)) && (skb->len >= RT_VLAN_HLEN))
+        proto = rt_vlan_untag(skb);
+#endif
+
+    if (ntohs(proto) >= 1536)
+        return proto;
 
     rawp = skb->data;
 
@@ -0,0 +1,44 @@
+/***
+ *
+ *  include/ipv4/ip_forward.h - real-time IPv4 forwarding
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __RTNET_IP_FORWARD_H_
+#define __RTNET_IP_FORWARD_H_
+
+#include <linux/init.h>
+
+#include <rtskb.h>
+
+
+#ifdef CONFIG_RTNET_RTIPV4_ROUTER
+
+int rt_ip_forward(struct rtskb *skb);
+
+int __init rt_ip_forward_init(void);
+void rt_ip_forward_release(void);
+
+#else /* !CONFIG_RTNET_RTIPV4_ROUTER */
+
+#define rt_ip_forward_init()        0
+#define rt_ip_forward_release()     do {} while (0)
+
+#endif /* CONFIG_RTNET_RTIPV4_ROUTER */
+
+
+#endif  /* __RTNET_IP_FORWARD_H_ */
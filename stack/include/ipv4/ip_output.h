@@ -28,13 +28,40 @@
 #include <linux/init.h>
 
 #include <rtdev.h>
+#include <rtnet_socket.h>
 #include <ipv4/route.h>
 
 
 extern int rt_ip_build_xmit(struct rtsocket *sk,
-    int getfrag (const void *, unsigned char *, unsigned int, unsigned int),
+    int getfrag (const void *, unsigned char *, unsigned int, unsigned int,
+                 struct rtskb *),
     const void *frag, unsigned length, struct dest_route *rt, int flags);
 
+extern u16 rt_ip_id_reserve(u32 daddr, u8 protocol);
+
+extern void rt_ip_xmit_cache_fill(struct rtsocket *sk, struct dest_route *rt,
+                                  unsigned long generation, unsigned int epoch,
+                                  u16 sport, u16 dport);
+extern int rt_ip_xmit_cache_hold(struct rtsocket *sk, unsigned int length,
+                                 struct rt_ip_xmit_cache *tmpl);
+extern int rt_ip_build_xmit_cached(struct rtsocket *sk,
+    int getfrag (const void *, unsigned char *, unsigned int, unsigned int,
+                 struct rtskb *),
+    const void *frag, unsigned length, struct rt_ip_xmit_cache *tmpl,
+    int flags);
+
+/* to be called when the addresses or ports of the socket change */
+static inline void rt_ip_xmit_cache_invalidate(struct rtsocket *sk)
+{
+    rtdm_lockctx_t context;
+
+
+    rtdm_lock_get_irqsave(&sk->param_lock, context);
+    sk->prot.inet.xmit_cache.valid = 0;
+    sk->prot.inet.xmit_cache.epoch++;
+    rtdm_lock_put_irqrestore(&sk->param_lock, context);
+}
+
 extern void __init rt_ip_init(void);
 extern void rt_ip_release(void);
 
@@ -0,0 +1,85 @@
+/***
+ *
+ *  include/ipv4/multicast.h - IPv4 multicast group membership
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __RTNET_MULTICAST_H_
+#define __RTNET_MULTICAST_H_
+
+#include <linux/in.h>
+#include <linux/errno.h>
+
+#include <rtdev.h>
+#include <rtnet_socket.h>
+#include <ipv4/route.h>
+
+
+/* groups joined by all sockets of the station */
+#define RT_IP_MC_GROUPS         32
+
+
+/***
+ *  rt_ip_mc_map - map an IPv4 group to its Ethernet address (RFC 1112)
+ */
+static inline void rt_ip_mc_map(u32 group, unsigned char *mac)
+{
+    u32 addr = ntohl(group);
+
+    mac[0] = 0x01;
+    mac[1] = 0x00;
+    mac[2] = 0x5e;
+    mac[3] = (addr >> 16) & 0x7f;
+    mac[4] = (addr >> 8) & 0xff;
+    mac[5] = addr & 0xff;
+}
+
+
+#ifdef CONFIG_RTNET_RTIPV4_MULTICAST
+
+int rt_ip_mc_check(struct rtnet_device *rtdev, u32 group);
+int rt_ip_route_output_mc(struct dest_route *rt_buf, u32 daddr, u32 saddr);
+
+int rt_ip_mc_setsockopt(struct rtsocket *sock, int optname,
+                        const void *optval, socklen_t optlen);
+int rt_ip_mc_getsockopt(struct rtsocket *sock, int optname,
+                        void *optval, socklen_t *optlen);
+
+void rt_ip_mc_socket_init(struct rtsocket *sock);
+void rt_ip_mc_socket_cleanup(struct rtsocket *sock);
+
+#else /* !CONFIG_RTNET_RTIPV4_MULTICAST */
+
+static inline int rt_ip_mc_setsockopt(struct rtsocket *sock, int optname,
+                                      const void *optval, socklen_t optlen)
+{
+    return -ENOPROTOOPT;
+}
+
+static inline int rt_ip_mc_getsockopt(struct rtsocket *sock, int optname,
+                                      void *optval, socklen_t *optlen)
+{
+    return -ENOPROTOOPT;
+}
+
+#define rt_ip_mc_socket_init(sock)      do {} while (0)
+#define rt_ip_mc_socket_cleanup(sock)   do {} while (0)
+
+#endif /* CONFIG_RTNET_RTIPV4_MULTICAST */
+
+
+#endif  /* __RTNET_MULTICAST_H_ */
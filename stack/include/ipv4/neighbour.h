@@ -0,0 +1,62 @@
+/***
+ *
+ *  include/ipv4/neighbour.h - asynchronous address resolution
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __RTNET_NEIGHBOUR_H_
+#define __RTNET_NEIGHBOUR_H_
+
+#include <linux/init.h>
+#include <linux/types.h>
+
+#include <rtdev.h>
+#include <rtskb.h>
+#include <ipv4/route.h>
+
+
+/* one neighbour per host route at most */
+#define RT_NEIGH_ENTRIES        CONFIG_RTNET_RTIPV4_HOST_ROUTES
+
+enum rt_neigh_state {
+    RT_NEIGH_NONE,              /* unused entry */
+    RT_NEIGH_INCOMPLETE,        /* requests sent, packets are queued */
+    RT_NEIGH_REACHABLE,         /* host route installed */
+    RT_NEIGH_PROBE,             /* host route installed, refresh pending */
+    RT_NEIGH_FAILED             /* no reply, packets are dropped */
+};
+
+
+int rt_neigh_resolve(u32 addr, u32 saddr);
+int rt_neigh_resolve_dev(u32 addr, struct rtnet_device *rtdev);
+int rt_neigh_resolve_list(struct rtnet_device *rtdev, u32 *addrs,
+                          unsigned int count, unsigned int timeout,
+                          u32 *resolved);
+struct rtnet_device *rt_neigh_pending(u32 addr, u32 saddr);
+int rt_neigh_queue(struct rtskb *skb, struct dest_route *rt);
+int rt_neigh_queue_list(struct rtskb_queue *list, unsigned int count,
+                        struct dest_route *rt);
+void rt_neigh_confirm(u32 addr, unsigned char *dev_addr,
+                      struct rtnet_device *rtdev);
+void rt_neigh_forget(u32 addr, struct rtnet_device *rtdev);
+void rt_neigh_flush(struct rtnet_device *rtdev);
+
+int __init rt_neigh_init(void);
+void rt_neigh_release(void);
+
+
+#endif  /* __RTNET_NEIGHBOUR_H_ */
@@ -35,6 +35,8 @@ struct dest_route {
     u32                 ip;
     unsigned char       dev_addr[MAX_ADDR_LEN];
     struct rtnet_device *rtdev;
+    u32                 neigh;  /* next hop awaiting resolution, see
+                                   rt_neigh_queue */
 };
 
 
@@ -47,14 +49,15 @@ int rt_ip_route_add_net(u32 addr, u32 mask, u32 gw_addr);
 int rt_ip_route_del_net(u32 addr, u32 mask);
 #endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
-#ifdef CONFIG_RTNET_RTIPV4_ROUTER
-int rt_ip_route_forward(struct rtskb *rtskb, u32 daddr);
-#endif /* CONFIG_RTNET_RTIPV4_ROUTER */
-
 int rt_ip_route_del_host(u32 addr, struct rtnet_device *rtdev);
 int rt_ip_route_get_host(u32 addr, char* if_name, unsigned char *dev_addr,
                          struct rtnet_device *rtdev);
 int rt_ip_route_output(struct dest_route *rt_buf, u32 daddr, u32 saddr);
+int rt_ip_route_output_pending(struct dest_route *rt_buf, u32 daddr,
+                               u32 saddr);
+int rt_ip_route_hold(struct dest_route *rt, unsigned long generation);
+
+extern volatile unsigned long rt_ip_route_generation;
 
 int __init rt_ip_routing_init(void);
 void rt_ip_routing_release(void);
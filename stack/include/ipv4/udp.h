@@ -30,4 +30,7 @@
    Only increase with care (look-up delays!), must be power of 2 */
 #define RT_UDP_SOCKETS      64
 
+/* Maximum number of sockets sharing a port, see RTNET_RTIOC_REUSEPORT */
+#define RT_UDP_REUSEPORT_MAX    16
+
 #endif  /* __RTNET_UDP_H_ */
@@ -28,6 +28,9 @@
 #include <rtnet_chrdev.h>
 
 
+/* addresses per resolve request, limited by the size of ipv4_cmd */
+#define IPV4_RESOLVE_MAX    13
+
 struct ipv4_cmd {
     struct rtnet_ioctl_head head;
 
@@ -62,6 +65,13 @@ struct ipv4_cmd {
             __u32       net_mask;
         } delnet;
 
+        struct {
+            __u32       count;
+            __u32       timeout;    /* ms, 0: do not wait */
+            __u32       resolved;   /* bit per resolved address */
+            __u32       ip_addr[IPV4_RESOLVE_MAX];
+        } resolve;
+
         /*** rtping ***/
         struct {
             __u32       ip_addr;
@@ -100,5 +110,7 @@ struct ipv4_cmd {
 					      struct ipv4_cmd)
 #define IOC_RT_HOST_ROUTE_GET_DEV       _IOWR(RTNET_IOC_TYPE_IPV4, 8,   \
 					      struct ipv4_cmd)
+#define IOC_RT_HOST_ROUTE_RESOLVE       _IOWR(RTNET_IOC_TYPE_IPV4, 9,   \
+                                              struct ipv4_cmd)
 
 #endif  /* __IPV4_H_ */
@@ -28,10 +28,14 @@
 
 #define MAX_RT_DEVICES                  8
 
+/* link layer multicast addresses per device, see rtdev_mc_add() */
+#define RTDEV_MC_MAX                    16
+
 
 #ifdef __KERNEL__
 
 #include <asm/atomic.h>
+#include <linux/if_ether.h>
 #include <linux/netdevice.h>
 
 #include <rtskb.h>
@@ -46,6 +50,10 @@
 #define NETIF_F_LLTX                    4096
 #endif
 
+/* hardware inserts the 802.1Q tag found in rtskb.vlan_tci, see rtvlan.h;
+ * deliberately not NETIF_F_HW_VLAN_*, drivers inherit those from Linux */
+#define RTNETIF_F_HW_VLAN_TX            0x40000000
+
 
 enum rtnet_link_state {
 	__RTNET_LINK_STATE_XOFF = 0,
@@ -103,16 +111,25 @@ struct rtnet_device {
     int                 promiscuity;
     int                 allmulti;
 
+    /* multicast receive filter, packed for the drivers */
+    unsigned char       mc_list[RTDEV_MC_MAX][ETH_ALEN];
+    unsigned int        mc_users[RTDEV_MC_MAX];
+    unsigned int        mc_count;
+
     __u32               local_ip;   /* IP address in network order  */
     __u32               broadcast_ip; /* broadcast IP in network order */
+    __u32               netmask;    /* subnet mask in network order */
 
     rtdm_event_t        *stack_event;
+    struct rtnet_mgr    *stack_mgr; /* stack manager receiving our frames */
+    struct rtnet_mgr    *own_stack_mgr; /* dedicated manager, if enabled  */
 
     rtdm_mutex_t        xmit_mutex; /* protects xmit routine        */
     rtdm_lock_t         rtdev_lock; /* management lock              */
     struct mutex        nrt_lock;   /* non-real-time locking        */
 
     unsigned int        add_rtskbs; /* additionally allocated global rtskbs */
+    unsigned int        add_jumbo_rtskbs; /* ... and global jumbo rtskbs */
 
     /* RTmac related fields */
     struct rtmac_disc   *mac_disc;
@@ -145,6 +162,9 @@ struct rtnet_device {
 
     int                 (*do_ioctl)(struct rtnet_device *rtdev, 
 				    unsigned int request, void * cmd);
+
+    /* programs mc_list into the hardware filter, called with nrt_lock held */
+    void                (*set_multicast_list)(struct rtnet_device *rtdev);
     struct net_device_stats *(*get_stats)(struct rtnet_device *rtdev);
 
     /* DMA pre-mapping hooks */
@@ -182,6 +202,9 @@ void rtdev_del_event_hook(struct rtdev_event_hook *hook);
 
 void rtdev_alloc_name (struct rtnet_device *rtdev, const char *name_mask);
 
+int rtdev_mc_add(struct rtnet_device *rtdev, const unsigned char *addr);
+int rtdev_mc_del(struct rtnet_device *rtdev, const unsigned char *addr);
+
 /**
  *  __rtdev_get_by_index - find a rtnet_device by its ifindex
  *  @ifindex: index of device
@@ -25,6 +25,7 @@
 #ifndef __RTMAC_PROTO_H_
 #define __RTMAC_PROTO_H_
 
+#include <rtnet_stats.h>
 #include <stack_mgr.h>
 
 
@@ -71,6 +72,8 @@ static inline int rtmac_xmit(struct rtskb *skb)
     int ret;
 
 
+    rtnet_trace_end(skb, RTNET_LAT_TX_XMIT, RTNET_LAT_TX_TOTAL);
+
     ret = rtdev->hard_start_xmit(skb, rtdev);
     if (ret != 0)
         kfree_rtskb(skb);
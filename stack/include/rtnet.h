@@ -77,6 +77,133 @@ typedef int64_t                 nanosecs_rel_t;
  * Use RTNET_RTIOC_TIMEOUT with any negative timeout value instead. */
 #define RTNET_RTIOC_EXTPOOL     _IOW(RTIOC_TYPE_NETWORK, 0x14, unsigned int)
 #define RTNET_RTIOC_SHRPOOL     _IOW(RTIOC_TYPE_NETWORK, 0x15, unsigned int)
+/* 0x16: RTNET_RTIOC_ZEROCOPY, kernel only */
+#define RTNET_RTIOC_RECVMMSG    _IOWR(RTIOC_TYPE_NETWORK, 0x17, \
+                                      struct rtnet_mmsg_args)
+#define RTNET_RTIOC_SENDMMSG    _IOWR(RTIOC_TYPE_NETWORK, 0x18, \
+                                      struct rtnet_mmsg_args)
+
+/* batch reception/transmission of datagrams (RTNET_RTIOC_RECVMMSG/SENDMMSG)
+ * The IOCTLs return the number of processed messages. Reception waits only
+ * for the first datagram and then collects what is already pending,
+ * transmission looks up the route once per destination. */
+struct rtnet_mmsghdr {
+    struct msghdr   msg_hdr;
+    unsigned int    msg_len;    /* bytes received/sent for this message */
+};
+
+struct rtnet_mmsg_args {
+    struct rtnet_mmsghdr    *msgvec;
+    unsigned int            vlen;
+    int                     flags;  /* MSG_* flags for all messages */
+};
+
+#define RTNET_RTIOC_RXRING      _IOWR(RTIOC_TYPE_NETWORK, 0x19, \
+                                      struct rtnet_rxring_req)
+#define RTNET_RTIOC_RXRING_WAIT _IO(RTIOC_TYPE_NETWORK, 0x1A)
+
+/* memory-mapped receive ring (RTNET_RTIOC_RXRING, UDP and packet sockets)
+ * Once set up, received datagrams are no longer delivered via recvmsg or
+ * select (both fail with EINVAL) but published in ring frames: the stack
+ * advances head, the application advances tail after processing frame tail.
+ * The stack only reads tail, all other header fields are output only. A full
+ * ring drops new datagrams. RTNET_RTIOC_RXRING_WAIT blocks according to the
+ * receive timeout until the ring is non-empty. */
+struct rtnet_rxring_req {
+    unsigned int            frame_size; /* bytes per frame incl. descriptor,
+                                           multiple of 16 */
+    unsigned int            frame_nr;   /* frames, power of 2 */
+    void                    *ring;      /* returns the mapped ring header */
+};
+
+struct rtnet_rxring_hdr {
+    uint32_t                frame_size;
+    uint32_t                frame_nr;
+    uint32_t                offset;     /* of frame 0 from the header */
+    uint32_t                dropped;    /* datagrams lost on a full ring */
+    volatile uint32_t       head;       /* written by the stack */
+    uint32_t                __padding1[11];
+    volatile uint32_t       tail;       /* written by the application */
+    uint32_t                __padding2[15];
+};
+
+struct rtnet_rxring_desc {
+    uint64_t                stamp;      /* reception time stamp */
+    uint32_t                len;        /* datagram length */
+    uint32_t                copied;     /* less than len if truncated */
+    uint16_t                addrlen;
+    uint16_t                __padding1;
+    uint8_t                 addr[24];   /* sockaddr_in or sockaddr_ll */
+    uint32_t                __padding2;
+};
+
+#define RTNET_RXRING_DESC_SIZE  48
+
+#define RTNET_RXRING_FRAME(hdr, index) \
+    ((struct rtnet_rxring_desc *)((char *)(hdr) + (hdr)->offset + \
+        ((index) & ((hdr)->frame_nr - 1)) * (hdr)->frame_size))
+#define RTNET_RXRING_DATA(desc) \
+    ((unsigned char *)(desc) + RTNET_RXRING_DESC_SIZE)
+
+#define RTNET_RTIOC_REUSEPORT   _IOW(RTIOC_TYPE_NETWORK, 0x1B, unsigned int)
+
+/* port sharing modes (RTNET_RTIOC_REUSEPORT, UDP sockets)
+ * Sockets with the same, non-zero mode may bind to the same local address
+ * and port. The mode has to be set before binding. */
+#define RTNET_REUSEPORT_OFF     0
+#define RTNET_REUSEPORT_HASH    1   /* spread by source address and port */
+#define RTNET_REUSEPORT_RR      2   /* spread round-robin */
+#define RTNET_REUSEPORT_FANOUT  3   /* deliver a copy to every socket */
+
+#define RTNET_RTIOC_RXPRIO      _IOW(RTIOC_TYPE_NETWORK, 0x1C, \
+                                     struct rtnet_rxprio_req)
+
+/* priority-ordered reception (RTNET_RTIOC_RXPRIO, UDP and packet sockets)
+ * recvmsg returns the pending datagram of the highest priority first, those
+ * of equal priority in arrival order. RTNET_RXPRIO_TOS derives the priority
+ * from the DSCP of IPv4 datagrams, RTNET_RXPRIO_SENDER looks up their source
+ * address and port in map. Anything else is queued with def_prio. Receive
+ * rings (RTNET_RTIOC_RXRING) are not affected. */
+#define RTNET_RXPRIO_OFF        0
+#define RTNET_RXPRIO_TOS        1
+#define RTNET_RXPRIO_SENDER     2
+
+#define RTNET_RXPRIO_MAX        0   /* highest priority */
+#define RTNET_RXPRIO_MIN        31  /* lowest priority */
+
+#define RTNET_RXPRIO_MAP_SIZE   8
+
+struct rtnet_rxprio_entry {
+    uint32_t                addr;       /* IPv4 source, network order */
+    uint16_t                port;       /* source port, network order,
+                                           0 matches any */
+    uint16_t                prio;
+};
+
+struct rtnet_rxprio_req {
+    unsigned int            mode;
+    unsigned int            def_prio;
+    unsigned int            map_len;    /* used entries of map */
+    struct rtnet_rxprio_entry map[RTNET_RXPRIO_MAP_SIZE];
+};
+
+#define RTNET_RTIOC_TXAREA      _IOWR(RTIOC_TYPE_NETWORK, 0x1D, \
+                                      struct rtnet_txarea_req)
+
+/* preregistered transmission area (RTNET_RTIOC_TXAREA, UDP sockets)
+ * Maps size bytes of stack memory into the process, once per socket. Payload
+ * that sendmsg finds completely inside this area is passed by reference to
+ * NICs able to gather it instead of being copied, sendmsg then blocks until
+ * the NIC released it. The payload must not be modified meanwhile. Other
+ * payload, or payload spread over more than RTNET_TXAREA_IOVS iovec entries,
+ * is copied as usual. */
+#define RTNET_TXAREA_MAX        0x100000    /* bytes */
+#define RTNET_TXAREA_IOVS       4
+
+struct rtnet_txarea_req {
+    unsigned int            size;       /* bytes, up to RTNET_TXAREA_MAX */
+    void                    *area;      /* returns the mapped area */
+};
 
 /* socket transmission priorities */
 #define SOCK_MAX_PRIO           0
@@ -106,6 +233,11 @@ struct rtnet_callback {
 #define RTNET_RTIOC_CALLBACK    _IOW(RTIOC_TYPE_NETWORK, 0x12, \
                                      struct rtnet_callback)
 
+/* Transmit payload by reference instead of copying it (non-zero argument).
+ * Only usable inside the kernel, sendmsg then blocks until the NIC released
+ * the payload. */
+#define RTNET_RTIOC_ZEROCOPY    _IOW(RTIOC_TYPE_NETWORK, 0x16, unsigned int)
+
 /* utility functions */
 
 /* provided by rt_ipv4 */
@@ -85,7 +85,7 @@ struct rtnet_core_cmd {
             __u32       set_dev_flags;
             __u32       clear_dev_flags;
             __u32       dev_addr_type;
-            __u32       __padding;
+            __u32       netmask;
             __u8        dev_addr[DEV_ADDR_LEN];
         } up;
 
@@ -99,11 +99,149 @@ struct rtnet_core_cmd {
             __u8        dev_addr[DEV_ADDR_LEN];
         } info;
 
+        struct {
+            __u32       dedicated;
+            __u32       priority;
+            __s32       cpu;
+        } stack_mgr;
+
+        struct {
+            __u32       vid;
+        } vlan;
+
         __u64 __padding[8];
     } args;
 };
 
 
+/* drop and error counters of the stack, see IOC_RT_DROPSTATS */
+enum rtnet_drop_reason {
+    RTNET_DROP_RX_FIFO,             /* stack manager RX FIFO full */
+    RTNET_DROP_NO_HANDLER,          /* no layer 3 handler accepted packet */
+    RTNET_DROP_TX_ERROR,            /* driver rejected transmission */
+    RTNET_DROP_RTSKB_ALLOC,         /* alloc_rtskb on empty pool */
+    RTNET_DROP_RTSKB_ACQUIRE,       /* no compensation rtskb in pool */
+    RTNET_DROP_IP_HEADER,           /* malformed IP header or checksum */
+    RTNET_DROP_IP_NO_PROTOCOL,      /* unsupported IP protocol */
+    RTNET_DROP_IP_NO_SOCKET,        /* no destination socket */
+    RTNET_DROP_IP_SOCKET_POOL,      /* socket pool empty */
+    RTNET_DROP_IP_NO_ROUTE,         /* output route lookup failed */
+    RTNET_DROP_IP_FORWARD,          /* router could not forward */
+    RTNET_DROP_FRAG_NO_COLLECTOR,   /* all reassembly collectors busy */
+    RTNET_DROP_FRAG_SOCKET_POOL,    /* socket pool empty while reassembling */
+    RTNET_DROP_FRAG_UNORDERED,      /* unused, out-of-order is reassembled */
+    RTNET_DROP_ICMP_ERROR,          /* malformed or unsupported ICMP */
+    RTNET_DROP_UDP_ERROR,           /* malformed UDP datagram */
+    RTNET_DROP_TCP_CHECKSUM,        /* TCP checksum mismatch */
+    RTNET_DROP_TCP_NO_SOCKET,       /* no matching TCP socket */
+    RTNET_DROP_TCP_WINDOW,          /* segment out of window or bad ACK */
+    RTNET_DROP_TCP_ERROR,           /* malformed TCP segment, TX failures */
+    RTNET_DROP_RTMAC_UNATTACHED,    /* RTmac frame without discipline */
+    RTNET_DROP_RTMAC_VERSION,       /* unsupported RTmac version */
+    RTNET_DROP_RTMAC_VNIC,          /* VNIC queue or pool exhausted */
+    RTNET_DROP_PACKET_POOL,         /* packet socket pool empty */
+    RTNET_DROP_UDP_CHECKSUM,        /* UDP checksum mismatch */
+    RTNET_DROP_RXRING_FULL,         /* mapped receive ring full */
+    RTNET_DROP_IP_MC_FILTER,        /* multicast group not joined */
+    RTNET_DROP_FRAG_TIMEOUT,        /* datagram incomplete on timeout */
+    RTNET_DROP_FRAG_QUOTA,          /* socket exceeded its collectors */
+    RTNET_DROP_FRAG_OVERLAP,        /* overlapping or inconsistent fragment */
+    RTNET_DROP_FRAG_POOL,           /* fragment pool empty, no socket yet */
+    RTNET_DROP_IP_FWD_TTL,          /* TTL expired while forwarding */
+    RTNET_DROP_IP_FWD_MTU,          /* forwarded packet exceeds output MTU */
+    RTNET_DROP_IP_FWD_QUEUE,        /* forwarding queue of output device full */
+    RTNET_DROP_NEIGH_QUEUE,         /* too many packets await a neighbour */
+    RTNET_DROP_NEIGH_FAILED,        /* neighbour could not be resolved */
+    RTNET_DROP_VLAN_UNKNOWN,        /* no VLAN device for the tagged VID */
+
+    RTNET_DROP_REASONS
+};
+
+#define RTNET_DROP_MAX_REASONS          64
+
+/* names in the order of enum rtnet_drop_reason */
+#define RTNET_DROP_REASON_NAMES { \
+    "rx_fifo_full", \
+    "no_l3_handler", \
+    "tx_error", \
+    "rtskb_alloc_failed", \
+    "rtskb_acquire_failed", \
+    "ip_bad_header", \
+    "ip_no_protocol", \
+    "ip_no_socket", \
+    "ip_socket_pool_empty", \
+    "ip_no_route", \
+    "ip_forward_failed", \
+    "frag_no_collector", \
+    "frag_socket_pool_empty", \
+    "frag_unordered", \
+    "icmp_error", \
+    "udp_error", \
+    "tcp_bad_checksum", \
+    "tcp_no_socket", \
+    "tcp_out_of_window", \
+    "tcp_error", \
+    "rtmac_unattached", \
+    "rtmac_bad_version", \
+    "rtmac_vnic_dropped", \
+    "packet_socket_pool_empty", \
+    "udp_bad_checksum", \
+    "rxring_full", \
+    "ip_mc_not_joined", \
+    "frag_timeout", \
+    "frag_socket_quota", \
+    "frag_overlap", \
+    "frag_pool_empty", \
+    "ip_fwd_ttl_exceeded", \
+    "ip_fwd_mtu_exceeded", \
+    "ip_fwd_queue_full", \
+    "neigh_queue_full", \
+    "neigh_unresolved", \
+    "vlan_unknown" \
+}
+
+/* traced stages, each accounts the delay since the previous one */
+enum rtnet_latency_stage {
+    RTNET_LAT_RX_IRQ,               /* driver IRQ -> RX FIFO */
+    RTNET_LAT_RX_FIFO,              /* RX FIFO -> stack manager */
+    RTNET_LAT_RX_PROTO,             /* stack manager -> IP input */
+    RTNET_LAT_RX_SOCKET,            /* protocol -> socket queue */
+    RTNET_LAT_RX_USER,              /* socket queue -> recvmsg */
+    RTNET_LAT_RX_TOTAL,             /* driver IRQ -> recvmsg */
+    RTNET_LAT_TX_RTMAC_ENQUEUE,     /* sendmsg -> RTmac queue */
+    RTNET_LAT_TX_RTMAC_DEQUEUE,     /* RTmac queue -> RTmac dequeue */
+    RTNET_LAT_TX_XMIT,              /* previous stage -> driver xmit */
+    RTNET_LAT_TX_TOTAL,             /* sendmsg -> driver xmit */
+    RTNET_LAT_FWD,                  /* IP input -> forwarding queue */
+    RTNET_LAT_FWD_TOTAL,            /* driver IRQ -> forwarding queue */
+
+    RTNET_LAT_STAGES
+};
+
+#define RTNET_LAT_STAGE_NAMES { \
+    "rx_irq_to_fifo", \
+    "rx_fifo_to_stack", \
+    "rx_stack_to_proto", \
+    "rx_proto_to_socket", \
+    "rx_socket_to_user", \
+    "rx_total", \
+    "tx_send_to_rtmac", \
+    "tx_rtmac_queue", \
+    "tx_to_driver", \
+    "tx_total", \
+    "fwd_proto_to_queue", \
+    "fwd_total" \
+}
+
+struct rtnet_drop_stats_cmd {
+    struct rtnet_ioctl_head head;
+
+    __u32       count;              /* number of valid counters */
+    __u32       __padding;
+    __u64       counter[RTNET_DROP_MAX_REASONS];
+};
+
+
 #define RTNET_IOC_NODEV_PARAM           0x80
 
 #define RTNET_IOC_TYPE_CORE             0
@@ -119,5 +257,18 @@ struct rtnet_core_cmd {
 #define IOC_RT_IFINFO                   _IOWR(RTNET_IOC_TYPE_CORE, 2 |  \
                                               RTNET_IOC_NODEV_PARAM,    \
                                               struct rtnet_core_cmd)
+#define IOC_RT_IFSTACKMGR               _IOW(RTNET_IOC_TYPE_CORE, 3,    \
+                                             struct rtnet_core_cmd)
+#define IOC_RT_DROPSTATS                _IOWR(RTNET_IOC_TYPE_CORE, 4 |  \
+                                              RTNET_IOC_NODEV_PARAM,    \
+                                              struct rtnet_drop_stats_cmd)
+#define IOC_RT_LATENCY_RESET            _IOW(RTNET_IOC_TYPE_CORE, 5 |   \
+                                             RTNET_IOC_NODEV_PARAM,     \
+                                             struct rtnet_core_cmd)
+#define IOC_RT_VLAN_ADD                 _IOW(RTNET_IOC_TYPE_CORE, 6,    \
+                                             struct rtnet_core_cmd)
+#define IOC_RT_VLAN_DEL                 _IOW(RTNET_IOC_TYPE_CORE, 7 |   \
+                                             RTNET_IOC_NODEV_PARAM,     \
+                                             struct rtnet_core_cmd)
 
 #endif  /* __RTNET_CHRDEV_H_ */
@@ -52,6 +52,7 @@
 
 
 struct rtnet_device;
+struct rtskb_fifo;
 
 /*struct rtnet_msg {
     int                 msg_type;
@@ -63,6 +64,8 @@ struct rtnet_mgr {
     rtdm_task_t     task;
 /*    MBX     mbx;*/
     rtdm_event_t    event;
+    struct rtskb_fifo *rx_fifo; /* stack manager: incoming frames       */
+    int             cpu;        /* stack manager: CPU to run on, or -1  */
 };
 
 
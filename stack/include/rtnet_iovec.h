@@ -25,6 +25,11 @@
 
 #include <linux/uio.h>
 
+#include <rtskb.h>
+
+/* minimum data length passed as rtskb fragments, shorter data is copied */
+#define RT_IOVEC_FRAG_MIN       128
+
 
 /***
  *  rt_iovec_len
@@ -43,6 +48,18 @@ static inline size_t rt_iovec_len(const struct iovec *iov, int iovlen)
 
 extern void rt_memcpy_tokerneliovec(struct iovec *iov, unsigned char *kdata, int len);
 extern void rt_memcpy_fromkerneliovec(unsigned char *kdata, struct iovec *iov, int len);
+extern unsigned int rt_csum_copy_fromkerneliovec(unsigned char *kdata,
+                                                 struct iovec *iov, int len,
+                                                 unsigned int csum);
+extern unsigned int rt_csum_kerneliovec(const struct iovec *iov, int len,
+                                        int offset, unsigned int csum);
+extern unsigned int rt_csum_copy_tokerneliovec(const struct iovec *iov,
+                                               int offset, unsigned char *kdata,
+                                               int len, unsigned int csum);
+extern void rt_iovec_advance(struct iovec *iov, int len);
+extern int rt_iovec_to_frags(struct rtskb *skb, unsigned char *kdata,
+                             struct iovec *iov, int len,
+                             struct rtskb_zerocopy *zc);
 
 
 #endif  /* __KERNEL__ */
@@ -28,22 +28,85 @@
 #define __RTNET_SOCKET_H_
 
 #include <asm/atomic.h>
+#include <linux/ip.h>
 #include <linux/list.h>
 
 #include <rtdev.h>
 #include <rtnet.h>
+#include <rtnet_stats.h>
 #include <rtnet_sys.h>
 #include <stack_mgr.h>
+#include <ipv4/route.h>
 
 #include <rtdm/rtdm_driver.h>
 
 
+#define RT_IP_CACHE_LINK_HDR    16
+
+/* multicast groups a single IP socket can join */
+#define RT_IP_MC_SOCK_GROUPS    8
+
+/* output path of a connected IP socket, see rt_ip_xmit_cache_hold */
+struct rt_ip_xmit_cache {
+    int                 valid;
+    unsigned int        epoch;      /* bumped when the socket is rebound */
+    unsigned long       generation; /* rt_ip_route_generation of rt */
+    struct dest_route   rt;         /* rtdev is not referenced */
+    unsigned int        priority;   /* socket priority the entry was built for */
+    unsigned int        mtu;
+    unsigned int        hh_len;     /* reserved link layer headroom */
+    unsigned int        link_len;   /* prebuilt link header, 0 if none */
+    unsigned char       link_hdr[RT_IP_CACHE_LINK_HDR];
+    struct iphdr        iph;        /* tot_len, id and check are zero */
+    u32                 iph_csum;   /* partial checksum of iph */
+    u16                 sport;      /* transport ports */
+    u16                 dport;
+};
+
+/* mapped receive ring, see RTNET_RTIOC_RXRING
+ * The application may overwrite the shared header at any time, so the stack
+ * keeps the geometry and its indices here and only reads the tail. */
+struct rtsocket_rxring {
+    struct rtnet_rxring_hdr *hdr;       /* shared area */
+    unsigned char           *frames;    /* frame 0 */
+    unsigned int            frame_size;
+    unsigned int            frame_nr;
+    unsigned int            data_size;  /* payload bytes per frame */
+    u32                     reserve;    /* next frame to be filled */
+    u32                     head;       /* next frame to be published */
+    u32                     dropped;
+    unsigned char           *ready;     /* filled, awaiting publication */
+    rtdm_lock_t             lock;       /* protects indices and ready */
+    atomic_t                refs;       /* socket and user mappings */
+    atomic_t                waiting;    /* RTNET_RTIOC_RXRING_WAIT pending */
+};
+
+/* preregistered transmission area, see RTNET_RTIOC_TXAREA */
+struct rtsocket_txarea {
+    void                    *kaddr;     /* direct-mapped, physically
+                                           contiguous */
+    unsigned long           uaddr;      /* address the owner maps it to */
+    unsigned long           size;
+    unsigned int            order;      /* of the page allocation */
+    atomic_t                refs;       /* socket and user mapping */
+};
+
+/* priority-ordered receive queue, see RTNET_RTIOC_RXPRIO */
+struct rtsocket_rxprio {
+    struct rtskb_prio_queue queue;
+    unsigned int            mode;       /* protected by queue.lock */
+    unsigned int            def_prio;
+    unsigned int            map_len;
+    struct rtnet_rxprio_entry map[RTNET_RXPRIO_MAP_SIZE];
+};
+
 struct rtsocket {
     unsigned short          protocol;
 
     struct rtskb_queue      skb_pool;
     unsigned int            pool_size;
     struct mutex            pool_nrt_lock;
+    atomic_t                frag_count; /* IP reassembly collectors held */
 
     struct rtskb_queue      incoming;
 
@@ -51,8 +114,12 @@ struct rtsocket {
 
     unsigned int            priority;
     nanosecs_rel_t          timeout;    /* receive timeout, 0 for infinite */
+    int                     zerocopy;   /* transmit payload by reference */
 
     rtdm_sem_t              pending_sem;
+    struct rtsocket_rxring  *rxring;    /* mapped receive ring, optional */
+    struct rtsocket_rxprio  *rxprio;    /* set once, freed on cleanup */
+    struct rtsocket_txarea  *txarea;    /* mapped TX area, optional */
 
     void                    (*callback_func)(struct rtdm_dev_context *,
                                              void *arg);
@@ -69,6 +136,17 @@ struct rtsocket {
             int             reg_index;  /* index in port registry */
             u8              tos;
             u8              state;
+            u16             ip_id;      /* next ID of unfragmented datagrams */
+
+            struct rt_ip_xmit_cache xmit_cache;
+
+#ifdef CONFIG_RTNET_RTIPV4_MULTICAST
+            u32             mc_if;      /* IP_MULTICAST_IF address */
+            struct {
+                u32         group;
+                int         ifindex;
+            } mc_groups[RT_IP_MC_SOCK_GROUPS];  /* see IP_ADD_MEMBERSHIP */
+#endif
         } inet;
 
         /* packet socket specific */
@@ -105,6 +183,61 @@ int rt_socket_select_bind(struct rtdm_dev_context *context,
                           unsigned fd_index);
 #endif /* CONFIG_RTNET_SELECT_SUPPORT */
 
+int rt_socket_rxring_setup(struct rtdm_dev_context *context,
+                           rtdm_user_info_t *user_info,
+                           struct rtnet_rxring_req *req);
+int rt_socket_rxring_wait(struct rtsocket *sock);
+
+struct rtnet_rxring_desc *rt_socket_rxring_frame(struct rtsocket_rxring *ring,
+                                                 u32 *index);
+void rt_socket_rxring_publish(struct rtsocket *sock, u32 index);
+
+int rt_socket_txarea_setup(struct rtdm_dev_context *context,
+                           rtdm_user_info_t *user_info,
+                           struct rtnet_txarea_req *req);
+int rt_socket_txarea_iovec(struct rtsocket *sock, const struct msghdr *msg,
+                           struct iovec *kiov);
+
+int rt_socket_rxprio_setup(struct rtdm_dev_context *context,
+                           rtdm_user_info_t *user_info,
+                           struct rtnet_rxprio_req *req);
+void rt_socket_rxprio_queue(struct rtsocket *sock, struct rtskb *skb,
+                            struct iphdr *iph, u16 sport);
+
+/***
+ *  rt_socket_queue_rx - queue a received datagram for recvmsg
+ *  @iph:   IPv4 header of the datagram, NULL if there is none
+ *  @sport: source port in network order, 0 if unknown
+ */
+static inline void rt_socket_queue_rx(struct rtsocket *sock, struct rtskb *skb,
+                                      struct iphdr *iph, u16 sport)
+{
+    struct rtsocket_rxprio  *rxprio = sock->rxprio;
+
+
+    if ((rxprio != NULL) && (rxprio->mode != RTNET_RXPRIO_OFF))
+        rt_socket_rxprio_queue(sock, skb, iph, sport);
+    else
+        rtskb_queue_tail(&sock->incoming, skb);
+}
+
+/***
+ *  rt_socket_dequeue_chain - remove the next datagram to be received
+ *
+ *  The FIFO is only non-empty while priorities are disabled or after
+ *  MSG_PEEK requeued a datagram there, so it always goes first.
+ */
+static inline struct rtskb *rt_socket_dequeue_chain(struct rtsocket *sock)
+{
+    struct rtskb            *skb = rtskb_dequeue_chain(&sock->incoming);
+
+
+    if ((skb == NULL) && (sock->rxprio != NULL))
+        skb = rtskb_prio_dequeue_chain(&sock->rxprio->queue);
+
+    return skb;
+}
+
 int rt_bare_socket_init(struct rtsocket *sock, unsigned short protocol,
                         unsigned int priority, unsigned int pool_size);
 
@@ -0,0 +1,191 @@
+/***
+ *
+ *  rtnet_stats.h - per-CPU drop and error counters
+ *
+ *  RTnet - real-time networking subsystem
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __RTNET_STATS_H_
+#define __RTNET_STATS_H_
+
+#ifdef __KERNEL__
+
+#include <linux/cache.h>
+
+#include <rtnet_chrdev.h>
+#include <rtnet_internal.h>
+
+
+/***
+ *  Drop and error accounting
+ *
+ *  Every path that discards a packet or fails to process it accounts the
+ *  event under one of the reasons of enum rtnet_drop_reason instead of
+ *  printing from real-time context. The counters are kept per CPU, so
+ *  accounting never touches shared cache lines. They are summed up on
+ *  demand for /proc/rtnet/drops and IOC_RT_DROPSTATS.
+ */
+
+struct rtnet_drop_counters {
+    unsigned long       count[RTNET_DROP_REASONS];
+} ____cacheline_aligned_in_smp;
+
+extern struct rtnet_drop_counters rtnet_drop_counters[NR_CPUS];
+extern const char *rtnet_drop_reason_names[RTNET_DROP_REASONS];
+
+
+static inline void rtnet_count_drop(enum rtnet_drop_reason reason)
+{
+    rtdm_lockctx_t  context;
+
+
+    rtdm_lock_irqsave(context);
+    rtnet_drop_counters[rtos_processor_id()].count[reason]++;
+    rtdm_lock_irqrestore(context);
+}
+
+
+void rtnet_drop_stats(unsigned long *counters);
+
+
+/***
+ *  Latency tracing
+ *
+ *  A traced rtskb carries the time stamp of its first and its previous
+ *  stage. Each further stage accounts the delay since the previous one in
+ *  a per-CPU log-linear histogram (4 buckets per power of two, i.e. at most
+ *  25% relative error). Reception is traced from the driver's time_stamp,
+ *  transmission from the allocation of the rtskb by the protocol.
+ */
+
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+
+#define RTNET_LAT_BUCKETS       100     /* up to 2^26 ns, ~67 ms */
+
+struct rtnet_latency_hist {
+    unsigned long       count;
+    u64                 sum;
+    u32                 min;
+    u32                 max;
+    u32                 bucket[RTNET_LAT_BUCKETS];
+};
+
+struct rtnet_latency_stats {
+    struct rtnet_latency_hist   stage[RTNET_LAT_STAGES];
+} ____cacheline_aligned_in_smp;
+
+extern struct rtnet_latency_stats rtnet_latency_stats[NR_CPUS];
+extern const char *rtnet_latency_stage_names[RTNET_LAT_STAGES];
+
+
+static inline unsigned int rtnet_latency_bucket(u32 ns)
+{
+    unsigned int msb;
+
+
+    if (ns < 4)
+        return ns;
+
+    msb = fls(ns) - 1;
+    if (msb > 25)
+        return RTNET_LAT_BUCKETS - 1;
+
+    return 4 * (msb - 1) + ((ns >> (msb - 2)) & 3);
+}
+
+
+static inline void rtnet_latency_account(enum rtnet_latency_stage stage,
+                                         nanosecs_rel_t delay)
+{
+    struct rtnet_latency_hist   *hist;
+    rtdm_lockctx_t              context;
+    u32                         ns;
+
+
+    ns = (delay < 0) ? 0 : ((delay > 0xFFFFFFFFLL) ? 0xFFFFFFFF : delay);
+
+    rtdm_lock_irqsave(context);
+
+    hist = &rtnet_latency_stats[rtos_processor_id()].stage[stage];
+    if ((hist->count == 0) || (ns < hist->min))
+        hist->min = ns;
+    if (ns > hist->max)
+        hist->max = ns;
+    hist->count++;
+    hist->sum += ns;
+    hist->bucket[rtnet_latency_bucket(ns)]++;
+
+    rtdm_lock_irqrestore(context);
+}
+
+
+/* starts tracing @skb, @stamp is the time of the first stage */
+static inline void rtnet_trace_start(struct rtskb *skb, nanosecs_abs_t stamp)
+{
+    skb->trace_start = stamp;
+    skb->trace_last  = stamp;
+}
+
+
+/* accounts the delay since the previous stage of a traced @skb */
+static inline void rtnet_trace(struct rtskb *skb,
+                               enum rtnet_latency_stage stage)
+{
+    nanosecs_abs_t  now;
+
+
+    if (skb->trace_start == 0)
+        return;
+
+    now = rtdm_clock_read();
+    rtnet_latency_account(stage, now - skb->trace_last);
+    skb->trace_last = now;
+}
+
+
+/* like rtnet_trace, additionally accounts the total delay and stops */
+static inline void rtnet_trace_end(struct rtskb *skb,
+                                   enum rtnet_latency_stage stage,
+                                   enum rtnet_latency_stage total)
+{
+    if (skb->trace_start == 0)
+        return;
+
+    rtnet_trace(skb, stage);
+    rtnet_latency_account(total, skb->trace_last - skb->trace_start);
+    skb->trace_start = 0;
+}
+
+
+void rtnet_latency_reset(void);
+void rtnet_latency_merge(enum rtnet_latency_stage stage,
+                         struct rtnet_latency_hist *hist);
+u32 rtnet_latency_percentile(struct rtnet_latency_hist *hist,
+                             unsigned int per_mille);
+
+#else /* !CONFIG_RTNET_LATENCY_TRACE */
+
+#define rtnet_trace_start(skb, stamp)       do {} while (0)
+#define rtnet_trace(skb, stage)             do {} while (0)
+#define rtnet_trace_end(skb, stage, total)  do {} while (0)
+
+#endif /* CONFIG_RTNET_LATENCY_TRACE */
+
+#endif /* __KERNEL__ */
+
+#endif  /* __RTNET_STATS_H_ */
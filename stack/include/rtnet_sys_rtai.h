@@ -59,4 +59,17 @@ static inline void rtos_irq_reacquire_lock(void)
     rt_sched_unlock();
 }
 
+static inline int rtos_processor_id(void)
+{
+    return rtai_cpuid();
+}
+
+static inline int rtos_task_migrate(int cpu)
+{
+    if ((cpu < 0) || (cpu >= num_online_cpus()))
+        return -EINVAL;
+    rt_set_runnable_on_cpuid(rt_whoami(), cpu);
+    return 0;
+}
+
 #endif /* __RTNET_SYS_RTAI_H_ */
@@ -65,4 +65,18 @@ static inline void rtos_irq_reacquire_lock(void)
     xnpod_set_thread_mode(xnpod_current_thread(), XNLOCK, 0);
 }
 
+static inline int rtos_processor_id(void)
+{
+    return rthal_processor_id();
+}
+
+static inline int rtos_task_migrate(int cpu)
+{
+#ifdef CONFIG_SMP
+    return xnpod_migrate_thread(cpu);
+#else
+    return (cpu == 0) ? 0 : -EINVAL;
+#endif
+}
+
 #endif /* __RTNET_SYS_XENOMAI_H_ */
@@ -41,10 +41,12 @@ rtskb Management - A Short Introduction
 1. rtskbs (Real-Time Socket Buffers)
 
 A rtskb consists of a management structure (struct rtskb) and a fixed-sized
-(RTSKB_SIZE) data buffer. It is used to store network packets on their way from
-the API routines through the stack to the NICs or vice versa. rtskbs are
-allocated as one chunk of memory which contains both the managment structure
-and the buffer memory itself.
+data buffer. It is used to store network packets on their way from the API
+routines through the stack to the NICs or vice versa. rtskbs are allocated as
+one chunk of memory which contains both the managment structure and the buffer
+memory itself. The buffer size depends on the size class of the rtskb: small
+(RTSKB_SMALL_SIZE), standard (RTSKB_SIZE), or jumbo (RTSKB_JUMBO_SIZE). The
+actual size is recorded in rtskb.buf_len.
 
 
 2. rtskb Queues
@@ -89,6 +91,33 @@ rtskbs can be exchanged between pools (rtskb_acquire()). In this case, the
 passed rtskb switches over to from its owning pool to a given pool, but only if
 this pool can pass an empty rtskb from its own queue back.
 
+Optionally (CONFIG_RTNET_RTSKB_MAGAZINES), a pool can be created with per-CPU
+magazines (rtskb_pool_init_ex(), RTSKB_POOL_MAGAZINES). Each CPU then caches a
+few free rtskbs of the pool which are allocated and freed with local IRQs
+disabled only. The pool lock is just taken to refill or flush half a magazine
+at once. rtskbs in a magazine remain owned by their pool, but they are only
+visible to the CPU caching them. Thus, magazines should only be enabled for
+pools that are large compared to the number of CPUs times RTSKB_MAGAZINE_SIZE.
+
+Every pool holds rtskbs of a single size class, standard by default
+(RTSKB_POOL_SMALL or RTSKB_POOL_JUMBO select the others). Pools of other
+classes can be attached to a pool (rtskb_pool_attach()). alloc_rtskb() then
+takes the rtskb from the smallest class that fits the requested size, falling
+back to larger classes if that one is exhausted. rtskb_acquire() compensates
+with an rtskb of the same class as the acquired one and fails if the consumer
+has no pool of that class. Only jumbo rtskbs are compensated from a shared pool
+instead (global_jumbo_pool, extended by "device_rtskbs" for each device
+registered with a jumbo MTU) if the consumer has no jumbo class attached. The
+acquired rtskb is then returned to that shared pool, not to the consumer's one.
+Attached pools are not released together with their parent pool.
+
+As another option (CONFIG_RTNET_RTSKB_LOCKFREE), a pool can be backed by a
+bounded lock-free ring instead of its queue (RTSKB_POOL_LOCKFREE). Allocating
+and freeing rtskbs then never spins on a lock held by another CPU, only local
+IRQs are disabled for a few instructions. The ring capacity is fixed when the
+pool is created (module parameter "lockfree_slots"), the pool cannot be
+extended beyond it. A lock-free pool does not use magazines.
+
 
 5. rtskb Chains
 
@@ -103,13 +132,40 @@ newly allocated rtskb is always reset to a "single rtskb chain". Furthermore,
 the acquisition of complete chains is NOT supported (rtskb_acquire()).
 
 
-6. Capturing Support (Optional)
+6. Shared rtskbs (Clones)
+
+rtskb_clone() creates a new rtskb head from the consumer's pool which refers
+to the data buffer of the original rtskb instead of copying it. The clone is
+taken from the smallest size class of the pool, so N consumers of a packet
+cost N (small) heads and no payload copies. The data buffer is reference
+counted (data_users of the owning rtskb) and only returned to its pool when
+the original rtskb and all clones are freed. To avoid draining the pool of the
+original owner (typically a NIC receive pool), cloning also takes over the
+ownership of the buffer the same way rtskb_acquire() does, i.e. the consumer
+pool passes one rtskb to the previous owner. Shared data must not be modified,
+rtskb_cloned() reports if this is the case. rtskb_copy() creates a private
+copy, e.g. for retransmissions or for forwarding a shared rtskb.
+
+
+7. Fragments (Scatter-Gather)
+
+Besides its linear buffer, an outgoing rtskb can refer to up to RTSKB_MAX_FRAGS
+payload fragments in direct-mapped kernel memory (rtskb_add_frag()). The
+protocol headers always remain in the linear part, rtskb.len includes the
+fragments, rtskb.data_len only counts the fragments. Only drivers announcing
+NETIF_F_SG in rtnet_device.features receive such rtskbs, rtdev_xmit()
+linearises them for all other devices (rtskb_linearize()). Fragments usually
+refer to memory of the sender which must not be modified before the rtskb is
+released. This is tracked by struct rtskb_zerocopy: rtskb_zerocopy_wait()
+blocks until all rtskbs referencing the memory have been freed or linearised.
+
+
+8. Capturing Support (Optional)
 
 When incoming or outgoing packets are captured, the assigned rtskb needs to be
-shared between the stack, the driver, and the capturing service. In contrast to
-many other network stacks, RTnet does not create a new rtskb head and
-re-references the payload. Instead, additional fields at the end of the rtskb
-structure are use for sharing a rtskb with a capturing service. If the sharing
+shared between the stack, the driver, and the capturing service. RTcap does
+not use clones (see 6.) for this purpose. Instead, additional fields at the end
+of the rtskb structure are use for sharing a rtskb with a capturing service. If the sharing
 bit (RTSKB_CAP_SHARED) in cap_flags is set, the rtskb will not be returned to
 the owning pool upon the call of kfree_rtskb. Instead this bit will be reset,
 and a compensation rtskb stored in cap_comp_skb will be returned to the owning
@@ -146,10 +202,24 @@ cap_rtmac_stamp field now contains valid data.
 
 #define RTSKB_UNMAPPED          0
 
+#define RTSKB_MAX_FRAGS         4   /* payload fragments per rtskb */
+
 struct rtskb_queue;
 struct rtsocket;
 struct rtnet_device;
 
+/* payload referenced by an rtskb, transmitted after the linear part */
+struct rtskb_frag {
+    void                *addr;      /* direct-mapped kernel address */
+    unsigned int        len;
+};
+
+/* tracks the release of rtskbs referencing the memory of a sender */
+struct rtskb_zerocopy {
+    atomic_t            pending;
+    rtdm_event_t        done;
+};
+
 /***
  *  rtskb - realtime socket buffer
  */
@@ -203,6 +273,10 @@ struct rtskb {
     unsigned char       ip_summed;
     unsigned int        csum;
 
+#ifdef CONFIG_RTNET_VLAN
+    unsigned short      vlan_tci;   /* 802.1Q tag, see RT_VLAN_TAG_PRESENT */
+#endif
+
     unsigned char       *data;
     unsigned char       *tail;
     unsigned char       *end;
@@ -211,6 +285,15 @@ struct rtskb {
     dma_addr_t          buf_dma_addr;
 
     unsigned char       *buf_start;
+    unsigned int        buf_len;    /* size of the data buffer */
+
+    struct rtskb        *data_owner; /* rtskb providing the data of a clone */
+    atomic_t            data_users; /* references to the own data buffer */
+
+    unsigned int        data_len;   /* bytes in frags, included in len */
+    unsigned int        nr_frags;
+    struct rtskb_frag   frags[RTSKB_MAX_FRAGS];
+    struct rtskb_zerocopy *zerocopy; /* owner of the fragment memory */
 
 #ifdef CONFIG_RTNET_CHECKED
     unsigned char       *buf_end;
@@ -218,6 +301,11 @@ struct rtskb {
     int                 chain_len;
 #endif
 
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+    nanosecs_abs_t      trace_start; /* first traced stage, 0 if untraced  */
+    nanosecs_abs_t      trace_last; /* previous traced stage               */
+#endif
+
 #ifdef CONFIG_RTNET_ADDON_RTCAP
     int                 cap_flags;  /* see RTSKB_CAP_xxx                    */
     struct rtskb        *cap_comp_skb; /* compensation rtskb                */
@@ -230,6 +318,37 @@ struct rtskb {
     struct list_head    entry; /* for global rtskb list */
 };
 
+/* rtskb size classes, in ascending order */
+#define RTSKB_CLASS_SMALL       0
+#define RTSKB_CLASS_STANDARD    1
+#define RTSKB_CLASS_JUMBO       2
+#define RTSKB_CLASSES           3
+
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+#define RTSKB_MAGAZINE_SIZE     8
+
+struct rtskb_magazine {
+    unsigned int        count;
+    struct rtskb        *rtskbs[RTSKB_MAGAZINE_SIZE];
+} ____cacheline_aligned_in_smp;
+#endif
+
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+struct rtskb_lf_slot {
+    unsigned long       seq;
+    struct rtskb        *rtskb;
+};
+
+struct rtskb_lf_ring {
+    unsigned long       head ____cacheline_aligned_in_smp; /* next to take */
+    unsigned long       tail ____cacheline_aligned_in_smp; /* next to fill */
+    unsigned long       mask ____cacheline_aligned_in_smp;
+    unsigned int        size;       /* rtskbs owned by the pool */
+    unsigned long       retries;    /* lost races, for statistics only */
+    struct rtskb_lf_slot slots[0];
+};
+#endif
+
 struct rtskb_queue {
     struct rtskb        *first;
     struct rtskb        *last;
@@ -237,8 +356,22 @@ struct rtskb_queue {
 #ifdef CONFIG_RTNET_CHECKED
     int                 pool_balance;
 #endif
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+    struct rtskb_magazine *magazines; /* per-CPU caches of a pool or NULL */
+#endif
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+    struct rtskb_lf_ring *lf_ring;  /* replaces the queue of a pool or NULL */
+#endif
+    unsigned int        size_class; /* RTSKB_CLASS_xxx of a pool */
+    struct rtskb_queue  *class_pool[RTSKB_CLASSES]; /* attached pools */
 };
 
+/* rtskb_pool_init_ex flags */
+#define RTSKB_POOL_MAGAZINES    0x0001  /* use per-CPU magazines, if enabled */
+#define RTSKB_POOL_LOCKFREE     0x0002  /* use a lock-free ring, if enabled */
+#define RTSKB_POOL_SMALL        0x0004  /* small size class */
+#define RTSKB_POOL_JUMBO        0x0008  /* jumbo size class */
+
 #define QUEUE_MAX_PRIO          0
 #define QUEUE_MIN_PRIO          31
 
@@ -263,15 +396,21 @@ struct rtskb_prio_queue {
 /* default values for the module parameter */
 #define DEFAULT_GLOBAL_RTSKBS       0       /* default number of rtskb's in global pool */
 #define DEFAULT_DEVICE_RTSKBS       16      /* default additional rtskbs per network adapter */
+#define DEFAULT_GLOBAL_SMALL_RTSKBS 0       /* default number of small rtskb's in global pool */
 #define DEFAULT_SOCKET_RTSKBS       16      /* default number of rtskb's in socket pools */
+#define DEFAULT_LOCKFREE_SLOTS      1024    /* default capacity of lock-free pools */
 
 #define ALIGN_RTSKB_STRUCT_LEN      SKB_DATA_ALIGN(sizeof(struct rtskb))
 #define RTSKB_SIZE                  1544    /* maximum needed by pcnet32-rt */
+#define RTSKB_SMALL_SIZE            256     /* control frames, e.g. TDMA sync */
+#define RTSKB_JUMBO_SIZE            (16384 + 64) /* largest e1000 RX buffer */
 
 extern unsigned int rtskb_pools;        /* current number of rtskb pools      */
 extern unsigned int rtskb_pools_max;    /* maximum number of rtskb pools      */
 extern unsigned int rtskb_amount;       /* current number of allocated rtskbs */
 extern unsigned int rtskb_amount_max;   /* maximum number of allocated rtskbs */
+extern unsigned int rtskb_memory;       /* current memory used by rtskbs      */
+extern unsigned int rtskb_memory_max;   /* maximum memory used by rtskbs      */
 
 #ifdef CONFIG_RTNET_CHECKED
 extern void rtskb_over_panic(struct rtskb *skb, int len, void *here);
@@ -294,6 +433,14 @@ static inline void rtskb_queue_init(struct rtskb_queue *queue)
     rtdm_lock_init(&queue->lock);
     queue->first = NULL;
     queue->last  = NULL;
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+    queue->magazines = NULL;
+#endif
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+    queue->lf_ring = NULL;
+#endif
+    queue->size_class = RTSKB_CLASS_STANDARD;
+    memset(queue->class_pool, 0, sizeof(queue->class_pool));
 }
 
 /***
@@ -603,7 +750,44 @@ static inline void rtskb_queue_purge(struct rtskb_queue *queue)
 
 static inline int rtskb_headlen(const struct rtskb *skb)
 {
-    return skb->len;
+    return skb->len - skb->data_len;
+}
+
+/***
+ *  rtskb_add_frag - append a payload fragment to an rtskb
+ *  @skb:  rtskb with less than RTSKB_MAX_FRAGS fragments
+ *  @addr: direct-mapped kernel address of the payload
+ *  @len:  payload length
+ *  @zc:   tracks the release of the payload memory
+ */
+static inline void rtskb_add_frag(struct rtskb *skb, void *addr,
+                                  unsigned int len, struct rtskb_zerocopy *zc)
+{
+    struct rtskb_frag *frag;
+
+
+    RTNET_ASSERT(skb->nr_frags < RTSKB_MAX_FRAGS, return;);
+
+    frag = &skb->frags[skb->nr_frags++];
+    frag->addr = addr;
+    frag->len  = len;
+
+    skb->len      += len;
+    skb->data_len += len;
+
+    if (skb->zerocopy == NULL) {
+        skb->zerocopy = zc;
+        atomic_inc(&zc->pending);
+    }
+}
+
+/***
+ *  rtskb_cloned - check if the data of an rtskb is shared with clones
+ *  @skb: rtskb, either the original or a clone
+ */
+static inline int rtskb_cloned(struct rtskb *skb)
+{
+    return (skb->data_owner != NULL) || (atomic_read(&skb->data_users) > 1);
 }
 
 static inline void rtskb_reserve(struct rtskb *skb, unsigned int len)
@@ -701,9 +885,13 @@ static inline dma_addr_t rtskb_data_dma_addr(struct rtskb *rtskb,
 }
 
 extern struct rtskb_queue global_pool;
+extern struct rtskb_queue global_jumbo_pool;
 
 extern unsigned int rtskb_pool_init(struct rtskb_queue *pool,
                                     unsigned int initial_size);
+extern unsigned int rtskb_pool_init_ex(struct rtskb_queue *pool,
+                                       unsigned int initial_size,
+                                       unsigned int flags);
 extern unsigned int rtskb_pool_init_rt(struct rtskb_queue *pool,
                                        unsigned int initial_size);
 extern void __rtskb_pool_release(struct rtskb_queue *pool);
@@ -735,13 +923,32 @@ extern unsigned int rtskb_pool_shrink(struct rtskb_queue *pool,
                                       unsigned int rem_rtskbs);
 extern unsigned int rtskb_pool_shrink_rt(struct rtskb_queue *pool,
                                          unsigned int rem_rtskbs);
+extern void rtskb_pool_queue_tail(struct rtskb_queue *pool,
+                                  struct rtskb *skb);
+extern int rtskb_pool_attach(struct rtskb_queue *pool,
+                             struct rtskb_queue *class_pool);
+extern unsigned int rtskb_pool_max_size(struct rtskb_queue *pool);
 extern int rtskb_acquire(struct rtskb *rtskb, struct rtskb_queue *comp_pool);
 extern struct rtskb* rtskb_clone(struct rtskb *rtskb,
                                  struct rtskb_queue *pool);
+extern struct rtskb* rtskb_copy(struct rtskb *rtskb,
+                                struct rtskb_queue *pool);
+extern int rtskb_linearize(struct rtskb *skb);
+extern void rtskb_zerocopy_init(struct rtskb_zerocopy *zc);
+extern void rtskb_zerocopy_wait(struct rtskb_zerocopy *zc);
 
 extern int rtskb_pools_init(void);
 extern void rtskb_pools_release(void);
 
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+extern void rtskb_magazine_stats(unsigned long *hits, unsigned long *misses);
+#endif
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+extern void rtskb_lockfree_stats(struct rtskb_queue *pool,
+                                 unsigned int *size, unsigned int *capacity,
+                                 unsigned long *retries);
+#endif
+
 extern unsigned int rtskb_copy_and_csum_bits(const struct rtskb *skb,
                                              int offset, u8 *to, int len,
                                              unsigned int csum);
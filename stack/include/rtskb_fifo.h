@@ -87,6 +87,56 @@ static inline int rtskb_fifo_insert_inirq(struct rtskb_fifo *fifo,
     return result;
 }
 
+/* Inserts up to count rtskbs, returns the number actually inserted */
+static inline unsigned int __rtskb_fifo_insert_bulk(struct rtskb_fifo *fifo,
+                                                    struct rtskb **rtskbs,
+                                                    unsigned int count)
+{
+    unsigned long pos = fifo->write_pos;
+    unsigned long free = (fifo->read_pos - pos - 1) & fifo->size_mask;
+    unsigned int i;
+
+    if (count > free)
+        count = free;
+
+    for (i = 0; i < count; i++)
+        fifo->buffer[(pos + i) & fifo->size_mask] = rtskbs[i];
+
+    /* all rtskbs must have been written before write_pos update */
+    smp_wmb();
+
+    fifo->write_pos = (pos + count) & fifo->size_mask;
+
+    return count;
+}
+
+static inline unsigned int rtskb_fifo_insert_bulk(struct rtskb_fifo *fifo,
+                                                  struct rtskb **rtskbs,
+                                                  unsigned int count)
+{
+    rtdm_lockctx_t context;
+    unsigned int result;
+
+    rtdm_lock_get_irqsave(&fifo->write_lock, context);
+    result = __rtskb_fifo_insert_bulk(fifo, rtskbs, count);
+    rtdm_lock_put_irqrestore(&fifo->write_lock, context);
+
+    return result;
+}
+
+static inline unsigned int
+    rtskb_fifo_insert_bulk_inirq(struct rtskb_fifo *fifo,
+                                 struct rtskb **rtskbs, unsigned int count)
+{
+    unsigned int result;
+
+    rtdm_lock_get(&fifo->write_lock);
+    result = __rtskb_fifo_insert_bulk(fifo, rtskbs, count);
+    rtdm_lock_put(&fifo->write_lock);
+
+    return result;
+}
+
 static inline struct rtskb *__rtskb_fifo_remove(struct rtskb_fifo *fifo)
 {
     unsigned long pos = fifo->read_pos;
@@ -133,6 +183,52 @@ static inline struct rtskb *rtskb_fifo_remove_inirq(struct rtskb_fifo *fifo)
     return result;
 }
 
+/* Removes up to max rtskbs, returns the number actually removed */
+static inline unsigned int __rtskb_fifo_remove_bulk(struct rtskb_fifo *fifo,
+                                                    struct rtskb **rtskbs,
+                                                    unsigned int max)
+{
+    unsigned long pos = fifo->read_pos;
+    unsigned long used = (fifo->write_pos - pos) & fifo->size_mask;
+    unsigned int i;
+
+    if (used == 0)
+        return 0;
+
+    /* write_pos must have been read before the rtskbs */
+    smp_rmb();
+
+    if (max > used)
+        max = used;
+
+    for (i = 0; i < max; i++)
+        rtskbs[i] = fifo->buffer[(pos + i) & fifo->size_mask];
+
+    /* rtskbs must have been read before read_pos update */
+    smp_mb();
+
+    fifo->read_pos = (pos + max) & fifo->size_mask;
+
+    /* read_pos must have been written for a consitent fifo state on exit */
+    smp_wmb();
+
+    return max;
+}
+
+static inline unsigned int rtskb_fifo_remove_bulk(struct rtskb_fifo *fifo,
+                                                  struct rtskb **rtskbs,
+                                                  unsigned int max)
+{
+    rtdm_lockctx_t context;
+    unsigned int result;
+
+    rtdm_lock_get_irqsave(&fifo->read_lock, context);
+    result = __rtskb_fifo_remove_bulk(fifo, rtskbs, max);
+    rtdm_lock_put_irqrestore(&fifo->read_lock, context);
+
+    return result;
+}
+
 /* for now inlined... */
 static inline void rtskb_fifo_init(struct rtskb_fifo *fifo,
                                    unsigned long size)
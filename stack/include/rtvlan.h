@@ -0,0 +1,103 @@
+/***
+ *
+ *  include/rtvlan.h - 802.1Q virtual LAN devices
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#ifndef __RTVLAN_H_
+#define __RTVLAN_H_
+
+#include <linux/init.h>
+#include <linux/if_ether.h>
+
+#include <rtdev.h>
+#include <rtskb.h>
+
+
+#define RT_VLAN_HLEN            4       /* TCI and encapsulated protocol */
+#define RT_VLAN_VID_MASK        0x0fff
+#define RT_VLAN_PCP_SHIFT       13
+#define RT_VLAN_PCPS            8
+
+/* The CFI bit is always clear on Ethernet, in rtskb.vlan_tci it marks the
+ * tag as valid, so that priority tags (VID 0, PCP 0) are not lost. */
+#define RT_VLAN_TAG_PRESENT     0x1000
+
+#ifndef ETH_P_8021Q
+#define ETH_P_8021Q             0x8100
+#endif
+
+
+#ifdef CONFIG_RTNET_VLAN
+
+/***
+ *  rt_vlan_untag - remove the in-band tag of a received frame
+ *  @skb: packet, data points to the TCI behind the Ethernet header
+ *
+ *  Returns the encapsulated protocol in network order.
+ */
+static inline unsigned short rt_vlan_untag(struct rtskb *skb)
+{
+    unsigned short protocol;
+
+
+    skb->vlan_tci = ntohs(*(u16 *)skb->data) | RT_VLAN_TAG_PRESENT;
+    protocol = *(u16 *)(skb->data + 2);
+
+    rtskb_pull(skb, RT_VLAN_HLEN);
+
+    return protocol;
+}
+
+/* for drivers: the hardware stripped the tag of a received frame */
+static inline void rt_vlan_put_tag(struct rtskb *skb, unsigned short tci)
+{
+    skb->vlan_tci = tci | RT_VLAN_TAG_PRESENT;
+}
+
+/* for drivers: the tag to insert on transmission, see RTNETIF_F_HW_VLAN_TX */
+static inline int rt_vlan_tag_present(struct rtskb *skb)
+{
+    return skb->vlan_tci & RT_VLAN_TAG_PRESENT;
+}
+
+static inline unsigned short rt_vlan_tag_get(struct rtskb *skb)
+{
+    return skb->vlan_tci & ~RT_VLAN_TAG_PRESENT;
+}
+
+int rt_vlan_rx(struct rtskb *skb);
+
+int rt_vlan_add(struct rtnet_device *real_dev, unsigned int vid);
+int rt_vlan_del(const char *name);
+
+int __init rt_vlan_init(void);
+void rt_vlan_release(void);
+
+#else /* !CONFIG_RTNET_VLAN */
+
+#define rt_vlan_put_tag(skb, tci)   do {} while (0)
+#define rt_vlan_tag_present(skb)    0
+#define rt_vlan_tag_get(skb)        0
+
+#define rt_vlan_init()              0
+#define rt_vlan_release()           do {} while (0)
+
+#endif /* CONFIG_RTNET_VLAN */
+
+
+#endif  /* __RTVLAN_H_ */
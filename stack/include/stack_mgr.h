@@ -44,7 +44,8 @@ struct rtpacket_type {
     struct list_head    list_entry;
 
     unsigned short      type;
-    short               refcount;
+    short               removing;   /* unlinked, see rtdev_remove_pack() */
+    unsigned long       epoch;      /* dispatch epoch at unlink time */
 
     int                 (*handler)(struct rtskb *, struct rtpacket_type *);
     int                 (*err_handler)(struct rtskb *, struct rtnet_device *,
@@ -65,7 +66,12 @@ void rt_stack_deliver(struct rtskb *rtskb);
 int rt_stack_mgr_init(struct rtnet_mgr *mgr);
 void rt_stack_mgr_delete(struct rtnet_mgr *mgr);
 
+int rt_stack_mgr_dev_setup(struct rtnet_device *rtdev, unsigned int prio,
+                           int cpu);
+void rt_stack_mgr_dev_release(struct rtnet_device *rtdev);
+
 void rtnetif_rx(struct rtskb *skb);
+void rtnetif_rx_bulk(struct rtskb **skbs, unsigned int count);
 
 static inline void rtnetif_tx(struct rtnet_device *rtdev)
 {
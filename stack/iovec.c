@@ -26,6 +26,9 @@
 #include <linux/module.h>
 #include <linux/string.h>
 
+#include <linux/mm.h>
+#include <net/checksum.h>
+
 #include <rtnet_iovec.h>
 
 
@@ -73,5 +76,201 @@ void rt_memcpy_fromkerneliovec(unsigned char *kdata, struct iovec *iov,int len)
 }
 
 
+/***
+ *  rt_csum_copy_fromkerneliovec - copy iovec data and checksum it in one pass
+ *  @kdata: destination
+ *  @iov:   kernel iovec, advanced like by rt_memcpy_fromkerneliovec
+ *  @len:   data length
+ *  @csum:  initial checksum
+ *
+ *  Returns the partial checksum of the copied data added to csum.
+ */
+unsigned int rt_csum_copy_fromkerneliovec(unsigned char *kdata,
+                                          struct iovec *iov, int len,
+                                          unsigned int csum)
+{
+    int pos = 0;
+
+    while (len > 0)
+    {
+        if (iov->iov_len)
+        {
+            int copy=min_t(unsigned int, len, iov->iov_len);
+
+            /* entries may end at odd offsets, fold in each block at its
+               position within the data */
+            csum = csum_block_add(csum,
+                csum_partial_copy_nocheck(iov->iov_base, kdata, copy, 0), pos);
+            pos+=copy;
+            len-=copy;
+            kdata+=copy;
+            iov->iov_base+=copy;
+            iov->iov_len-=copy;
+        }
+        iov++;
+    }
+
+    return csum;
+}
+
+
+/***
+ *  rt_csum_kerneliovec - checksum iovec data without consuming it
+ *  @iov:    kernel iovec, left untouched
+ *  @len:    data length
+ *  @offset: position of the data within the checksummed block
+ *  @csum:   initial checksum
+ */
+unsigned int rt_csum_kerneliovec(const struct iovec *iov, int len, int offset,
+                                 unsigned int csum)
+{
+    while (len > 0)
+    {
+        if (iov->iov_len)
+        {
+            int size=min_t(unsigned int, len, iov->iov_len);
+
+            csum = csum_block_add(csum,
+                csum_partial(iov->iov_base, size, 0), offset);
+            offset+=size;
+            len-=size;
+        }
+        iov++;
+    }
+
+    return csum;
+}
+
+
+/***
+ *  rt_csum_copy_tokerneliovec - copy data into an iovec and checksum it
+ *  @iov:    kernel iovec, left untouched
+ *  @offset: position within the iovec data to copy to, also the position
+ *           of the data within the checksummed block
+ *  @kdata:  source
+ *  @len:    data length, has to fit into the iovec
+ *  @csum:   initial checksum
+ *
+ *  Unlike rt_memcpy_tokerneliovec, the iovec is not consumed so that the
+ *  copy can be discarded if the checksum turns out to be wrong. Use
+ *  rt_iovec_advance to consume it afterwards.
+ */
+unsigned int rt_csum_copy_tokerneliovec(const struct iovec *iov, int offset,
+                                        unsigned char *kdata, int len,
+                                        unsigned int csum)
+{
+    int pos = offset;
+
+    if (len <= 0)
+        return csum;
+
+    while (offset >= iov->iov_len)
+    {
+        offset-=iov->iov_len;
+        iov++;
+    }
+
+    while (len > 0)
+    {
+        if (iov->iov_len > offset)
+        {
+            int copy=min_t(unsigned int, len, iov->iov_len - offset);
+
+            csum = csum_block_add(csum,
+                csum_partial_copy_nocheck(kdata, iov->iov_base + offset,
+                                          copy, 0), pos);
+            pos+=copy;
+            len-=copy;
+            kdata+=copy;
+        }
+        offset = 0;
+        iov++;
+    }
+
+    return csum;
+}
+
+
+/***
+ *  rt_iovec_advance - consume iovec data like the copy functions do
+ */
+void rt_iovec_advance(struct iovec *iov, int len)
+{
+    while (len > 0)
+    {
+        if (iov->iov_len)
+        {
+            int size=min_t(unsigned int, len, iov->iov_len);
+
+            len-=size;
+            iov->iov_base+=size;
+            iov->iov_len-=size;
+        }
+        iov++;
+    }
+}
+
+
+/***
+ *  rt_iovec_to_frags - pass kernel iovec data as rtskb fragments
+ *  @skb:   rtskb, kdata has to lie within its linear part
+ *  @kdata: position in the linear part the data would have been copied to
+ *  @iov:   kernel iovec, advanced like by rt_memcpy_fromkerneliovec
+ *  @len:   data length
+ *  @zc:    tracks the release of the iovec memory
+ *
+ *  The linear part of the rtskb is trimmed to kdata. Returns -EMSGSIZE
+ *  without touching skb or iov if the data is too short, not direct-mapped,
+ *  or spread over more iovec entries than free fragments are available. The
+ *  caller then has to copy it.
+ */
+int rt_iovec_to_frags(struct rtskb *skb, unsigned char *kdata,
+                      struct iovec *iov, int len, struct rtskb_zerocopy *zc)
+{
+    struct iovec    *entry = iov;
+    unsigned int    frags = skb->nr_frags;
+    int             left = len;
+
+
+    if (len < RT_IOVEC_FRAG_MIN)
+        return -EMSGSIZE;
+
+    while (left > 0) {
+        if (entry->iov_len) {
+            int size = min_t(unsigned int, left, entry->iov_len);
+
+            if ((frags == RTSKB_MAX_FRAGS) ||
+                !virt_addr_valid(entry->iov_base) ||
+                !virt_addr_valid(entry->iov_base + size - 1))
+                return -EMSGSIZE;
+            frags++;
+            left -= size;
+        }
+        entry++;
+    }
+
+    rtskb_trim(skb, kdata - skb->data);
+
+    while (len > 0) {
+        if (iov->iov_len) {
+            int size = min_t(unsigned int, len, iov->iov_len);
+
+            rtskb_add_frag(skb, iov->iov_base, size, zc);
+            len-=size;
+            iov->iov_base+=size;
+            iov->iov_len-=size;
+        }
+        iov++;
+    }
+
+    return 0;
+}
+
+
 EXPORT_SYMBOL(rt_memcpy_tokerneliovec);
 EXPORT_SYMBOL(rt_memcpy_fromkerneliovec);
+EXPORT_SYMBOL(rt_csum_copy_fromkerneliovec);
+EXPORT_SYMBOL(rt_csum_kerneliovec);
+EXPORT_SYMBOL(rt_csum_copy_tokerneliovec);
+EXPORT_SYMBOL(rt_iovec_advance);
+EXPORT_SYMBOL(rt_iovec_to_frags);
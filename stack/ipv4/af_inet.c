@@ -31,54 +31,21 @@
 #include <rtnet_rtpc.h>
 #include <ipv4/arp.h>
 #include <ipv4/icmp.h>
+#include <ipv4/ip_forward.h>
 #include <ipv4/ip_output.h>
+#include <ipv4/neighbour.h>
 #include <ipv4/protocol.h>
 #include <ipv4/route.h>
 
 
 MODULE_LICENSE("GPL");
 
-struct route_solicit_params {
-    struct rtnet_device *rtdev;
-    __u32               ip_addr;
-};
-
 #ifdef CONFIG_PROC_FS
 struct proc_dir_entry *ipv4_proc_root;
 EXPORT_SYMBOL(ipv4_proc_root);
 #endif
 
 
-static int route_solicit_handler(struct rt_proc_call *call)
-{
-    struct route_solicit_params *param;
-    struct rtnet_device         *rtdev;
-
-
-    param = rtpc_get_priv(call, struct route_solicit_params);
-    rtdev = param->rtdev;
-
-    if ((rtdev->flags & IFF_UP) == 0)
-        return -ENODEV;
-
-    rt_arp_solicit(rtdev, param->ip_addr);
-
-    return 0;
-}
-
-
-
-static void cleanup_route_solicit(void *priv_data)
-{
-    struct route_solicit_params *param;
-
-
-    param = (struct route_solicit_params *)priv_data;
-    rtdev_dereference(param->rtdev);
-}
-
-
-
 #ifdef CONFIG_RTNET_RTIPV4_ICMP
 static int ping_handler(struct rt_proc_call *call)
 {
@@ -122,9 +89,8 @@ static void ping_complete_handler(struct rt_proc_call *call, void *priv_data)
 static int ipv4_ioctl(struct rtnet_device *rtdev, unsigned int request,
                       unsigned long arg)
 {
-    struct ipv4_cmd             cmd;
-    struct route_solicit_params params;
-    int                         ret;
+    struct ipv4_cmd cmd;
+    int             ret;
 
 
     ret = copy_from_user(&cmd, (void *)arg, sizeof(cmd));
@@ -136,6 +102,8 @@ static int ipv4_ioctl(struct rtnet_device *rtdev, unsigned int request,
             if (mutex_lock_interruptible(&rtdev->nrt_lock))
                 return -ERESTARTSYS;
 
+            /* manual routes are permanent */
+            rt_neigh_forget(cmd.args.addhost.ip_addr, rtdev);
             ret = rt_ip_route_add_host(cmd.args.addhost.ip_addr,
                                        cmd.args.addhost.dev_addr, rtdev);
 
@@ -146,21 +114,30 @@ static int ipv4_ioctl(struct rtnet_device *rtdev, unsigned int request,
             if (mutex_lock_interruptible(&rtdev->nrt_lock))
                 return -ERESTARTSYS;
 
-            rtdev_reference(rtdev);
-            params.rtdev   = rtdev;
-            params.ip_addr = cmd.args.solicit.ip_addr;
-
-            /* We need the rtpc wrapping because rt_arp_solicit can block on a
-             * real-time lock in the NIC's xmit routine. */
-            ret = rtpc_dispatch_call(route_solicit_handler, 0, &params,
-                                     sizeof(params), NULL,
-                                     cleanup_route_solicit);
+            /* the request is sent by the resolution task */
+            ret = rt_neigh_resolve_dev(cmd.args.solicit.ip_addr, rtdev);
 
             mutex_unlock(&rtdev->nrt_lock);
             break;
 
+        case IOC_RT_HOST_ROUTE_RESOLVE:
+            if ((cmd.args.resolve.count == 0) ||
+                (cmd.args.resolve.count > IPV4_RESOLVE_MAX))
+                return -EINVAL;
+
+            ret = rt_neigh_resolve_list(rtdev, cmd.args.resolve.ip_addr,
+                                        cmd.args.resolve.count,
+                                        cmd.args.resolve.timeout,
+                                        &cmd.args.resolve.resolved);
+            if ((ret >= 0) || (ret == -ETIMEDOUT)) {
+                if (copy_to_user((void *)arg, &cmd, sizeof(cmd)) != 0)
+                    ret = -EFAULT;
+            }
+            break;
+
         case IOC_RT_HOST_ROUTE_DELETE:
         case IOC_RT_HOST_ROUTE_DELETE_DEV:
+            rt_neigh_forget(cmd.args.delhost.ip_addr, rtdev);
             ret = rt_ip_route_del_host(cmd.args.delhost.ip_addr, rtdev);
             break;
 
@@ -244,6 +221,7 @@ static void rt_ip_ifup(struct rtnet_device *rtdev,
     if (up_cmd->args.up.ip_addr != 0xFFFFFFFF) {
         rtdev->local_ip     = up_cmd->args.up.ip_addr;
         rtdev->broadcast_ip = up_cmd->args.up.broadcast_ip;
+        rtdev->netmask      = up_cmd->args.up.netmask;
     }
 
     if (rtdev->local_ip != 0) {
@@ -270,6 +248,7 @@ static void rt_ip_ifup(struct rtnet_device *rtdev,
 
 static void rt_ip_ifdown(struct rtnet_device *rtdev)
 {
+    rt_neigh_flush(rtdev);
     rt_ip_route_del_all(rtdev);
 }
 
@@ -314,13 +293,23 @@ static int __init rt_ipv4_proto_init(void)
 
     if ((result = rt_ip_routing_init()) < 0)
         goto err1;
-    if ((result = rtnet_register_ioctls(&ipv4_ioctls)) < 0)
+    if ((result = rt_neigh_init()) < 0)
         goto err2;
+    if ((result = rt_ip_forward_init()) < 0)
+        goto err3;
+    if ((result = rtnet_register_ioctls(&ipv4_ioctls)) < 0)
+        goto err4;
 
     rtdev_add_event_hook(&rtdev_hook);
 
     return 0;
 
+  err4:
+    rt_ip_forward_release();
+
+  err3:
+    rt_neigh_release();
+
   err2:
     rt_ip_routing_release();
 
@@ -341,6 +330,8 @@ static void __exit rt_ipv4_proto_release(void)
 {
     rtdev_del_event_hook(&rtdev_hook);
     rtnet_unregister_ioctls(&ipv4_ioctls);
+    rt_ip_forward_release();
+    rt_neigh_release();
     rt_ip_routing_release();
 
 #ifdef CONFIG_PROC_FS
@@ -24,6 +24,7 @@
 #include <rtdev.h>
 #include <stack_mgr.h>
 #include <ipv4/arp.h>
+#include <ipv4/neighbour.h>
 
 #ifdef CONFIG_RTNET_ADDON_PROXY_ARP
 #include <ipv4/ip_input.h>
@@ -169,6 +170,7 @@ int rt_arp_rcv(struct rtskb *skb, struct rtpacket_type *pt)
     /* process only requests/replies directed to us */
     if (tip == rtdev->local_ip) {
         rt_ip_route_add_host(sip, sha, rtdev);
+        rt_neigh_confirm(sip, sha, rtdev);
 
 #ifndef CONFIG_RTNET_ADDON_PROXY_ARP
         if (arp->ar_op == __constant_htons(ARPOP_REQUEST))
@@ -212,5 +214,8 @@ void __init rt_arp_init(void)
  */
 void rt_arp_release(void)
 {
-    rtdev_remove_pack(&arp_packet_type);
+    while (rtdev_remove_pack(&arp_packet_type) == -EAGAIN) {
+        set_current_state(TASK_UNINTERRUPTIBLE);
+        schedule_timeout(1);
+    }
 }
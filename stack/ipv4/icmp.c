@@ -33,6 +33,7 @@
 
 #include <rtskb.h>
 #include <rtnet_socket.h>
+#include <rtnet_stats.h>
 #include <ipv4_chrdev.h>
 #include <ipv4/icmp.h>
 #include <ipv4/ip_fragment.h>
@@ -148,7 +149,8 @@ static void rt_icmp_discard(struct rtskb *skb)
 
 
 static int rt_icmp_glue_reply_bits(const void *p, unsigned char *to,
-                                   unsigned int offset, unsigned int fraglen)
+                                   unsigned int offset, unsigned int fraglen,
+                                   struct rtskb *skb)
 {
     struct icmp_bxm *icmp_param = (struct icmp_bxm *)p;
     struct icmphdr  *icmph;
@@ -200,9 +202,8 @@ static void rt_icmp_send_reply(struct icmp_bxm *icmp_param, struct rtskb *skb)
 
     rtdev_dereference(rt.rtdev);
 
-    RTNET_ASSERT(err == 0,
-                 rtdm_printk("RTnet: %s() error in xmit\n", __FUNCTION__););
-    (void)err;
+    if (unlikely(err != 0))
+        rtnet_count_drop(RTNET_DROP_ICMP_ERROR);
 }
 
 
@@ -270,7 +271,8 @@ static void rt_icmp_echo_request(struct rtskb *skb)
 
 
 static int rt_icmp_glue_request_bits(const void *p, unsigned char *to,
-                                     unsigned int offset, unsigned int fraglen)
+                                     unsigned int offset, unsigned int fraglen,
+                                     struct rtskb *skb)
 {
     struct icmp_bxm *icmp_param = (struct icmp_bxm *)p;
     struct icmphdr  *icmph;
@@ -457,34 +459,24 @@ void rt_icmp_rcv(struct rtskb *skb)
 
     /* check header sanity and don't accept fragmented packets */
     if ((length < sizeof(struct icmphdr)) || (skb->next != NULL))
-    {
-        rtdm_printk("RTnet: improper length in icmp packet\n");
-        goto cleanup;
-    }
+        goto drop;
 
     if (ip_compute_csum((unsigned char *)icmpHdr, length))
-    {
-        rtdm_printk("RTnet: invalid checksum in icmp packet %d\n", length);
-        goto cleanup;
-    }
+        goto drop;
 
     if (!rtskb_pull(skb, sizeof(struct icmphdr)))
-    {
-        rtdm_printk("RTnet: pull failed %p\n", (skb->sk));
-        goto cleanup;
-    }
-
+        goto drop;
 
     if (icmpHdr->type > NR_ICMP_TYPES)
-    {
-        rtdm_printk("RTnet: invalid icmp type\n");
-        goto cleanup;
-    }
+        goto drop;
 
     /* sane packet, process it */
     rt_icmp_pointers[icmpHdr->type].handler(skb);
+    kfree_rtskb(skb);
+    return;
 
-  cleanup:
+  drop:
+    rtnet_count_drop(RTNET_DROP_ICMP_ERROR);
     kfree_rtskb(skb);
 }
 
@@ -495,7 +487,7 @@ void rt_icmp_rcv(struct rtskb *skb)
  */
 void rt_icmp_rcv_err(struct rtskb *skb)
 {
-    rtdm_printk("RTnet: rt_icmp_rcv err\n");
+    rtnet_count_drop(RTNET_DROP_ICMP_ERROR);
 }
 
 
@@ -0,0 +1,435 @@
+/***
+ *
+ *  ipv4/ip_forward.c - real-time IPv4 forwarding
+ *
+ *  Packets which are not addressed to the receiving station are forwarded
+ *  from the stack manager of the input device. The next hop is taken from a
+ *  per-destination cache that is revalidated against the route generation,
+ *  so the routing tables are only consulted on the first packet of a
+ *  destination or after a route changed. TTL and header checksum are
+ *  updated incrementally (RFC 1624). Forwarded packets are prioritised by
+ *  their IP precedence and pass a per-output-device queue, so that packets
+ *  forwarded concurrently by several stack managers leave in priority order.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/in.h>
+#include <linux/moduleparam.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <net/ip.h>
+
+#include <rtdev.h>
+#include <rtnet_internal.h>
+#include <rtnet_port.h>
+#include <rtnet_stats.h>
+#include <ipv4/af_inet.h>
+#include <ipv4/ip_forward.h>
+#include <ipv4/route.h>
+
+#define FWD_CACHE_SIZE      CONFIG_RTNET_RTIPV4_FWD_CACHE
+#define FWD_CACHE_MASK      (FWD_CACHE_SIZE - 1)
+
+#if (FWD_CACHE_SIZE & (FWD_CACHE_SIZE - 1))
+# error CONFIG_RTNET_RTIPV4_FWD_CACHE must be power of 2
+#endif
+
+/* IP precedence, the upper 3 bits of the TOS field */
+#define FWD_PRECEDENCES     8
+
+static int fwd_prio_map[FWD_PRECEDENCES] = { 16, 14, 12, 10, 8, 6, 4, 2 };
+static unsigned int fwd_channel = RTSKB_DEF_RT_CHANNEL;
+static unsigned int fwd_queue_len = 32;
+static unsigned int fwd_rtskbs = 16;
+
+compat_module_int_param_array(fwd_prio_map, FWD_PRECEDENCES);
+module_param(fwd_channel, uint, 0444);
+module_param(fwd_queue_len, uint, 0444);
+module_param(fwd_rtskbs, uint, 0444);
+MODULE_PARM_DESC(fwd_prio_map, "transmission priority of forwarded packets "
+                 "per IP precedence 0..7 (default: 16,14,12,10,8,6,4,2)");
+MODULE_PARM_DESC(fwd_channel, "transmission channel of forwarded packets "
+                 "(default: 0, real-time)");
+MODULE_PARM_DESC(fwd_queue_len, "forwarded packets queued per output device "
+                 "(default: 32)");
+MODULE_PARM_DESC(fwd_rtskbs, "rtskbs compensating forwarded packets "
+                 "(default: 16)");
+
+struct fwd_cache_entry {
+    rtdm_lock_t         lock;
+    u32                 daddr;      /* 0: unused entry */
+    unsigned long       generation; /* rt_ip_route_generation of rt */
+    struct dest_route   rt;         /* rtdev is not referenced */
+} ____cacheline_aligned_in_smp;
+
+struct fwd_queue {
+    struct rtskb_prio_queue queue;  /* lock also protects the fields below */
+    unsigned int        length;
+    unsigned int        max_length;
+} ____cacheline_aligned_in_smp;
+
+struct fwd_stats {
+    unsigned long       forwarded;
+    unsigned long       cache_hits;
+    unsigned long       cache_misses;
+    unsigned long       ttl_exceeded;
+    unsigned long       no_route;
+    unsigned long       mtu_exceeded;
+    unsigned long       no_buffer;
+    unsigned long       queue_full;
+    unsigned long       tx_errors;
+} ____cacheline_aligned_in_smp;
+
+static struct fwd_cache_entry   fwd_cache[FWD_CACHE_SIZE];
+static struct fwd_queue         fwd_queues[MAX_RT_DEVICES];
+static struct fwd_stats         fwd_stats[NR_CPUS];
+
+/* compensates forwarded packets, keeps them away from the global pool */
+static struct rtskb_queue       fwd_pool;
+
+
+#define rt_ip_fwd_count(counter)                                \
+    do {                                                        \
+        rtdm_lockctx_t __context;                               \
+                                                                \
+        rtdm_lock_irqsave(__context);                           \
+        fwd_stats[rtos_processor_id()].counter++;               \
+        rtdm_lock_irqrestore(__context);                        \
+    } while (0)
+
+
+
+static inline unsigned int fwd_hashkey(u32 daddr)
+{
+    u32 key = ntohl(daddr);
+
+    return (key ^ (key >> 8) ^ (key >> 16)) & FWD_CACHE_MASK;
+}
+
+
+
+/***
+ *  rt_ip_fwd_route - look up the next hop of a forwarded packet
+ *  @daddr: destination
+ *  @rt:    route buffer, its rtdev is referenced on success
+ *
+ *  A cached next hop is used as long as no route changed since it was
+ *  looked up, otherwise the entry is refreshed from the routing tables.
+ */
+static int rt_ip_fwd_route(u32 daddr, struct dest_route *rt)
+{
+    struct fwd_cache_entry  *entry = &fwd_cache[fwd_hashkey(daddr)];
+    unsigned long           generation;
+    rtdm_lockctx_t          context;
+
+
+    rtdm_lock_get_irqsave(&entry->lock, context);
+
+    if (entry->daddr == daddr) {
+        *rt        = entry->rt;
+        generation = entry->generation;
+
+        rtdm_lock_put_irqrestore(&entry->lock, context);
+
+        if (likely(rt_ip_route_hold(rt, generation) == 0)) {
+            rt_ip_fwd_count(cache_hits);
+            return 0;
+        }
+    } else
+        rtdm_lock_put_irqrestore(&entry->lock, context);
+
+    rt_ip_fwd_count(cache_misses);
+
+    /* a concurrent change is caught by the generation, see rt_udp_sendmsg */
+    generation = rt_ip_route_generation;
+    smp_rmb();
+    if (rt_ip_route_output(rt, daddr, INADDR_ANY) < 0)
+        return -EHOSTUNREACH;
+
+    rtdm_lock_get_irqsave(&entry->lock, context);
+    entry->daddr      = daddr;
+    entry->generation = generation;
+    entry->rt         = *rt;
+    rtdm_lock_put_irqrestore(&entry->lock, context);
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_ip_fwd_xmit - queue a forwarded packet on its output device
+ *
+ *  Each caller transmits exactly one packet, the most urgent one queued at
+ *  that time. So a stack manager never sends on behalf of others for longer
+ *  than a single packet, and a more urgent packet queued meanwhile by a
+ *  higher-priority manager overtakes the remaining ones. The reference on
+ *  the output device held by each packet is dropped after its transmission.
+ */
+static void rt_ip_fwd_xmit(struct rtskb *skb)
+{
+    struct rtnet_device *rtdev = skb->rtdev;
+    struct fwd_queue    *fwd_queue = &fwd_queues[rtdev->ifindex - 1];
+    rtdm_lockctx_t      context;
+
+
+    rtdm_lock_get_irqsave(&fwd_queue->queue.lock, context);
+
+    if (unlikely(fwd_queue->length >= fwd_queue_len)) {
+        rtdm_lock_put_irqrestore(&fwd_queue->queue.lock, context);
+
+        rt_ip_fwd_count(queue_full);
+        rtnet_count_drop(RTNET_DROP_IP_FWD_QUEUE);
+        kfree_rtskb(skb);
+        rtdev_dereference(rtdev);
+        return;
+    }
+
+    __rtskb_prio_queue_tail(&fwd_queue->queue, skb);
+    if (++fwd_queue->length > fwd_queue->max_length)
+        fwd_queue->max_length = fwd_queue->length;
+
+    /* never empty, there is at least the packet just queued */
+    skb = __rtskb_prio_dequeue(&fwd_queue->queue);
+    fwd_queue->length--;
+
+    rtdm_lock_put_irqrestore(&fwd_queue->queue.lock, context);
+
+    if (rtdev_xmit(skb) == 0)
+        rt_ip_fwd_count(forwarded);
+    else
+        rt_ip_fwd_count(tx_errors);
+    rtdev_dereference(rtdev);
+}
+
+
+
+/***
+ *  rt_ip_forward - forward a packet not addressed to this station
+ *  @skb: received packet with a valid IP header
+ *
+ *  Returns 0 if the packet shall be delivered locally, 1 if it was consumed.
+ */
+int rt_ip_forward(struct rtskb *skb)
+{
+    struct rtnet_device *rtdev = skb->rtdev;
+    struct iphdr        *iph = skb->nh.iph;
+    struct dest_route   rt;
+    u32                 check;
+    int                 prio;
+
+
+    if (likely((iph->daddr == rtdev->local_ip) ||
+               (iph->daddr == rtdev->broadcast_ip) ||
+               (rtdev->flags & IFF_LOOPBACK)))
+        return 0;
+
+    /* no ICMP time exceeded, the sender learns from missing replies */
+    if (unlikely(iph->ttl <= 1)) {
+        rt_ip_fwd_count(ttl_exceeded);
+        rtnet_count_drop(RTNET_DROP_IP_FWD_TTL);
+        goto drop;
+    }
+
+    /* the drop is already accounted by rt_ip_route_output */
+    if (unlikely(rt_ip_fwd_route(iph->daddr, &rt) < 0)) {
+        rt_ip_fwd_count(no_route);
+        goto drop;
+    }
+
+    /* forwarded packets are not fragmented */
+    if (unlikely(skb->len > rt.rtdev->mtu)) {
+        rt_ip_fwd_count(mtu_exceeded);
+        rtnet_count_drop(RTNET_DROP_IP_FWD_MTU);
+        goto drop_route;
+    }
+
+    if (unlikely(rtskb_cloned(skb))) {
+        /* the headers are rewritten, don't touch shared data */
+        struct rtskb *copy_skb = rtskb_copy(skb, &fwd_pool);
+
+        kfree_rtskb(skb);
+        if (copy_skb == NULL) {
+            rt_ip_fwd_count(no_buffer);
+            rtnet_count_drop(RTNET_DROP_IP_FORWARD);
+            rtdev_dereference(rt.rtdev);
+            return 1;
+        }
+        skb = copy_skb;
+        iph = skb->nh.iph;
+    } else if (rtskb_acquire(skb, &fwd_pool) != 0) {
+        rt_ip_fwd_count(no_buffer);
+        rtnet_count_drop(RTNET_DROP_IP_FORWARD);
+        goto drop_route;
+    }
+
+    /* the checksum was verified on input, so it can be updated in place */
+    check = iph->check;
+    check += htons(0x0100);
+    iph->check = check + (check >= 0xFFFF);
+    iph->ttl--;
+
+    prio = fwd_prio_map[iph->tos >> 5];
+    if ((prio < QUEUE_MAX_PRIO) || (prio > QUEUE_MIN_PRIO))
+        prio = QUEUE_MIN_PRIO;
+
+    skb->rtdev    = rt.rtdev;
+    skb->priority = RTSKB_PRIO_VALUE(prio, fwd_channel);
+
+    if ((rt.rtdev->hard_header) &&
+        (rt.rtdev->hard_header(skb, rt.rtdev, ETH_P_IP, rt.dev_addr,
+                               rt.rtdev->dev_addr, skb->len) < 0)) {
+        rtnet_count_drop(RTNET_DROP_IP_FORWARD);
+        goto drop_route;
+    }
+
+    rtnet_trace_end(skb, RTNET_LAT_FWD, RTNET_LAT_FWD_TOTAL);
+
+    rt_ip_fwd_xmit(skb);
+
+    return 1;
+
+  drop_route:
+    rtdev_dereference(rt.rtdev);
+
+  drop:
+    kfree_rtskb(skb);
+    return 1;
+}
+
+
+
+#ifdef CONFIG_PROC_FS
+static int rtnet_ipv4_forward_show(struct seq_file *p, void *data)
+{
+    struct fwd_stats    sum;
+    struct rtnet_device *rtdev;
+    int                 cpu;
+    int                 i;
+
+
+    memset(&sum, 0, sizeof(sum));
+    for (cpu = 0; cpu < NR_CPUS; cpu++) {
+        sum.forwarded    += fwd_stats[cpu].forwarded;
+        sum.cache_hits   += fwd_stats[cpu].cache_hits;
+        sum.cache_misses += fwd_stats[cpu].cache_misses;
+        sum.ttl_exceeded += fwd_stats[cpu].ttl_exceeded;
+        sum.no_route     += fwd_stats[cpu].no_route;
+        sum.mtu_exceeded += fwd_stats[cpu].mtu_exceeded;
+        sum.no_buffer    += fwd_stats[cpu].no_buffer;
+        sum.queue_full   += fwd_stats[cpu].queue_full;
+        sum.tx_errors    += fwd_stats[cpu].tx_errors;
+    }
+
+    seq_printf(p, "Forwarded:\t\t%lu\n"
+               "Cache hits/misses:\t%lu/%lu\n"
+               "TTL exceeded:\t\t%lu\n"
+               "No route:\t\t%lu\n"
+               "MTU exceeded:\t\t%lu\n"
+               "No buffer:\t\t%lu\n"
+               "Queue full:\t\t%lu\n"
+               "TX errors:\t\t%lu\n",
+               sum.forwarded, sum.cache_hits, sum.cache_misses,
+               sum.ttl_exceeded, sum.no_route, sum.mtu_exceeded,
+               sum.no_buffer, sum.queue_full, sum.tx_errors);
+
+    seq_printf(p, "Next hop cache size:\t%d\n"
+               "Channel:\t\t%u\n"
+               "Priority by precedence:\t", FWD_CACHE_SIZE, fwd_channel);
+    for (i = 0; i < FWD_PRECEDENCES; i++)
+        seq_printf(p, "%d%c", fwd_prio_map[i],
+                   (i < FWD_PRECEDENCES - 1) ? ',' : '\n');
+
+    seq_printf(p, "\nDevice\tQueued\tMax\tLimit\n");
+    for (i = 0; i < MAX_RT_DEVICES; i++) {
+        rtdev = rtdev_get_by_index(i + 1);
+        if (rtdev == NULL)
+            continue;
+
+        seq_printf(p, "%s\t%u\t%u\t%u\n", rtdev->name,
+                   fwd_queues[i].length, fwd_queues[i].max_length,
+                   fwd_queue_len);
+
+        rtdev_dereference(rtdev);
+    }
+
+    return 0;
+}
+
+static int rtnet_ipv4_forward_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, rtnet_ipv4_forward_show, NULL);
+}
+
+static const struct file_operations rtnet_ipv4_forward_fops = {
+    .open       = rtnet_ipv4_forward_open,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+#endif /* CONFIG_PROC_FS */
+
+
+
+/***
+ *  rt_ip_forward_init
+ */
+int __init rt_ip_forward_init(void)
+{
+    int i;
+
+
+    for (i = 0; i < FWD_CACHE_SIZE; i++)
+        rtdm_lock_init(&fwd_cache[i].lock);
+
+    for (i = 0; i < MAX_RT_DEVICES; i++)
+        rtskb_prio_queue_init(&fwd_queues[i].queue);
+
+    if (rtskb_pool_init(&fwd_pool, fwd_rtskbs) < fwd_rtskbs) {
+        rtskb_pool_release(&fwd_pool);
+        return -ENOMEM;
+    }
+
+#ifdef CONFIG_PROC_FS
+    if (!proc_create("forward", S_IFREG | S_IRUGO, ipv4_proc_root,
+                     &rtnet_ipv4_forward_fops)) {
+        /*ERRMSG*/printk("RTnet: unable to initialize /proc entry "
+                         "(forward)\n");
+        rtskb_pool_release(&fwd_pool);
+        return -ENOMEM;
+    }
+#endif /* CONFIG_PROC_FS */
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_ip_forward_release
+ *
+ *  The queues are always drained by their last user, so only the pool is
+ *  left. Packets arriving meanwhile fail to acquire a buffer and are dropped.
+ */
+void rt_ip_forward_release(void)
+{
+#ifdef CONFIG_PROC_FS
+    remove_proc_entry("forward", ipv4_proc_root);
+#endif /* CONFIG_PROC_FS */
+
+    rtskb_pool_release(&fwd_pool);
+}
@@ -21,12 +21,14 @@
 
 
 #include <linux/module.h>
+#include <linux/moduleparam.h>
 #include <net/checksum.h>
 #include <net/ip.h>
 
 #include <rtdev.h>
 #include <rtnet_internal.h>
 #include <rtnet_socket.h>
+#include <rtnet_stats.h>
 
 #include <linux/ip.h>
 #include <linux/in.h>
@@ -38,178 +40,365 @@
 #endif /* CONFIG_RTNET_ADDON_PROXY */
 
 /*
- * This defined sets the number of incoming fragmented IP messages that
- * can be handled in parallel.
+ * Number of incoming fragmented IP datagrams that can be reassembled in
+ * parallel. Collectors are hashed by their datagram key, one bucket per
+ * collector keeps the chains short.
  */
-#define COLLECTOR_COUNT 10
+#define COLLECTOR_COUNT     CONFIG_RTNET_RTIPV4_FRAG_COLLECTORS
+#define FRAG_HASH_SIZE      COLLECTOR_COUNT
+#define FRAG_HASH_MASK      (FRAG_HASH_SIZE - 1)
+
+#if (COLLECTOR_COUNT & (COLLECTOR_COUNT - 1))
+# error CONFIG_RTNET_RTIPV4_FRAG_COLLECTORS must be power of 2
+#endif
+
+static unsigned int frag_timeout = 1000;
+static unsigned int frag_quota   = COLLECTOR_COUNT / 2;
+static unsigned int frag_rtskbs  = 16;
+
+module_param(frag_timeout, uint, 0444);
+module_param(frag_quota, uint, 0444);
+module_param(frag_rtskbs, uint, 0444);
+MODULE_PARM_DESC(frag_timeout, "reassembly timeout in ms (default: 1000)");
+MODULE_PARM_DESC(frag_quota, "collectors a single socket may occupy "
+                 "(default: half of all collectors)");
+MODULE_PARM_DESC(frag_rtskbs, "rtskbs for fragments which arrive before "
+                 "the first one of their datagram (default: 16)");
+
+enum collector_state {
+    COLL_ASSEMBLE,      /* collecting fragments */
+    COLL_DISCARD,       /* datagram lost, drop remaining fragments */
+    COLL_PROXY          /* datagram handled by the fallback handler */
+};
 
 struct ip_collector
 {
-    int   in_use;
+    struct ip_collector *next;      /* hash chain or free list */
+
     __u32 saddr;
     __u32 daddr;
     __u16 id;
     __u8  protocol;
+    __u8  state;
+
+    struct rtskb *first;            /* fragments sorted by offset */
+    struct rtskb *last;
+    unsigned int frags;
+    struct rtsocket *sock;          /* NULL until the first fragment arrived */
+    unsigned int buf_size;          /* payload bytes received */
+    unsigned int total_size;        /* 0 until the last fragment arrived */
+    unsigned int drop_reason;       /* see COLL_DISCARD */
+    nanosecs_abs_t expires;
+};
 
-    struct rtskb_queue frags;
-    struct rtsocket *sock;
-    unsigned int buf_size;
+struct ip_frag_bucket
+{
+    struct ip_collector *chain;
+    rtdm_lock_t lock;
 };
 
-static struct ip_collector collector[COLLECTOR_COUNT];
+static struct ip_collector   collector[COLLECTOR_COUNT];
+static struct ip_collector   *free_collectors;
+static rtdm_lock_t           free_collectors_lock = RTDM_LOCK_UNLOCKED;
+static struct ip_frag_bucket frag_hash[FRAG_HASH_SIZE];
+
+/* compensates fragments as long as their socket is unknown */
+static struct rtskb_queue    frag_pool;
+
+static rtdm_timer_t          frag_timer;
 
 
-static void alloc_collector(struct rtskb *skb, struct rtsocket *sock)
+
+static inline unsigned int frag_hashkey(struct iphdr *iph)
 {
-    int                 i;
-    rtdm_lockctx_t      context;
-    struct ip_collector *p_coll;
-    struct iphdr        *iph = skb->nh.iph;
-
-
-    /*
-     * Find a free collector
-     *
-     * Note: We once used to clean up probably outdated chains, but the
-     * algorithm was not stable enough and could cause incorrect drops even
-     * under medium load. If we run in overload, we will loose data anyhow.
-     * What we should do in the future is to account collectors per socket or
-     * socket owner and set quotations.
-     * Garbage collection is now performed only on socket close.
-     */
-    for (i = 0; i < COLLECTOR_COUNT; i++) {
-        p_coll = &collector[i];
-        rtdm_lock_get_irqsave(&p_coll->frags.lock, context);
-
-        if (!p_coll->in_use) {
-            p_coll->in_use        = 1;
-            p_coll->buf_size      = skb->len;
-            p_coll->frags.first   = skb;
-            p_coll->frags.last    = skb;
-            p_coll->saddr         = iph->saddr;
-            p_coll->daddr         = iph->daddr;
-            p_coll->id            = iph->id;
-            p_coll->protocol      = iph->protocol;
-            p_coll->sock          = sock;
-
-            rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-
-            return;
-        }
+    u32 saddr = ntohl(iph->saddr);
 
-        rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-    }
+    return (ntohs(iph->id) ^ saddr ^ (saddr >> 16) ^ iph->protocol) &
+        FRAG_HASH_MASK;
+}
 
-    rtdm_printk("RTnet: IP fragmentation - no collector available\n");
-    kfree_rtskb(skb);
+
+
+/* Note: the IP header has already been pulled from the fragment */
+static inline unsigned int frag_offset(struct rtskb *skb)
+{
+    return (ntohs(skb->nh.iph->frag_off) & IP_OFFSET) << 3;
+}
+
+
+
+static inline unsigned int frag_end(struct rtskb *skb)
+{
+    return frag_offset(skb) + skb->len;
 }
 
 
 
 /*
- * Return a pointer to the collector that holds the message which
- * fits to the iphdr of the passed rtskb.
- * */
-static struct rtskb *add_to_collector(struct rtskb *skb, unsigned int offset, int more_frags)
+ * Allocates a collector and links it into its hash bucket. Must be called
+ * with the bucket lock held.
+ */
+static struct ip_collector *alloc_collector(struct ip_frag_bucket *bucket,
+                                            struct iphdr *iph)
 {
-    int                 i;
-    rtdm_lockctx_t      context;
     struct ip_collector *p_coll;
-    struct iphdr        *iph = skb->nh.iph;
-    struct rtskb        *first_skb;
 
 
-    /* Search in existing collectors */
-    for (i = 0; i < COLLECTOR_COUNT; i++)
-    {
-        p_coll = &collector[i];
-        rtdm_lock_get_irqsave(&p_coll->frags.lock, context);
+    rtdm_lock_get(&free_collectors_lock);
+
+    p_coll = free_collectors;
+    if (p_coll != NULL)
+        free_collectors = p_coll->next;
+
+    rtdm_lock_put(&free_collectors_lock);
+
+    if (p_coll == NULL)
+        return NULL;
+
+    p_coll->saddr       = iph->saddr;
+    p_coll->daddr       = iph->daddr;
+    p_coll->id          = iph->id;
+    p_coll->protocol    = iph->protocol;
+    p_coll->state       = COLL_ASSEMBLE;
+    p_coll->first       = NULL;
+    p_coll->last        = NULL;
+    p_coll->frags       = 0;
+    p_coll->sock        = NULL;
+    p_coll->buf_size    = 0;
+    p_coll->total_size  = 0;
+    p_coll->expires     = rtdm_clock_read() +
+        (nanosecs_abs_t)frag_timeout * 1000000;
+
+    p_coll->next  = bucket->chain;
+    bucket->chain = p_coll;
+
+    return p_coll;
+}
+
+
+
+/*
+ * Unlinks a collector from its bucket and returns it to the free list. Must
+ * be called with the bucket lock held.
+ */
+static void free_collector(struct ip_frag_bucket *bucket,
+                           struct ip_collector *p_coll)
+{
+    struct ip_collector **pp_coll = &bucket->chain;
+
 
-        if (p_coll->in_use  &&
+    while (*pp_coll != p_coll)
+        pp_coll = &(*pp_coll)->next;
+    *pp_coll = p_coll->next;
+
+    rtdm_lock_get(&free_collectors_lock);
+
+    p_coll->next    = free_collectors;
+    free_collectors = p_coll;
+
+    rtdm_lock_put(&free_collectors_lock);
+}
+
+
+
+static struct ip_collector *find_collector(struct ip_frag_bucket *bucket,
+                                           struct iphdr *iph)
+{
+    struct ip_collector *p_coll;
+
+
+    for (p_coll = bucket->chain; p_coll != NULL; p_coll = p_coll->next)
+        if ((iph->id       == p_coll->id) &&
             (iph->saddr    == p_coll->saddr) &&
             (iph->daddr    == p_coll->daddr) &&
-            (iph->id       == p_coll->id) &&
             (iph->protocol == p_coll->protocol))
-        {
-            first_skb = p_coll->frags.first;
+            break;
 
-            /* Acquire the rtskb at the expense of the protocol pool */
-            if (rtskb_acquire(skb, &p_coll->sock->skb_pool) != 0) {
-                /* We have to drop this fragment => clean up the whole chain */
-                p_coll->in_use = 0;
+    return p_coll;
+}
 
-                rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
 
-#ifdef FRAG_DBG
-                rtdm_printk("RTnet: Compensation pool empty - IP fragments "
-                            "dropped (saddr:%x, daddr:%x)\n",
-                            iph->saddr, iph->daddr);
+
+/*
+ * Releases all collected fragments, further fragments of the datagram will
+ * be dropped until it is over or timed out.
+ */
+static void discard_collector(struct ip_collector *p_coll, unsigned int reason)
+{
+    if (p_coll->first != NULL) {
+        kfree_rtskb(p_coll->first);
+        p_coll->first = NULL;
+        p_coll->last  = NULL;
+    }
+
+    if (p_coll->sock != NULL) {
+        atomic_dec(&p_coll->sock->frag_count);
+        p_coll->sock = NULL;
+    }
+
+    p_coll->state       = COLL_DISCARD;
+    p_coll->drop_reason = reason;
+}
+
+
+
+/*
+ * Assigns the destination socket once the first fragment arrived and moves
+ * the fragments collected so far to its pool. Returns a drop reason on
+ * failure.
+ */
+static int attach_collector(struct ip_collector *p_coll, struct rtsocket *sock)
+{
+    struct rtskb *skb;
+
+
+    if (atomic_inc_return(&sock->frag_count) > frag_quota) {
+        atomic_dec(&sock->frag_count);
+        return RTNET_DROP_FRAG_QUOTA;
+    }
+    p_coll->sock = sock;
+
+    for (skb = p_coll->first; skb != NULL; skb = skb->next)
+        if (rtskb_acquire(skb, &sock->skb_pool) != 0)
+            return RTNET_DROP_FRAG_SOCKET_POOL;
+
+    return 0;
+}
+
+
+
+/*
+ * Inserts a fragment at its offset into the chain. Returns a drop reason if
+ * it does not fit to the collected ones, the datagram has to be discarded
+ * then.
+ */
+static int add_to_collector(struct ip_collector *p_coll, struct rtskb *skb,
+                            unsigned int offset, unsigned int end,
+                            int more_frags)
+{
+    struct rtskb *prev = NULL;
+    struct rtskb *next = p_coll->first;
+
+
+    if (!more_frags) {
+        if (((p_coll->total_size != 0) && (p_coll->total_size != end)) ||
+            ((p_coll->last != NULL) && (frag_end(p_coll->last) > end)))
+            return RTNET_DROP_FRAG_OVERLAP;
+    } else if ((p_coll->total_size != 0) && (end >= p_coll->total_size))
+        return RTNET_DROP_FRAG_OVERLAP;
+
+    /* Fast path for fragments arriving in order */
+    if ((p_coll->last != NULL) && (frag_offset(p_coll->last) < offset)) {
+        prev = p_coll->last;
+        next = NULL;
+    } else
+        while ((next != NULL) && (frag_offset(next) < offset)) {
+            prev = next;
+            next = next->next;
+        }
+
+    if (((prev != NULL) && (frag_end(prev) > offset)) ||
+        ((next != NULL) && (end > frag_offset(next))))
+        return RTNET_DROP_FRAG_OVERLAP;
+
+    /* Acquire the rtskb at the expense of the socket or the fragment pool */
+    if (p_coll->sock != NULL) {
+        if (rtskb_acquire(skb, &p_coll->sock->skb_pool) != 0)
+            return RTNET_DROP_FRAG_SOCKET_POOL;
+    } else if (rtskb_acquire(skb, &frag_pool) != 0)
+        return RTNET_DROP_FRAG_POOL;
+
+    skb->next = next;
+    if (prev == NULL)
+        p_coll->first = skb;
+    else
+        prev->next = skb;
+    if (next == NULL)
+        p_coll->last = skb;
+
+    /* The first rtskb describes the whole chain */
+    p_coll->frags++;
+    p_coll->first->chain_end = p_coll->last;
+#ifdef CONFIG_RTNET_CHECKED
+    p_coll->first->chain_len = p_coll->frags;
 #endif
 
-                kfree_rtskb(first_skb);
-                kfree_rtskb(skb);
-                return NULL;
-            }
+    if (!more_frags)
+        p_coll->total_size = end;
+    p_coll->buf_size += skb->len;
+
+    return 0;
+}
+
+
+
+#ifdef CONFIG_RTNET_ADDON_PROXY
+static void proxy_fragments(struct rtskb *skb)
+{
+    struct rtskb *next;
 
-            /* Optimized version of __rtskb_queue_tail */
-            skb->next = NULL;
-            p_coll->frags.last->next = skb;
-            p_coll->frags.last = skb;
 
-            /* Extend the chain */
-            first_skb->chain_end = skb;
+    while (skb != NULL) {
+        next = skb->next;
+
+        skb->next      = NULL;
+        skb->chain_end = skb;
 #ifdef CONFIG_RTNET_CHECKED
-            first_skb->chain_len++;
+        skb->chain_len = 1;
 #endif
+        __rtskb_push(skb, skb->nh.iph->ihl*4);
+        rt_ip_fallback_handler(skb);
 
-            /* Sanity check: unordered fragments are not allowed! */
-            if (offset != p_coll->buf_size) {
-                /* We have to drop this fragment => clean up the whole chain */
-                p_coll->in_use = 0;
-                skb = first_skb;
+        skb = next;
+    }
+}
+#endif /* CONFIG_RTNET_ADDON_PROXY */
 
-                rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-                break; /* leave the for loop */
-            }
 
-            p_coll->buf_size += skb->len;
 
-            if (!more_frags) {
-                p_coll->in_use = 0;
+/*
+ * Reclaims the collectors of timed out datagrams
+ */
+static void frag_timer_proc(rtdm_timer_t *timer)
+{
+    nanosecs_abs_t      now = rtdm_clock_read();
+    struct ip_collector **pp_coll;
+    struct ip_collector *p_coll;
+    rtdm_lockctx_t      context;
+    int                 i;
+
+
+    for (i = 0; i < FRAG_HASH_SIZE; i++) {
+        rtdm_lock_get_irqsave(&frag_hash[i].lock, context);
 
-                rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-                return first_skb;
-            } else {
-                rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-                return NULL;
+        pp_coll = &frag_hash[i].chain;
+        while ((p_coll = *pp_coll) != NULL) {
+            if (p_coll->expires > now) {
+                pp_coll = &p_coll->next;
+                continue;
             }
-        }
 
-        rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
-    }
+            if (p_coll->state == COLL_ASSEMBLE) {
+                rtnet_count_drop(RTNET_DROP_FRAG_TIMEOUT);
+                discard_collector(p_coll, RTNET_DROP_FRAG_TIMEOUT);
+            }
 
-#ifdef CONFIG_RTNET_ADDON_PROXY
-    if (rt_ip_fallback_handler) {
-	    __rtskb_push(skb, iph->ihl*4);
-	    rt_ip_fallback_handler(skb);
-	    return NULL;
-    }
-#endif
+            *pp_coll = p_coll->next;
 
-#ifdef FRAG_DBG
-    rtdm_printk("RTnet: Unordered IP fragment (saddr:%x, daddr:%x)"
-                " - dropped\n", iph->saddr, iph->daddr);
-#endif
+            rtdm_lock_get(&free_collectors_lock);
+            p_coll->next    = free_collectors;
+            free_collectors = p_coll;
+            rtdm_lock_put(&free_collectors_lock);
+        }
 
-    kfree_rtskb(skb);
-    return NULL;
+        rtdm_lock_put_irqrestore(&frag_hash[i].lock, context);
+    }
 }
 
 
 
 /*
  * Cleans up all collectors referring to the specified socket.
- * This is now the only kind of garbage collection we do.
  */
 void rt_ip_frag_invalidate_socket(struct rtsocket *sock)
 {
@@ -218,18 +407,16 @@ void rt_ip_frag_invalidate_socket(struct rtsocket *sock)
     struct ip_collector *p_coll;
 
 
-    for (i = 0; i < COLLECTOR_COUNT; i++)
+    for (i = 0; i < FRAG_HASH_SIZE; i++)
     {
-        p_coll = &collector[i];
-        rtdm_lock_get_irqsave(&p_coll->frags.lock, context);
+        rtdm_lock_get_irqsave(&frag_hash[i].lock, context);
 
-        if ((p_coll->in_use) && (p_coll->sock == sock))
-        {
-            p_coll->in_use = 0;
-            kfree_rtskb(p_coll->frags.first);
-        }
+        for (p_coll = frag_hash[i].chain; p_coll != NULL;
+             p_coll = p_coll->next)
+            if (p_coll->sock == sock)
+                discard_collector(p_coll, RTNET_DROP_IP_NO_SOCKET);
 
-        rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
+        rtdm_lock_put_irqrestore(&frag_hash[i].lock, context);
     }
 }
 EXPORT_SYMBOL(rt_ip_frag_invalidate_socket);
@@ -246,18 +433,16 @@ static void cleanup_all_collectors(void)
     struct ip_collector *p_coll;
 
 
-    for (i = 0; i < COLLECTOR_COUNT; i++)
+    for (i = 0; i < FRAG_HASH_SIZE; i++)
     {
-        p_coll = &collector[i];
-        rtdm_lock_get_irqsave(&p_coll->frags.lock, context);
+        rtdm_lock_get_irqsave(&frag_hash[i].lock, context);
 
-        if (p_coll->in_use)
-        {
-            p_coll->in_use = 0;
-            kfree_rtskb(p_coll->frags.first);
+        while ((p_coll = frag_hash[i].chain) != NULL) {
+            discard_collector(p_coll, RTNET_DROP_FRAG_TIMEOUT);
+            free_collector(&frag_hash[i], p_coll);
         }
 
-        rtdm_lock_put_irqrestore(&p_coll->frags.lock, context);
+        rtdm_lock_put_irqrestore(&frag_hash[i].lock, context);
     }
 }
 
@@ -266,15 +451,25 @@ static void cleanup_all_collectors(void)
 /*
  * This function returns an rtskb that contains the complete, accumulated IP message.
  * If not all fragments of the IP message have been received yet, it returns NULL
+ * Fragments may arrive in any order, the returned chain is sorted by offset.
  * Note: the IP header must have already been pulled from the rtskb!
  * */
 struct rtskb *rt_ip_defrag(struct rtskb *skb, struct rtinet_protocol *ipprot)
 {
-    unsigned int    more_frags;
-    unsigned int    offset;
-    struct rtsocket *sock;
-    struct iphdr    *iph = skb->nh.iph;
-    int             ret;
+    unsigned int            more_frags;
+    unsigned int            offset;
+    unsigned int            end;
+    struct rtsocket         *sock = NULL;
+    struct iphdr            *iph = skb->nh.iph;
+    struct ip_frag_bucket   *bucket;
+    struct ip_collector     *p_coll;
+    struct rtskb            *orphans = NULL;
+    struct rtskb            *complete = NULL;
+    rtdm_lockctx_t          context;
+#ifdef CONFIG_RTNET_ADDON_PROXY
+    int                     state;
+#endif
+    int                     reason;
 
 
     /* Parse the IP header */
@@ -282,44 +477,110 @@ struct rtskb *rt_ip_defrag(struct rtskb *skb, struct rtinet_protocol *ipprot)
     more_frags = offset & IP_MF;
     offset &= IP_OFFSET;
     offset <<= 3;   /* offset is in 8-byte chunks */
+    end = offset + skb->len;
+
+    /* All but the last fragment carry multiples of 8 bytes */
+    if ((skb->len == 0) || (end > 0xFFFF) || (more_frags && (skb->len & 7))) {
+        rtnet_count_drop(RTNET_DROP_IP_HEADER);
+        kfree_rtskb(skb);
+        return NULL;
+    }
 
-    /* First fragment? */
+    /* The first fragment identifies the destination socket */
     if (offset == 0)
-    {
-        /* Get the destination socket */
-        if ((sock = ipprot->dest_socket(skb)) == NULL) {
-#ifdef CONFIG_RTNET_ADDON_PROXY
-                if (rt_ip_fallback_handler) {
-                    __rtskb_push(skb, iph->ihl*4);
-                    rt_ip_fallback_handler(skb);
-                    return NULL;
-                }
-#endif
-            /* Drop the rtskb */
+        sock = ipprot->dest_socket(skb);
+
+    bucket = &frag_hash[frag_hashkey(iph)];
+
+    rtdm_lock_get_irqsave(&bucket->lock, context);
+
+    p_coll = find_collector(bucket, iph);
+    if (p_coll == NULL) {
+        p_coll = alloc_collector(bucket, iph);
+        if (p_coll == NULL) {
+            rtdm_lock_put_irqrestore(&bucket->lock, context);
+
+            rtnet_count_drop(RTNET_DROP_FRAG_NO_COLLECTOR);
             kfree_rtskb(skb);
-            return NULL;
+            goto out;
         }
+    }
 
-        /* Acquire the rtskb at the expense of the socket's pool */
-        ret = rtskb_acquire(skb, &sock->skb_pool);
+    if ((offset == 0) && (p_coll->state == COLL_ASSEMBLE) &&
+        (p_coll->sock == NULL)) {
+        if (sock != NULL) {
+            reason = attach_collector(p_coll, sock);
+            if (reason != 0)
+                discard_collector(p_coll, reason);
+        }
+#ifdef CONFIG_RTNET_ADDON_PROXY
+        else if (rt_ip_fallback_handler) {
+            orphans        = p_coll->first;
+            p_coll->first  = NULL;
+            p_coll->last   = NULL;
+            p_coll->state  = COLL_PROXY;
+        }
+#endif /* CONFIG_RTNET_ADDON_PROXY */
+        else
+            discard_collector(p_coll, RTNET_DROP_IP_NO_SOCKET);
+    }
 
-        /* socket is now implicitely locked by the missing rtskb */
-        rt_socket_dereference(sock);
+    if (p_coll->state == COLL_ASSEMBLE) {
+        reason = add_to_collector(p_coll, skb, offset, end, more_frags);
+        if (reason == 0) {
+            /* The first fragment has arrived if the socket is known */
+            if ((p_coll->sock != NULL) &&
+                (p_coll->buf_size == p_coll->total_size)) {
+                complete = p_coll->first;
+                atomic_dec(&p_coll->sock->frag_count);
+                free_collector(bucket, p_coll);
+            }
 
-        if (ret != 0) {
-            /* Drop the rtskb */
-            kfree_rtskb(skb);
-        } else {
-            /* Allocates a new collector */
-            alloc_collector(skb, sock);
+            rtdm_lock_put_irqrestore(&bucket->lock, context);
+            goto out;
         }
-        return NULL;
+
+        discard_collector(p_coll, reason);
     }
-    else
-    {
-        /* Add to an existing collector */
-        return add_to_collector(skb, offset, more_frags);
+
+    /* Account the fragment to release the collector when the datagram is
+     * over, timeouts catch lost fragments */
+#ifdef CONFIG_RTNET_ADDON_PROXY
+    state  = p_coll->state;
+#endif
+    reason = p_coll->drop_reason;
+
+    p_coll->buf_size += skb->len;
+    if (!more_frags)
+        p_coll->total_size = end;
+    if ((p_coll->total_size != 0) &&
+        (p_coll->buf_size >= p_coll->total_size))
+        free_collector(bucket, p_coll);
+
+    rtdm_lock_put_irqrestore(&bucket->lock, context);
+
+#ifdef CONFIG_RTNET_ADDON_PROXY
+    if (state == COLL_PROXY) {
+        __rtskb_push(skb, iph->ihl*4);
+        rt_ip_fallback_handler(skb);
+        proxy_fragments(orphans);
+        goto out;
     }
+#endif /* CONFIG_RTNET_ADDON_PROXY */
+
+#ifdef FRAG_DBG
+    rtdm_printk("RTnet: IP fragment dropped (saddr:%x, daddr:%x, reason:%d)\n",
+                iph->saddr, iph->daddr, reason);
+#endif
+    rtnet_count_drop(reason);
+    kfree_rtskb(skb);
+
+  out:
+    /* The socket is now implicitely locked by the collected rtskbs */
+    if (sock != NULL)
+        rt_socket_dereference(sock);
+
+    return complete;
 }
 
 
@@ -329,11 +590,28 @@ int __init rt_ip_fragment_init(void)
     int i;
 
 
-    /* Probably not needed (static variable...) */
-    memset(collector, 0, sizeof(collector));
+    for (i = 0; i < FRAG_HASH_SIZE; i++) {
+        frag_hash[i].chain = NULL;
+        rtdm_lock_init(&frag_hash[i].lock);
+    }
+
+    free_collectors = NULL;
+    for (i = 0; i < COLLECTOR_COUNT; i++) {
+        collector[i].next = free_collectors;
+        free_collectors   = &collector[i];
+    }
+
+    if (rtskb_pool_init(&frag_pool, frag_rtskbs) < frag_rtskbs)
+        printk("RTnet: IP fragment pool incomplete, out-of-order "
+               "fragments may be dropped\n");
+
+    if (frag_timeout == 0)
+        frag_timeout = 1;
 
-    for (i = 0; i < COLLECTOR_COUNT; i++)
-        rtdm_lock_init(&collector[i].frags.lock);
+    rtdm_timer_init(&frag_timer, frag_timer_proc, "RT IP fragment timer");
+    rtdm_timer_start(&frag_timer, (nanosecs_abs_t)frag_timeout * 250000,
+                     (nanosecs_rel_t)frag_timeout * 250000,
+                     RTDM_TIMERMODE_RELATIVE);
 
     return 0;
 }
@@ -342,5 +620,9 @@ int __init rt_ip_fragment_init(void)
 
 void rt_ip_fragment_cleanup(void)
 {
+    rtdm_timer_destroy(&frag_timer);
+
     cleanup_all_collectors();
+
+    rtskb_pool_release(&frag_pool);
 }
@@ -26,8 +26,11 @@
 
 #include <rtskb.h>
 #include <rtnet_socket.h>
+#include <rtnet_stats.h>
 #include <stack_mgr.h>
+#include <ipv4/ip_forward.h>
 #include <ipv4/ip_fragment.h>
+#include <ipv4/multicast.h>
 #include <ipv4/protocol.h>
 #include <ipv4/route.h>
 
@@ -77,6 +80,7 @@ static inline void rt_ip_local_deliver(struct rtskb *skb)
                     return;
                 }
 #endif
+                rtnet_count_drop(RTNET_DROP_IP_NO_SOCKET);
                 kfree_rtskb(skb);
                 return;
             }
@@ -88,6 +92,7 @@ static inline void rt_ip_local_deliver(struct rtskb *skb)
             rt_socket_dereference(sock);
 
             if (err) {
+                rtnet_count_drop(RTNET_DROP_IP_SOCKET_POOL);
                 kfree_rtskb(skb);
                 return;
             }
@@ -102,7 +107,7 @@ static inline void rt_ip_local_deliver(struct rtskb *skb)
         rt_ip_fallback_handler(skb);
 #endif /* CONFIG_RTNET_ADDON_PROXY */
     } else {
-        rtdm_printk("RTnet: no protocol found\n");
+        rtnet_count_drop(RTNET_DROP_IP_NO_PROTOCOL);
         kfree_rtskb(skb);
     }
 }
@@ -120,6 +125,8 @@ int rt_ip_rcv(struct rtskb *skb, struct rtpacket_type *pt)
     /* When the interface is in promisc. mode, drop all the crap
      * that it receives, do not try to analyse it.
      */
+    rtnet_trace(skb, RTNET_LAT_RX_PROTO);
+
     if (skb->pkt_type == PACKET_OTHERHOST)
         goto drop;
 
@@ -136,25 +143,40 @@ int rt_ip_rcv(struct rtskb *skb, struct rtpacket_type *pt)
      *  4.  Doesn't have a bogus length
      */
     if (iph->ihl < 5 || iph->version != 4)
-        goto drop;
+        goto bad_header;
 
     if ( ip_fast_csum((u8 *)iph, iph->ihl)!=0 )
-        goto drop;
+        goto bad_header;
 
     len = ntohs(iph->tot_len);
     if ( (skb->len<len) || (len<((__u32)iph->ihl<<2)) )
-        goto drop;
+        goto bad_header;
 
     rtskb_trim(skb, len);
 
+#ifdef CONFIG_RTNET_RTIPV4_MULTICAST
+    /* multicast is never forwarded, the NIC filter may be imperfect */
+    if (IN_MULTICAST(ntohl(iph->daddr))) {
+        if (!rt_ip_mc_check(skb->rtdev, iph->daddr)) {
+            rtnet_count_drop(RTNET_DROP_IP_MC_FILTER);
+            goto drop;
+        }
+        rt_ip_local_deliver(skb);
+        return 0;
+    }
+#endif /* CONFIG_RTNET_RTIPV4_MULTICAST */
+
 #ifdef CONFIG_RTNET_RTIPV4_ROUTER
-    if (rt_ip_route_forward(skb, iph->daddr))
+    if (rt_ip_forward(skb))
         return 0;
 #endif /* CONFIG_RTNET_RTIPV4_ROUTER */
 
     rt_ip_local_deliver(skb);
     return 0;
 
+  bad_header:
+    rtnet_count_drop(RTNET_DROP_IP_HEADER);
+
   drop:
     kfree_rtskb(skb);
     return 0;
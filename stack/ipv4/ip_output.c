@@ -22,36 +22,89 @@
  */
 
 #include <linux/ip.h>
+#include <linux/random.h>
 #include <net/checksum.h>
 #include <net/ip.h>
+#include <ethernet/eth.h>
 
 #include <rtnet_socket.h>
+#include <rtnet_stats.h>
 #include <stack_mgr.h>
 #include <ipv4/ip_fragment.h>
 #include <ipv4/ip_input.h>
+#include <ipv4/ip_output.h>
+#include <ipv4/neighbour.h>
 #include <ipv4/route.h>
 
 
-static rtdm_lock_t  rt_ip_id_lock  = RTDM_LOCK_UNLOCKED;
-static u16          rt_ip_id_count = 0;
+/* IDs of fragmented datagrams must not repeat towards a peer while their
+   fragments may still be reassembled. Instead of a single locked counter,
+   the counters are hashed by destination and protocol, so that senders to
+   different peers neither contend nor share cache lines. */
+#define RT_IP_IDENTS        256     /* must be power of 2 */
+
+static struct {
+    unsigned long   id;
+} ____cacheline_aligned_in_smp rt_ip_idents[RT_IP_IDENTS];
+
+
+
+/***
+ *  rt_ip_id_reserve - get the ID for a datagram which may be fragmented
+ */
+u16 rt_ip_id_reserve(u32 daddr, u8 protocol)
+{
+    u32                     key = ntohl(daddr) ^ protocol;
+    volatile unsigned long  *ident;
+    unsigned long           id;
+
+
+    key ^= key >> 16;
+    key ^= key >> 8;
+    ident = &rt_ip_idents[key & (RT_IP_IDENTS-1)].id;
+
+    do {
+        id = *ident;
+    } while (cmpxchg(ident, id, id + 1) != id);
+
+    return (u16)id;
+}
+EXPORT_SYMBOL(rt_ip_id_reserve);
+
+
+
+/***
+ *  rt_ip_atomic_id - get the ID for a datagram which is never fragmented
+ *
+ *  Datagrams with DF set are atomic in the sense of RFC 6864, their ID is not
+ *  used for reassembly and may repeat. The per-socket counter is therefore
+ *  incremented without any synchronisation.
+ */
+static inline u16 rt_ip_atomic_id(struct rtsocket *sk)
+{
+    return sk->prot.inet.ip_id++;
+}
+
 
 /***
  *  Slow path for fragmented packets
  */
 int rt_ip_build_xmit_slow(struct rtsocket *sk,
-        int getfrag(const void *, char *, unsigned int, unsigned int),
+        int getfrag(const void *, char *, unsigned int, unsigned int,
+                    struct rtskb *),
         const void *frag, unsigned length, struct dest_route *rt,
         int msg_flags, unsigned int mtu, unsigned int prio)
 {
     int             err, next_err;
     struct rtskb    *skb;
     struct rtskb    *next_skb;
+    struct rtskb_queue pending;     /* fragments for an unresolved next hop */
+    unsigned int    pending_count = 0;
     struct          iphdr *iph;
     struct          rtnet_device *rtdev = rt->rtdev;
     unsigned int    fragdatalen;
     unsigned int    offset = 0;
     u16             msg_rt_ip_id;
-    rtdm_lockctx_t  context;
     unsigned int    rtskb_size;
     int             hh_len = (rtdev->hard_header_len + 15) & ~15;
 
@@ -60,13 +113,13 @@ int rt_ip_build_xmit_slow(struct rtsocket *sk,
 
     fragdatalen  = ((mtu - FRAGHEADERLEN) & ~7);
 
-    /* Store id in local variable */
-    rtdm_lock_get_irqsave(&rt_ip_id_lock, context);
-    msg_rt_ip_id = rt_ip_id_count++;
-    rtdm_lock_put_irqrestore(&rt_ip_id_lock, context);
+    /* all fragments share the id */
+    msg_rt_ip_id = rt_ip_id_reserve(rt->ip, sk->protocol);
 
     rtskb_size = mtu + hh_len + 15;
 
+    rtskb_queue_init(&pending);
+
     /* TODO: delay previous skb until ALL errors are catched which may occure
              during next skb setup */
 
@@ -74,6 +127,7 @@ int rt_ip_build_xmit_slow(struct rtsocket *sk,
     skb = alloc_rtskb(rtskb_size, &sk->skb_pool);
     if (skb == NULL)
         return -ENOBUFS;
+    rtnet_trace_start(skb, rtdm_clock_read());
 
     for (offset = 0; offset < length; offset += fragdatalen)
     {
@@ -98,7 +152,8 @@ int rt_ip_build_xmit_slow(struct rtsocket *sk,
             if (next_skb == NULL) {
                 frag_off &= ~IP_MF; /* cut the chain */
                 next_err = -ENOBUFS;
-            }
+            } else
+                rtnet_trace_start(next_skb, rtdm_clock_read());
         }
 
         rtskb_reserve(skb, hh_len);
@@ -121,17 +176,24 @@ int rt_ip_build_xmit_slow(struct rtsocket *sk,
         iph->check    = ip_fast_csum((unsigned char *)iph, 5 /*iph->ihl*/);
 
         if ( (err=getfrag(frag, ((char *)iph) + 5 /*iph->ihl*/ * 4, offset,
-                          fraglen - FRAGHEADERLEN)) )
+                          fraglen - FRAGHEADERLEN, skb)) )
             goto error;
 
-        if (rtdev->hard_header) {
-            err = rtdev->hard_header(skb, rtdev, ETH_P_IP, rt->dev_addr,
-                                     rtdev->dev_addr, skb->len);
-            if (err < 0)
-                goto error;
-        }
+        if (unlikely(rt->neigh != 0)) {
+            /* next hop still being resolved, queued as a whole below */
+            __rtskb_queue_tail(&pending, skb);
+            pending_count++;
+            err = 0;
+        } else {
+            if (rtdev->hard_header) {
+                err = rtdev->hard_header(skb, rtdev, ETH_P_IP, rt->dev_addr,
+                                         rtdev->dev_addr, skb->len);
+                if (err < 0)
+                    goto error;
+            }
 
-        err = rtdev_xmit(skb);
+            err = rtdev_xmit(skb);
+        }
 
         skb = next_skb;
 
@@ -140,9 +202,16 @@ int rt_ip_build_xmit_slow(struct rtsocket *sk,
             goto error;
         }
 
-        if (next_err != 0)
-            return next_err;
+        if (next_err != 0) {
+            err = next_err;
+            goto drop_pending;
+        }
     }
+
+    /* consumes the fragments */
+    if (pending_count > 0)
+        return rt_neigh_queue_list(&pending, pending_count, rt);
+
     return 0;
 
   error:
@@ -152,16 +221,41 @@ int rt_ip_build_xmit_slow(struct rtsocket *sk,
         if (next_skb != NULL)
             kfree_rtskb(next_skb);
     }
+
+  drop_pending:
+    while ((skb = __rtskb_dequeue(&pending)) != NULL)
+        kfree_rtskb(skb);
     return err;
 }
 
 
 
+/***
+ *  rt_ip_xmit_mtu - MTU and link layer headroom for a transmission
+ */
+static inline unsigned int rt_ip_xmit_mtu(struct rtsocket *sk,
+                                          struct rtnet_device *rtdev,
+                                          unsigned int prio, int *hh_len)
+{
+    unsigned int mtu = rtdev->get_mtu(rtdev, prio);
+
+    /* do not build frames exceeding the rtskbs of the socket pool, e.g. when
+       the device uses jumbo frames */
+    *hh_len = (rtdev->hard_header_len+15)&~15;
+    if (mtu > rtskb_pool_max_size(&sk->skb_pool) - *hh_len - 15)
+        mtu = rtskb_pool_max_size(&sk->skb_pool) - *hh_len - 15;
+
+    return mtu;
+}
+
+
+
 /***
  *  Fast path for unfragmented packets.
  */
 int rt_ip_build_xmit(struct rtsocket *sk,
-        int getfrag(const void *, char *, unsigned int, unsigned int),
+        int getfrag(const void *, char *, unsigned int, unsigned int,
+                    struct rtskb *),
         const void *frag, unsigned length, struct dest_route *rt,
         int msg_flags)
 {
@@ -170,7 +264,6 @@ int rt_ip_build_xmit(struct rtsocket *sk,
     struct iphdr            *iph;
     int                     hh_len;
     u16                     msg_rt_ip_id;
-    rtdm_lockctx_t          context;
     struct  rtnet_device    *rtdev = rt->rtdev;
     unsigned int            prio;
     unsigned int            mtu;
@@ -180,7 +273,7 @@ int rt_ip_build_xmit(struct rtsocket *sk,
        we use a consitent value, also for the MTU which is derived from the
        channel. */
     prio = (volatile unsigned int)sk->priority;
-    mtu = rtdev->get_mtu(rtdev, prio);
+    mtu = rt_ip_xmit_mtu(sk, rtdev, prio, &hh_len);
 
     /*
      *  Try the simple case first. This leaves fragmented frames, and by choice
@@ -193,16 +286,12 @@ int rt_ip_build_xmit(struct rtsocket *sk,
                                      length - sizeof(struct iphdr),
                                      rt, msg_flags, mtu, prio);
 
-    /* Store id in local variable */
-    rtdm_lock_get_irqsave(&rt_ip_id_lock, context);
-    msg_rt_ip_id = rt_ip_id_count++;
-    rtdm_lock_put_irqrestore(&rt_ip_id_lock, context);
-
-    hh_len = (rtdev->hard_header_len+15)&~15;
+    msg_rt_ip_id = rt_ip_atomic_id(sk);
 
     skb = alloc_rtskb(length+hh_len+15, &sk->skb_pool);
     if (skb==NULL)
         return -ENOBUFS;
+    rtnet_trace_start(skb, rtdm_clock_read());
 
     rtskb_reserve(skb, hh_len);
 
@@ -224,11 +313,211 @@ int rt_ip_build_xmit(struct rtsocket *sk,
     iph->check    = ip_fast_csum((unsigned char *)iph, 5 /*iph->ihl*/);
 
     if ( (err=getfrag(frag, ((char *)iph) + 5 /*iph->ihl*/ * 4, 0,
-                      length - 5 /*iph->ihl*/ * 4)) )
+                      length - 5 /*iph->ihl*/ * 4, skb)) )
         goto error;
 
-    if (rtdev->hard_header) {
-        err = rtdev->hard_header(skb, rtdev, ETH_P_IP, rt->dev_addr,
+    if (unlikely(rt->neigh != 0))
+        /* next hop still being resolved, consumes skb */
+        err = rt_neigh_queue(skb, rt);
+    else {
+        if (rtdev->hard_header) {
+            err = rtdev->hard_header(skb, rtdev, ETH_P_IP, rt->dev_addr,
+                                     rtdev->dev_addr, skb->len);
+            if (err < 0)
+                goto error;
+        }
+
+        err = rtdev_xmit(skb);
+    }
+
+    if (err)
+        return -EAGAIN;
+    else
+        return 0;
+
+  error:
+    kfree_rtskb(skb);
+    return err;
+}
+EXPORT_SYMBOL(rt_ip_build_xmit);
+
+
+
+/***
+ *  rt_ip_xmit_cache_fill - remember the output path of a connected socket
+ *  @sk:         socket
+ *  @rt:         route as returned by rt_ip_route_output
+ *  @generation: rt_ip_route_generation read before the route lookup
+ *  @epoch:      cache epoch as returned by a failed rt_ip_xmit_cache_hold
+ *  @sport:      source port of the transport header
+ *  @dport:      destination port of the transport header
+ */
+void rt_ip_xmit_cache_fill(struct rtsocket *sk, struct dest_route *rt,
+                           unsigned long generation, unsigned int epoch,
+                           u16 sport, u16 dport)
+{
+    struct rt_ip_xmit_cache *cache = &sk->prot.inet.xmit_cache;
+    struct rtnet_device     *rtdev = rt->rtdev;
+    struct ethhdr           *eth;
+    unsigned int            prio;
+    int                     hh_len;
+    rtdm_lockctx_t          context;
+
+
+    /* the link layer address is not known yet */
+    if (rt->neigh != 0)
+        return;
+
+    prio = (volatile unsigned int)sk->priority;
+
+    rtdm_lock_get_irqsave(&sk->param_lock, context);
+
+    /* socket was rebound meanwhile, rt may be outdated */
+    if (cache->epoch != epoch) {
+        rtdm_lock_put_irqrestore(&sk->param_lock, context);
+        return;
+    }
+
+    cache->generation = generation;
+    cache->rt         = *rt;
+    cache->priority   = prio;
+    cache->mtu        = rt_ip_xmit_mtu(sk, rtdev, prio, &hh_len);
+    cache->hh_len     = hh_len;
+    cache->sport      = sport;
+    cache->dport      = dport;
+
+    /* the Ethernet header does not depend on the packet, other link layers
+       still build theirs per packet */
+    cache->link_len = 0;
+    if ((rtdev->hard_header == rt_eth_header) &&
+        (rtdev->hard_header_len == ETH_HLEN)) {
+        eth = (struct ethhdr *)cache->link_hdr;
+
+        if (rtdev->flags & (IFF_LOOPBACK|IFF_NOARP))
+            memset(eth->h_dest, 0, ETH_ALEN);
+        else
+            memcpy(eth->h_dest, rt->dev_addr, ETH_ALEN);
+        memcpy(eth->h_source, rtdev->dev_addr, ETH_ALEN);
+        eth->h_proto = htons(ETH_P_IP);
+
+        cache->link_len = ETH_HLEN;
+    }
+
+    memset(&cache->iph, 0, sizeof(struct iphdr));
+    cache->iph.version  = 4;
+    cache->iph.ihl      = 5;
+    cache->iph.tos      = sk->prot.inet.tos;
+    cache->iph.frag_off = htons(IP_DF);
+    cache->iph.ttl      = 255;
+    cache->iph.protocol = sk->protocol;
+    cache->iph.saddr    = rtdev->local_ip;
+    cache->iph.daddr    = rt->ip;
+    cache->iph_csum     = csum_partial((unsigned char *)&cache->iph,
+                                       sizeof(struct iphdr), 0);
+
+    cache->valid = 1;
+
+    rtdm_lock_put_irqrestore(&sk->param_lock, context);
+}
+EXPORT_SYMBOL(rt_ip_xmit_cache_fill);
+
+
+
+/***
+ *  rt_ip_xmit_cache_hold - obtain the cached output path of a socket
+ *  @sk:     socket
+ *  @length: transport layer length of the packet to send
+ *  @tmpl:   returns a copy of the cache entry, tmpl->rt.rtdev is referenced
+ *
+ *  Returns -ESTALE if there is no valid entry or the packet would have to be
+ *  fragmented. The caller then takes the regular path and may refill the
+ *  cache, passing tmpl->epoch to rt_ip_xmit_cache_fill.
+ */
+int rt_ip_xmit_cache_hold(struct rtsocket *sk, unsigned int length,
+                          struct rt_ip_xmit_cache *tmpl)
+{
+    struct rt_ip_xmit_cache *cache = &sk->prot.inet.xmit_cache;
+    rtdm_lockctx_t          context;
+
+
+    rtdm_lock_get_irqsave(&sk->param_lock, context);
+
+    tmpl->epoch = cache->epoch;
+
+    if (!cache->valid || (cache->priority != sk->priority) ||
+        (cache->iph.tos != sk->prot.inet.tos) ||
+        (length + sizeof(struct iphdr) > cache->mtu)) {
+        rtdm_lock_put_irqrestore(&sk->param_lock, context);
+        return -ESTALE;
+    }
+
+    *tmpl = *cache;
+
+    rtdm_lock_put_irqrestore(&sk->param_lock, context);
+
+    if (rt_ip_route_hold(&tmpl->rt, tmpl->generation) < 0) {
+        rtdm_lock_get_irqsave(&sk->param_lock, context);
+        if (cache->epoch == tmpl->epoch)
+            cache->valid = 0;
+        rtdm_lock_put_irqrestore(&sk->param_lock, context);
+        return -ESTALE;
+    }
+
+    return 0;
+}
+EXPORT_SYMBOL(rt_ip_xmit_cache_hold);
+
+
+
+/***
+ *  rt_ip_build_xmit_cached - send an unfragmented packet using a template
+ *  @tmpl: cache entry obtained via rt_ip_xmit_cache_hold
+ *
+ *  Only the length, the ID, and the header checksum are set per packet.
+ */
+int rt_ip_build_xmit_cached(struct rtsocket *sk,
+        int getfrag(const void *, char *, unsigned int, unsigned int,
+                    struct rtskb *),
+        const void *frag, unsigned length, struct rt_ip_xmit_cache *tmpl,
+        int msg_flags)
+{
+    int                     err = 0;
+    struct rtskb            *skb;
+    struct iphdr            *iph;
+    u16                     msg_rt_ip_id;
+    struct  rtnet_device    *rtdev = tmpl->rt.rtdev;
+
+
+    length += sizeof(struct iphdr);
+
+    msg_rt_ip_id = rt_ip_atomic_id(sk);
+
+    skb = alloc_rtskb(length+tmpl->hh_len+15, &sk->skb_pool);
+    if (skb==NULL)
+        return -ENOBUFS;
+    rtnet_trace_start(skb, rtdm_clock_read());
+
+    rtskb_reserve(skb, tmpl->hh_len);
+
+    skb->rtdev    = rtdev;
+    skb->nh.iph   = iph = (struct iphdr *) rtskb_put(skb, length);
+    skb->priority = tmpl->priority;
+
+    memcpy(iph, &tmpl->iph, sizeof(struct iphdr));
+    iph->tot_len  = htons(length);
+    iph->id       = htons(msg_rt_ip_id);
+    iph->check    = csum_fold(csum_add(tmpl->iph_csum,
+                                       iph->tot_len + iph->id));
+
+    if ( (err=getfrag(frag, ((char *)iph) + 5 /*iph->ihl*/ * 4, 0,
+                      length - 5 /*iph->ihl*/ * 4, skb)) )
+        goto error;
+
+    if (tmpl->link_len > 0) {
+        skb->mac.raw = rtskb_push(skb, tmpl->link_len);
+        memcpy(skb->mac.raw, tmpl->link_hdr, tmpl->link_len);
+    } else if (rtdev->hard_header) {
+        err = rtdev->hard_header(skb, rtdev, ETH_P_IP, tmpl->rt.dev_addr,
                                  rtdev->dev_addr, skb->len);
         if (err < 0)
             goto error;
@@ -245,7 +534,7 @@ int rt_ip_build_xmit(struct rtsocket *sk,
     kfree_rtskb(skb);
     return err;
 }
-EXPORT_SYMBOL(rt_ip_build_xmit);
+EXPORT_SYMBOL(rt_ip_build_xmit_cached);
 
 
 
@@ -264,6 +553,9 @@ static struct rtpacket_type ip_packet_type = {
  */
 void __init rt_ip_init(void)
 {
+    /* do not start all peers at the same, predictable ID */
+    get_random_bytes(rt_ip_idents, sizeof(rt_ip_idents));
+
     rtdev_add_pack(&ip_packet_type);
     rt_ip_fragment_init();
 }
@@ -276,5 +568,8 @@ void __init rt_ip_init(void)
 void rt_ip_release(void)
 {
     rt_ip_fragment_cleanup();
-    rtdev_remove_pack(&ip_packet_type);
+    while (rtdev_remove_pack(&ip_packet_type) == -EAGAIN) {
+        set_current_state(TASK_UNINTERRUPTIBLE);
+        schedule_timeout(1);
+    }
 }
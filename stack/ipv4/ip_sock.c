@@ -26,6 +26,7 @@
 #include <linux/in.h>
 
 #include <rtnet_socket.h>
+#include <ipv4/multicast.h>
 
 
 int rt_ip_setsockopt(struct rtsocket *s, int level, int optname,
@@ -45,6 +46,12 @@ int rt_ip_setsockopt(struct rtsocket *s, int level, int optname,
             s->prot.inet.tos = *(unsigned int *)optval;
             break;
 
+        case IP_ADD_MEMBERSHIP:
+        case IP_DROP_MEMBERSHIP:
+        case IP_MULTICAST_IF:
+            err = rt_ip_mc_setsockopt(s, optname, optval, optlen);
+            break;
+
         default:
             err = -ENOPROTOOPT;
             break;
@@ -70,6 +77,10 @@ int rt_ip_getsockopt(struct rtsocket *s, int level, int optname,
             *optlen = sizeof(unsigned int);
             break;
 
+        case IP_MULTICAST_IF:
+            err = rt_ip_mc_getsockopt(s, optname, optval, optlen);
+            break;
+
         default:
             err = -ENOPROTOOPT;
             break;
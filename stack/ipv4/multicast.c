@@ -0,0 +1,397 @@
+/***
+ *
+ *  ipv4/multicast.c - IPv4 multicast group membership
+ *
+ *  Groups are joined statically by the sockets (IP_ADD_MEMBERSHIP) from
+ *  non-real-time context. The station-wide group table is consulted by the
+ *  receive path, the link layer addresses of the joined groups are programmed
+ *  into the receive filter of the NIC via rtdev_mc_add.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/in.h>
+#include <linux/socket.h>
+
+#include <rtdev.h>
+#include <rtnet_internal.h>
+#include <rtnet_socket.h>
+#include <ipv4/ip_output.h>
+#include <ipv4/multicast.h>
+#include <ipv4/route.h>
+
+
+struct mc_group {
+    int                 ifindex;    /* 0: unused entry */
+    u32                 group;
+    unsigned int        users;
+};
+
+static struct mc_group      mc_groups[RT_IP_MC_GROUPS];
+static rtdm_lock_t          mc_groups_lock = RTDM_LOCK_UNLOCKED;
+
+/* serialises joins and leaves, including the per-socket slots */
+static DEFINE_MUTEX(mc_nrt_lock);
+
+
+
+/***
+ *  rt_ip_mc_check - check if a group was joined on a device
+ *
+ *  Called from the receive path.
+ */
+int rt_ip_mc_check(struct rtnet_device *rtdev, u32 group)
+{
+    rtdm_lockctx_t      context;
+    int                 i;
+    int                 ret = 0;
+
+
+    rtdm_lock_get_irqsave(&mc_groups_lock, context);
+
+    for (i = 0; i < RT_IP_MC_GROUPS; i++)
+        if ((mc_groups[i].group == group) &&
+            (mc_groups[i].ifindex == rtdev->ifindex)) {
+            ret = 1;
+            break;
+        }
+
+    rtdm_lock_put_irqrestore(&mc_groups_lock, context);
+
+    return ret;
+}
+
+
+
+/***
+ *  rt_ip_mc_dev - find the device to use for a group
+ *  @addr: local address of the device, INADDR_ANY selects the first device
+ *         which is up, not the loopback and has an address assigned
+ *
+ *  Note: increments refcount on the returned rtdev
+ */
+static struct rtnet_device *rt_ip_mc_dev(u32 addr)
+{
+    struct rtnet_device *rtdev;
+    int                 i;
+
+
+    for (i = 1; i <= MAX_RT_DEVICES; i++) {
+        rtdev = rtdev_get_by_index(i);
+        if (rtdev == NULL)
+            continue;
+
+        if (addr != INADDR_ANY) {
+            if (rtdev->local_ip == addr)
+                return rtdev;
+        } else if ((rtdev->flags & IFF_UP) &&
+                   !(rtdev->flags & IFF_LOOPBACK) &&
+                   (rtdev->local_ip != INADDR_ANY))
+            return rtdev;
+
+        rtdev_dereference(rtdev);
+    }
+
+    return NULL;
+}
+
+
+
+/***
+ *  rt_ip_route_output_mc - output route of a multicast datagram
+ *  @saddr: source address, selects the output device if set
+ *
+ *  Multicast destinations are not listed in the routing tables, the datagram
+ *  is sent directly to the group address.
+ *
+ *  Note: increments refcount on returned rtdev in rt_buf
+ */
+int rt_ip_route_output_mc(struct dest_route *rt_buf, u32 daddr, u32 saddr)
+{
+    struct rtnet_device *rtdev;
+
+
+    rtdev = rt_ip_mc_dev(saddr);
+    if (rtdev == NULL)
+        return -EHOSTUNREACH;
+
+    rt_ip_mc_map(daddr, rt_buf->dev_addr);
+    rt_buf->rtdev = rtdev;
+    rt_buf->ip    = daddr;
+
+    return 0;
+}
+
+
+
+static int rt_ip_mc_join(struct rtnet_device *rtdev, u32 group)
+{
+    unsigned char       mac[ETH_ALEN];
+    rtdm_lockctx_t      context;
+    int                 i, free = -1;
+    int                 ret;
+
+
+    for (i = 0; i < RT_IP_MC_GROUPS; i++) {
+        if ((mc_groups[i].group == group) &&
+            (mc_groups[i].ifindex == rtdev->ifindex)) {
+            mc_groups[i].users++;
+            return 0;
+        }
+        if ((mc_groups[i].ifindex == 0) && (free < 0))
+            free = i;
+    }
+
+    if (free < 0)
+        return -ENOBUFS;
+
+    rt_ip_mc_map(group, mac);
+    ret = rtdev_mc_add(rtdev, mac);
+    if (ret < 0)
+        return ret;
+
+    rtdm_lock_get_irqsave(&mc_groups_lock, context);
+    mc_groups[free].group   = group;
+    mc_groups[free].ifindex = rtdev->ifindex;
+    mc_groups[free].users   = 1;
+    rtdm_lock_put_irqrestore(&mc_groups_lock, context);
+
+    return 0;
+}
+
+
+
+static void rt_ip_mc_leave(int ifindex, u32 group)
+{
+    struct rtnet_device *rtdev;
+    unsigned char       mac[ETH_ALEN];
+    rtdm_lockctx_t      context;
+    int                 i;
+
+
+    for (i = 0; i < RT_IP_MC_GROUPS; i++)
+        if ((mc_groups[i].group == group) &&
+            (mc_groups[i].ifindex == ifindex))
+            break;
+
+    if ((i == RT_IP_MC_GROUPS) || (--mc_groups[i].users > 0))
+        return;
+
+    rtdm_lock_get_irqsave(&mc_groups_lock, context);
+    mc_groups[i].ifindex = 0;
+    mc_groups[i].group   = INADDR_ANY;
+    rtdm_lock_put_irqrestore(&mc_groups_lock, context);
+
+    /* the device may have been unregistered meanwhile */
+    rtdev = rtdev_get_by_index(ifindex);
+    if (rtdev != NULL) {
+        rt_ip_mc_map(group, mac);
+        rtdev_mc_del(rtdev, mac);
+        rtdev_dereference(rtdev);
+    }
+}
+
+
+
+static int rt_ip_mc_add_membership(struct rtsocket *sock,
+                                   const struct ip_mreq *mreq)
+{
+    struct rtnet_device *rtdev;
+    u32                 group = mreq->imr_multiaddr.s_addr;
+    int                 i, free = -1;
+    int                 ret;
+
+
+    if (!IN_MULTICAST(ntohl(group)))
+        return -EINVAL;
+
+    rtdev = rt_ip_mc_dev(mreq->imr_interface.s_addr);
+    if (rtdev == NULL)
+        return -ENODEV;
+
+    mutex_lock(&mc_nrt_lock);
+
+    for (i = 0; i < RT_IP_MC_SOCK_GROUPS; i++) {
+        if ((sock->prot.inet.mc_groups[i].group == group) &&
+            (sock->prot.inet.mc_groups[i].ifindex == rtdev->ifindex)) {
+            ret = -EADDRINUSE;
+            goto out;
+        }
+        if ((sock->prot.inet.mc_groups[i].ifindex == 0) && (free < 0))
+            free = i;
+    }
+
+    if (free < 0) {
+        ret = -ENOBUFS;
+        goto out;
+    }
+
+    ret = rt_ip_mc_join(rtdev, group);
+    if (ret == 0) {
+        sock->prot.inet.mc_groups[free].group   = group;
+        sock->prot.inet.mc_groups[free].ifindex = rtdev->ifindex;
+    }
+
+  out:
+    mutex_unlock(&mc_nrt_lock);
+
+    rtdev_dereference(rtdev);
+
+    return ret;
+}
+
+
+
+static int rt_ip_mc_drop_membership(struct rtsocket *sock,
+                                    const struct ip_mreq *mreq)
+{
+    u32                 group = mreq->imr_multiaddr.s_addr;
+    u32                 addr  = mreq->imr_interface.s_addr;
+    struct rtnet_device *rtdev;
+    int                 i;
+    int                 ret = -EADDRNOTAVAIL;
+
+
+    mutex_lock(&mc_nrt_lock);
+
+    for (i = 0; i < RT_IP_MC_SOCK_GROUPS; i++) {
+        if ((sock->prot.inet.mc_groups[i].ifindex == 0) ||
+            (sock->prot.inet.mc_groups[i].group != group))
+            continue;
+
+        /* INADDR_ANY drops the group on whatever device it was joined */
+        if (addr != INADDR_ANY) {
+            rtdev = rtdev_get_by_index(sock->prot.inet.mc_groups[i].ifindex);
+            if (rtdev == NULL)
+                continue;
+            ret = (rtdev->local_ip == addr);
+            rtdev_dereference(rtdev);
+            if (!ret) {
+                ret = -EADDRNOTAVAIL;
+                continue;
+            }
+        }
+
+        rt_ip_mc_leave(sock->prot.inet.mc_groups[i].ifindex, group);
+        sock->prot.inet.mc_groups[i].ifindex = 0;
+        sock->prot.inet.mc_groups[i].group   = INADDR_ANY;
+        ret = 0;
+        break;
+    }
+
+    mutex_unlock(&mc_nrt_lock);
+
+    return ret;
+}
+
+
+
+/***
+ *  rt_ip_mc_setsockopt - IP_ADD_MEMBERSHIP, IP_DROP_MEMBERSHIP and
+ *                        IP_MULTICAST_IF
+ *
+ *  Changing the group memberships requires non-real-time context. Only UDP
+ *  sockets set up and release their multicast state (rt_ip_mc_socket_init,
+ *  rt_ip_mc_socket_cleanup), other protocols are rejected.
+ */
+int rt_ip_mc_setsockopt(struct rtsocket *sock, int optname,
+                        const void *optval, socklen_t optlen)
+{
+    if (sock->protocol != IPPROTO_UDP)
+        return -ENOPROTOOPT;
+
+    switch (optname) {
+        case IP_ADD_MEMBERSHIP:
+        case IP_DROP_MEMBERSHIP:
+            if (optlen < sizeof(struct ip_mreq))
+                return -EINVAL;
+
+            if (rtdm_in_rt_context())
+                return -ENOSYS;
+
+            if (optname == IP_ADD_MEMBERSHIP)
+                return rt_ip_mc_add_membership(sock, optval);
+            else
+                return rt_ip_mc_drop_membership(sock, optval);
+
+        case IP_MULTICAST_IF:
+            if (optlen < sizeof(struct in_addr))
+                return -EINVAL;
+
+            sock->prot.inet.mc_if = ((struct in_addr *)optval)->s_addr;
+            rt_ip_xmit_cache_invalidate(sock);
+            return 0;
+
+        default:
+            return -ENOPROTOOPT;
+    }
+}
+EXPORT_SYMBOL(rt_ip_mc_setsockopt);
+
+
+
+int rt_ip_mc_getsockopt(struct rtsocket *sock, int optname,
+                        void *optval, socklen_t *optlen)
+{
+    if (sock->protocol != IPPROTO_UDP)
+        return -ENOPROTOOPT;
+
+    switch (optname) {
+        case IP_MULTICAST_IF:
+            if (*optlen < sizeof(struct in_addr))
+                return -EINVAL;
+
+            ((struct in_addr *)optval)->s_addr = sock->prot.inet.mc_if;
+            *optlen = sizeof(struct in_addr);
+            return 0;
+
+        default:
+            return -ENOPROTOOPT;
+    }
+}
+EXPORT_SYMBOL(rt_ip_mc_getsockopt);
+
+
+
+void rt_ip_mc_socket_init(struct rtsocket *sock)
+{
+    sock->prot.inet.mc_if = INADDR_ANY;
+    memset(sock->prot.inet.mc_groups, 0, sizeof(sock->prot.inet.mc_groups));
+}
+EXPORT_SYMBOL(rt_ip_mc_socket_init);
+
+
+
+/***
+ *  rt_ip_mc_socket_cleanup - leave all groups of a closing socket
+ */
+void rt_ip_mc_socket_cleanup(struct rtsocket *sock)
+{
+    int i;
+
+
+    mutex_lock(&mc_nrt_lock);
+
+    for (i = 0; i < RT_IP_MC_SOCK_GROUPS; i++)
+        if (sock->prot.inet.mc_groups[i].ifindex != 0) {
+            rt_ip_mc_leave(sock->prot.inet.mc_groups[i].ifindex,
+                           sock->prot.inet.mc_groups[i].group);
+            sock->prot.inet.mc_groups[i].ifindex = 0;
+        }
+
+    mutex_unlock(&mc_nrt_lock);
+}
+EXPORT_SYMBOL(rt_ip_mc_socket_cleanup);
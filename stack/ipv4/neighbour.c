@@ -0,0 +1,925 @@
+/***
+ *
+ *  ipv4/neighbour.c - asynchronous address resolution
+ *
+ *  Host routes double as the ARP cache. Routes learned by resolution are
+ *  tracked as neighbours: a miss of the output route starts the resolution
+ *  of the next hop without blocking the sender, and a few packets are queued
+ *  until the reply arrives. Resolved neighbours are probed by unicast
+ *  requests before they expire, so the host route of a live peer is
+ *  refreshed in the background. Requests are sent by a dedicated task, the
+ *  real-time paths only update the table. Host routes that were added
+ *  manually are never tracked and never expire.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/in.h>
+#include <linux/moduleparam.h>
+#include <linux/proc_fs.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+
+#include <rtdev.h>
+#include <rtnet_internal.h>
+#include <rtnet_port.h>
+#include <rtnet_stats.h>
+#include <ipv4/af_inet.h>
+#include <ipv4/arp.h>
+#include <ipv4/neighbour.h>
+#include <ipv4/route.h>
+
+static unsigned int neigh_reachable = 60000;
+static unsigned int neigh_retrans   = 1000;
+static unsigned int neigh_probes    = 3;
+static unsigned int neigh_queue_len = 4;
+static unsigned int neigh_prio      = RTDM_TASK_LOWEST_PRIORITY;
+
+module_param(neigh_reachable, uint, 0444);
+module_param(neigh_retrans, uint, 0444);
+module_param(neigh_probes, uint, 0444);
+module_param(neigh_queue_len, uint, 0444);
+module_param(neigh_prio, uint, 0444);
+MODULE_PARM_DESC(neigh_reachable, "ms until a resolved neighbour is probed, "
+                 "0: never (default: 60000)");
+MODULE_PARM_DESC(neigh_retrans, "ms between ARP requests (default: 1000)");
+MODULE_PARM_DESC(neigh_probes, "ARP requests before a neighbour is given up "
+                 "(default: 3)");
+MODULE_PARM_DESC(neigh_queue_len, "packets queued per unresolved neighbour "
+                 "(default: 4)");
+MODULE_PARM_DESC(neigh_prio, "priority of the resolution task "
+                 "(default: lowest real-time priority)");
+
+struct rt_neighbour {
+    u32                 addr;
+    struct rtnet_device *rtdev;     /* not referenced, flushed on ifdown */
+    enum rt_neigh_state state;
+    unsigned int        probes;     /* requests sent in the current state */
+    nanosecs_abs_t      timeout;    /* next transition, 0: none */
+    unsigned char       dev_addr[MAX_ADDR_LEN];
+    struct rtskb_queue  pending;    /* packets awaiting the resolution */
+    unsigned int        pending_len;
+};
+
+enum rt_neigh_action {
+    NEIGH_ACT_NONE,
+    NEIGH_ACT_SOLICIT,              /* broadcast request */
+    NEIGH_ACT_PROBE,                /* unicast request to the known address */
+    NEIGH_ACT_EXPIRE                /* remove the host route */
+};
+
+static struct rt_neighbour  neighbours[RT_NEIGH_ENTRIES];
+static rtdm_lock_t          neigh_lock = RTDM_LOCK_UNLOCKED;
+
+static rtdm_event_t         neigh_event;
+static rtdm_task_t          neigh_task;
+
+
+#define rt_neigh_ms(ms)     ((nanosecs_rel_t)(ms) * 1000000)
+
+
+
+/***
+ *  rt_neigh_find - look up a neighbour, any device if @rtdev is NULL
+ *
+ *  Note: must be called with neigh_lock held
+ */
+static struct rt_neighbour *rt_neigh_find(u32 addr,
+                                          struct rtnet_device *rtdev)
+{
+    struct rt_neighbour *neigh;
+    int                 i;
+
+
+    for (i = 0; i < RT_NEIGH_ENTRIES; i++) {
+        neigh = &neighbours[i];
+        if ((neigh->state != RT_NEIGH_NONE) && (neigh->addr == addr) &&
+            ((rtdev == NULL) || (neigh->rtdev == rtdev)))
+            return neigh;
+    }
+
+    return NULL;
+}
+
+
+
+/***
+ *  rt_neigh_create - start the resolution of a new neighbour
+ *
+ *  Note: must be called with neigh_lock held
+ */
+static struct rt_neighbour *rt_neigh_create(u32 addr,
+                                            struct rtnet_device *rtdev)
+{
+    struct rt_neighbour *neigh;
+    int                 i;
+
+
+    for (i = 0; i < RT_NEIGH_ENTRIES; i++) {
+        neigh = &neighbours[i];
+        if (neigh->state != RT_NEIGH_NONE)
+            continue;
+
+        neigh->addr        = addr;
+        neigh->rtdev       = rtdev;
+        neigh->state       = RT_NEIGH_INCOMPLETE;
+        neigh->probes      = 0;
+        neigh->timeout     = rtdm_clock_read();
+        neigh->pending_len = 0;
+
+        return neigh;
+    }
+
+    return NULL;
+}
+
+
+
+/***
+ *  rt_neigh_take_pending - detach the queued packets of a neighbour
+ *
+ *  Note: must be called with neigh_lock held
+ */
+static struct rtskb *rt_neigh_take_pending(struct rt_neighbour *neigh)
+{
+    struct rtskb *skb = neigh->pending.first;
+
+
+    neigh->pending.first = NULL;
+    neigh->pending.last  = NULL;
+    neigh->pending_len   = 0;
+
+    return skb;
+}
+
+
+
+/***
+ *  rt_neigh_free - release an entry, returns its queued packets
+ *
+ *  Note: must be called with neigh_lock held
+ */
+static struct rtskb *rt_neigh_free(struct rt_neighbour *neigh)
+{
+    neigh->state = RT_NEIGH_NONE;
+
+    return rt_neigh_take_pending(neigh);
+}
+
+
+
+static void rt_neigh_drop(struct rtskb *skb)
+{
+    struct rtskb *next;
+
+
+    while (skb != NULL) {
+        next = skb->next;
+        skb->next = NULL;
+
+        rtnet_count_drop(RTNET_DROP_NEIGH_FAILED);
+        kfree_rtskb(skb);
+
+        skb = next;
+    }
+}
+
+
+
+static int rt_neigh_xmit(struct rtskb *skb, unsigned char *dev_addr)
+{
+    struct rtnet_device *rtdev = skb->rtdev;
+
+
+    if (rtdev->hard_header &&
+        (rtdev->hard_header(skb, rtdev, ETH_P_IP, dev_addr, rtdev->dev_addr,
+                            skb->len) < 0)) {
+        kfree_rtskb(skb);
+        return -EINVAL;
+    }
+
+    return rtdev_xmit(skb);
+}
+
+
+
+/* host part of the subnet of a device in host order */
+static inline u32 rt_neigh_host_mask(struct rtnet_device *rtdev)
+{
+    return ~ntohl(rtdev->netmask);
+}
+
+
+
+/***
+ *  rt_neigh_output_dev - find the device whose subnet contains @addr
+ *
+ *  Returns the device with the longest matching subnet, referenced.
+ */
+static struct rtnet_device *rt_neigh_output_dev(u32 addr, u32 saddr)
+{
+    struct rtnet_device *rtdev;
+    struct rtnet_device *best = NULL;
+    u32                 best_mask = 0;
+    u32                 host_mask;
+    int                 i;
+
+
+    if ((addr == INADDR_ANY) || (addr == INADDR_BROADCAST))
+        return NULL;
+
+    for (i = 1; i <= MAX_RT_DEVICES; i++) {
+        rtdev = rtdev_get_by_index(i);
+        if (rtdev == NULL)
+            continue;
+
+        if (((rtdev->flags & (IFF_UP | IFF_LOOPBACK | IFF_NOARP)) ==
+             IFF_UP) && (rtdev->local_ip != 0) &&
+            (addr != rtdev->local_ip) && (addr != rtdev->broadcast_ip) &&
+            ((saddr == INADDR_ANY) || (saddr == rtdev->local_ip))) {
+            host_mask = rt_neigh_host_mask(rtdev);
+
+            if ((((ntohl(addr) ^ ntohl(rtdev->local_ip)) & ~host_mask) == 0) &&
+                ((best == NULL) || (host_mask < best_mask))) {
+                if (best != NULL)
+                    rtdev_dereference(best);
+                best      = rtdev;
+                best_mask = host_mask;
+                continue;
+            }
+        }
+
+        rtdev_dereference(rtdev);
+    }
+
+    return best;
+}
+
+
+
+static int __rt_neigh_resolve(u32 addr, struct rtnet_device *rtdev)
+{
+    struct rt_neighbour *neigh;
+    rtdm_lockctx_t      context;
+    int                 created = 0;
+
+
+    rtdm_lock_get_irqsave(&neigh_lock, context);
+
+    neigh = rt_neigh_find(addr, rtdev);
+    if (neigh == NULL) {
+        neigh   = rt_neigh_create(addr, rtdev);
+        created = 1;
+    }
+
+    rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+    if (neigh == NULL)
+        return -ENOBUFS;
+
+    if (created)
+        rtdm_event_signal(&neigh_event);
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_neigh_resolve - start resolving a next hop without an output route
+ *  @addr:  next hop
+ *  @saddr: required source address, INADDR_ANY for any
+ *
+ *  Can be called from real-time context, never blocks.
+ */
+int rt_neigh_resolve(u32 addr, u32 saddr)
+{
+    struct rtnet_device *rtdev;
+    int                 ret;
+
+
+    rtdev = rt_neigh_output_dev(addr, saddr);
+    if (rtdev == NULL)
+        return -EHOSTUNREACH;
+
+    ret = __rt_neigh_resolve(addr, rtdev);
+
+    rtdev_dereference(rtdev);
+
+    return ret;
+}
+
+
+
+static int rt_neigh_resolved(u32 addr, struct rtnet_device *rtdev)
+{
+    char            if_name[IFNAMSIZ];
+    unsigned char   dev_addr[MAX_ADDR_LEN];
+
+
+    return (rt_ip_route_get_host(addr, if_name, dev_addr, rtdev) == 0);
+}
+
+
+
+/***
+ *  rt_neigh_resolve_dev - start resolving an address on a given device
+ *
+ *  Addresses which already have a host route on the device are left alone.
+ */
+int rt_neigh_resolve_dev(u32 addr, struct rtnet_device *rtdev)
+{
+    if ((rtdev->flags & IFF_UP) == 0)
+        return -ENODEV;
+
+    if (rt_neigh_resolved(addr, rtdev))
+        return 0;
+
+    return __rt_neigh_resolve(addr, rtdev);
+}
+
+
+
+/***
+ *  rt_neigh_resolve_list - resolve a list of addresses, e.g. on startup
+ *  @rtdev:    output device
+ *  @addrs:    addresses, at most 32
+ *  @count:    number of addresses
+ *  @timeout:  ms to wait for all replies, 0 to only start the resolution
+ *  @resolved: returns a bit per address which has a host route
+ *
+ *  Note: must be called from non-real-time context
+ */
+int rt_neigh_resolve_list(struct rtnet_device *rtdev, u32 *addrs,
+                          unsigned int count, unsigned int timeout,
+                          u32 *resolved)
+{
+    unsigned long   deadline = jiffies + msecs_to_jiffies(timeout);
+    unsigned int    i;
+    int             ret;
+
+
+    *resolved = 0;
+
+    for (i = 0; i < count; i++) {
+        ret = rt_neigh_resolve_dev(addrs[i], rtdev);
+        if (ret < 0)
+            return ret;
+    }
+
+    while (1) {
+        for (i = 0; i < count; i++)
+            if (!(*resolved & (1 << i)) && rt_neigh_resolved(addrs[i], rtdev))
+                *resolved |= 1 << i;
+
+        if (*resolved == (u32)((1ULL << count) - 1))
+            return 0;
+
+        if (timeout == 0)
+            return 0;
+        if (time_after(jiffies, deadline))
+            return -ETIMEDOUT;
+
+        set_current_state(TASK_INTERRUPTIBLE);
+        schedule_timeout(1);
+        if (signal_pending(current))
+            return -EINTR;
+    }
+}
+
+
+
+/***
+ *  rt_neigh_pending - accept a next hop that is still being resolved
+ *  @addr:  next hop without host route
+ *  @saddr: required source address, INADDR_ANY for any
+ *
+ *  Returns the referenced output device if packets to @addr can be queued
+ *  via rt_neigh_queue, NULL if the next hop is not on a local subnet or
+ *  failed to resolve recently.
+ */
+struct rtnet_device *rt_neigh_pending(u32 addr, u32 saddr)
+{
+    struct rtnet_device *rtdev;
+    struct rt_neighbour *neigh;
+    rtdm_lockctx_t      context;
+    int                 created = 0;
+
+
+    rtdev = rt_neigh_output_dev(addr, saddr);
+    if (rtdev == NULL)
+        return NULL;
+
+    rtdm_lock_get_irqsave(&neigh_lock, context);
+
+    neigh = rt_neigh_find(addr, rtdev);
+    if (neigh == NULL) {
+        neigh   = rt_neigh_create(addr, rtdev);
+        created = 1;
+    } else if (neigh->state == RT_NEIGH_FAILED)
+        neigh = NULL;
+
+    rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+    if (created && (neigh != NULL))
+        rtdm_event_signal(&neigh_event);
+
+    if (neigh == NULL) {
+        rtdev_dereference(rtdev);
+        return NULL;
+    }
+
+    return rtdev;
+}
+
+
+
+/***
+ *  rt_neigh_queue - send a packet whose next hop is being resolved
+ *  @skb: packet with IP header, the link layer header is still missing
+ *  @rt:  route as returned by rt_ip_route_output_pending
+ *
+ *  The packet is queued until the reply arrives or sent right away if the
+ *  neighbour was resolved meanwhile. It is consumed in any case.
+ */
+int rt_neigh_queue(struct rtskb *skb, struct dest_route *rt)
+{
+    struct rt_neighbour *neigh;
+    unsigned char       dev_addr[MAX_ADDR_LEN];
+    rtdm_lockctx_t      context;
+    int                 ret;
+
+
+    rtdm_lock_get_irqsave(&neigh_lock, context);
+
+    neigh = rt_neigh_find(rt->neigh, skb->rtdev);
+    if (neigh == NULL) {
+        ret = -EHOSTUNREACH;
+        goto drop;
+    }
+
+    switch (neigh->state) {
+        case RT_NEIGH_REACHABLE:
+        case RT_NEIGH_PROBE:
+            memcpy(dev_addr, neigh->dev_addr, sizeof(dev_addr));
+            rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+            return rt_neigh_xmit(skb, dev_addr);
+
+        case RT_NEIGH_INCOMPLETE:
+            if (neigh->pending_len >= neigh_queue_len) {
+                rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+                rtnet_count_drop(RTNET_DROP_NEIGH_QUEUE);
+                kfree_rtskb(skb);
+                return -ENOBUFS;
+            }
+
+            __rtskb_queue_tail(&neigh->pending, skb);
+            neigh->pending_len++;
+
+            rtdm_lock_put_irqrestore(&neigh_lock, context);
+            return 0;
+
+        default:
+            ret = -EHOSTUNREACH;
+            break;
+    }
+
+  drop:
+    rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+    rtnet_count_drop(RTNET_DROP_NEIGH_FAILED);
+    kfree_rtskb(skb);
+    return ret;
+}
+
+
+
+/***
+ *  rt_neigh_queue_list - send the fragments of a datagram whose next hop is
+ *                        being resolved
+ *  @list:  packets as for rt_neigh_queue, in transmission order
+ *  @count: number of packets on @list
+ *  @rt:    route as returned by rt_ip_route_output_pending
+ *
+ *  The packets are either all queued or all dropped. A partial datagram
+ *  would only occupy a reassembly context of the peer until it times out.
+ *  The list is consumed in any case.
+ */
+int rt_neigh_queue_list(struct rtskb_queue *list, unsigned int count,
+                        struct dest_route *rt)
+{
+    struct rt_neighbour *neigh;
+    struct rtskb        *skb;
+    unsigned char       dev_addr[MAX_ADDR_LEN];
+    rtdm_lockctx_t      context;
+    int                 ret;
+
+
+    rtdm_lock_get_irqsave(&neigh_lock, context);
+
+    neigh = rt_neigh_find(rt->neigh, rt->rtdev);
+    if (neigh == NULL) {
+        ret = -EHOSTUNREACH;
+        goto drop;
+    }
+
+    switch (neigh->state) {
+        case RT_NEIGH_REACHABLE:
+        case RT_NEIGH_PROBE:
+            memcpy(dev_addr, neigh->dev_addr, sizeof(dev_addr));
+            rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+            ret = 0;
+            while ((skb = __rtskb_dequeue(list)) != NULL)
+                if ((rt_neigh_xmit(skb, dev_addr) != 0) && (ret == 0))
+                    ret = -EAGAIN;
+            return ret;
+
+        case RT_NEIGH_INCOMPLETE:
+            if (neigh->pending_len + count > neigh_queue_len) {
+                rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+                while ((skb = __rtskb_dequeue(list)) != NULL) {
+                    rtnet_count_drop(RTNET_DROP_NEIGH_QUEUE);
+                    kfree_rtskb(skb);
+                }
+                return -ENOBUFS;
+            }
+
+            while ((skb = __rtskb_dequeue(list)) != NULL)
+                __rtskb_queue_tail(&neigh->pending, skb);
+            neigh->pending_len += count;
+
+            rtdm_lock_put_irqrestore(&neigh_lock, context);
+            return 0;
+
+        default:
+            ret = -EHOSTUNREACH;
+            break;
+    }
+
+  drop:
+    rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+    while ((skb = __rtskb_dequeue(list)) != NULL) {
+        rtnet_count_drop(RTNET_DROP_NEIGH_FAILED);
+        kfree_rtskb(skb);
+    }
+    return ret;
+}
+
+
+
+/***
+ *  rt_neigh_confirm - a neighbour proved to be reachable
+ *
+ *  Called for every ARP request or reply addressed to the station. Packets
+ *  queued for the neighbour are sent from here.
+ */
+void rt_neigh_confirm(u32 addr, unsigned char *dev_addr,
+                      struct rtnet_device *rtdev)
+{
+    struct rt_neighbour *neigh;
+    struct rtskb        *skb;
+    struct rtskb        *next;
+    unsigned char       hw_addr[MAX_ADDR_LEN];
+    rtdm_lockctx_t      context;
+
+
+    rtdm_lock_get_irqsave(&neigh_lock, context);
+
+    neigh = rt_neigh_find(addr, rtdev);
+    if (neigh == NULL) {
+        rtdm_lock_put_irqrestore(&neigh_lock, context);
+        return;
+    }
+
+    memcpy(neigh->dev_addr, dev_addr, rtdev->addr_len);
+    memcpy(hw_addr, neigh->dev_addr, sizeof(hw_addr));
+
+    neigh->state   = RT_NEIGH_REACHABLE;
+    neigh->probes  = 0;
+    neigh->timeout = (neigh_reachable == 0) ? 0 :
+        rtdm_clock_read() + rt_neigh_ms(neigh_reachable);
+
+    skb = rt_neigh_take_pending(neigh);
+
+    rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+    /* the task may sleep without timeout so far */
+    rtdm_event_signal(&neigh_event);
+
+    while (skb != NULL) {
+        next = skb->next;
+        skb->next = NULL;
+
+        rt_neigh_xmit(skb, hw_addr);
+
+        skb = next;
+    }
+}
+
+
+
+/***
+ *  rt_neigh_forget - stop tracking a neighbour, e.g. for a manual route
+ *  @rtdev: device, NULL for all
+ */
+void rt_neigh_forget(u32 addr, struct rtnet_device *rtdev)
+{
+    struct rt_neighbour *neigh;
+    struct rtskb        *skb = NULL;
+    rtdm_lockctx_t      context;
+
+
+    rtdm_lock_get_irqsave(&neigh_lock, context);
+
+    while ((neigh = rt_neigh_find(addr, rtdev)) != NULL) {
+        rt_neigh_drop(skb);
+        skb = rt_neigh_free(neigh);
+    }
+
+    rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+    rt_neigh_drop(skb);
+}
+
+
+
+/***
+ *  rt_neigh_flush - drop all neighbours of a device, NULL for all
+ */
+void rt_neigh_flush(struct rtnet_device *rtdev)
+{
+    struct rt_neighbour *neigh;
+    struct rtskb        *skb;
+    rtdm_lockctx_t      context;
+    int                 i;
+
+
+    for (i = 0; i < RT_NEIGH_ENTRIES; i++) {
+        neigh = &neighbours[i];
+        skb   = NULL;
+
+        rtdm_lock_get_irqsave(&neigh_lock, context);
+
+        if ((neigh->state != RT_NEIGH_NONE) &&
+            ((rtdev == NULL) || (neigh->rtdev == rtdev)))
+            skb = rt_neigh_free(neigh);
+
+        rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+        rt_neigh_drop(skb);
+    }
+}
+
+
+
+/***
+ *  rt_neigh_process - advance all due neighbours
+ *
+ *  Returns the delay until the next transition, 0 if there is none.
+ */
+static nanosecs_rel_t rt_neigh_process(void)
+{
+    struct rt_neighbour     *neigh;
+    struct rtnet_device     *rtdev = NULL;
+    struct rtskb            *skb;
+    enum rt_neigh_action    action;
+    unsigned char           dev_addr[MAX_ADDR_LEN];
+    nanosecs_abs_t          now = rtdm_clock_read();
+    nanosecs_rel_t          next = 0;
+    nanosecs_rel_t          delay;
+    rtdm_lockctx_t          context;
+    u32                     addr = 0;
+    int                     i;
+
+
+    for (i = 0; i < RT_NEIGH_ENTRIES; i++) {
+        neigh  = &neighbours[i];
+        action = NEIGH_ACT_NONE;
+        skb    = NULL;
+
+        rtdm_lock_get_irqsave(&neigh_lock, context);
+
+        if ((neigh->state == RT_NEIGH_NONE) || (neigh->timeout == 0) ||
+            (neigh->timeout > now))
+            goto schedule;
+
+        addr  = neigh->addr;
+        rtdev = neigh->rtdev;
+
+        switch (neigh->state) {
+            case RT_NEIGH_INCOMPLETE:
+                if ((neigh->probes < neigh_probes) &&
+                    (rtdev->flags & IFF_UP)) {
+                    neigh->probes++;
+                    action = NEIGH_ACT_SOLICIT;
+                } else {
+                    /* keep the failure for a while, senders get errors */
+                    neigh->state = RT_NEIGH_FAILED;
+                    skb = rt_neigh_take_pending(neigh);
+                }
+                neigh->timeout = now + rt_neigh_ms(neigh_retrans);
+                break;
+
+            case RT_NEIGH_REACHABLE:
+                neigh->state  = RT_NEIGH_PROBE;
+                neigh->probes = 0;
+                /* fall through */
+
+            case RT_NEIGH_PROBE:
+                if ((neigh->probes < neigh_probes) &&
+                    (rtdev->flags & IFF_UP)) {
+                    neigh->probes++;
+                    memcpy(dev_addr, neigh->dev_addr, sizeof(dev_addr));
+                    action = NEIGH_ACT_PROBE;
+                    neigh->timeout = now + rt_neigh_ms(neigh_retrans);
+                } else {
+                    rtdev_reference(rtdev);
+                    skb = rt_neigh_free(neigh);
+                    action = NEIGH_ACT_EXPIRE;
+                }
+                break;
+
+            default:
+                skb = rt_neigh_free(neigh);
+                break;
+        }
+
+        if ((action == NEIGH_ACT_SOLICIT) || (action == NEIGH_ACT_PROBE))
+            rtdev_reference(rtdev);
+
+      schedule:
+        if ((neigh->state != RT_NEIGH_NONE) && (neigh->timeout != 0)) {
+            delay = (neigh->timeout > now) ? neigh->timeout - now : 1;
+            if ((next == 0) || (delay < next))
+                next = delay;
+        }
+
+        rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+        rt_neigh_drop(skb);
+
+        switch (action) {
+            case NEIGH_ACT_SOLICIT:
+                rt_arp_solicit(rtdev, addr);
+                break;
+
+            case NEIGH_ACT_PROBE:
+                rt_arp_send(ARPOP_REQUEST, ETH_P_ARP, addr, rtdev,
+                            rtdev->local_ip, dev_addr, NULL, NULL);
+                break;
+
+            case NEIGH_ACT_EXPIRE:
+                rt_ip_route_del_host(addr, rtdev);
+                break;
+
+            default:
+                continue;
+        }
+
+        rtdev_dereference(rtdev);
+    }
+
+    return next;
+}
+
+
+
+static void rt_neigh_task_proc(void *arg)
+{
+    nanosecs_rel_t timeout = 0;
+
+
+    while (rtdm_event_timedwait(&neigh_event, timeout, NULL) != -EIDRM)
+        timeout = rt_neigh_process();
+}
+
+
+
+#ifdef CONFIG_PROC_FS
+static int rtnet_ipv4_neighbour_show(struct seq_file *p, void *data)
+{
+    static const char   *state_names[] = {
+        "none", "incomplete", "reachable", "probe", "failed"
+    };
+    struct rt_neighbour neigh;
+    rtdm_lockctx_t      context;
+    int                 i;
+
+
+    seq_printf(p, "Destination\tHW Address\t\tDevice\tState\t\tQueued\n");
+
+    for (i = 0; i < RT_NEIGH_ENTRIES; i++) {
+        rtdm_lock_get_irqsave(&neigh_lock, context);
+
+        if (neighbours[i].state == RT_NEIGH_NONE) {
+            rtdm_lock_put_irqrestore(&neigh_lock, context);
+            continue;
+        }
+
+        memcpy(&neigh, &neighbours[i], sizeof(neigh));
+        rtdev_reference(neigh.rtdev);
+
+        rtdm_lock_put_irqrestore(&neigh_lock, context);
+
+        if (neigh.state == RT_NEIGH_INCOMPLETE ||
+            neigh.state == RT_NEIGH_FAILED)
+            memset(neigh.dev_addr, 0, sizeof(neigh.dev_addr));
+
+        seq_printf(p, "%u.%u.%u.%-3u\t"
+                   "%02X:%02X:%02X:%02X:%02X:%02X\t%s\t%-10s\t%u\n",
+                   NIPQUAD(neigh.addr),
+                   neigh.dev_addr[0], neigh.dev_addr[1], neigh.dev_addr[2],
+                   neigh.dev_addr[3], neigh.dev_addr[4], neigh.dev_addr[5],
+                   neigh.rtdev->name, state_names[neigh.state],
+                   neigh.pending_len);
+
+        rtdev_dereference(neigh.rtdev);
+    }
+
+    return 0;
+}
+
+static int rtnet_ipv4_neighbour_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, rtnet_ipv4_neighbour_show, NULL);
+}
+
+static const struct file_operations rtnet_ipv4_neighbour_fops = {
+    .open       = rtnet_ipv4_neighbour_open,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+#endif /* CONFIG_PROC_FS */
+
+
+
+/***
+ *  rt_neigh_init
+ */
+int __init rt_neigh_init(void)
+{
+    int i;
+    int ret;
+
+
+    for (i = 0; i < RT_NEIGH_ENTRIES; i++)
+        rtskb_queue_init(&neighbours[i].pending);
+
+    rtdm_event_init(&neigh_event, 0);
+
+    ret = rtdm_task_init(&neigh_task, "rtnet-neigh", rt_neigh_task_proc,
+                         NULL, neigh_prio, 0);
+    if (ret < 0) {
+        rtdm_event_destroy(&neigh_event);
+        return ret;
+    }
+
+#ifdef CONFIG_PROC_FS
+    if (!proc_create("neighbour", S_IFREG | S_IRUGO, ipv4_proc_root,
+                     &rtnet_ipv4_neighbour_fops)) {
+        /*ERRMSG*/printk("RTnet: unable to initialize /proc entry "
+                         "(neighbour)\n");
+        rtdm_event_destroy(&neigh_event);
+        rtdm_task_join_nrt(&neigh_task, 100);
+        return -ENOMEM;
+    }
+#endif /* CONFIG_PROC_FS */
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_neigh_release
+ */
+void rt_neigh_release(void)
+{
+#ifdef CONFIG_PROC_FS
+    remove_proc_entry("neighbour", ipv4_proc_root);
+#endif /* CONFIG_PROC_FS */
+
+    rtdm_event_destroy(&neigh_event);
+    rtdm_task_join_nrt(&neigh_task, 100);
+
+    rt_neigh_flush(NULL);
+}
@@ -23,35 +23,47 @@
  */
 
 #include <linux/moduleparam.h>
+#include <linux/sched.h>
 #include <net/ip.h>
 
 #include <rtnet_internal.h>
 #include <rtnet_port.h>
 #include <rtnet_chrdev.h>
+#include <rtnet_stats.h>
 #include <ipv4/af_inet.h>
+#include <ipv4/multicast.h>
+#include <ipv4/neighbour.h>
 #include <ipv4/route.h>
 
 
-/* FIXME: should also become some tunable parameter */
-#define ROUTER_FORWARD_PRIO \
-    RTSKB_PRIO_VALUE(QUEUE_MAX_PRIO+(QUEUE_MIN_PRIO-QUEUE_MAX_PRIO+1)/2, \
-                     RTSKB_DEF_RT_CHANNEL)
-
-
 /* First-level routing: explicite host routes */
 struct host_route {
     struct host_route       *next;
+    struct host_route       *next_free; /* free list and limbo */
+    unsigned int            seq;        /* odd while dest_host is updated */
     struct dest_route       dest_host;
 };
 
 /* Second-level routing: routes to other networks */
 struct net_route {
-    struct net_route        *next;
+    struct net_route        *next;      /* free list and limbo */
     u32                     dest_net_ip;
     u32                     dest_net_mask;
     u32                     gw_ip;
 };
 
+/* Network routes are kept in a path-compressed binary trie keyed by the
+ * destination prefix. Every node except the root either carries a route or
+ * branches into two subtries, so a table of n routes never needs more than
+ * 2n nodes, and no lookup visits more than 33 of them. */
+struct net_node {
+    struct net_node         *child[2];
+    u32                     key;        /* prefix, host order */
+    unsigned int            prefix_len;
+    struct net_route        *route;     /* route for exactly this prefix */
+    struct net_node         *next_free; /* free list and limbo */
+};
+
 #if (CONFIG_RTNET_RTIPV4_HOST_ROUTES & (CONFIG_RTNET_RTIPV4_HOST_ROUTES - 1))
 # error CONFIG_RTNET_RTIPV4_HOST_ROUTES must be power of 2
 #endif
@@ -66,30 +78,145 @@ static struct host_route    host_routes[CONFIG_RTNET_RTIPV4_HOST_ROUTES];
 static struct host_route    *free_host_route;
 static int                  allocated_host_routes;
 static struct host_route    *host_hash_tbl[HOST_HASH_TBL_SIZE];
+static struct host_route    *host_route_limbo;
+static unsigned long        host_route_limbo_epoch;
 static rtdm_lock_t          host_table_lock = RTDM_LOCK_UNLOCKED;
 
+/* bumped on every change which may alter output routes, see rt_ip_route_hold */
+volatile unsigned long      rt_ip_route_generation = 1;
+
+/* Note: must be called with host_table_lock held, after the change was
+ * made, so that lookups which saw the old state see the old generation */
+#define rt_ip_route_changed()                   \
+    do {                                        \
+        smp_wmb();                              \
+        rt_ip_route_generation++;               \
+    } while (0)
+
+/*
+ * Lookups run without taking any lock. Each one is accounted in a per-CPU
+ * reader slot instead, selected by the parity of route_epoch, just like the
+ * protocol dispatch table of the stack manager. Writers serialise on the
+ * table locks and publish entries only after they are fully set up. Removed
+ * entries are parked in a limbo list and reused once the epoch advanced
+ * twice. Host routes are updated in place, readers retry on their seq.
+ */
+static volatile unsigned long route_epoch;
+static rtdm_lock_t          route_epoch_lock = RTDM_LOCK_UNLOCKED;
+
+static struct {
+    atomic_t        active[2];
+} ____cacheline_aligned_in_smp route_readers[NR_CPUS];
+
+
+/***
+ *  rt_route_enter - start a lockless lookup
+ *
+ *  Returns the reader slot to pass to rt_route_leave().
+ */
+static inline unsigned int rt_route_enter(void)
+{
+    unsigned int    slot;
+
+
+    slot = rtos_processor_id() * 2 + (route_epoch & 1);
+    atomic_inc(&route_readers[slot / 2].active[slot & 1]);
+
+    /* pairs with the barrier in rt_route_advance() */
+    smp_mb();
+
+    return slot;
+}
+
+
+static inline void rt_route_leave(unsigned int slot)
+{
+    smp_mb__before_atomic_dec();
+    atomic_dec(&route_readers[slot / 2].active[slot & 1]);
+}
+
+
+/***
+ *  rt_route_advance - start a new reader epoch if the previous one is over
+ *
+ *  Returns 1 if the epoch was advanced, 0 if readers of the previous epoch
+ *  are still active.
+ */
+static int rt_route_advance(void)
+{
+    rtdm_lockctx_t  context;
+    unsigned int    prev;
+    int             cpu;
+    int             ret = 0;
+
+
+    rtdm_lock_get_irqsave(&route_epoch_lock, context);
+
+    prev = (route_epoch + 1) & 1;
+
+    /* order preceding unlinks before sampling the readers */
+    smp_mb();
+
+    for (cpu = 0; cpu < NR_CPUS; cpu++)
+        if (atomic_read(&route_readers[cpu].active[prev]) != 0)
+            goto out;
+
+    smp_mb();
+    route_epoch++;
+    ret = 1;
+
+  out:
+    rtdm_lock_put_irqrestore(&route_epoch_lock, context);
+
+    return ret;
+}
+
+
+/***
+ *  rt_route_quiescent - check if entries removed at epoch are unreferenced
+ */
+static int rt_route_quiescent(unsigned long epoch)
+{
+    while ((route_epoch - epoch < 2) && rt_route_advance());
+
+    return (route_epoch - epoch >= 2);
+}
+
 #ifdef CONFIG_RTNET_RTIPV4_NETROUTING
-#if (CONFIG_RTNET_RTIPV4_NET_ROUTES & (CONFIG_RTNET_RTIPV4_NET_ROUTES - 1))
-# error CONFIG_RTNET_RTIPV4_NET_ROUTES must be power of 2
-#endif
-#if CONFIG_RTNET_RTIPV4_NET_ROUTES < 256
-# define NET_HASH_TBL_SIZE  64
-#else
-# define NET_HASH_TBL_SIZE  ((CONFIG_RTNET_RTIPV4_NET_ROUTES / 256) * 64)
-#endif
-#define NET_HASH_KEY_MASK   (NET_HASH_TBL_SIZE-1)
-#define NET_HASH_KEY_SHIFT  8
+#define NET_TRIE_NODES      (2 * CONFIG_RTNET_RTIPV4_NET_ROUTES)
 
 static struct net_route     net_routes[CONFIG_RTNET_RTIPV4_NET_ROUTES];
 static struct net_route     *free_net_route;
 static int                  allocated_net_routes;
-static struct net_route     *net_hash_tbl[NET_HASH_TBL_SIZE + 1];
-static unsigned int         net_hash_key_shift = NET_HASH_KEY_SHIFT;
+static struct net_node      net_nodes[NET_TRIE_NODES];
+static struct net_node      *free_net_node;
+static int                  allocated_net_nodes;
+static struct net_node      net_trie_root;  /* 0.0.0.0/0, never released */
+static struct net_route     *net_route_limbo;
+static struct net_node      *net_node_limbo;
+static unsigned long        net_limbo_epoch;
 static rtdm_lock_t          net_table_lock = RTDM_LOCK_UNLOCKED;
 
-module_param(net_hash_key_shift, uint, 0444);
-MODULE_PARM_DESC(net_hash_key_shift, "destination right shift for "
-                 "network hash key (default: 8)");
+/* network route changes are accounted under the host table lock as well */
+static inline void rt_ip_net_route_changed(void)
+{
+    rtdm_lockctx_t context;
+
+    rtdm_lock_get_irqsave(&host_table_lock, context);
+    rt_ip_route_changed();
+    rtdm_lock_put_irqrestore(&host_table_lock, context);
+}
+
+static inline u32 rt_net_prefix_mask(unsigned int prefix_len)
+{
+    return (prefix_len == 0) ? 0 : ~0U << (32 - prefix_len);
+}
+
+/* bit following a prefix of the given length, selects the child */
+static inline unsigned int rt_net_key_bit(u32 key, unsigned int prefix_len)
+{
+    return (key >> (31 - prefix_len)) & 1;
+}
 #endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
 
@@ -100,10 +227,6 @@ MODULE_PARM_DESC(net_hash_key_shift, "destination right shift for "
 #ifdef CONFIG_PROC_FS
 static int rtnet_ipv4_route_show(struct seq_file *p, void *data)
 {
-#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
-    u32 mask;
-#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
-
     seq_printf(p, "Host routes allocated/total:\t%d/%d\n"
 	       "Host hash table size:\t\t%d\n",
 	       allocated_host_routes,
@@ -111,13 +234,10 @@ static int rtnet_ipv4_route_show(struct seq_file *p, void *data)
 	       HOST_HASH_TBL_SIZE);
 
 #ifdef CONFIG_RTNET_RTIPV4_NETROUTING
-    mask = NET_HASH_KEY_MASK << net_hash_key_shift;
     seq_printf(p, "Network routes allocated/total:\t%d/%d\n"
-	       "Network hash table size:\t%d\n"
-	       "Network hash key shift/mask:\t%d/%08X\n",
-	       allocated_net_routes,
-	       CONFIG_RTNET_RTIPV4_NET_ROUTES, NET_HASH_TBL_SIZE,
-	       net_hash_key_shift, mask);
+	       "Network trie nodes used/total:\t%d/%d\n",
+	       allocated_net_routes, CONFIG_RTNET_RTIPV4_NET_ROUTES,
+	       allocated_net_nodes, NET_TRIE_NODES);
 #endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
 #ifdef CONFIG_RTNET_RTIPV4_ROUTER
@@ -201,67 +321,78 @@ static const struct file_operations rtnet_ipv4_host__route_fops = {
 
 
 #ifdef CONFIG_RTNET_RTIPV4_NETROUTING
-static int rt_net_route_read_proc(char *buf, char **start, off_t offset,
-                                  int count, int *eof, void *data)
+/***
+ *  rt_net_route_get - copy the index-th network route in prefix order
+ *
+ *  Note: must be called with net_table_lock held
+ */
+static int rt_net_route_get(unsigned int index, struct net_route *buf,
+                            unsigned int *prefix_len)
 {
-    struct net_route    *entry_ptr;
-    u32                 dest_net_ip;
-    u32                 dest_net_mask;
-    u32                 gw_ip;
-    unsigned int        key;
-    unsigned int        index;
-    unsigned int        i;
-    rtdm_lockctx_t      context;
-    RTNET_PROC_PRINT_VARS_EX(80);
+    struct net_node     *stack[34];
+    struct net_node     *node;
+    int                 depth = 0;
 
 
-    if (!RTNET_PROC_PRINT_EX("Hash\tDestination\tMask\t\t\tGateway\n"))
-        goto done;
+    stack[depth++] = &net_trie_root;
 
-    for (key = 0; key < NET_HASH_TBL_SIZE + 1; key++) {
-        index = 0;
-        while (1) {
-            rtdm_lock_get_irqsave(&net_table_lock, context);
+    /* pre-order walk, children have longer prefixes than their parents */
+    while (depth > 0) {
+        node = stack[--depth];
 
-            entry_ptr = net_hash_tbl[key];
+        if ((node->route != NULL) && (index-- == 0)) {
+            *buf        = *node->route;
+            *prefix_len = node->prefix_len;
+            return 0;
+        }
 
-            for (i = 0; (i < index) && (entry_ptr != NULL); i++)
-                entry_ptr = entry_ptr->next;
+        if (node->child[1] != NULL)
+            stack[depth++] = node->child[1];
+        if (node->child[0] != NULL)
+            stack[depth++] = node->child[0];
+    }
 
-            if (entry_ptr == NULL) {
-                rtdm_lock_put_irqrestore(&net_table_lock, context);
-                break;
-            }
+    return -ENOENT;
+}
 
-            dest_net_ip   = entry_ptr->dest_net_ip;
-            dest_net_mask = entry_ptr->dest_net_mask;
-            gw_ip         = entry_ptr->gw_ip;
-
-            rtdm_lock_put_irqrestore(&net_table_lock, context);
-
-            if (key < NET_HASH_TBL_SIZE) {
-                if (!RTNET_PROC_PRINT_EX("%02X\t%u.%u.%u.%-3u\t%u.%u.%u.%-3u"
-                                         "\t\t%u.%u.%u.%-3u\n",
-                                         key, NIPQUAD(dest_net_ip),
-                                         NIPQUAD(dest_net_mask),
-                                         NIPQUAD(gw_ip)))
-                    goto done;
-            } else {
-                if (!RTNET_PROC_PRINT_EX("*\t%u.%u.%u.%-3u\t%u.%u.%u.%-3u\t\t"
-                                         "%u.%u.%u.%-3u\n",
-                                         NIPQUAD(dest_net_ip),
-                                         NIPQUAD(dest_net_mask),
-                                         NIPQUAD(gw_ip)))
-                    goto done;
-            }
 
-            index++;
-        }
+
+static int rtnet_ipv4_net__route_show(struct seq_file *p, void *data)
+{
+    struct net_route    entry;
+    unsigned int        prefix_len;
+    unsigned int        index;
+    rtdm_lockctx_t      context;
+    int                 ret;
+
+
+    seq_printf(p, "Prefix\tDestination\tMask\t\t\tGateway\n");
+    for (index = 0; ; index++) {
+        rtdm_lock_get_irqsave(&net_table_lock, context);
+        ret = rt_net_route_get(index, &entry, &prefix_len);
+        rtdm_lock_put_irqrestore(&net_table_lock, context);
+
+        if (ret < 0)
+            break;
+
+        seq_printf(p, "/%u\t%u.%u.%u.%-3u\t%u.%u.%u.%-3u\t\t%u.%u.%u.%-3u\n",
+                   prefix_len, NIPQUAD(entry.dest_net_ip),
+                   NIPQUAD(entry.dest_net_mask), NIPQUAD(entry.gw_ip));
     }
+    return 0;
+}
 
-  done:
-    RTNET_PROC_PRINT_DONE_EX;
+static int rtnet_ipv4_net__route_open(struct inode *inode,
+					   struct  file *file) {
+  return single_open(file, rtnet_ipv4_net__route_show, NULL);
 }
+
+static const struct file_operations rtnet_ipv4_net__route_fops = {
+  .open = rtnet_ipv4_net__route_open,
+  .read = seq_read,
+  .llseek = seq_lseek,
+  .release = single_release,
+};
 #endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
 
@@ -329,22 +460,25 @@ static void rt_route_proc_unregister(void)
 
 /***
  *  rt_alloc_host_route - allocates new host route
+ *
+ *  Note: must be called with host_table_lock held
  */
 static inline struct host_route *rt_alloc_host_route(void)
 {
-    rtdm_lockctx_t      context;
     struct host_route   *rt;
 
 
-    rtdm_lock_get_irqsave(&host_table_lock, context);
+    if ((free_host_route == NULL) && (host_route_limbo != NULL) &&
+        rt_route_quiescent(host_route_limbo_epoch)) {
+        free_host_route  = host_route_limbo;
+        host_route_limbo = NULL;
+    }
 
     if ((rt = free_host_route) != NULL) {
-        free_host_route = rt->next;
+        free_host_route = rt->next_free;
         allocated_host_routes++;
     }
 
-    rtdm_lock_put_irqrestore(&host_table_lock, context);
-
     return rt;
 }
 
@@ -353,17 +487,54 @@ static inline struct host_route *rt_alloc_host_route(void)
 /***
  *  rt_free_host_route - releases host route
  *
+ *  The entry is only reused when concurrent lookups are done with it, its
+ *  next pointer stays intact until then.
+ *
  *  Note: must be called with host_table_lock held
  */
 static inline void rt_free_host_route(struct host_route *rt)
 {
-    rt->next        = free_host_route;
-    free_host_route = rt;
+    struct host_route   *last;
+
+
+    if ((host_route_limbo != NULL) &&
+        rt_route_quiescent(host_route_limbo_epoch)) {
+        for (last = host_route_limbo; last->next_free != NULL;
+             last = last->next_free);
+        last->next_free  = free_host_route;
+        free_host_route  = host_route_limbo;
+        host_route_limbo = NULL;
+    }
+
+    rt->next_free          = host_route_limbo;
+    host_route_limbo       = rt;
+    host_route_limbo_epoch = route_epoch;
     allocated_host_routes--;
 }
 
 
 
+/***
+ *  rt_route_synchronize - wait until lookups started so far are done
+ *
+ *  Only sleeps in non-real-time context.
+ */
+static void rt_route_synchronize(void)
+{
+    unsigned long   epoch = route_epoch;
+
+
+    if (rtdm_in_rt_context())
+        return;
+
+    while (!rt_route_quiescent(epoch)) {
+        set_current_state(TASK_UNINTERRUPTIBLE);
+        schedule_timeout(1);
+    }
+}
+
+
+
 /***
  *  rt_ip_route_add_host: add or update host route
  */
@@ -387,12 +558,6 @@ int rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
 
     rtdm_lock_put_irqrestore(&rtdev->rtdev_lock, context);
 
-    if ((new_route = rt_alloc_host_route()) != NULL) {
-        new_route->dest_host.ip    = addr;
-        new_route->dest_host.rtdev = rtdev;
-        memcpy(new_route->dest_host.dev_addr, dev_addr, rtdev->addr_len);
-    }
-
     key = ntohl(addr) & HOST_HASH_KEY_MASK;
 
     rtdm_lock_get_irqsave(&host_table_lock, context);
@@ -401,11 +566,18 @@ int rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
     while (rt != NULL) {
         if ((rt->dest_host.ip == addr) &&
             (rt->dest_host.rtdev->local_ip == rtdev->local_ip)) {
-            rt->dest_host.rtdev = rtdev;
-            memcpy(rt->dest_host.dev_addr, dev_addr, rtdev->addr_len);
-
-            if (new_route)
-                rt_free_host_route(new_route);
+            /* ARP refreshes routes frequently, only real changes count */
+            if ((rt->dest_host.rtdev != rtdev) ||
+                memcmp(rt->dest_host.dev_addr, dev_addr, rtdev->addr_len)) {
+                rt->seq++;
+                smp_wmb();
+                rt->dest_host.rtdev = rtdev;
+                memcpy(rt->dest_host.dev_addr, dev_addr, rtdev->addr_len);
+                smp_wmb();
+                rt->seq++;
+
+                rt_ip_route_changed();
+            }
 
             rtdm_lock_put_irqrestore(&host_table_lock, context);
 
@@ -415,15 +587,24 @@ int rt_ip_route_add_host(u32 addr, unsigned char *dev_addr,
         rt = rt->next;
     }
 
-    if (new_route) {
-        new_route->next    = host_hash_tbl[key];
+    if ((new_route = rt_alloc_host_route()) != NULL) {
+        new_route->dest_host.ip    = addr;
+        new_route->dest_host.rtdev = rtdev;
+        memcpy(new_route->dest_host.dev_addr, dev_addr, rtdev->addr_len);
+        new_route->next = host_hash_tbl[key];
+
+        /* publish the entry only after it is fully set up */
+        smp_wmb();
         host_hash_tbl[key] = new_route;
+        rt_ip_route_changed();
 
         rtdm_lock_put_irqrestore(&host_table_lock, context);
     } else {
         rtdm_lock_put_irqrestore(&host_table_lock, context);
 
-        /*ERRMSG*/rtdm_printk("RTnet: no more host routes available\n");
+        /* misses are resolved from real-time context as well */
+        if (!rtdm_in_rt_context())
+            /*ERRMSG*/printk("RTnet: no more host routes available\n");
         ret = -ENOBUFS;
     }
 
@@ -458,6 +639,7 @@ int rt_ip_route_del_host(u32 addr, struct rtnet_device *rtdev)
             *last_ptr = rt->next;
 
             rt_free_host_route(rt);
+            rt_ip_route_changed();
 
             rtdm_lock_put_irqrestore(&host_table_lock, context);
 
@@ -477,6 +659,9 @@ int rt_ip_route_del_host(u32 addr, struct rtnet_device *rtdev)
 
 /***
  *  rt_ip_route_del_all - deletes all routes associated with a specified device
+ *
+ *  When called from non-real-time context, lookups which may still reference
+ *  the device are finished on return.
  */
 void rt_ip_route_del_all(struct rtnet_device *rtdev)
 {
@@ -499,6 +684,7 @@ void rt_ip_route_del_all(struct rtnet_device *rtdev)
                 *last_host_ptr = host_rt->next;
 
                 rt_free_host_route(host_rt);
+                rt_ip_route_changed();
 
                 rtdm_lock_put_irqrestore(&host_table_lock, context);
 
@@ -514,6 +700,8 @@ void rt_ip_route_del_all(struct rtnet_device *rtdev)
 
     if ((ip = rtdev->local_ip) != 0)
         rt_ip_route_del_host(ip, rtdev);
+
+    rt_route_synchronize();
 }
 
 
@@ -554,39 +742,137 @@ int rt_ip_route_get_host(u32 addr, char *if_name, unsigned char *dev_addr,
 
 
 #ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+/***
+ *  rt_net_reclaim - reuse removed routes and nodes no lookup can reference
+ *
+ *  Note: must be called with net_table_lock held
+ */
+static void rt_net_reclaim(void)
+{
+    struct net_route    *rt;
+    struct net_node     *node;
+
+
+    if (((net_route_limbo == NULL) && (net_node_limbo == NULL)) ||
+        !rt_route_quiescent(net_limbo_epoch))
+        return;
+
+    while ((rt = net_route_limbo) != NULL) {
+        net_route_limbo = rt->next;
+        rt->next        = free_net_route;
+        free_net_route  = rt;
+    }
+
+    while ((node = net_node_limbo) != NULL) {
+        net_node_limbo  = node->next_free;
+        node->next_free = free_net_node;
+        free_net_node   = node;
+    }
+}
+
+
+
 /***
  *  rt_alloc_net_route - allocates new network route
+ *
+ *  Note: must be called with net_table_lock held
  */
 static inline struct net_route *rt_alloc_net_route(void)
 {
-    rtdm_lockctx_t      context;
     struct net_route    *rt;
 
 
-    rtdm_lock_get_irqsave(&net_table_lock, context);
+    if (free_net_route == NULL)
+        rt_net_reclaim();
 
     if ((rt = free_net_route) != NULL) {
         free_net_route = rt->next;
         allocated_net_routes++;
     }
 
-    rtdm_lock_put_irqrestore(&net_table_lock, context);
-
     return rt;
 }
 
 
 
 /***
- *  rt_free_net_route - releases network route
+ *  rt_free_net_route - releases network route once lookups are done with it
  *
  *  Note: must be called with net_table_lock held
  */
 static inline void rt_free_net_route(struct net_route *rt)
 {
-    rt->next       = free_net_route;
-    free_net_route = rt;
-    allocated_host_routes--;
+    rt->next        = net_route_limbo;
+    net_route_limbo = rt;
+    net_limbo_epoch = route_epoch;
+    allocated_net_routes--;
+}
+
+
+
+/***
+ *  rt_alloc_net_node - allocates new trie node
+ *
+ *  Note: must be called with net_table_lock held
+ */
+static inline struct net_node *rt_alloc_net_node(u32 key,
+                                                 unsigned int prefix_len)
+{
+    struct net_node     *node;
+
+
+    if (free_net_node == NULL)
+        rt_net_reclaim();
+
+    if ((node = free_net_node) != NULL) {
+        free_net_node = node->next_free;
+        allocated_net_nodes++;
+
+        node->child[0]   = NULL;
+        node->child[1]   = NULL;
+        node->key        = key;
+        node->prefix_len = prefix_len;
+        node->route      = NULL;
+    }
+
+    return node;
+}
+
+
+
+/***
+ *  rt_free_net_node - releases trie node once lookups are done with it
+ *
+ *  Its children stay intact for lookups still standing on it.
+ *
+ *  Note: must be called with net_table_lock held
+ */
+static inline void rt_free_net_node(struct net_node *node)
+{
+    node->next_free = net_node_limbo;
+    net_node_limbo  = node;
+    net_limbo_epoch = route_epoch;
+    allocated_net_nodes--;
+}
+
+
+
+/***
+ *  rt_net_mask_to_prefix - length of a contiguous network mask
+ *
+ *  Returns -EINVAL for non-contiguous masks, those have no longest match.
+ */
+static int rt_net_mask_to_prefix(u32 mask)
+{
+    u32 host_mask = ntohl(mask);
+
+
+    if (host_mask == 0)
+        return 0;
+    if ((~host_mask & (~host_mask + 1)) != 0)
+        return -EINVAL;
+
+    return 33 - ffs(host_mask);
 }
 
 
@@ -597,60 +883,112 @@ static inline void rt_free_net_route(struct net_route *rt)
 int rt_ip_route_add_net(u32 addr, u32 mask, u32 gw_addr)
 {
     rtdm_lockctx_t      context;
-    struct net_route    *new_route;
+    struct net_node     *node;
+    struct net_node     *child;
+    struct net_node     *leaf;
+    struct net_node     *branch;
     struct net_route    *rt;
-    struct net_route    **last_ptr;
-    unsigned int        key;
-    u32                 shifted_mask;
+    unsigned int        dir;
+    unsigned int        common;
+    u32                 key;
+    int                 prefix_len;
+
 
+    prefix_len = rt_net_mask_to_prefix(mask);
+    if (prefix_len < 0)
+        return prefix_len;
 
     addr &= mask;
+    key = ntohl(addr);
 
-    if ((new_route = rt_alloc_net_route()) != NULL) {
-        new_route->dest_net_ip   = addr;
-        new_route->dest_net_mask = mask;
-        new_route->gw_ip         = gw_addr;
-    }
+    rtdm_lock_get_irqsave(&net_table_lock, context);
 
-    shifted_mask = NET_HASH_KEY_MASK << net_hash_key_shift;
-    if ((mask & shifted_mask) == shifted_mask)
-        key = (ntohl(addr) >> net_hash_key_shift) & NET_HASH_KEY_MASK;
-    else
-        key = NET_HASH_TBL_SIZE;
-    last_ptr = &net_hash_tbl[key];
+    /* descend while the child's prefix covers the new one */
+    node = &net_trie_root;
+    while (node->prefix_len < prefix_len) {
+        dir   = rt_net_key_bit(key, node->prefix_len);
+        child = node->child[dir];
 
-    rtdm_lock_get_irqsave(&net_table_lock, context);
+        if (child != NULL) {
+            /* length of the prefix both have in common */
+            common = min_t(unsigned int, prefix_len, child->prefix_len);
+            common = min_t(unsigned int, common, 32 - fls(key ^ child->key));
 
-    rt = net_hash_tbl[key];
-    while (rt != NULL) {
-        if ((rt->dest_net_ip == addr) && (rt->dest_net_mask == mask)) {
-            rt->gw_ip = gw_addr;
+            if (common == child->prefix_len) {
+                node = child;
+                continue;
+            }
+        }
 
-            if (new_route)
-                rt_free_net_route(new_route);
+        /* the new prefix ends between node and child: insert a node */
+        rt = rt_alloc_net_route();
+        if (rt == NULL)
+            goto no_route;
 
-            rtdm_lock_put_irqrestore(&net_table_lock, context);
+        rt->dest_net_ip   = addr;
+        rt->dest_net_mask = mask;
+        rt->gw_ip         = gw_addr;
 
-            return 0;
+        leaf = rt_alloc_net_node(key, prefix_len);
+        if (leaf == NULL) {
+            rt_free_net_route(rt);
+            goto no_route;
         }
+        leaf->route = rt;
+
+        if (child == NULL) {
+            smp_wmb();
+            node->child[dir] = leaf;
+        } else if (common == prefix_len) {
+            leaf->child[rt_net_key_bit(child->key, prefix_len)] = child;
+            smp_wmb();
+            node->child[dir] = leaf;
+        } else {
+            /* the prefixes diverge: both hang off a new branch */
+            branch = rt_alloc_net_node(key & rt_net_prefix_mask(common),
+                                       common);
+            if (branch == NULL) {
+                rt_free_net_node(leaf);
+                rt_free_net_route(rt);
+                goto no_route;
+            }
+            branch->child[rt_net_key_bit(key, common)]        = leaf;
+            branch->child[rt_net_key_bit(child->key, common)] = child;
+            smp_wmb();
+            node->child[dir] = branch;
+        }
+        goto out;
+    }
 
-        last_ptr = &rt->next;
-        rt = rt->next;
+    /* exact match of an existing node */
+    rt = node->route;
+    if (rt != NULL)
+        rt->gw_ip = gw_addr;
+    else {
+        rt = rt_alloc_net_route();
+        if (rt == NULL)
+            goto no_route;
+
+        rt->dest_net_ip   = addr;
+        rt->dest_net_mask = mask;
+        rt->gw_ip         = gw_addr;
+
+        /* publish the route only after it is fully set up */
+        smp_wmb();
+        node->route = rt;
     }
 
-    if (new_route) {
-        new_route->next = *last_ptr;
-        *last_ptr       = new_route;
+  out:
+    rtdm_lock_put_irqrestore(&net_table_lock, context);
 
-        rtdm_lock_put_irqrestore(&net_table_lock, context);
+    rt_ip_net_route_changed();
+    return 0;
 
-        return 0;
-    } else {
-        rtdm_lock_put_irqrestore(&net_table_lock, context);
+  no_route:
+    rtdm_lock_put_irqrestore(&net_table_lock, context);
 
-        /*ERRMSG*/rtdm_printk("RTnet: no more network routes available\n");
-        return -ENOBUFS;
-    }
+    /*ERRMSG*/rtdm_printk("RTnet: no more network routes available\n");
+    return -ENOBUFS;
 }
 
 
@@ -661,192 +999,270 @@ int rt_ip_route_add_net(u32 addr, u32 mask, u32 gw_addr)
 int rt_ip_route_del_net(u32 addr, u32 mask)
 {
     rtdm_lockctx_t      context;
-    struct net_route    *rt;
-    struct net_route    **last_ptr;
-    unsigned int        key;
-    u32                 shifted_mask;
+    struct net_node     *node;
+    struct net_node     *parent = NULL;
+    struct net_node     *grandparent = NULL;
+    struct net_node     *child;
+    unsigned int        dir = 0;
+    unsigned int        parent_dir = 0;
+    u32                 key;
+    int                 prefix_len;
 
 
-    addr &= mask;
+    prefix_len = rt_net_mask_to_prefix(mask);
+    if (prefix_len < 0)
+        return prefix_len;
 
-    shifted_mask = NET_HASH_KEY_MASK << net_hash_key_shift;
-    if ((mask & shifted_mask) == shifted_mask)
-        key = (ntohl(addr) >> net_hash_key_shift) & NET_HASH_KEY_MASK;
-    else
-        key = NET_HASH_TBL_SIZE;
-    last_ptr = &net_hash_tbl[key];
+    key = ntohl(addr & mask);
 
     rtdm_lock_get_irqsave(&net_table_lock, context);
 
-    rt = net_hash_tbl[key];
-    while (rt != NULL) {
-        if ((rt->dest_net_ip == addr) && (rt->dest_net_mask == mask)) {
-            *last_ptr = rt->next;
-
-            rt_free_net_route(rt);
+    node = &net_trie_root;
+    while ((node != NULL) && (node->prefix_len < prefix_len)) {
+        grandparent = parent;
+        parent_dir  = dir;
+        parent      = node;
+        dir         = rt_net_key_bit(key, node->prefix_len);
+        node        = node->child[dir];
+    }
 
-            rtdm_lock_put_irqrestore(&net_table_lock, context);
+    if ((node == NULL) || (node->prefix_len != prefix_len) ||
+        (node->key != key) || (node->route == NULL)) {
+        rtdm_lock_put_irqrestore(&net_table_lock, context);
+        return -ENOENT;
+    }
 
-            return 0;
+    rt_free_net_route(node->route);
+    node->route = NULL;
+
+    /* drop nodes which neither carry a route nor branch anymore */
+    if (parent != NULL) {
+        if ((node->child[0] == NULL) || (node->child[1] == NULL)) {
+            parent->child[dir] = (node->child[0] != NULL) ?
+                node->child[0] : node->child[1];
+            rt_free_net_node(node);
+
+            child = parent->child[!dir];
+            if ((grandparent != NULL) && (parent->route == NULL) &&
+                (parent->child[dir] == NULL)) {
+                grandparent->child[parent_dir] = child;
+                rt_free_net_node(parent);
+            }
         }
-
-        last_ptr = &rt->next;
-        rt = rt->next;
     }
 
     rtdm_lock_put_irqrestore(&net_table_lock, context);
 
-    return -ENOENT;
+    rt_ip_net_route_changed();
+    return 0;
+}
+
+
+
+/***
+ *  rt_ip_route_lookup_net - find the gateway of the longest matching prefix
+ *
+ *  Note: must be called between rt_route_enter and rt_route_leave
+ */
+static inline int rt_ip_route_lookup_net(u32 daddr, u32 *gw_ip)
+{
+    struct net_node     *node = &net_trie_root;
+    struct net_route    *best = NULL;
+    struct net_route    *rt;
+    u32                 key   = ntohl(daddr);
+
+
+    do {
+        if ((key & rt_net_prefix_mask(node->prefix_len)) != node->key)
+            break;
+        if ((rt = node->route) != NULL)
+            best = rt;
+        if (node->prefix_len == 32)
+            break;
+        node = node->child[rt_net_key_bit(key, node->prefix_len)];
+    } while (node != NULL);
+
+    if (best == NULL)
+        return -EHOSTUNREACH;
+
+    *gw_ip = best->gw_ip;
+    return 0;
 }
 #endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
 
 
 /***
- *  rt_ip_route_output - looks up output route
+ *  __rt_ip_route_output - looks up output route
+ *  @nexthop: returns the next hop without host route on failure
  *
  *  Note: increments refcount on returned rtdev in rt_buf
  */
-int rt_ip_route_output(struct dest_route *rt_buf, u32 daddr, u32 saddr)
+static int __rt_ip_route_output(struct dest_route *rt_buf, u32 daddr,
+                                u32 saddr, u32 *nexthop)
 {
-    rtdm_lockctx_t      context;
     struct host_route   *host_rt;
-    unsigned int        key;
-
-#ifndef CONFIG_RTNET_RTIPV4_NETROUTING
-    #define DADDR       daddr
-#else
-    #define DADDR       real_daddr
-
-    struct net_route    *net_rt;
+    struct rtnet_device *rtdev;
+    unsigned int        slot;
+    unsigned int        seq;
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
     int                 lookup_gw  = 1;
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
     u32                 real_daddr = daddr;
 
 
-  restart:
-#endif /* !CONFIG_RTNET_RTIPV4_NETROUTING */
+    rt_buf->neigh = 0;
+    *nexthop      = INADDR_ANY;
 
-    key = ntohl(daddr) & HOST_HASH_KEY_MASK;
+#ifdef CONFIG_RTNET_RTIPV4_MULTICAST
+    if (IN_MULTICAST(ntohl(daddr)))
+        return rt_ip_route_output_mc(rt_buf, daddr, saddr);
+#endif /* CONFIG_RTNET_RTIPV4_MULTICAST */
 
-    rtdm_lock_get_irqsave(&host_table_lock, context);
+    slot = rt_route_enter();
 
-    host_rt = host_hash_tbl[key];
-    if (likely(saddr == INADDR_ANY))
-        while (host_rt != NULL) {
-            if (host_rt->dest_host.ip == daddr) {
-              host_route_found:
-                memcpy(rt_buf->dev_addr, &host_rt->dest_host.dev_addr,
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+  restart:
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
+    host_rt = host_hash_tbl[ntohl(daddr) & HOST_HASH_KEY_MASK];
+    while (host_rt != NULL) {
+        if (host_rt->dest_host.ip == daddr) {
+            /* retry while the entry is updated concurrently */
+            do {
+                while ((seq = host_rt->seq) & 1)
+                    cpu_relax();
+                smp_rmb();
+
+                rtdev = host_rt->dest_host.rtdev;
+                memcpy(rt_buf->dev_addr, host_rt->dest_host.dev_addr,
                        sizeof(rt_buf->dev_addr));
-                rt_buf->rtdev = host_rt->dest_host.rtdev;
-                rtdev_reference(rt_buf->rtdev);
 
-                rtdm_lock_put_irqrestore(&host_table_lock, context);
+                smp_rmb();
+            } while (seq != host_rt->seq);
+
+            if (likely(saddr == INADDR_ANY) || (rtdev->local_ip == saddr)) {
+                rtdev_reference(rtdev);
+                rt_route_leave(slot);
 
-                rt_buf->ip = DADDR;
+                rt_buf->rtdev = rtdev;
+                rt_buf->ip    = real_daddr;
 
                 return 0;
             }
-            host_rt = host_rt->next;
         }
-    else
-        while (host_rt != NULL) {
-            if ((host_rt->dest_host.ip == daddr) &&
-                (host_rt->dest_host.rtdev->local_ip == saddr))
-                goto host_route_found;
-            host_rt = host_rt->next;
-        }
-
-    rtdm_lock_put_irqrestore(&host_table_lock, context);
+        host_rt = host_rt->next;
+    }
 
 #ifdef CONFIG_RTNET_RTIPV4_NETROUTING
     if (lookup_gw) {
         lookup_gw = 0;
-        key = (ntohl(daddr) >> net_hash_key_shift) & NET_HASH_KEY_MASK;
-
-        rtdm_lock_get_irqsave(&net_table_lock, context);
-
-        net_rt = net_hash_tbl[key];
-        while (net_rt != NULL) {
-            if (net_rt->dest_net_ip == (daddr & net_rt->dest_net_mask)) {
-                daddr = net_rt->gw_ip;
 
-                rtdm_lock_put_irqrestore(&net_table_lock, context);
-
-                /* start over, now using the gateway ip as destination */
-                goto restart;
-            }
+        if (rt_ip_route_lookup_net(daddr, &daddr) == 0)
+            /* start over, now using the gateway ip as destination */
+            goto restart;
+    }
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
-            net_rt = net_rt->next;
-        }
+    rt_route_leave(slot);
 
-        rtdm_lock_put_irqrestore(&net_table_lock, context);
+    /* the gateway if a network route matched */
+    *nexthop = daddr;
 
-        /* last try: no hash key */
-        rtdm_lock_get_irqsave(&net_table_lock, context);
+    return -EHOSTUNREACH;
+}
 
-        net_rt = net_hash_tbl[NET_HASH_TBL_SIZE];
-        while (net_rt != NULL) {
-            if (net_rt->dest_net_ip == (daddr & net_rt->dest_net_mask)) {
-                daddr = net_rt->gw_ip;
 
-                rtdm_lock_put_irqrestore(&net_table_lock, context);
 
-                /* start over, now using the gateway ip as destination */
-                goto restart;
-            }
+/***
+ *  rt_ip_route_output - looks up output route
+ *
+ *  Starts the resolution of the next hop if it lacks a host route, the
+ *  lookup still fails then.
+ *
+ *  Note: increments refcount on returned rtdev in rt_buf
+ */
+int rt_ip_route_output(struct dest_route *rt_buf, u32 daddr, u32 saddr)
+{
+    u32 nexthop;
+    int ret;
 
-            net_rt = net_rt->next;
-        }
 
-        rtdm_lock_put_irqrestore(&net_table_lock, context);
+    ret = __rt_ip_route_output(rt_buf, daddr, saddr, &nexthop);
+    if ((ret < 0) && (nexthop != INADDR_ANY)) {
+        rt_neigh_resolve(nexthop, saddr);
+        rtnet_count_drop(RTNET_DROP_IP_NO_ROUTE);
     }
-#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
-    /*ERRMSG*/rtdm_printk("RTnet: host %u.%u.%u.%u unreachable\n", NIPQUAD(daddr));
-    return -EHOSTUNREACH;
+    return ret;
 }
 
 
 
-#ifdef CONFIG_RTNET_RTIPV4_ROUTER
-int rt_ip_route_forward(struct rtskb *rtskb, u32 daddr)
+/***
+ *  rt_ip_route_output_pending - looks up output route, accepting next hops
+ *                               which are still being resolved
+ *
+ *  If the next hop lacks a host route, rt_buf->neigh is set and packets
+ *  along the route have to be passed to rt_neigh_queue instead of being
+ *  sent directly.
+ *
+ *  Note: increments refcount on returned rtdev in rt_buf
+ */
+int rt_ip_route_output_pending(struct dest_route *rt_buf, u32 daddr,
+                               u32 saddr)
 {
-    struct rtnet_device *rtdev = rtskb->rtdev;
-    struct dest_route   dest;
+    struct rtnet_device *rtdev;
+    u32                 nexthop;
+    int                 ret;
 
 
-    if (likely((daddr == rtdev->local_ip) || (daddr == rtdev->broadcast_ip) ||
-        (rtdev->flags & IFF_LOOPBACK)))
-        return 0;
+    ret = __rt_ip_route_output(rt_buf, daddr, saddr, &nexthop);
+    if ((ret == 0) || (nexthop == INADDR_ANY))
+        return ret;
 
-    if (rtskb_acquire(rtskb, &global_pool) != 0) {
-        /*ERRMSG*/rtdm_printk("RTnet: router overloaded, dropping packet\n");
-        goto error;
+    rtdev = rt_neigh_pending(nexthop, saddr);
+    if (rtdev == NULL) {
+        rtnet_count_drop(RTNET_DROP_IP_NO_ROUTE);
+        return ret;
     }
 
-    if (rt_ip_route_output(&dest, daddr, INADDR_ANY) < 0) {
-        /*ERRMSG*/rtdm_printk("RTnet: unable to forward packet from %u.%u.%u.%u\n",
-                              NIPQUAD(rtskb->nh.iph->saddr));
-        goto error;
-    }
+    memset(rt_buf->dev_addr, 0, sizeof(rt_buf->dev_addr));
+    rt_buf->rtdev = rtdev;
+    rt_buf->ip    = daddr;
+    rt_buf->neigh = nexthop;
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_ip_route_hold - revalidate a route obtained from rt_ip_route_output
+ *  @rt:         route, its rtdev must not be referenced by the caller
+ *  @generation: rt_ip_route_generation read before the route was looked up
+ *
+ *  Takes a reference on rt->rtdev and returns 0 if no route changed since
+ *  then. Devices can only disappear after their routes were removed and
+ *  rt_ip_route_del_all waited for pending lookups, so the reference is safe
+ *  to take inside a lookup section.
+ */
+int rt_ip_route_hold(struct dest_route *rt, unsigned long generation)
+{
+    unsigned int        slot;
+    int                 ret = -ESTALE;
 
-    rtskb->rtdev    = dest.rtdev;
-    rtskb->priority = ROUTER_FORWARD_PRIO;
 
-    if ((dest.rtdev->hard_header) &&
-        (dest.rtdev->hard_header(rtskb, dest.rtdev, ETH_P_IP, dest.dev_addr,
-                                 dest.rtdev->dev_addr, rtskb->len) < 0))
-        goto error;
+    slot = rt_route_enter();
 
-    rtdev_xmit(rtskb);
+    if (likely(generation == rt_ip_route_generation)) {
+        rtdev_reference(rt->rtdev);
+        ret = 0;
+    }
 
-    return 1;
+    rt_route_leave(slot);
 
-  error:
-    kfree_rtskb(rtskb);
-    return 1;
+    return ret;
 }
-#endif /* CONFIG_RTNET_RTIPV4_ROUTER */
 
 
 
@@ -859,13 +1275,17 @@ int __init rt_ip_routing_init(void)
 
 
     for (i = 0; i < CONFIG_RTNET_RTIPV4_HOST_ROUTES-2; i++)
-        host_routes[i].next = &host_routes[i+1];
+        host_routes[i].next_free = &host_routes[i+1];
     free_host_route = &host_routes[0];
 
 #ifdef CONFIG_RTNET_RTIPV4_NETROUTING
-    for (i = 0; i < CONFIG_RTNET_RTIPV4_NET_ROUTES-2; i++)
+    for (i = 0; i < CONFIG_RTNET_RTIPV4_NET_ROUTES-1; i++)
         net_routes[i].next = &net_routes[i+1];
     free_net_route = &net_routes[0];
+
+    for (i = 0; i < NET_TRIE_NODES-1; i++)
+        net_nodes[i].next_free = &net_nodes[i+1];
+    free_net_node = &net_nodes[0];
 #endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
 
 #ifdef CONFIG_PROC_FS
@@ -892,3 +1312,10 @@ EXPORT_SYMBOL(rt_ip_route_add_host);
 EXPORT_SYMBOL(rt_ip_route_del_host);
 EXPORT_SYMBOL(rt_ip_route_del_all);
 EXPORT_SYMBOL(rt_ip_route_output);
+EXPORT_SYMBOL(rt_ip_route_output_pending);
+EXPORT_SYMBOL(rt_ip_route_hold);
+EXPORT_SYMBOL(rt_ip_route_generation);
+#ifdef CONFIG_RTNET_RTIPV4_NETROUTING
+EXPORT_SYMBOL(rt_ip_route_add_net);
+EXPORT_SYMBOL(rt_ip_route_del_net);
+#endif /* CONFIG_RTNET_RTIPV4_NETROUTING */
@@ -32,6 +32,7 @@
 #include <rtskb.h>
 #include <rtdev.h>
 #include <rtnet_port.h>
+#include <rtnet_stats.h>
 #include <ipv4/tcp.h>
 #include <ipv4/ip_sock.h>
 #include <ipv4/ip_output.h>
@@ -445,14 +446,14 @@ static void rt_tcp_retransmit_handler(void *data)
         ts->timer_state--;
         timerwheel_add_timer(&ts->timer, rt_tcp_retransmission_timeout);
 
-        /* warning, rtskb_clone is under lock */
-        skb = rtskb_clone(ts->retransmit_queue.first, &ts->sock.skb_pool);
+        /* warning, rtskb_copy is under lock */
+        skb = rtskb_copy(ts->retransmit_queue.first, &ts->sock.skb_pool);
         rtdm_lock_put_irqrestore(&ts->socket_lock, context);
 
         /* BUG, window changes are not respected */
         if (unlikely(rtdev_xmit(skb)) != 0) {
             kfree_rtskb(skb);
-            rtdm_printk("rttcp: packet retransmission from timer failed\n");
+            rtnet_count_drop(RTNET_DROP_TCP_ERROR);
         }
     } else {
         ts->timer_state = max_retransmits;
@@ -590,7 +591,7 @@ static int rt_ip_build_frame(struct rtskb *skb, struct rtsocket *sk,
     rtdev_dereference(rt->rtdev);
 
     if (ret != rtdev->hard_header_len) {
-        rtdm_printk("rttcp: rt_ip_build_frame: error on lower level\n");
+        rtnet_count_drop(RTNET_DROP_TCP_ERROR);
         return -EINVAL;
     }
 
@@ -655,10 +656,9 @@ rt_tcp_segment(struct dest_route *rt, struct tcp_socket *ts, __be32 flags,
 
     u8 *data = NULL;
 
-    if ((skb = alloc_rtskb(mtu + hh_len + 15, &sk->skb_pool)) == NULL) {
-        rtdm_printk("rttcp: no more elements in skb_pool for allocation\n");
+    if ((skb = alloc_rtskb(mtu + hh_len + 15, &sk->skb_pool)) == NULL)
         return -ENOBUFS;
-    }
+    rtnet_trace_start(skb, rtdm_clock_read());
 
     /* rtskb_reserve(skb, hh_len + 20); */
     rtskb_reserve(skb, hh_len);
@@ -698,12 +698,12 @@ rt_tcp_segment(struct dest_route *rt, struct tcp_socket *ts, __be32 flags,
     /* add rtskb entry to the socket retransmission queue */
     if (ts->tcp_state != TCP_CLOSE &&
         ((flags & (TCP_FLAG_SYN|TCP_FLAG_FIN)) || data_len)) {
-        /* rtskb_clone below is called under lock, this is an admission,
-           because for now there is no rtskb copy by reference */
-        cloned_skb = rtskb_clone(skb, &ts->sock.skb_pool);
+        /* rtskb_copy below is called under lock, this is an admission,
+           because a clone by reference cannot be transmitted */
+        cloned_skb = rtskb_copy(skb, &ts->sock.skb_pool);
         if (!cloned_skb) {
             rtdm_lock_put_irqrestore(&ts->socket_lock, context);
-            rtdm_printk("rttcp: cann't clone skb\n");
+            rtnet_count_drop(RTNET_DROP_TCP_ERROR);
             ret = -ENOMEM;
             goto error;
         }
@@ -753,7 +753,7 @@ static int rt_tcp_send(struct tcp_socket *ts, __be32 flags)
         }
     }
     if (ret < 0)
-        rtdm_printk("rttcp: can't send a packet: err %d\n", -ret);
+        rtnet_count_drop(RTNET_DROP_TCP_ERROR);
     return ret;
 }
 
@@ -816,15 +816,13 @@ static struct rtsocket *rt_tcp_dest_socket(struct rtskb *skb)
 
     if (tcp_v4_check(skb->len, saddr, daddr,
                      csum_partial(skb->data, skb->len, 0))) {
-        rtdm_printk("rttcp: invalid TCP packet checksum, dropped\n");
+        rtnet_count_drop(RTNET_DROP_TCP_CHECKSUM);
         return NULL; /* Invalid checksum, drop the packet */
     }
 
     /* find the destination socket */
     if ((skb->sk = rt_tcp_v4_lookup(daddr, dport)) == NULL) {
-        /*
-          rtdm_printk("Not found addr:0x%08x, port: 0x%04x\n", daddr, dport);
-        */
+        rtnet_count_drop(RTNET_DROP_TCP_NO_SOCKET);
         if (!th->rst) {
             /* No listening socket found, send RST|ACK */
             rst_socket.saddr = daddr;
@@ -965,15 +963,12 @@ static void rt_tcp_rcv(struct rtskb *skb)
             /* but reset ack from old connection */
             ts->tcp_state == TCP_ESTABLISHED) {
             rtdm_lock_put_irqrestore(&ts->socket_lock, context);
-            rtdm_printk("rttcp: dropped unappropriate ACK packet %u\n",
-                        ts->sync.ack_seq);
+            rtnet_count_drop(RTNET_DROP_TCP_WINDOW);
             goto drop;
         }
 
         rtdm_lock_put_irqrestore(&ts->socket_lock, context);
-        rtdm_printk("rttcp: sequence number is not in window, "
-                    "dropped (failed: %u <= %u <= %u)\n",
-                    ts->sync.ack_seq, seq, ts->sync.ack_seq + ts->sync.window);
+        rtnet_count_drop(RTNET_DROP_TCP_WINDOW);
 
         /* That's a forced RST for a lost connection */
         rst_socket.saddr = skb->nh.iph->daddr;
@@ -1081,11 +1076,8 @@ static void rt_tcp_rcv(struct rtskb *skb)
     if (th->ack) {
         /* Check ack sequence */
         if (rt_tcp_before(ts->sync.seq + 1, ntohl(th->ack_seq))) {
-            rtdm_printk("rttcp: unexpected ACK %u %u %u\n",
-                        ts->sync.seq,
-                        ts->nacked_first,
-                        ntohl(th->ack_seq));
             rtdm_lock_put_irqrestore(&ts->socket_lock, context);
+            rtnet_count_drop(RTNET_DROP_TCP_WINDOW);
             goto drop;
         }
 
@@ -1160,7 +1152,7 @@ static void rt_tcp_rcv(struct rtskb *skb)
  */
 static void rt_tcp_rcv_err(struct rtskb *skb)
 {
-    rtdm_printk("rttcp: rt_tcp_rcv err\n");
+    rtnet_count_drop(RTNET_DROP_TCP_ERROR);
 }
 
 static int rt_tcp_window_send(struct tcp_socket *ts, u32 data_len,
@@ -1174,7 +1166,7 @@ static int rt_tcp_window_send(struct tcp_socket *ts, u32 data_len,
 
     if ((ret = rt_tcp_segment(&ts->rt, ts, TCP_FLAG_ACK,
                               data_len, data_ptr, 0)) < 0) {
-        rtdm_printk("rttcp: cann't send a packet: err %d\n", -ret);
+        rtnet_count_drop(RTNET_DROP_TCP_ERROR);
         return ret;
     }
 
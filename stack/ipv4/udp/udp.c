@@ -29,16 +29,20 @@
 #include <linux/udp.h>
 #include <linux/tcp.h>
 #include <net/checksum.h>
+#include <net/ip.h>
 #include <linux/list.h>
+#include <linux/random.h>
 
 #include <rtskb.h>
 #include <rtnet_internal.h>
 #include <rtnet_port.h>
 #include <rtnet_iovec.h>
 #include <rtnet_socket.h>
+#include <rtnet_stats.h>
 #include <ipv4/ip_fragment.h>
 #include <ipv4/ip_output.h>
 #include <ipv4/ip_sock.h>
+#include <ipv4/multicast.h>
 #include <ipv4/protocol.h>
 #include <ipv4/route.h>
 #include <ipv4/udp.h>
@@ -54,6 +58,8 @@ struct udp_socket {
     u32             saddr;      /* local ip-addr */
     struct rtsocket *sock;
     struct hlist_node link;
+    unsigned int    reuseport;  /* RTNET_REUSEPORT_* mode */
+    unsigned int    rr_next;    /* round-robin position, see port_hash_select */
 };
 
 /***
@@ -90,16 +96,28 @@ MODULE_PARM_DESC(auto_port_start, "Start of automatically assigned port range");
 MODULE_PARM_DESC(auto_port_mask,
                  "Mask that defines port range for automatic assignment");
 
+static inline int port_hash_match(struct udp_socket *sock, u32 saddr, u16 sport)
+{
+	return sock->sport == sport &&
+		(saddr == INADDR_ANY
+		 || sock->saddr == saddr
+		 || sock->saddr == INADDR_ANY);
+}
+
+/* sockets sharing a port are bound to the very same address */
+static inline int port_hash_shared(struct udp_socket *sock,
+				   struct udp_socket *other)
+{
+	return sock->sport == other->sport && sock->saddr == other->saddr;
+}
+
 static inline struct udp_socket *port_hash_search(u32 saddr, u16 sport)
 {
 	unsigned bucket = sport & port_hash_mask;
 	struct udp_socket *sock;
 
 	hlist_for_each_entry(sock, &port_hash[bucket], link)
-		if (sock->sport == sport &&
-		    (saddr == INADDR_ANY
-		     || sock->saddr == saddr
-		     || sock->saddr == INADDR_ANY))
+		if (port_hash_match(sock, saddr, sport))
 			return sock;
 
 	return NULL;
@@ -107,18 +125,68 @@ static inline struct udp_socket *port_hash_search(u32 saddr, u16 sport)
 
 static inline int port_hash_insert(struct udp_socket *sock, u32 saddr, u16 sport)
 {
-	unsigned bucket;
-
-	if (port_hash_search(saddr, sport))
+	unsigned bucket = sport & port_hash_mask;
+	struct udp_socket *other;
+	int members = 0;
+
+	/* a port may only be shared by sockets of the same mode and address */
+	hlist_for_each_entry(other, &port_hash[bucket], link)
+		if (port_hash_match(other, saddr, sport)) {
+			if (!sock->reuseport ||
+			    other->reuseport != sock->reuseport ||
+			    other->saddr != saddr)
+				return -EADDRINUSE;
+			members++;
+		}
+	if (members >= RT_UDP_REUSEPORT_MAX)
 		return -EADDRINUSE;
 
-	bucket = sport & port_hash_mask;
 	sock->saddr = saddr;
 	sock->sport = sport;
 	hlist_add_head(&sock->link, &port_hash[bucket]);
 	return 0;
 }
 
+/***
+ *  port_hash_select - choose the receiver among sockets sharing a port
+ *  @first: socket found by port_hash_search
+ *  @saddr: source address of the datagram
+ *  @sport: source port of the datagram
+ *
+ *  Hashing keeps all datagrams of a flow on the same socket. Fan-out groups
+ *  always deliver to @first, copies are made by rt_udp_fanout.
+ */
+static inline struct udp_socket *port_hash_select(struct udp_socket *first,
+						  u32 saddr, u16 sport)
+{
+	unsigned bucket = first->sport & port_hash_mask;
+	struct udp_socket *sock;
+	unsigned int members = 0;
+	unsigned int index;
+
+	if (first->reuseport != RTNET_REUSEPORT_HASH &&
+	    first->reuseport != RTNET_REUSEPORT_RR)
+		return first;
+
+	hlist_for_each_entry(sock, &port_hash[bucket], link)
+		if (port_hash_shared(sock, first))
+			members++;
+	if (members <= 1)
+		return first;
+
+	if (first->reuseport == RTNET_REUSEPORT_RR)
+		index = first->rr_next++ % members;
+	else
+		index = (((ntohl(saddr) ^ ntohs(sport)) * 0x9e3779b1) >> 16) %
+			members;
+
+	hlist_for_each_entry(sock, &port_hash[bucket], link)
+		if (port_hash_shared(sock, first) && index-- == 0)
+			return sock;
+
+	return first;
+}
+
 static inline void port_hash_del(struct udp_socket *sock)
 {
 	hlist_del(&sock->link);
@@ -127,7 +195,8 @@ static inline void port_hash_del(struct udp_socket *sock)
 /***
  *  rt_udp_v4_lookup
  */
-static inline struct rtsocket *rt_udp_v4_lookup(u32 daddr, u16 dport)
+static inline struct rtsocket *rt_udp_v4_lookup(u32 daddr, u16 dport,
+                                                u32 saddr, u16 sport)
 {
     rtdm_lockctx_t  context;
     struct udp_socket *sock;
@@ -135,6 +204,10 @@ static inline struct rtsocket *rt_udp_v4_lookup(u32 daddr, u16 dport)
     rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
     sock = port_hash_search(daddr, dport);
     if (sock) {
+	    if (unlikely(sock->reuseport))
+		    sock = port_hash_select(sock, saddr, sport);
+
+
 	    rt_socket_reference(sock->sock);
 
 	    rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
@@ -199,6 +272,9 @@ int rt_udp_bind(struct rtsocket *sock, const struct sockaddr *addr,
  unlock_out:
     rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
 
+    if (err == 0)
+        rt_ip_xmit_cache_invalidate(sock);
+
     return err;
 }
 
@@ -251,6 +327,8 @@ int rt_udp_connect(struct rtsocket *sock, const struct sockaddr *serv_addr,
         rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
     }
 
+    rt_ip_xmit_cache_invalidate(sock);
+
     return 0;
 }
 
@@ -276,6 +354,9 @@ int rt_udp_socket(struct rtdm_dev_context *sockctx,
     sock->prot.inet.saddr = INADDR_ANY;
     sock->prot.inet.state = TCP_CLOSE;
     sock->prot.inet.tos   = 0;
+    memset(&sock->prot.inet.xmit_cache, 0, sizeof(struct rt_ip_xmit_cache));
+    get_random_bytes(&sock->prot.inet.ip_id, sizeof(sock->prot.inet.ip_id));
+    rt_ip_mc_socket_init(sock);
 
     rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
 
@@ -298,6 +379,7 @@ int rt_udp_socket(struct rtdm_dev_context *sockctx,
     sock->prot.inet.sport     = index + auto_port_start;
 
     /* register UDP socket */
+    port_registry[index].reuseport = RTNET_REUSEPORT_OFF;
     port_hash_insert(&port_registry[index], INADDR_ANY, sock->prot.inet.sport);
     port_registry[index].sock  = sock;
 
@@ -336,11 +418,13 @@ int rt_udp_close(struct rtdm_dev_context *sockctx,
 
     rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
 
+    rt_ip_mc_socket_cleanup(sock);
+
     /* cleanup already collected fragments */
     rt_ip_frag_invalidate_socket(sock);
 
     /* free packets in incoming queue */
-    while ((del = rtskb_dequeue(&sock->incoming)) != NULL)
+    while ((del = rt_socket_dequeue_chain(sock)) != NULL)
         kfree_rtskb(del);
 
     return rt_socket_cleanup(sockctx);
@@ -348,70 +432,32 @@ int rt_udp_close(struct rtdm_dev_context *sockctx,
 
 
 
-int rt_udp_ioctl(struct rtdm_dev_context *sockctx,
-                 rtdm_user_info_t *user_info,
-                 unsigned int request, void *arg)
-{
-    struct rtsocket *sock = (struct rtsocket *)&sockctx->dev_private;
-    struct _rtdm_setsockaddr_args *setaddr = arg;
-
-
-    /* fast path for common socket IOCTLs */
-    if (_IOC_TYPE(request) == RTIOC_TYPE_NETWORK)
-        return rt_socket_common_ioctl(sockctx, user_info, request, arg);
-
-    switch (request) {
-        case _RTIOC_BIND:
-            return rt_udp_bind(sock, setaddr->addr, setaddr->addrlen);
-
-        case _RTIOC_CONNECT:
-            return rt_udp_connect(sock, setaddr->addr, setaddr->addrlen);
-
-        default:
-            return rt_ip_ioctl(sockctx, user_info, request, arg);
-    }
-}
-
-
-
 /***
- *  rt_udp_recvmsg
+ *  rt_udp_copy_datagram - deliver a dequeued datagram to a message buffer
+ *  @sock:      receiving socket
+ *  @skb:       datagram (chain of IP fragments) removed from sock->incoming
+ *  @msg:       destination message buffer
+ *  @msg_flags: MSG_PEEK requeues the datagram instead of releasing it
+ *
+ *  Datagrams which were not validated by the NIC are checksummed while being
+ *  copied. Returns the number of copied bytes or -EBADMSG if the checksum is
+ *  wrong. The datagram is then dropped, and the iovec is left unconsumed.
  */
-ssize_t rt_udp_recvmsg(struct rtdm_dev_context *sockctx,
-                       rtdm_user_info_t *user_info, struct msghdr *msg,
-                       int msg_flags)
+static ssize_t rt_udp_copy_datagram(struct rtsocket *sock, struct rtskb *skb,
+                                    struct msghdr *msg, int msg_flags)
 {
-    struct rtsocket     *sock = (struct rtsocket *)&sockctx->dev_private;
     size_t              len   = rt_iovec_len(msg->msg_iov, msg->msg_iovlen);
-    struct rtskb        *skb;
     struct rtskb        *first_skb;
     size_t              copied = 0;
     size_t              block_size;
+    size_t              copy;
     size_t              data_len;
     struct udphdr       *uh;
     struct sockaddr_in  *sin;
-    nanosecs_rel_t      timeout = sock->timeout;
-    int                 ret;
-
-
-    /* non-blocking receive? */
-    if (testbits(msg_flags, MSG_DONTWAIT))
-        timeout = -1;
-
-    ret = rtdm_sem_timeddown(&sock->pending_sem, timeout, NULL);
-    if (unlikely(ret < 0))
-        switch (ret) {
-            case -EWOULDBLOCK:
-            case -ETIMEDOUT:
-            case -EINTR:
-                return ret;
+    unsigned int        csum;
 
-            default:
-                return -EBADF;   /* socket has been closed */
-        }
 
-    skb = rtskb_dequeue_chain(&sock->incoming);
-    RTNET_ASSERT(skb != NULL, return -EFAULT;);
+    rtnet_trace_end(skb, RTNET_LAT_RX_USER, RTNET_LAT_RX_TOTAL);
 
     uh = skb->h.uh;
     data_len = ntohs(uh->len) - sizeof(struct udphdr);
@@ -425,41 +471,85 @@ ssize_t rt_udp_recvmsg(struct rtdm_dev_context *sockctx,
         sin->sin_addr.s_addr = skb->nh.iph->saddr;
     }
 
-    /* remove the UDP header */
-    __rtskb_pull(skb, sizeof(struct udphdr));
-
     first_skb = skb;
 
-    /* iterate over all IP fragments */
-    do {
-        rtskb_trim(skb, data_len);
+    if (skb->ip_summed != CHECKSUM_UNNECESSARY) {
+        /* skb->csum carries the pseudo header, see rt_udp_dest_socket */
+        csum = csum_partial((unsigned char *)uh, sizeof(struct udphdr),
+                            skb->csum);
+
+        /* remove the UDP header */
+        __rtskb_pull(skb, sizeof(struct udphdr));
+
+        /* iterate over all IP fragments, the checksum has to cover the
+           truncated data as well */
+        do {
+            rtskb_trim(skb, data_len);
+
+            block_size = skb->len;
+            data_len -= block_size;
+
+            copy = min(block_size, len - copied);
+            csum = rt_csum_copy_tokerneliovec(msg->msg_iov, copied,
+                                              skb->data, copy, csum);
+            if (copy < block_size) {
+                msg->msg_flags |= MSG_TRUNC;
+                csum = csum_block_add(csum,
+                    csum_partial(skb->data + copy, block_size - copy, 0),
+                    copied + copy);
+            }
+            copied += copy;
+
+            /* next fragment */
+            skb = skb->next;
+        } while (skb != NULL);
+
+        if (unlikely(csum_fold(csum) != 0)) {
+            rtnet_count_drop(RTNET_DROP_UDP_CHECKSUM);
+            msg->msg_flags &= ~MSG_TRUNC;
+            kfree_rtskb(first_skb);
+            return -EBADMSG;
+        }
 
-        block_size = skb->len;
-        copied += block_size;
-        data_len -= block_size;
+        rt_iovec_advance(msg->msg_iov, copied);
 
-        /* The data must not be longer than the available buffer size */
-        if (copied > len) {
-            block_size -= copied - len;
-            copied = len;
-            msg->msg_flags |= MSG_TRUNC;
+        /* a peeked datagram does not need to be verified again */
+        first_skb->ip_summed = CHECKSUM_UNNECESSARY;
+    } else {
+        /* remove the UDP header */
+        __rtskb_pull(skb, sizeof(struct udphdr));
 
-            /* copy the data */
-            rt_memcpy_tokerneliovec(msg->msg_iov, skb->data, block_size);
+        /* iterate over all IP fragments */
+        do {
+            rtskb_trim(skb, data_len);
 
-            break;
-        }
+            block_size = skb->len;
+            copied += block_size;
+            data_len -= block_size;
 
-        /* copy the data */
-        rt_memcpy_tokerneliovec(msg->msg_iov, skb->data, block_size);
+            /* The data must not be longer than the available buffer size */
+            if (copied > len) {
+                block_size -= copied - len;
+                copied = len;
+                msg->msg_flags |= MSG_TRUNC;
 
-        /* next fragment */
-        skb = skb->next;
-    } while (skb != NULL);
+                /* copy the data */
+                rt_memcpy_tokerneliovec(msg->msg_iov, skb->data, block_size);
+
+                break;
+            }
 
-    /* did we copied all bytes? */
-    if (data_len > 0)
-        msg->msg_flags |= MSG_TRUNC;
+            /* copy the data */
+            rt_memcpy_tokerneliovec(msg->msg_iov, skb->data, block_size);
+
+            /* next fragment */
+            skb = skb->next;
+        } while (skb != NULL);
+
+        /* did we copied all bytes? */
+        if (data_len > 0)
+            msg->msg_flags |= MSG_TRUNC;
+    }
 
     if ((msg_flags & MSG_PEEK) == 0)
         kfree_rtskb(first_skb);
@@ -474,6 +564,133 @@ ssize_t rt_udp_recvmsg(struct rtdm_dev_context *sockctx,
 
 
 
+/***
+ *  rt_udp_wait - wait for the next datagram
+ */
+static inline int rt_udp_wait(struct rtsocket *sock, nanosecs_rel_t timeout)
+{
+    int ret;
+
+
+    /* datagrams only arrive through the mapped ring then */
+    if (unlikely(sock->rxring != NULL))
+        return -EINVAL;
+
+    ret = rtdm_sem_timeddown(&sock->pending_sem, timeout, NULL);
+    if (unlikely(ret < 0))
+        switch (ret) {
+            case -EWOULDBLOCK:
+            case -ETIMEDOUT:
+            case -EINTR:
+                return ret;
+
+            default:
+                return -EBADF;   /* socket has been closed */
+        }
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_udp_recvmsg
+ */
+ssize_t rt_udp_recvmsg(struct rtdm_dev_context *sockctx,
+                       rtdm_user_info_t *user_info, struct msghdr *msg,
+                       int msg_flags)
+{
+    struct rtsocket     *sock = (struct rtsocket *)&sockctx->dev_private;
+    struct rtskb        *skb;
+    nanosecs_rel_t      timeout = sock->timeout;
+    ssize_t             ret;
+
+
+    /* non-blocking receive? */
+    if (testbits(msg_flags, MSG_DONTWAIT))
+        timeout = -1;
+
+    /* corrupted datagrams are dropped, wait for the next one then */
+    do {
+        ret = rt_udp_wait(sock, timeout);
+        if (unlikely(ret < 0))
+            return ret;
+
+        skb = rt_socket_dequeue_chain(sock);
+        RTNET_ASSERT(skb != NULL, return -EFAULT;);
+
+        ret = rt_udp_copy_datagram(sock, skb, msg, msg_flags);
+    } while (ret == -EBADMSG);
+
+    return ret;
+}
+
+
+
+/***
+ *  rt_udp_recvmmsg - receive a batch of datagrams
+ *  @sockctx:   socket context
+ *  @user_info: caller, NULL for kernel users
+ *  @msgvec:    message buffers, msg_len receives the length of each datagram
+ *  @vlen:      number of message buffers
+ *  @msg_flags: MSG_DONTWAIT
+ *
+ *  Blocks (according to the socket timeout) only for the first datagram, the
+ *  remaining buffers are filled with what is already queued on the socket.
+ *  Returns the number of received datagrams or a negative error code if none
+ *  was received.
+ */
+static int rt_udp_recvmmsg(struct rtdm_dev_context *sockctx,
+                           rtdm_user_info_t *user_info,
+                           struct rtnet_mmsghdr *msgvec, unsigned int vlen,
+                           int msg_flags)
+{
+    struct rtsocket     *sock = (struct rtsocket *)&sockctx->dev_private;
+    struct rtskb        *skb;
+    nanosecs_rel_t      timeout = sock->timeout;
+    unsigned int        i;
+    ssize_t             ret;
+
+
+    /* peeking would return the same datagram for every buffer */
+    if (msg_flags & ~MSG_DONTWAIT)
+        return -EINVAL;
+
+    if (vlen == 0)
+        return 0;
+
+    if (user_info &&
+        !rtdm_rw_user_ok(user_info, msgvec, vlen * sizeof(*msgvec)))
+        return -EFAULT;
+
+    if (testbits(msg_flags, MSG_DONTWAIT))
+        timeout = -1;
+
+    i = 0;
+    do {
+        ret = rt_udp_wait(sock, timeout);
+        if (unlikely(ret < 0))
+            return ret;
+
+        /* the first datagram is already accounted, further ones are only
+           picked up if they are pending - this never blocks */
+        do {
+            skb = rt_socket_dequeue_chain(sock);
+            RTNET_ASSERT(skb != NULL, break;);
+
+            /* corrupted datagrams are dropped, their buffer is reused */
+            ret = rt_udp_copy_datagram(sock, skb, &msgvec[i].msg_hdr, 0);
+            if (ret >= 0)
+                msgvec[i++].msg_len = ret;
+        } while ((i < vlen) &&
+                 (rtdm_sem_timeddown(&sock->pending_sem, -1, NULL) == 0));
+    } while (i == 0);
+
+    return i;
+}
+
+
+
 /***
  *  struct udpfakehdr
  */
@@ -485,31 +702,60 @@ struct udpfakehdr
     struct iovec *iov;
     int iovlen;
     u32 wcheck;
+    struct rtskb_zerocopy *zc;  /* pass payload as fragments if set */
 };
 
 
 
+/* attach the payload as fragments if possible, copy it otherwise */
+static inline void rt_udp_put_payload(struct udpfakehdr *ufh,
+                                      unsigned char *to, unsigned int len,
+                                      struct rtskb *skb)
+{
+    if ((ufh->zc == NULL) ||
+        (rt_iovec_to_frags(skb, to, ufh->iov, len, ufh->zc) < 0))
+        rt_memcpy_fromkerneliovec(to, ufh->iov, len);
+}
+
+
+
 /***
+ *  rt_udp_getfrag - fill in UDP header and payload of a (fragment) frame
  *
+ *  The checksum is computed while copying the payload. Only if the datagram
+ *  is fragmented, the data following the first fragment has to be read an
+ *  additional time: fragments are sent in order, but the checksum in the
+ *  leading header already has to cover them.
  */
 static int rt_udp_getfrag(const void *p, unsigned char *to,
-                          unsigned int offset, unsigned int fraglen)
+                          unsigned int offset, unsigned int fraglen,
+                          struct rtskb *skb)
 {
     struct udpfakehdr *ufh = (struct udpfakehdr *)p;
-    int i;
+    unsigned int datalen;
+    unsigned int restlen;
 
 
-    // We should optimize this function a bit (copy+csum...)!
     if (offset==0) {
-        /* Checksum of the complete data part of the UDP message: */
-        for (i = 0; i < ufh->iovlen; i++) {
-            ufh->wcheck = csum_partial(ufh->iov[i].iov_base, ufh->iov[i].iov_len,
-                                       ufh->wcheck);
+        datalen = fraglen - sizeof(struct udphdr);
+        restlen = ntohs(ufh->uh.len) - sizeof(struct udphdr) - datalen;
+
+        if (ufh->zc == NULL) {
+            ufh->wcheck = rt_csum_copy_fromkerneliovec(to +
+                sizeof(struct udphdr), ufh->iov, datalen, ufh->wcheck);
+
+            /* the iovec now starts at the data of the next fragment */
+            if (restlen > 0)
+                ufh->wcheck = rt_csum_kerneliovec(ufh->iov, restlen, datalen,
+                                                  ufh->wcheck);
+        } else {
+            /* payload passed by reference is never touched but for the
+               checksum */
+            ufh->wcheck = rt_csum_kerneliovec(ufh->iov, datalen + restlen, 0,
+                                              ufh->wcheck);
+            rt_udp_put_payload(ufh, to + sizeof(struct udphdr), datalen, skb);
         }
 
-        rt_memcpy_fromkerneliovec(to + sizeof(struct udphdr), ufh->iov,
-                                  fraglen - sizeof(struct udphdr));
-
         /* Checksum of the udp header: */
         ufh->wcheck = csum_partial((unsigned char *)ufh,
                                    sizeof(struct udphdr), ufh->wcheck);
@@ -524,7 +770,7 @@ static int rt_udp_getfrag(const void *p, unsigned char *to,
         return 0;
     }
 
-    rt_memcpy_fromkerneliovec(to, ufh->iov, fraglen);
+    rt_udp_put_payload(ufh, to, fraglen, skb);
 
     return 0;
 }
@@ -532,79 +778,114 @@ static int rt_udp_getfrag(const void *p, unsigned char *to,
 
 
 /***
- *  rt_udp_sendmsg
+ *  rt_udp_dest - resolve the destination of an outgoing message
  */
-ssize_t rt_udp_sendmsg(struct rtdm_dev_context *sockctx,
-                       rtdm_user_info_t *user_info,
-                       const struct msghdr *msg, int msg_flags)
+static int rt_udp_dest(struct rtsocket *sock, const struct msghdr *msg,
+                       u32 *saddr, u32 *daddr, u16 *sport, u16 *dport)
 {
-    struct rtsocket     *sock = (struct rtsocket *)&sockctx->dev_private;
-    size_t              len   = rt_iovec_len(msg->msg_iov, msg->msg_iovlen);
-    int                 ulen  = len + sizeof(struct udphdr);
     struct sockaddr_in  *usin;
-    struct udpfakehdr   ufh;
-    struct dest_route   rt;
-    u32                 saddr;
-    u32                 daddr;
-    u16                 dport;
-    int                 err;
     rtdm_lockctx_t      context;
 
 
-    if ((len < 0) || (len > 0xFFFF-sizeof(struct iphdr)-sizeof(struct udphdr)))
-        return -EMSGSIZE;
-
-    if (msg_flags & MSG_OOB)   /* Mirror BSD error message compatibility */
-        return -EOPNOTSUPP;
-
-    if (msg_flags & ~(MSG_DONTROUTE|MSG_DONTWAIT) )
-        return -EINVAL;
-
     if ((msg->msg_name) && (msg->msg_namelen==sizeof(struct sockaddr_in))) {
         usin = (struct sockaddr_in*) msg->msg_name;
 
         if ((usin->sin_family != AF_INET) && (usin->sin_family != AF_UNSPEC))
             return -EINVAL;
 
-        daddr = usin->sin_addr.s_addr;
-        dport = usin->sin_port;
+        *daddr = usin->sin_addr.s_addr;
+        *dport = usin->sin_port;
 
         rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
     } else {
         rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
 
-        if (sock->prot.inet.state != TCP_ESTABLISHED)
+        if (sock->prot.inet.state != TCP_ESTABLISHED) {
+            rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
             return -ENOTCONN;
+        }
 
-        daddr = sock->prot.inet.daddr;
-        dport = sock->prot.inet.dport;
+        *daddr = sock->prot.inet.daddr;
+        *dport = sock->prot.inet.dport;
     }
-    saddr         = sock->prot.inet.saddr;
-    ufh.uh.source = sock->prot.inet.sport;
+    *saddr = sock->prot.inet.saddr;
+    *sport = sock->prot.inet.sport;
+
+#ifdef CONFIG_RTNET_RTIPV4_MULTICAST
+    /* IP_MULTICAST_IF selects the output device of unbound sockets */
+    if ((*saddr == INADDR_ANY) && IN_MULTICAST(ntohl(*daddr)))
+        *saddr = sock->prot.inet.mc_if;
+#endif /* CONFIG_RTNET_RTIPV4_MULTICAST */
 
     rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
 
-    if ((daddr | dport) == 0)
+    if ((*daddr | *dport) == 0)
         return -EINVAL;
 
-    /* get output route */
-    err = rt_ip_route_output(&rt, daddr, saddr);
-    if (err)
-        return err;
+    return 0;
+}
+
+
+
+/***
+ *  rt_udp_xmit - build and send a datagram via a resolved route
+ *  @tmpl: cached output path of the socket, rt has to point to tmpl->rt then
+ */
+static ssize_t rt_udp_xmit(struct rtsocket *sock, rtdm_user_info_t *user_info,
+                           const struct msghdr *msg, int msg_flags,
+                           struct dest_route *rt, u32 saddr, u32 daddr,
+                           u16 sport, u16 dport, struct rt_ip_xmit_cache *tmpl)
+{
+    size_t              len   = rt_iovec_len(msg->msg_iov, msg->msg_iovlen);
+    int                 ulen  = len + sizeof(struct udphdr);
+    struct udpfakehdr   ufh;
+    struct rtskb_zerocopy zc;
+    struct iovec        area_iov[RTNET_TXAREA_IOVS];
+    int                 err;
+
+
+    if ((len < 0) || (len > 0xFFFF-sizeof(struct iphdr)-sizeof(struct udphdr)))
+        return -EMSGSIZE;
 
     /* we found a route, remember the routing dest-addr could be the netmask */
-    ufh.saddr     = saddr != INADDR_ANY ? saddr : rt.rtdev->local_ip;
+    ufh.saddr     = saddr != INADDR_ANY ? saddr : rt->rtdev->local_ip;
     ufh.daddr     = daddr;
+    ufh.uh.source = sport;
     ufh.uh.dest   = dport;
     ufh.uh.len    = htons(ulen);
     ufh.uh.check  = 0;
     ufh.iov       = msg->msg_iov;
     ufh.iovlen    = msg->msg_iovlen;
     ufh.wcheck    = 0;
+    ufh.zc        = NULL;
+
+    /* payload by reference requires kernel memory, a NIC able to gather it,
+       and a caller which may wait for the transmission - which is unbounded
+       while the next hop is being resolved */
+    if ((rt->neigh == 0) && (rt->rtdev->features & NETIF_F_SG) &&
+        rtdm_in_rt_context()) {
+        if (user_info == NULL) {
+            if (sock->zerocopy) {
+                rtskb_zerocopy_init(&zc);
+                ufh.zc = &zc;
+            }
+        } else if (rt_socket_txarea_iovec(sock, msg, area_iov) == 0) {
+            /* user payload inside the preregistered area */
+            ufh.iov = area_iov;
+            rtskb_zerocopy_init(&zc);
+            ufh.zc = &zc;
+        }
+    }
 
-    err = rt_ip_build_xmit(sock, rt_udp_getfrag, &ufh, ulen, &rt, msg_flags);
+    if (tmpl != NULL)
+        err = rt_ip_build_xmit_cached(sock, rt_udp_getfrag, &ufh, ulen, tmpl,
+                                      msg_flags);
+    else
+        err = rt_ip_build_xmit(sock, rt_udp_getfrag, &ufh, ulen, rt,
+                               msg_flags);
 
-    rtdev_dereference(rt.rtdev);
+    if (ufh.zc != NULL)
+        rtskb_zerocopy_wait(&zc);
 
     if (!err)
         return len;
@@ -614,15 +895,260 @@ ssize_t rt_udp_sendmsg(struct rtdm_dev_context *sockctx,
 
 
 
+static inline int rt_udp_check_flags(int msg_flags)
+{
+    if (msg_flags & MSG_OOB)   /* Mirror BSD error message compatibility */
+        return -EOPNOTSUPP;
+
+    if (msg_flags & ~(MSG_DONTROUTE|MSG_DONTWAIT) )
+        return -EINVAL;
+
+    return 0;
+}
+
+
+
+/***
+ *  rt_udp_sendmsg
+ *
+ *  Connected sockets reuse the output path of their previous datagram as long
+ *  as no route changed. This skips the route lookup and most of the header
+ *  construction.
+ */
+ssize_t rt_udp_sendmsg(struct rtdm_dev_context *sockctx,
+                       rtdm_user_info_t *user_info,
+                       const struct msghdr *msg, int msg_flags)
+{
+    struct rtsocket     *sock = (struct rtsocket *)&sockctx->dev_private;
+    struct rt_ip_xmit_cache tmpl;
+    struct dest_route   rt;
+    unsigned long       generation;
+    int                 connected = (msg->msg_name == NULL);
+    u32                 saddr;
+    u32                 daddr;
+    u16                 sport;
+    u16                 dport;
+    ssize_t             ret;
+
+
+    ret = rt_udp_check_flags(msg_flags);
+    if (ret)
+        return ret;
+
+    if (connected &&
+        (rt_ip_xmit_cache_hold(sock, sizeof(struct udphdr) +
+                rt_iovec_len(msg->msg_iov, msg->msg_iovlen), &tmpl) == 0)) {
+        ret = rt_udp_xmit(sock, user_info, msg, msg_flags, &tmpl.rt,
+                          tmpl.iph.saddr, tmpl.iph.daddr,
+                          tmpl.sport, tmpl.dport, &tmpl);
+
+        rtdev_dereference(tmpl.rt.rtdev);
+
+        return ret;
+    }
+
+    ret = rt_udp_dest(sock, msg, &saddr, &daddr, &sport, &dport);
+    if (ret)
+        return ret;
+
+    /* get output route, a concurrent change is caught by the generation,
+       packets to a next hop which is still being resolved are queued */
+    generation = rt_ip_route_generation;
+    smp_rmb();
+    ret = rt_ip_route_output_pending(&rt, daddr, saddr);
+    if (ret)
+        return ret;
+
+    ret = rt_udp_xmit(sock, user_info, msg, msg_flags, &rt,
+                      saddr, daddr, sport, dport, NULL);
+
+    if (connected && (ret >= 0))
+        rt_ip_xmit_cache_fill(sock, &rt, generation, tmpl.epoch, sport, dport);
+
+    rtdev_dereference(rt.rtdev);
+
+    return ret;
+}
+
+
+
+/***
+ *  rt_udp_sendmmsg - send a batch of datagrams
+ *  @sockctx:   socket context
+ *  @user_info: caller, NULL for kernel users
+ *  @msgvec:    messages, msg_len receives the number of bytes sent for each
+ *  @vlen:      number of messages
+ *  @msg_flags: MSG_DONTROUTE, MSG_DONTWAIT
+ *
+ *  The output route is only looked up again when the destination address
+ *  changes between consecutive messages. Returns the number of sent messages
+ *  or a negative error code if the first one already failed.
+ */
+static int rt_udp_sendmmsg(struct rtdm_dev_context *sockctx,
+                           rtdm_user_info_t *user_info,
+                           struct rtnet_mmsghdr *msgvec, unsigned int vlen,
+                           int msg_flags)
+{
+    struct rtsocket     *sock = (struct rtsocket *)&sockctx->dev_private;
+    struct dest_route   rt;
+    u32                 rt_daddr = 0;
+    u32                 saddr;
+    u32                 daddr;
+    u16                 sport;
+    u16                 dport;
+    unsigned int        i;
+    ssize_t             ret;
+
+
+    ret = rt_udp_check_flags(msg_flags);
+    if (ret)
+        return ret;
+
+    if (vlen == 0)
+        return 0;
+
+    if (user_info &&
+        !rtdm_rw_user_ok(user_info, msgvec, vlen * sizeof(*msgvec)))
+        return -EFAULT;
+
+    rt.rtdev = NULL;
+
+    for (i = 0; i < vlen; i++) {
+        ret = rt_udp_dest(sock, &msgvec[i].msg_hdr, &saddr, &daddr,
+                          &sport, &dport);
+        if (ret)
+            break;
+
+        if ((rt.rtdev == NULL) || (daddr != rt_daddr)) {
+            if (rt.rtdev != NULL)
+                rtdev_dereference(rt.rtdev);
+
+            ret = rt_ip_route_output_pending(&rt, daddr, saddr);
+            if (ret) {
+                rt.rtdev = NULL;
+                break;
+            }
+            rt_daddr = daddr;
+        }
+
+        ret = rt_udp_xmit(sock, user_info, &msgvec[i].msg_hdr, msg_flags,
+                          &rt, saddr, daddr, sport, dport, NULL);
+        if (ret < 0)
+            break;
+
+        msgvec[i].msg_len = ret;
+    }
+
+    if (rt.rtdev != NULL)
+        rtdev_dereference(rt.rtdev);
+
+    return (i > 0) ? i : ret;
+}
+
+
+
 /***
- *  rt_udp_check
+ *  rt_udp_reuseport - set the port sharing mode of a socket
+ *
+ *  The mode cannot be changed while the port is shared with other sockets.
  */
-static inline unsigned short rt_udp_check(struct udphdr *uh, int len,
-                                          unsigned long saddr,
-                                          unsigned long daddr,
-                                          unsigned long base)
+static int rt_udp_reuseport(struct rtsocket *sock, unsigned int mode)
+{
+    struct udp_socket   *usock;
+    struct udp_socket   *other;
+    rtdm_lockctx_t      context;
+    int                 index;
+    int                 err = 0;
+
+
+    if (mode > RTNET_REUSEPORT_FANOUT)
+        return -EINVAL;
+
+    rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
+
+    if ((index = sock->prot.inet.reg_index) < 0) {
+        /* socket is being closed */
+        err = -EBADF;
+        goto unlock_out;
+    }
+    usock = &port_registry[index];
+
+    hlist_for_each_entry(other, &port_hash[usock->sport & port_hash_mask],
+                         link)
+        if ((other != usock) && port_hash_shared(other, usock)) {
+            err = -EBUSY;
+            goto unlock_out;
+        }
+
+    usock->reuseport = mode;
+    usock->rr_next   = 0;
+
+ unlock_out:
+    rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+
+    return err;
+}
+
+
+
+int rt_udp_ioctl(struct rtdm_dev_context *sockctx,
+                 rtdm_user_info_t *user_info,
+                 unsigned int request, void *arg)
 {
-    return(csum_tcpudp_magic(saddr, daddr, len, IPPROTO_UDP, base));
+    struct rtsocket *sock = (struct rtsocket *)&sockctx->dev_private;
+    struct _rtdm_setsockaddr_args *setaddr = arg;
+    struct rtnet_mmsg_args *mmsg = arg;
+
+
+    /* fast path for common socket IOCTLs */
+    if (_IOC_TYPE(request) == RTIOC_TYPE_NETWORK)
+        switch (request) {
+            case RTNET_RTIOC_RECVMMSG:
+                if (user_info &&
+                    !rtdm_read_user_ok(user_info, mmsg, sizeof(*mmsg)))
+                    return -EFAULT;
+
+                return rt_udp_recvmmsg(sockctx, user_info, mmsg->msgvec,
+                                       mmsg->vlen, mmsg->flags);
+
+            case RTNET_RTIOC_SENDMMSG:
+                if (user_info &&
+                    !rtdm_read_user_ok(user_info, mmsg, sizeof(*mmsg)))
+                    return -EFAULT;
+
+                return rt_udp_sendmmsg(sockctx, user_info, mmsg->msgvec,
+                                       mmsg->vlen, mmsg->flags);
+
+            case RTNET_RTIOC_RXRING:
+                return rt_socket_rxring_setup(sockctx, user_info, arg);
+
+            case RTNET_RTIOC_RXRING_WAIT:
+                return rt_socket_rxring_wait(sock);
+
+            case RTNET_RTIOC_RXPRIO:
+                return rt_socket_rxprio_setup(sockctx, user_info, arg);
+
+            case RTNET_RTIOC_TXAREA:
+                return rt_socket_txarea_setup(sockctx, user_info, arg);
+
+            case RTNET_RTIOC_REUSEPORT:
+                return rt_udp_reuseport(sock, *(unsigned int *)arg);
+
+            default:
+                return rt_socket_common_ioctl(sockctx, user_info, request,
+                                              arg);
+        }
+
+    switch (request) {
+        case _RTIOC_BIND:
+            return rt_udp_bind(sock, setaddr->addr, setaddr->addrlen);
+
+        case _RTIOC_CONNECT:
+            return rt_udp_connect(sock, setaddr->addr, setaddr->addrlen);
+
+        default:
+            return rt_ip_ioctl(sockctx, user_info, request, arg);
+    }
 }
 
 
@@ -638,26 +1164,21 @@ struct rtsocket *rt_udp_dest_socket(struct rtskb *skb)
 
     if (uh->check == 0)
         skb->ip_summed = CHECKSUM_UNNECESSARY;
-/* ip_summed (yet) never equals CHECKSUM_PARTIAL
-    else
-        if (skb->ip_summed == CHECKSUM_PARTIAL) {
-            skb->ip_summed = CHECKSUM_UNNECESSARY;
-
-            if ( !rt_udp_check(uh, ulen, saddr, daddr, skb->csum) )
-                return NULL;
-
-            skb->ip_summed = CHECKSUM_NONE;
-        }*/
-
-    if (skb->ip_summed != CHECKSUM_UNNECESSARY)
+    else if ((skb->ip_summed != CHECKSUM_UNNECESSARY) ||
+             (skb->nh.iph->frag_off & htons(IP_MF|IP_OFFSET))) {
+        /* Only a full validation by the NIC is trusted. Everything else,
+           including hardware sums over partial frames, is verified while
+           copying the payload in rt_udp_copy_datagram. */
+        skb->ip_summed = CHECKSUM_NONE;
         skb->csum = csum_tcpudp_nofold(saddr, daddr, ulen, IPPROTO_UDP, 0);
+    }
 
     /* patch broadcast daddr */
     if (daddr == rtdev->broadcast_ip)
         daddr = rtdev->local_ip;
 
     /* find the destination socket */
-    skb->sk = rt_udp_v4_lookup(daddr, uh->dest);
+    skb->sk = rt_udp_v4_lookup(daddr, uh->dest, saddr, uh->source);
 
     return skb->sk;
 }
@@ -665,18 +1186,105 @@ struct rtsocket *rt_udp_dest_socket(struct rtskb *skb)
 
 
 /***
- *  rt_udp_rcv
+ *  rt_udp_rxring_rcv - publish a datagram in the mapped receive ring
+ *
+ *  If the NIC did not verify the checksum, this is done before a frame is
+ *  reserved: every reserved frame has to be published, and earlier frames
+ *  hold back later ones until then.
  */
-void rt_udp_rcv (struct rtskb *skb)
+static void rt_udp_rxring_rcv(struct rtsocket *sock, struct rtskb *skb)
+{
+    struct rtsocket_rxring  *ring = sock->rxring;
+    struct rtnet_rxring_desc *desc;
+    struct rtskb            *first_skb = skb;
+    struct udphdr           *uh = skb->h.uh;
+    struct sockaddr_in      *sin;
+    unsigned char           *to;
+    size_t                  len = ntohs(uh->len) - sizeof(struct udphdr);
+    size_t                  data_len = len;
+    size_t                  pos = 0;
+    size_t                  copied = 0;
+    size_t                  copy;
+    int                     verify = (skb->ip_summed != CHECKSUM_UNNECESSARY);
+    unsigned int            csum = 0;
+    u32                     index;
+
+
+    if (verify)
+        csum = csum_partial((unsigned char *)uh, sizeof(struct udphdr),
+                            skb->csum);
+
+    __rtskb_pull(skb, sizeof(struct udphdr));
+
+    /* iterate over all IP fragments */
+    do {
+        rtskb_trim(skb, data_len);
+        data_len -= skb->len;
+
+        if (verify)
+            csum = csum_block_add(csum, csum_partial(skb->data, skb->len, 0),
+                                  pos);
+        pos += skb->len;
+
+        /* next fragment */
+        skb = skb->next;
+    } while (skb != NULL);
+
+    if (verify && unlikely(csum_fold(csum) != 0)) {
+        rtnet_count_drop(RTNET_DROP_UDP_CHECKSUM);
+        kfree_rtskb(first_skb);
+        return;
+    }
+
+    desc = rt_socket_rxring_frame(ring, &index);
+    if (desc == NULL) {
+        kfree_rtskb(first_skb);
+        return;
+    }
+    to = RTNET_RXRING_DATA(desc);
+
+    desc->stamp   = first_skb->time_stamp;
+    desc->len     = len;
+    desc->addrlen = sizeof(struct sockaddr_in);
+
+    sin = (struct sockaddr_in *)desc->addr;
+    sin->sin_family      = AF_INET;
+    sin->sin_port        = uh->source;
+    sin->sin_addr.s_addr = first_skb->nh.iph->saddr;
+
+    for (skb = first_skb; (skb != NULL) && (copied < ring->data_size);
+         skb = skb->next) {
+        copy = min_t(size_t, skb->len, ring->data_size - copied);
+        memcpy(to + copied, skb->data, copy);
+        copied += copy;
+    }
+
+    desc->copied = copied;
+
+    rt_socket_rxring_publish(sock, index);
+
+    rtnet_trace_end(first_skb, RTNET_LAT_RX_USER, RTNET_LAT_RX_TOTAL);
+    kfree_rtskb(first_skb);
+}
+
+
+
+/***
+ *  rt_udp_deliver - queue a datagram and notify the receiver
+ */
+static void rt_udp_deliver(struct rtsocket *sock, struct rtskb *skb)
 {
-    struct rtsocket *sock = skb->sk;
     void            (*callback_func)(struct rtdm_dev_context *, void *);
     void            *callback_arg;
     rtdm_lockctx_t  context;
 
 
-    rtskb_queue_tail(&sock->incoming, skb);
-    rtdm_sem_up(&sock->pending_sem);
+    if (sock->rxring != NULL)
+        rt_udp_rxring_rcv(sock, skb);
+    else {
+        rt_socket_queue_rx(sock, skb, skb->nh.iph, skb->h.uh->source);
+        rtdm_sem_up(&sock->pending_sem);
+    }
 
     rtdm_lock_get_irqsave(&sock->param_lock, context);
     callback_func = sock->callback_func;
@@ -689,12 +1297,115 @@ void rt_udp_rcv (struct rtskb *skb)
 
 
 
+/* clone all rtskbs of a (fragmented) datagram */
+static struct rtskb *rt_udp_clone_chain(struct rtskb *skb,
+                                        struct rtskb_queue *pool)
+{
+    struct rtskb    *first = NULL;
+    struct rtskb    *last = NULL;
+    struct rtskb    *clone;
+
+
+    do {
+        clone = rtskb_clone(skb, pool);
+        if (clone == NULL) {
+            if (first != NULL)
+                kfree_rtskb(first);
+            return NULL;
+        }
+
+        if (first == NULL)
+            first = clone;
+        else
+            last->next = clone;
+        last = clone;
+
+        skb = skb->next;
+    } while (skb != NULL);
+
+    first->chain_end = last;
+
+    return first;
+}
+
+
+
+/***
+ *  rt_udp_fanout - deliver copies of a datagram to all other sockets
+ *                  sharing the port of @sock in RTNET_REUSEPORT_FANOUT mode
+ *
+ *  The copies share the data of @skb, each socket only pays for the rtskb
+ *  heads out of its own pool.
+ */
+static void rt_udp_fanout(struct rtsocket *sock, struct rtskb *skb)
+{
+    struct rtsocket     *members[RT_UDP_REUSEPORT_MAX];
+    struct udp_socket   *usock;
+    struct udp_socket   *other;
+    struct rtskb        *clone;
+    unsigned int        count = 0;
+    unsigned int        i;
+    rtdm_lockctx_t      context;
+    int                 index;
+
+
+    rtdm_lock_get_irqsave(&udp_socket_base_lock, context);
+
+    if ((index = sock->prot.inet.reg_index) >= 0) {
+        usock = &port_registry[index];
+
+        hlist_for_each_entry(other,
+                             &port_hash[usock->sport & port_hash_mask], link)
+            if ((other != usock) && port_hash_shared(other, usock) &&
+                (count < RT_UDP_REUSEPORT_MAX)) {
+                rt_socket_reference(other->sock);
+                members[count++] = other->sock;
+            }
+    }
+
+    rtdm_lock_put_irqrestore(&udp_socket_base_lock, context);
+
+    for (i = 0; i < count; i++) {
+        clone = rt_udp_clone_chain(skb, &members[i]->skb_pool);
+        if (clone != NULL) {
+            clone->sk = members[i];
+            rt_udp_deliver(members[i], clone);
+        } else
+            rtnet_count_drop(RTNET_DROP_IP_SOCKET_POOL);
+
+        rt_socket_dereference(members[i]);
+    }
+}
+
+
+
+/***
+ *  rt_udp_rcv
+ */
+void rt_udp_rcv (struct rtskb *skb)
+{
+    struct rtsocket *sock = skb->sk;
+    int             index = sock->prot.inet.reg_index;
+
+
+    rtnet_trace(skb, RTNET_LAT_RX_SOCKET);
+
+    /* copies first, delivery may already release skb */
+    if (unlikely((index >= 0) &&
+                 (port_registry[index].reuseport == RTNET_REUSEPORT_FANOUT)))
+        rt_udp_fanout(sock, skb);
+
+    rt_udp_deliver(sock, skb);
+}
+
+
+
 /***
  *  rt_udp_rcv_err
  */
 void rt_udp_rcv_err (struct rtskb *skb)
 {
-    rtdm_printk("RTnet: rt_udp_rcv err\n");
+    rtnet_count_drop(RTNET_DROP_UDP_ERROR);
 }
 
 
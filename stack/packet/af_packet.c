@@ -27,11 +27,63 @@
 
 #include <rtnet_iovec.h>
 #include <rtnet_socket.h>
+#include <rtnet_stats.h>
 #include <stack_mgr.h>
 
 MODULE_LICENSE("GPL");
 
 
+/***
+ *  rt_packet_rxring_rcv - publish a packet in the mapped receive ring
+ *
+ *  The rtskb remains with the caller.
+ */
+static void rt_packet_rxring_rcv(struct rtsocket *sock, struct rtskb *skb)
+{
+    struct rtsocket_rxring  *ring  = sock->rxring;
+    struct rtnet_device     *rtdev = skb->rtdev;
+    struct rtnet_rxring_desc *desc;
+    struct sockaddr_ll      *sll;
+    unsigned char           *data  = skb->data;
+    unsigned int            len    = skb->len;
+    u32                     index;
+
+
+    desc = rt_socket_rxring_frame(ring, &index);
+    if (desc == NULL)
+        return;
+
+    /* Include the header in raw delivery */
+    if (rt_socket_context(sock)->device->socket_type != SOCK_DGRAM) {
+        len += skb->data - skb->mac.raw;
+        data = skb->mac.raw;
+    }
+
+    desc->stamp   = skb->time_stamp;
+    desc->len     = len;
+    desc->copied  = min(len, ring->data_size);
+    desc->addrlen = sizeof(*sll);
+
+    sll = (struct sockaddr_ll *)desc->addr;
+    sll->sll_family   = AF_PACKET;
+    sll->sll_hatype   = rtdev->type;
+    sll->sll_protocol = skb->protocol;
+    sll->sll_pkttype  = skb->pkt_type;
+    sll->sll_ifindex  = rtdev->ifindex;
+
+    /* Ethernet specific - we rather need some parse handler here */
+    memcpy(sll->sll_addr, skb->mac.ethernet->h_source, ETH_ALEN);
+    sll->sll_halen = ETH_ALEN;
+
+    memcpy(RTNET_RXRING_DATA(desc), data, desc->copied);
+
+    rtnet_trace_end(skb, RTNET_LAT_RX_USER, RTNET_LAT_RX_TOTAL);
+
+    rt_socket_rxring_publish(sock, index);
+}
+
+
+
 /***
  *  rt_packet_rcv
  */
@@ -48,23 +100,41 @@ static int rt_packet_rcv(struct rtskb *skb, struct rtpacket_type *pt)
     if (unlikely((ifindex != 0) && (ifindex != skb->rtdev->ifindex)))
         return -EUNATCH;
 
+    /* the ring takes a copy, no socket buffer is needed */
+    if (sock->rxring != NULL) {
+        rt_packet_rxring_rcv(sock, skb);
+#ifdef CONFIG_RTNET_ETH_P_ALL
+        if (pt->type != htons(ETH_P_ALL))
+#endif /* CONFIG_RTNET_ETH_P_ALL */
+            kfree_rtskb(skb);
+        goto signal;
+    }
+
 #ifdef CONFIG_RTNET_ETH_P_ALL
     if (pt->type == htons(ETH_P_ALL)) {
         struct rtskb *clone_skb = rtskb_clone(skb, &sock->skb_pool);
-        if (clone_skb == NULL)
+        if (clone_skb == NULL) {
+            rtnet_count_drop(RTNET_DROP_PACKET_POOL);
             return 0;
+        }
         skb = clone_skb;
     } else
 #endif /* CONFIG_RTNET_ETH_P_ALL */
         if (unlikely(rtskb_acquire(skb, &sock->skb_pool) < 0)) {
+            rtnet_count_drop(RTNET_DROP_PACKET_POOL);
             kfree_rtskb(skb);
             return 0;
         }
 
     rtdev_reference(skb->rtdev);
-    rtskb_queue_tail(&sock->incoming, skb);
+    rtnet_trace(skb, RTNET_LAT_RX_SOCKET);
+    rt_socket_queue_rx(sock, skb,
+                       ((skb->protocol == htons(ETH_P_IP)) &&
+                        (skb->len >= sizeof(struct iphdr))) ?
+                           skb->nh.iph : NULL, 0);
     rtdm_sem_up(&sock->pending_sem);
 
+  signal:
     rtdm_lock_get_irqsave(&sock->param_lock, context);
     callback_func = sock->callback_func;
     callback_arg  = sock->callback_arg;
@@ -219,7 +289,7 @@ static int rt_packet_close(struct rtdm_dev_context *sockctx,
     rtdm_lock_put_irqrestore(&sock->param_lock, context);
 
     /* free packets in incoming queue */
-    while ((del = rtskb_dequeue(&sock->incoming)) != NULL) {
+    while ((del = rt_socket_dequeue_chain(sock)) != NULL) {
         rtdev_dereference(del->rtdev);
         kfree_rtskb(del);
     }
@@ -246,7 +316,20 @@ static int rt_packet_ioctl(struct rtdm_dev_context *sockctx,
 
     /* fast path for common socket IOCTLs */
     if (_IOC_TYPE(request) == RTIOC_TYPE_NETWORK)
-        return rt_socket_common_ioctl(sockctx, user_info, request, arg);
+        switch (request) {
+            case RTNET_RTIOC_RXRING:
+                return rt_socket_rxring_setup(sockctx, user_info, arg);
+
+            case RTNET_RTIOC_RXRING_WAIT:
+                return rt_socket_rxring_wait(sock);
+
+            case RTNET_RTIOC_RXPRIO:
+                return rt_socket_rxprio_setup(sockctx, user_info, arg);
+
+            default:
+                return rt_socket_common_ioctl(sockctx, user_info, request,
+                                              arg);
+        }
 
     switch (request) {
         case _RTIOC_BIND:
@@ -280,6 +363,10 @@ static ssize_t rt_packet_recvmsg(struct rtdm_dev_context *sockctx,
     nanosecs_rel_t      timeout = sock->timeout;
 
 
+    /* packets only arrive through the mapped ring then */
+    if (unlikely(sock->rxring != NULL))
+        return -EINVAL;
+
     /* non-blocking receive? */
     if (testbits(msg_flags, MSG_DONTWAIT))
         timeout = -1;
@@ -296,9 +383,11 @@ static ssize_t rt_packet_recvmsg(struct rtdm_dev_context *sockctx,
                 return -EBADF;   /* socket has been closed */
         }
 
-    rtskb = rtskb_dequeue_chain(&sock->incoming);
+    rtskb = rt_socket_dequeue_chain(sock);
     RTNET_ASSERT(rtskb != NULL, return -EFAULT;);
 
+    rtnet_trace_end(rtskb, RTNET_LAT_RX_USER, RTNET_LAT_RX_TOTAL);
+
     sll = msg->msg_name;
 
     /* copy the address */
@@ -356,6 +445,9 @@ static ssize_t rt_packet_sendmsg(struct rtdm_dev_context *sockctx,
     struct sockaddr_ll  *sll  = (struct sockaddr_ll*)msg->msg_name;
     struct rtnet_device *rtdev;
     struct rtskb        *rtskb;
+    struct rtskb_zerocopy zc;
+    struct rtskb_zerocopy *use_zc = NULL;
+    unsigned char       *data;
     unsigned short      proto;
     unsigned char       *addr;
     int                 ifindex;
@@ -394,6 +486,7 @@ static ssize_t rt_packet_sendmsg(struct rtdm_dev_context *sockctx,
         ret = -ENOBUFS;
         goto out;
     }
+    rtnet_trace_start(rtskb, rtdm_clock_read());
 
     /* If an RTmac discipline is active, this becomes a pure sanity check to
        avoid writing beyond rtskb boundaries. The hard check is then performed
@@ -427,7 +520,20 @@ static ssize_t rt_packet_sendmsg(struct rtdm_dev_context *sockctx,
             goto err;
     }
 
-    rt_memcpy_fromkerneliovec(rtskb_put(rtskb, len), msg->msg_iov, len);
+    /* payload by reference requires kernel memory, a NIC able to gather it,
+       a caller which may wait for the transmission, and a linear link layer
+       header (i.e. no SOCK_RAW) */
+    if (sock->zerocopy && (user_info == NULL) &&
+        (rtdev->features & NETIF_F_SG) && rtdm_in_rt_context() &&
+        (sockctx->device->socket_type == SOCK_DGRAM)) {
+        rtskb_zerocopy_init(&zc);
+        use_zc = &zc;
+    }
+
+    data = rtskb_put(rtskb, len);
+    if ((use_zc == NULL) ||
+        (rt_iovec_to_frags(rtskb, data, msg->msg_iov, len, use_zc) < 0))
+        rt_memcpy_fromkerneliovec(data, msg->msg_iov, len);
 
     if ((rtdev->flags & IFF_UP) != 0) {
         if ((ret = rtdev_xmit(rtskb)) == 0)
@@ -438,6 +544,8 @@ static ssize_t rt_packet_sendmsg(struct rtdm_dev_context *sockctx,
     }
 
  out:
+    if (use_zc != NULL)
+        rtskb_zerocopy_wait(use_zc);
     rtdev_dereference(rtdev);
     return ret;
 
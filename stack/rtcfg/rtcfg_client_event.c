@@ -636,6 +636,7 @@ static void rtcfg_client_recv_stage_1(int ifindex, struct rtskb *rtskb)
 
                 rtdev->local_ip     = daddr;
                 rtdev->broadcast_ip = bcast;
+                rtdev->netmask      = mask;
 
                 if ((tmp = rtdev_get_loopback()) != NULL) {
                     rt_ip_route_add_host(daddr, tmp->dev_addr, tmp);
@@ -30,7 +30,9 @@
 #include <linux/moduleparam.h>
 
 #include <rtnet_internal.h>
+#include <rtnet_stats.h>
 #include <rtskb.h>
+#include <stack_mgr.h>
 #include <ethernet/eth.h>
 #include <rtmac/rtmac_disc.h>
 
@@ -264,6 +266,7 @@ void rtdev_free (struct rtnet_device *rtdev)
 {
     if (rtdev != NULL) {
         rtskb_pool_shrink(&global_pool, rtdev->add_rtskbs);
+        rtskb_pool_shrink(&global_jumbo_pool, rtdev->add_jumbo_rtskbs);
         rtdev->stack_event = NULL;
         rtdm_mutex_destroy(&rtdev->xmit_mutex);
         kfree(rtdev);
@@ -493,6 +496,11 @@ int rt_register_rtnetdev(struct rtnet_device *rtdev)
 
     rtdm_lock_put_irqrestore(&rtnet_devices_rt_lock, context);
 
+    /* compensation for jumbo frames taken over by the stack */
+    if ((rtdev->mtu > ETH_DATA_LEN) && (rtdev->add_jumbo_rtskbs == 0))
+        rtdev->add_jumbo_rtskbs =
+            rtskb_pool_extend(&global_jumbo_pool, device_rtskbs);
+
     list_for_each(entry, &event_hook_list) {
         hook = list_entry(entry, struct rtdev_event_hook, entry);
         if (hook->register_device)
@@ -561,6 +569,8 @@ int rt_unregister_rtnetdev(struct rtnet_device *rtdev)
 
     mutex_unlock(&rtnet_devices_nrt_lock);
 
+    rt_stack_mgr_dev_release(rtdev);
+
     clear_bit(__RTNET_LINK_STATE_PRESENT, &rtdev->link_state);
 
     RTNET_ASSERT(atomic_read(&rtdev->refcount) == 0,
@@ -642,6 +652,84 @@ int rtdev_close(struct rtnet_device *rtdev)
 
 
 
+/***
+ *  rtdev_mc_add - add an address to the multicast receive filter
+ *  @rtdev: device
+ *  @addr:  link layer multicast address
+ *
+ *  Addresses are reference counted. Returns -EOPNOTSUPP if the driver cannot
+ *  filter multicast frames and -ENOSPC if the filter list is full. Must be
+ *  called from non-real-time context.
+ */
+int rtdev_mc_add(struct rtnet_device *rtdev, const unsigned char *addr)
+{
+    unsigned int    i;
+    int             ret = 0;
+
+
+    if (rtdev->set_multicast_list == NULL)
+        return -EOPNOTSUPP;
+
+    mutex_lock(&rtdev->nrt_lock);
+
+    for (i = 0; i < rtdev->mc_count; i++)
+        if (memcmp(rtdev->mc_list[i], addr, ETH_ALEN) == 0) {
+            rtdev->mc_users[i]++;
+            goto out;
+        }
+
+    if (rtdev->mc_count == RTDEV_MC_MAX) {
+        ret = -ENOSPC;
+        goto out;
+    }
+
+    memcpy(rtdev->mc_list[i], addr, ETH_ALEN);
+    rtdev->mc_users[i] = 1;
+    rtdev->mc_count++;
+
+    rtdev->set_multicast_list(rtdev);
+
+  out:
+    mutex_unlock(&rtdev->nrt_lock);
+
+    return ret;
+}
+
+
+
+/***
+ *  rtdev_mc_del - release an address of the multicast receive filter
+ */
+int rtdev_mc_del(struct rtnet_device *rtdev, const unsigned char *addr)
+{
+    unsigned int    i, last;
+    int             ret = -ENOENT;
+
+
+    mutex_lock(&rtdev->nrt_lock);
+
+    for (i = 0; i < rtdev->mc_count; i++)
+        if (memcmp(rtdev->mc_list[i], addr, ETH_ALEN) == 0) {
+            ret = 0;
+            if (--rtdev->mc_users[i] > 0)
+                break;
+
+            /* keep the list packed */
+            last = --rtdev->mc_count;
+            memcpy(rtdev->mc_list[i], rtdev->mc_list[last], ETH_ALEN);
+            rtdev->mc_users[i] = rtdev->mc_users[last];
+
+            rtdev->set_multicast_list(rtdev);
+            break;
+        }
+
+    mutex_unlock(&rtdev->nrt_lock);
+
+    return ret;
+}
+
+
+
 static int rtdev_locked_xmit(struct rtskb *skb, struct rtnet_device *rtdev)
 {
     int ret;
@@ -671,12 +759,24 @@ int rtdev_xmit(struct rtskb *rtskb)
 
     RTNET_ASSERT(rtdev != NULL, return -EINVAL;);
 
+    if (unlikely(rtskb->nr_frags > 0) && !(rtdev->features & NETIF_F_SG)) {
+        err = rtskb_linearize(rtskb);
+        if (err) {
+            kfree_rtskb(rtskb);
+            return err;
+        }
+    }
+
+    /* with RTmac, the discipline queues first, see rtmac_xmit() */
+    if (rtdev->mac_disc == NULL)
+        rtnet_trace_end(rtskb, RTNET_LAT_TX_XMIT, RTNET_LAT_TX_TOTAL);
+
     err = rtdev->start_xmit(rtskb, rtdev);
     if (err) {
         /* on error we must free the rtskb here */
         kfree_rtskb(rtskb);
 
-        rtdm_printk("hard_start_xmit returned %d\n", err);
+        rtnet_count_drop(RTNET_DROP_TX_ERROR);
     }
 
     return err;
@@ -711,7 +811,7 @@ int rtdev_xmit_proxy(struct rtskb *rtskb)
             /* on error we must free the rtskb here */
             kfree_rtskb(rtskb);
 
-            rtdm_printk("hard_start_xmit returned %d\n", err);
+            rtnet_count_drop(RTNET_DROP_TX_ERROR);
         }
     }
 
@@ -732,6 +832,9 @@ EXPORT_SYMBOL(rtdev_free);
 
 EXPORT_SYMBOL(rtdev_alloc_name);
 
+EXPORT_SYMBOL(rtdev_mc_add);
+EXPORT_SYMBOL(rtdev_mc_del);
+
 EXPORT_SYMBOL(rt_register_rtnetdev);
 EXPORT_SYMBOL(rt_unregister_rtnetdev);
 
@@ -43,6 +43,7 @@ int nomac_rt_packet_tx(struct rtskb *rtskb, struct rtnet_device *rtdev)
 
 
     rtcap_mark_rtmac_enqueue(rtskb);
+    rtnet_trace(rtskb, RTNET_LAT_TX_RTMAC_ENQUEUE);
 
     /* no MAC: we simply transmit the packet under xmit_lock */
     rtdm_mutex_lock(&rtdev->xmit_mutex);
@@ -64,6 +65,7 @@ int nomac_nrt_packet_tx(struct rtskb *rtskb)
 
 
     rtcap_mark_rtmac_enqueue(rtskb);
+    rtnet_trace(rtskb, RTNET_LAT_TX_RTMAC_ENQUEUE);
 
     /* note: this routine may be called both in rt and non-rt context
      *       => detect and wrap the context if necessary */
@@ -92,6 +94,7 @@ void nrt_xmit_task(void *arg)
     while (rtdm_event_wait(&wakeup_sem) == 0)
         while ((rtskb = rtskb_dequeue(&nrt_rtskb_queue))) {
             rtdev = rtskb->rtdev;
+            rtnet_trace(rtskb, RTNET_LAT_TX_RTMAC_DEQUEUE);
 
             /* no MAC: we simply transmit the packet under xmit_lock */
             rtdm_mutex_lock(&rtdev->xmit_mutex);
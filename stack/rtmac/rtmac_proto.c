@@ -24,6 +24,7 @@
 
 
 #include <rtnet_sys.h>
+#include <rtnet_stats.h>
 #include <stack_mgr.h>
 #include <rtmac/rtmac_disc.h>
 #include <rtmac/rtmac_proto.h>
@@ -38,10 +39,7 @@ int rtmac_proto_rx(struct rtskb *skb, struct rtpacket_type *pt)
 
 
     if (disc == NULL) {
-#if 0 /* switch this warning off until we control error message output */
-        /*ERROR*/rtdm_printk("RTmac: received RTmac packet on unattached "
-                             "device %s\n", skb->rtdev->name);
-#endif
+        rtnet_count_drop(RTNET_DROP_RTMAC_UNATTACHED);
         goto error;
     }
 
@@ -49,9 +47,7 @@ int rtmac_proto_rx(struct rtskb *skb, struct rtpacket_type *pt)
     rtskb_pull(skb, sizeof(struct rtmac_hdr));
 
     if (hdr->ver != RTMAC_VERSION) {
-        rtdm_printk("RTmac: received unsupported RTmac protocol version on "
-                    "device %s.  Got 0x%x but expected 0x%x\n",
-                    skb->rtdev->name, hdr->ver, RTMAC_VERSION);
+        rtnet_count_drop(RTNET_DROP_RTMAC_VERSION);
         goto error;
     }
 
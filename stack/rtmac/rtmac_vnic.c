@@ -26,6 +26,7 @@
 #include <linux/rtnetlink.h>
 
 #include <rtnet_internal.h>
+#include <rtnet_stats.h>
 #include <rtdev.h>
 #include <rtnet_port.h> /* for netdev_priv() */
 #include <rtmac/rtmac_disc.h>
@@ -50,6 +51,7 @@ int rtmac_vnic_rx(struct rtskb *rtskb, u16 type)
 
     if (rtskb_acquire(rtskb, pool) != 0) {
         mac_priv->vnic_stats.rx_dropped++;
+        rtnet_count_drop(RTNET_DROP_RTMAC_VNIC);
         kfree_rtskb(rtskb);
         return -1;
     }
@@ -139,6 +139,7 @@ int tdma_rt_packet_tx(struct rtskb *rtskb, struct rtnet_device *rtdev)
     tdma = (struct tdma_priv *)rtdev->mac_priv->disc_priv;
 
     rtcap_mark_rtmac_enqueue(rtskb);
+    rtnet_trace(rtskb, RTNET_LAT_TX_RTMAC_ENQUEUE);
 
     rtdm_lock_get_irqsave(&tdma->lock, context);
 
@@ -176,6 +177,7 @@ int tdma_nrt_packet_tx(struct rtskb *rtskb)
     tdma = (struct tdma_priv *)rtskb->rtdev->mac_priv->disc_priv;
 
     rtcap_mark_rtmac_enqueue(rtskb);
+    rtnet_trace(rtskb, RTNET_LAT_TX_RTMAC_ENQUEUE);
 
     rtskb->priority = RTSKB_PRIO_VALUE(QUEUE_MIN_PRIO, DEFAULT_NRT_SLOT);
 
@@ -47,6 +47,7 @@ static void do_slot_job(struct tdma_priv *tdma, struct tdma_slot *job,
         return;
     rtdm_lock_put_irqrestore(&tdma->lock, lockctx);
 
+    rtnet_trace(rtskb, RTNET_LAT_TX_RTMAC_DEQUEUE);
     rtmac_xmit(rtskb);
 
     rtdm_lock_get_irqsave(&tdma->lock, lockctx);
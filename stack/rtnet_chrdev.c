@@ -33,6 +33,9 @@
 
 #include <rtnet_chrdev.h>
 #include <rtnet_internal.h>
+#include <rtnet_stats.h>
+#include <rtvlan.h>
+#include <stack_mgr.h>
 #include <ipv4/route.h>
 
 
@@ -103,6 +106,31 @@ static int rtnet_ioctl(struct inode *inode, struct file *file,
 
 
 
+static int rtnet_drop_stats_ioctl(unsigned long arg)
+{
+    struct rtnet_drop_stats_cmd cmd;
+    unsigned long               counters[RTNET_DROP_REASONS];
+    int                         i;
+
+
+    BUILD_BUG_ON(RTNET_DROP_REASONS > RTNET_DROP_MAX_REASONS);
+
+    memset(&cmd, 0, sizeof(cmd));
+
+    rtnet_drop_stats(counters);
+
+    cmd.count = RTNET_DROP_REASONS;
+    for (i = 0; i < RTNET_DROP_REASONS; i++)
+        cmd.counter[i] = counters[i];
+
+    if (copy_to_user((void *)arg, &cmd, sizeof(cmd)) != 0)
+        return -EFAULT;
+
+    return 0;
+}
+
+
+
 static int rtnet_core_ioctl(struct rtnet_device *rtdev, unsigned int request,
                             unsigned long arg)
 {
@@ -113,6 +141,10 @@ static int rtnet_core_ioctl(struct rtnet_device *rtdev, unsigned int request,
     rtdm_lockctx_t          context;
 
 
+    /* uses its own argument layout */
+    if (request == IOC_RT_DROPSTATS)
+        return rtnet_drop_stats_ioctl(arg);
+
     ret = copy_from_user(&cmd, (void *)arg, sizeof(cmd));
     if (ret != 0)
         return -EFAULT;
@@ -232,6 +264,49 @@ static int rtnet_core_ioctl(struct rtnet_device *rtdev, unsigned int request,
                 return -EFAULT;
             break;
 
+        case IOC_RT_IFSTACKMGR:
+            if (mutex_lock_interruptible(&rtdev->nrt_lock))
+                return -ERESTARTSYS;
+
+            /* The manager is only switched while no frames arrive. */
+            if (rtdev->flags & IFF_UP)
+                ret = -EBUSY;
+            else if (cmd.args.stack_mgr.dedicated)
+                ret = rt_stack_mgr_dev_setup(rtdev,
+                                             cmd.args.stack_mgr.priority,
+                                             cmd.args.stack_mgr.cpu);
+            else
+                rt_stack_mgr_dev_release(rtdev);
+
+            mutex_unlock(&rtdev->nrt_lock);
+            break;
+
+        case IOC_RT_LATENCY_RESET:
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+            rtnet_latency_reset();
+            ret = 0;
+#else
+            ret = -EOPNOTSUPP;
+#endif
+            break;
+
+        case IOC_RT_VLAN_ADD:
+#ifdef CONFIG_RTNET_VLAN
+            ret = rt_vlan_add(rtdev, cmd.args.vlan.vid);
+#else
+            ret = -EOPNOTSUPP;
+#endif
+            break;
+
+        case IOC_RT_VLAN_DEL:
+#ifdef CONFIG_RTNET_VLAN
+            cmd.head.if_name[IFNAMSIZ - 1] = 0;
+            ret = rt_vlan_del(cmd.head.if_name);
+#else
+            ret = -EOPNOTSUPP;
+#endif
+            break;
+
         default:
             ret = -ENOTTY;
     }
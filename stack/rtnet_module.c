@@ -26,14 +26,17 @@
 #include <linux/init.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
+#include <asm/div64.h>
 
 #include <rtdev_mgr.h>
 #include <rtnet_chrdev.h>
 #include <rtnet_internal.h>
 #include <rtnet_socket.h>
 #include <rtnet_rtpc.h>
+#include <rtnet_stats.h>
 #include <stack_mgr.h>
 #include <rtwlan.h>
+#include <rtvlan.h>
 
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("RTnet stack core");
@@ -96,16 +99,34 @@ static const struct file_operations proc_rtnet_devices_fops = {
 
 static int proc_rtnet_rtskb_show(struct seq_file *p, void *data)
 {
-    unsigned int rtskb_len;
-
-    rtskb_len = ALIGN_RTSKB_STRUCT_LEN + SKB_DATA_ALIGN(RTSKB_SIZE);
     seq_printf(p, "Statistics\t\tCurrent\tMaximum\n"
 	       "rtskb pools\t\t%d\t%d\n"
 	       "rtskbs\t\t\t%d\t%d\n"
 	       "rtskb memory need\t%d\t%d\n",
 	       rtskb_pools, rtskb_pools_max,
 	       rtskb_amount, rtskb_amount_max,
-	       rtskb_amount * rtskb_len, rtskb_amount_max * rtskb_len);
+	       rtskb_memory, rtskb_memory_max);
+
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+    {
+        unsigned long hits, misses;
+
+        rtskb_magazine_stats(&hits, &misses);
+        seq_printf(p, "magazine hits\t\t%lu\n"
+                   "magazine misses\t\t%lu\n", hits, misses);
+    }
+#endif
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+    {
+        unsigned int size, capacity;
+        unsigned long retries;
+
+        rtskb_lockfree_stats(&global_pool, &size, &capacity, &retries);
+        if (capacity > 0)
+            seq_printf(p, "global lock-free ring\t%u\t%u\n"
+                       "lock-free retries\t%lu\n", size, capacity, retries);
+    }
+#endif
 
     return 0;
 }
@@ -219,6 +240,76 @@ static const struct file_operations proc_rtnet_stats_fops = {
 };
 
 
+static int proc_rtnet_drops_show(struct seq_file *p, void *data)
+{
+    unsigned long   counters[RTNET_DROP_REASONS];
+    int             i;
+
+
+    rtnet_drop_stats(counters);
+
+    for (i = 0; i < RTNET_DROP_REASONS; i++)
+        seq_printf(p, "%-24s %lu\n", rtnet_drop_reason_names[i],
+                   counters[i]);
+
+    return 0;
+}
+
+static int proc_rtnet_drops_open(struct inode *inode, struct  file *file) {
+  return single_open(file, proc_rtnet_drops_show, NULL);
+}
+
+static const struct file_operations proc_rtnet_drops_fops = {
+  .open = proc_rtnet_drops_open,
+  .read = seq_read,
+  .llseek = seq_lseek,
+  .release = single_release,
+};
+
+
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+static int proc_rtnet_latency_show(struct seq_file *p, void *data)
+{
+    struct rtnet_latency_hist   hist;
+    u64                         avg;
+    int                         i;
+
+
+    seq_printf(p, "Stage (ns)               count      min      avg      p50"
+               "      p90      p99    p99.9      max\n");
+
+    for (i = 0; i < RTNET_LAT_STAGES; i++) {
+        rtnet_latency_merge(i, &hist);
+
+        avg = hist.sum;
+        if (hist.count > 0)
+            do_div(avg, hist.count);
+
+        seq_printf(p, "%-20s %9lu %8u %8lu %8u %8u %8u %8u %8u\n",
+                   rtnet_latency_stage_names[i], hist.count, hist.min,
+                   (unsigned long)avg,
+                   rtnet_latency_percentile(&hist, 500),
+                   rtnet_latency_percentile(&hist, 900),
+                   rtnet_latency_percentile(&hist, 990),
+                   rtnet_latency_percentile(&hist, 999), hist.max);
+    }
+
+    return 0;
+}
+
+static int proc_rtnet_latency_open(struct inode *inode, struct  file *file) {
+  return single_open(file, proc_rtnet_latency_show, NULL);
+}
+
+static const struct file_operations proc_rtnet_latency_fops = {
+  .open = proc_rtnet_latency_open,
+  .read = seq_read,
+  .llseek = seq_lseek,
+  .release = single_release,
+};
+#endif /* CONFIG_RTNET_LATENCY_TRACE */
+
+
 static int rtnet_proc_register(void)
 {
     struct proc_dir_entry *proc_entry;
@@ -247,8 +338,28 @@ static int rtnet_proc_register(void)
     if (!proc_entry)
         goto error5;
 
+    proc_entry = proc_create("drops", S_IRUGO,
+			     rtnet_proc_root, &proc_rtnet_drops_fops);
+    if (!proc_entry)
+        goto error6;
+
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+    proc_entry = proc_create("latency", S_IRUGO,
+			     rtnet_proc_root, &proc_rtnet_latency_fops);
+    if (!proc_entry)
+        goto error7;
+#endif
+
     return 0;
 
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+  error7:
+    remove_proc_entry("drops", rtnet_proc_root);
+#endif
+
+  error6:
+    remove_proc_entry("stats", rtnet_proc_root);
+
   error5:
     remove_proc_entry("version", rtnet_proc_root);
 
@@ -274,6 +385,10 @@ static void rtnet_proc_unregister(void)
     remove_proc_entry("rtskb", rtnet_proc_root);
     remove_proc_entry("version", rtnet_proc_root);
     remove_proc_entry("stats", rtnet_proc_root);
+    remove_proc_entry("drops", rtnet_proc_root);
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+    remove_proc_entry("latency", rtnet_proc_root);
+#endif
     remove_proc_entry("rtnet", 0);
 }
 #endif  /* CONFIG_PROC_FS */
@@ -313,12 +428,18 @@ int __init rtnet_init(void)
     if ((err = rtwlan_init()) != 0)
         goto err_out5;
 
-    if ((err = rtpc_init()) != 0)
+    if ((err = rt_vlan_init()) != 0)
         goto err_out6;
 
+    if ((err = rtpc_init()) != 0)
+        goto err_out7;
+
     return 0;
 
 
+err_out7:
+    rt_vlan_release();
+
 err_out6:
     rtwlan_exit();
 
@@ -349,6 +470,8 @@ void __exit rtnet_release(void)
 {
     rtpc_cleanup();
 
+    rt_vlan_release();
+
     rtwlan_exit();
 
     rtnet_chrdev_release();
@@ -0,0 +1,147 @@
+/***
+ *
+ *  stack/rtnet_stats.c - per-CPU drop and error counters
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <asm/div64.h>
+
+#include <rtnet_stats.h>
+
+
+struct rtnet_drop_counters rtnet_drop_counters[NR_CPUS];
+EXPORT_SYMBOL(rtnet_drop_counters);
+
+const char *rtnet_drop_reason_names[RTNET_DROP_REASONS] =
+    RTNET_DROP_REASON_NAMES;
+
+
+/***
+ *  rtnet_drop_stats - sum up the per-CPU counters
+ *  @counters: array of RTNET_DROP_REASONS entries to fill
+ */
+void rtnet_drop_stats(unsigned long *counters)
+{
+    int i, cpu;
+
+
+    for (i = 0; i < RTNET_DROP_REASONS; i++) {
+        counters[i] = 0;
+        for (cpu = 0; cpu < NR_CPUS; cpu++)
+            counters[i] += rtnet_drop_counters[cpu].count[i];
+    }
+}
+
+
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+struct rtnet_latency_stats rtnet_latency_stats[NR_CPUS];
+EXPORT_SYMBOL(rtnet_latency_stats);
+
+const char *rtnet_latency_stage_names[RTNET_LAT_STAGES] =
+    RTNET_LAT_STAGE_NAMES;
+
+
+/***
+ *  rtnet_latency_reset - clear all histograms
+ *
+ *  Samples accounted concurrently on other CPUs may get lost.
+ */
+void rtnet_latency_reset(void)
+{
+    rtdm_lockctx_t  context;
+    int             cpu;
+
+
+    for (cpu = 0; cpu < NR_CPUS; cpu++) {
+        rtdm_lock_irqsave(context);
+        memset(&rtnet_latency_stats[cpu], 0, sizeof(rtnet_latency_stats[cpu]));
+        rtdm_lock_irqrestore(context);
+    }
+}
+
+
+/***
+ *  rtnet_latency_merge - sum up the per-CPU histograms of a stage
+ *  @stage: the stage
+ *  @hist:  result
+ */
+void rtnet_latency_merge(enum rtnet_latency_stage stage,
+                         struct rtnet_latency_hist *hist)
+{
+    struct rtnet_latency_hist   *cpu_hist;
+    int                         cpu, i;
+
+
+    memset(hist, 0, sizeof(*hist));
+
+    for (cpu = 0; cpu < NR_CPUS; cpu++) {
+        cpu_hist = &rtnet_latency_stats[cpu].stage[stage];
+        if (cpu_hist->count == 0)
+            continue;
+
+        if ((hist->count == 0) || (cpu_hist->min < hist->min))
+            hist->min = cpu_hist->min;
+        if (cpu_hist->max > hist->max)
+            hist->max = cpu_hist->max;
+        hist->count += cpu_hist->count;
+        hist->sum   += cpu_hist->sum;
+
+        for (i = 0; i < RTNET_LAT_BUCKETS; i++)
+            hist->bucket[i] += cpu_hist->bucket[i];
+    }
+}
+
+
+/***
+ *  rtnet_latency_percentile - estimate a percentile of a histogram
+ *  @hist:      merged histogram
+ *  @per_mille: requested percentile in 1/1000
+ *
+ *  Returns the upper bound of the bucket containing the percentile, limited
+ *  by the observed maximum.
+ */
+u32 rtnet_latency_percentile(struct rtnet_latency_hist *hist,
+                             unsigned int per_mille)
+{
+    u64             rank;
+    unsigned long   seen = 0;
+    unsigned int    i, m;
+    u32             upper;
+
+
+    if (hist->count == 0)
+        return 0;
+
+    rank = (u64)hist->count * per_mille;
+    do_div(rank, 1000);
+
+    for (i = 0; i < RTNET_LAT_BUCKETS - 1; i++) {
+        seen += hist->bucket[i];
+        if (seen > rank)
+            break;
+    }
+
+    if (i < 4)
+        upper = i + 1;
+    else {
+        m = i / 4 + 1;
+        upper = (1 << m) + (((i % 4) + 1) << (m - 2));
+    }
+
+    return (upper < hist->max) ? upper : hist->max;
+}
+#endif /* CONFIG_RTNET_LATENCY_TRACE */
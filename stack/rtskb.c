@@ -27,6 +27,7 @@
 
 #include <rtdev.h>
 #include <rtnet_internal.h>
+#include <rtnet_stats.h>
 #include <rtskb.h>
 #include <rtnet_port.h>
 
@@ -34,19 +35,58 @@ static unsigned int global_rtskbs    = DEFAULT_GLOBAL_RTSKBS;
 module_param(global_rtskbs, uint, 0444);
 MODULE_PARM_DESC(global_rtskbs, "Number of realtime socket buffers in global pool");
 
+static unsigned int global_small_rtskbs = DEFAULT_GLOBAL_SMALL_RTSKBS;
+module_param(global_small_rtskbs, uint, 0444);
+MODULE_PARM_DESC(global_small_rtskbs, "Number of small realtime socket buffers "
+                 "attached to the global pool");
 
-/* Linux slab pool for rtskbs */
-static struct kmem_cache *rtskb_slab_pool;
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+static unsigned int lockfree_slots   = DEFAULT_LOCKFREE_SLOTS;
+module_param(lockfree_slots, uint, 0444);
+MODULE_PARM_DESC(lockfree_slots, "Maximum number of rtskbs in lock-free pools "
+                 "(power of two)");
+#endif
+
+
+/* Linux slab pools for rtskbs, one per size class */
+static struct kmem_cache *rtskb_slab_pool[RTSKB_CLASSES];
+
+static const char *rtskb_slab_name[RTSKB_CLASSES] = {
+    "rtskb_slab_small", "rtskb_slab_pool", "rtskb_slab_jumbo"
+};
+
+static const unsigned int rtskb_class_size[RTSKB_CLASSES] = {
+    SKB_DATA_ALIGN(RTSKB_SMALL_SIZE),
+    SKB_DATA_ALIGN(RTSKB_SIZE),
+    SKB_DATA_ALIGN(RTSKB_JUMBO_SIZE)
+};
 
 /* pool of rtskbs for global use */
 struct rtskb_queue global_pool;
 EXPORT_SYMBOL(global_pool);
 
+/* small rtskbs attached to the global pool */
+static struct rtskb_queue global_small_pool;
+
+/* jumbo rtskbs compensating consumers without an own jumbo class, scaled by
+   the devices with a jumbo MTU (see rt_register_rtnetdev()) */
+struct rtskb_queue global_jumbo_pool;
+
 /* pool statistics */
 unsigned int rtskb_pools=0;
 unsigned int rtskb_pools_max=0;
 unsigned int rtskb_amount=0;
 unsigned int rtskb_amount_max=0;
+unsigned int rtskb_memory=0;
+unsigned int rtskb_memory_max=0;
+
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+/* per-CPU magazine statistics */
+static struct {
+    unsigned long   hits;
+    unsigned long   misses;
+} ____cacheline_aligned_in_smp rtskb_mag_stats[NR_CPUS];
+#endif
 
 #ifdef CONFIG_RTNET_ADDON_RTCAP
 /* RTcap interface */
@@ -152,6 +192,413 @@ EXPORT_SYMBOL(rtskb_under_panic);
 #endif /* CONFIG_RTNET_CHECKED */
 
 
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+/***
+ *  rtskb_mag_get - take a free rtskb from the local magazine of a pool
+ *  @pool: pool with magazines
+ */
+static struct rtskb *rtskb_mag_get(struct rtskb_queue *pool)
+{
+    struct rtskb_magazine   *mag;
+    struct rtskb            *skb;
+    rtdm_lockctx_t          context;
+    int                     cpu;
+
+
+    rtdm_lock_irqsave(context);
+
+    cpu = rtos_processor_id();
+    mag = &pool->magazines[cpu];
+
+    if (likely(mag->count > 0))
+        rtskb_mag_stats[cpu].hits++;
+    else {
+        rtskb_mag_stats[cpu].misses++;
+
+        /* refill half of the magazine with a single lock round-trip */
+        rtdm_lock_get(&pool->lock);
+        while ((mag->count < RTSKB_MAGAZINE_SIZE / 2) &&
+               ((skb = __rtskb_dequeue(pool)) != NULL))
+            mag->rtskbs[mag->count++] = skb;
+        rtdm_lock_put(&pool->lock);
+
+        if (mag->count == 0) {
+            rtdm_lock_irqrestore(context);
+            return NULL;
+        }
+    }
+
+    skb = mag->rtskbs[--mag->count];
+
+    rtdm_lock_irqrestore(context);
+
+    return skb;
+}
+
+
+/***
+ *  rtskb_mag_put - return a single free rtskb to the local magazine
+ *  @pool: pool with magazines
+ *  @skb:  rtskb owned by the pool
+ */
+static void rtskb_mag_put(struct rtskb_queue *pool, struct rtskb *skb)
+{
+    struct rtskb_magazine   *mag;
+    rtdm_lockctx_t          context;
+    unsigned int            i;
+
+
+    rtdm_lock_irqsave(context);
+
+    mag = &pool->magazines[rtos_processor_id()];
+
+    if (unlikely(mag->count == RTSKB_MAGAZINE_SIZE)) {
+        /* flush the older half back to the pool */
+        rtdm_lock_get(&pool->lock);
+        for (i = 0; i < RTSKB_MAGAZINE_SIZE / 2; i++)
+            __rtskb_queue_tail(pool, mag->rtskbs[i]);
+        rtdm_lock_put(&pool->lock);
+
+        for (i = 0; i < RTSKB_MAGAZINE_SIZE / 2; i++)
+            mag->rtskbs[i] = mag->rtskbs[i + RTSKB_MAGAZINE_SIZE / 2];
+        mag->count = RTSKB_MAGAZINE_SIZE / 2;
+    }
+
+    mag->rtskbs[mag->count++] = skb;
+
+    rtdm_lock_irqrestore(context);
+}
+
+
+/***
+ *  rtskb_mag_flush - return cached rtskbs to the pool queue
+ *  @pool: pool with magazines
+ *  @cpu:  magazine to flush, -1 for all (only safe if the pool is unused)
+ */
+static void rtskb_mag_flush(struct rtskb_queue *pool, int cpu)
+{
+    struct rtskb_magazine   *mag;
+    rtdm_lockctx_t          context;
+    int                     i;
+
+
+    for (i = 0; i < NR_CPUS; i++) {
+        rtdm_lock_irqsave(context);
+
+        if ((cpu < 0) || (i == rtos_processor_id())) {
+            mag = &pool->magazines[i];
+
+            rtdm_lock_get(&pool->lock);
+            while (mag->count > 0)
+                __rtskb_queue_tail(pool, mag->rtskbs[--mag->count]);
+            rtdm_lock_put(&pool->lock);
+        }
+
+        rtdm_lock_irqrestore(context);
+    }
+}
+
+
+void rtskb_magazine_stats(unsigned long *hits, unsigned long *misses)
+{
+    int i;
+
+
+    *hits   = 0;
+    *misses = 0;
+    for (i = 0; i < NR_CPUS; i++) {
+        *hits   += rtskb_mag_stats[i].hits;
+        *misses += rtskb_mag_stats[i].misses;
+    }
+}
+#endif /* CONFIG_RTNET_RTSKB_MAGAZINES */
+
+
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+#define RTSKB_LF_READ(x)    (*(volatile typeof(x) *)&(x))
+
+/*
+ * The ring follows the bounded MPMC queue design by D. Vyukov: every slot
+ * carries a sequence number telling whether it is ready to be filled (seq ==
+ * pos) or to be taken (seq == pos + 1) at the ring position pos. Producers and
+ * consumers claim positions via cmpxchg, no lock is ever held. A consumer
+ * finding a slot that is claimed but not yet published reports an empty pool,
+ * a producer finding a slot not yet released retries. Local IRQs are disabled
+ * while a slot is claimed, so the owning CPU finishes within a few
+ * instructions and such retries are bounded.
+ */
+
+/***
+ *  rtskb_lf_enqueue - put a single rtskb into the ring of a lock-free pool
+ *  @ring: ring of the pool
+ *  @skb:  rtskb owned by the pool
+ */
+static void rtskb_lf_enqueue(struct rtskb_lf_ring *ring, struct rtskb *skb)
+{
+    struct rtskb_lf_slot    *slot;
+    unsigned long           pos;
+    long                    diff;
+    rtdm_lockctx_t          context;
+
+
+    rtdm_lock_irqsave(context);
+
+    pos = RTSKB_LF_READ(ring->tail);
+    while (1) {
+        slot = &ring->slots[pos & ring->mask];
+        diff = (long)(RTSKB_LF_READ(slot->seq) - pos);
+
+        if (diff == 0) {
+            if (cmpxchg(&ring->tail, pos, pos + 1) == pos)
+                break;
+            ring->retries++;
+        }
+        /* diff < 0: a consumer is still releasing the slot. The ring itself
+           cannot overflow as it holds all rtskbs of the pool (see
+           rtskb_pool_extend()). */
+
+        pos = RTSKB_LF_READ(ring->tail);
+    }
+
+    slot->rtskb = skb;
+    smp_wmb();
+    slot->seq = pos + 1;
+
+    rtdm_lock_irqrestore(context);
+}
+
+
+/***
+ *  rtskb_lf_dequeue - take a free rtskb from the ring of a lock-free pool
+ *  @ring: ring of the pool
+ */
+static struct rtskb *rtskb_lf_dequeue(struct rtskb_lf_ring *ring)
+{
+    struct rtskb_lf_slot    *slot;
+    struct rtskb            *skb;
+    unsigned long           pos;
+    long                    diff;
+    rtdm_lockctx_t          context;
+
+
+    rtdm_lock_irqsave(context);
+
+    pos = RTSKB_LF_READ(ring->head);
+    while (1) {
+        slot = &ring->slots[pos & ring->mask];
+        diff = (long)(RTSKB_LF_READ(slot->seq) - (pos + 1));
+
+        if (diff == 0) {
+            if (cmpxchg(&ring->head, pos, pos + 1) == pos)
+                break;
+            ring->retries++;
+        } else if (diff < 0) {
+            rtdm_lock_irqrestore(context);
+            return NULL;
+        }
+
+        pos = RTSKB_LF_READ(ring->head);
+    }
+
+    skb = slot->rtskb;
+    smp_mb();
+    slot->seq = pos + ring->mask + 1;
+
+    rtdm_lock_irqrestore(context);
+
+    skb->next = NULL;
+    return skb;
+}
+
+
+static struct rtskb_lf_ring *rtskb_lf_ring_alloc(unsigned int slots)
+{
+    struct rtskb_lf_ring    *ring;
+    unsigned int            i;
+
+
+    if ((slots == 0) || ((slots & (slots - 1)) != 0)) {
+        printk(KERN_ERR "RTnet: lockfree_slots must be a power of two\n");
+        return NULL;
+    }
+
+    ring = kmalloc(sizeof(struct rtskb_lf_ring) +
+                   slots * sizeof(struct rtskb_lf_slot), GFP_KERNEL);
+    if (ring == NULL)
+        return NULL;
+
+    ring->head    = 0;
+    ring->tail    = 0;
+    ring->mask    = slots - 1;
+    ring->size    = 0;
+    ring->retries = 0;
+    for (i = 0; i < slots; i++) {
+        ring->slots[i].seq   = i;
+        ring->slots[i].rtskb = NULL;
+    }
+
+    return ring;
+}
+
+
+void rtskb_lockfree_stats(struct rtskb_queue *pool,
+                          unsigned int *size, unsigned int *capacity,
+                          unsigned long *retries)
+{
+    struct rtskb_lf_ring *ring = pool->lf_ring;
+
+
+    if (ring == NULL) {
+        *size     = 0;
+        *capacity = 0;
+        *retries  = 0;
+        return;
+    }
+
+    *size     = ring->size;
+    *capacity = ring->mask + 1;
+    *retries  = ring->retries;
+}
+
+EXPORT_SYMBOL(rtskb_lockfree_stats);
+#endif /* CONFIG_RTNET_RTSKB_LOCKFREE */
+
+
+/* true if the pool is managed by its queue and the queue lock alone */
+static inline int rtskb_pool_queue_only(struct rtskb_queue *pool)
+{
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+    if (pool->lf_ring != NULL)
+        return 0;
+#endif
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+    if (pool->magazines != NULL)
+        return 0;
+#endif
+    return 1;
+}
+
+
+static inline struct rtskb *rtskb_pool_get(struct rtskb_queue *pool)
+{
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+    if (pool->lf_ring != NULL)
+        return rtskb_lf_dequeue(pool->lf_ring);
+#endif
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+    if (pool->magazines != NULL)
+        return rtskb_mag_get(pool);
+#endif
+    return rtskb_dequeue(pool);
+}
+
+
+static inline void rtskb_pool_put(struct rtskb_queue *pool, struct rtskb *skb)
+{
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+    if (pool->lf_ring != NULL) {
+        struct rtskb *chain_end = skb->chain_end;
+        struct rtskb *next;
+
+        /* the ring stores single rtskbs, split up chains */
+        while (1) {
+            next = skb->next;
+            skb->chain_end = skb;
+            rtskb_lf_enqueue(pool->lf_ring, skb);
+            if (skb == chain_end)
+                break;
+            skb = next;
+        }
+        return;
+    }
+#endif
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+    /* chains (only possible for non-RTcap builds) bypass the magazines */
+    if ((pool->magazines != NULL) && (skb->chain_end == skb)) {
+        rtskb_mag_put(pool, skb);
+        return;
+    }
+#endif
+    rtskb_queue_tail(pool, skb);
+}
+
+
+/***
+ *  rtskb_pool_queue_tail - return an rtskb to its pool bypassing kfree_rtskb
+ *  @pool: owning pool
+ *  @skb:  rtskb or rtskb chain
+ */
+void rtskb_pool_queue_tail(struct rtskb_queue *pool, struct rtskb *skb)
+{
+    rtskb_pool_put(pool, skb);
+}
+
+EXPORT_SYMBOL(rtskb_pool_queue_tail);
+
+
+/***
+ *  rtskb_pool_attach - attach a pool of another size class to a pool
+ *  @pool:       pool used by alloc_rtskb() and rtskb_acquire() callers
+ *  @class_pool: pool of a different size class
+ *
+ *  Must be called before the pool is used. The attached pool remains owned by
+ *  the caller and has to be released separately.
+ */
+int rtskb_pool_attach(struct rtskb_queue *pool, struct rtskb_queue *class_pool)
+{
+    unsigned int size_class = class_pool->size_class;
+
+
+    if ((size_class == pool->size_class) ||
+        (pool->class_pool[size_class] != NULL))
+        return -EBUSY;
+
+    pool->class_pool[size_class] = class_pool;
+
+    return 0;
+}
+
+EXPORT_SYMBOL(rtskb_pool_attach);
+
+
+/***
+ *  rtskb_pool_max_size - largest buffer that can be allocated from a pool
+ *  @pool: pool including its attached size classes
+ */
+unsigned int rtskb_pool_max_size(struct rtskb_queue *pool)
+{
+    int c;
+
+
+    for (c = RTSKB_CLASSES - 1; c > (int)pool->size_class; c--)
+        if (pool->class_pool[c] != NULL)
+            break;
+
+    return rtskb_class_size[c];
+}
+
+EXPORT_SYMBOL(rtskb_pool_max_size);
+
+
+/* pool of the given size class, either the pool itself or an attached one */
+static inline struct rtskb_queue *rtskb_pool_class(struct rtskb_queue *pool,
+                                                   unsigned int size_class)
+{
+    return (size_class == pool->size_class) ?
+        pool : pool->class_pool[size_class];
+}
+
+
+static inline unsigned int rtskb_size_class(struct rtskb *skb)
+{
+    unsigned int c = 0;
+
+    while (skb->buf_len > rtskb_class_size[c])
+        c++;
+    return c;
+}
+
+
 /***
  *  alloc_rtskb - allocate an rtskb from a pool
  *  @size: required buffer size (to check against maximum boundary)
@@ -159,16 +606,34 @@ EXPORT_SYMBOL(rtskb_under_panic);
  */
 struct rtskb *alloc_rtskb(unsigned int size, struct rtskb_queue *pool)
 {
-    struct rtskb *skb;
-
-
-    RTNET_ASSERT(size <= SKB_DATA_ALIGN(RTSKB_SIZE), return NULL;);
-
-    skb = rtskb_dequeue(pool);
-    if (!skb)
+    struct rtskb        *skb = NULL;
+    struct rtskb_queue  *class_pool;
+    unsigned int        c;
+
+
+    /* smallest fitting size class first, larger ones if it is exhausted */
+    for (c = 0; c < RTSKB_CLASSES; c++) {
+        if (size > rtskb_class_size[c])
+            continue;
+
+        class_pool = rtskb_pool_class(pool, c);
+        if ((class_pool != NULL) &&
+            ((skb = rtskb_pool_get(class_pool)) != NULL)) {
+            if (likely(size <= skb->buf_len))
+                break;
+
+            /* a smaller buffer got mixed into this class, leave it there */
+            RTNET_ASSERT(size <= skb->buf_len, );
+            rtskb_pool_put(class_pool, skb);
+            skb = NULL;
+        }
+    }
+    if (!skb) {
+        rtnet_count_drop(RTNET_DROP_RTSKB_ALLOC);
         return NULL;
+    }
 #ifdef CONFIG_RTNET_CHECKED
-    pool->pool_balance--;
+    class_pool->pool_balance--;
     skb->chain_len = 1;
 #endif
 
@@ -181,11 +646,18 @@ struct rtskb *alloc_rtskb(unsigned int size, struct rtskb_queue *pool)
     skb->chain_end = skb;
     skb->len = 0;
     skb->pkt_type = PACKET_HOST;
+    skb->ip_summed = CHECKSUM_NONE;
     skb->xmit_stamp = NULL;
+#ifdef CONFIG_RTNET_VLAN
+    skb->vlan_tci = 0;
+#endif
 
 #ifdef CONFIG_RTNET_ADDON_RTCAP
     skb->cap_flags = 0;
 #endif
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+    skb->trace_start = 0;
+#endif
 
     return skb;
 }
@@ -193,31 +665,111 @@ struct rtskb *alloc_rtskb(unsigned int size, struct rtskb_queue *pool)
 EXPORT_SYMBOL(alloc_rtskb);
 
 
+/* drop the reference of an rtskb on the memory of its fragments */
+static inline void rtskb_zerocopy_put(struct rtskb *skb)
+{
+    struct rtskb_zerocopy *zc = skb->zerocopy;
+
+
+    if (zc != NULL) {
+        skb->zerocopy = NULL;
+        if (atomic_dec_and_test(&zc->pending))
+            rtdm_event_signal(&zc->done);
+    }
+}
+
+
 /***
- *  kfree_rtskb
- *  @skb    rtskb
+ *  rtskb_zerocopy_init - prepare tracking of memory passed as fragments
+ *  @zc: tracking structure, typically on the stack of the sender
  */
-void kfree_rtskb(struct rtskb *skb)
+void rtskb_zerocopy_init(struct rtskb_zerocopy *zc)
+{
+    atomic_set(&zc->pending, 1);
+    rtdm_event_init(&zc->done, 0);
+}
+
+EXPORT_SYMBOL(rtskb_zerocopy_init);
+
+
+/***
+ *  rtskb_zerocopy_wait - wait until fragment memory is no longer referenced
+ *  @zc: tracking structure
+ *
+ *  Must be called in real-time context. Blocks until all rtskbs which were
+ *  passed the memory via rtskb_add_frag() have been freed or linearised.
+ */
+void rtskb_zerocopy_wait(struct rtskb_zerocopy *zc)
+{
+    if (!atomic_dec_and_test(&zc->pending))
+        rtdm_event_wait(&zc->done);
+    rtdm_event_destroy(&zc->done);
+}
+
+EXPORT_SYMBOL(rtskb_zerocopy_wait);
+
+
+/***
+ *  rtskb_linearize - copy the fragments of an rtskb into its linear buffer
+ *  @skb: rtskb
+ *
+ *  Returns 0 on success or -ENOMEM if the buffer cannot hold the fragments.
+ */
+int rtskb_linearize(struct rtskb *skb)
+{
+    unsigned int    i;
+
+
+    if (skb->tail + skb->data_len > skb->buf_start + skb->buf_len)
+        return -ENOMEM;
+
+    for (i = 0; i < skb->nr_frags; i++) {
+        memcpy(skb->tail, skb->frags[i].addr, skb->frags[i].len);
+        skb->tail += skb->frags[i].len;
+    }
+    if (skb->end < skb->tail)
+        skb->end = skb->tail;
+    skb->nr_frags = 0;
+    skb->data_len = 0;
+
+    rtskb_zerocopy_put(skb);
+
+    return 0;
+}
+
+EXPORT_SYMBOL(rtskb_linearize);
+
+
+/* return a single rtskb to its pool, followed by the buffer it shared */
+static void rtskb_release(struct rtskb *skb)
 {
+    struct rtskb    *owner;
 #ifdef CONFIG_RTNET_ADDON_RTCAP
     rtdm_lockctx_t  context;
     struct rtskb    *comp_skb;
-    struct rtskb    *next_skb;
-    struct rtskb    *chain_end;
 #endif
 
 
-    RTNET_ASSERT(skb != NULL, return;);
-    RTNET_ASSERT(skb->pool != NULL, return;);
-
-#ifdef CONFIG_RTNET_ADDON_RTCAP
-    next_skb  = skb;
-    chain_end = skb->chain_end;
-
     do {
-        skb      = next_skb;
-        next_skb = skb->next;
+        owner = skb->data_owner;
+        if (owner != NULL) {
+            /* detach the clone from the shared buffer */
+            skb->data_owner = NULL;
+            skb->buf_start  = ((unsigned char *)skb) + ALIGN_RTSKB_STRUCT_LEN;
+#ifdef CONFIG_RTNET_CHECKED
+            skb->buf_end    = skb->buf_start + skb->buf_len - 1;
+#endif
+        }
+        atomic_set(&skb->data_users, 1);
+        skb->chain_end = skb;
+
+        if (skb->nr_frags > 0) {
+            skb->nr_frags = 0;
+            skb->data_len = 0;
+            rtskb_zerocopy_put(skb);
+        }
 
+#ifdef CONFIG_RTNET_ADDON_RTCAP
         rtdm_lock_get_irqsave(&rtcap_lock, context);
 
         if (skb->cap_flags & RTSKB_CAP_SHARED) {
@@ -228,7 +780,7 @@ void kfree_rtskb(struct rtskb *skb)
 
             rtdm_lock_put_irqrestore(&rtcap_lock, context);
 
-            rtskb_queue_tail(comp_skb->pool, comp_skb);
+            rtskb_pool_put(comp_skb->pool, comp_skb);
 #ifdef CONFIG_RTNET_CHECKED
             comp_skb->pool->pool_balance++;
 #endif
@@ -236,23 +788,54 @@ void kfree_rtskb(struct rtskb *skb)
         else {
             rtdm_lock_put_irqrestore(&rtcap_lock, context);
 
-            skb->chain_end = skb;
-            rtskb_queue_tail(skb->pool, skb);
+            rtskb_pool_put(skb->pool, skb);
 #ifdef CONFIG_RTNET_CHECKED
             skb->pool->pool_balance++;
 #endif
         }
 
-    } while (chain_end != skb);
-
 #else  /* CONFIG_RTNET_ADDON_RTCAP */
 
-    rtskb_queue_tail(skb->pool, skb);
+        rtskb_pool_put(skb->pool, skb);
 #ifdef CONFIG_RTNET_CHECKED
-    skb->pool->pool_balance += skb->chain_len;
+        skb->pool->pool_balance++;
 #endif
 
 #endif /* CONFIG_RTNET_ADDON_RTCAP */
+
+        /* the last reference to a shared buffer releases it as well */
+        skb = owner;
+    } while ((skb != NULL) && atomic_dec_and_test(&skb->data_users));
+}
+
+
+/***
+ *  kfree_rtskb
+ *  @skb    rtskb
+ */
+void kfree_rtskb(struct rtskb *skb)
+{
+    struct rtskb    *next_skb;
+    struct rtskb    *chain_end;
+
+
+    RTNET_ASSERT(skb != NULL, return;);
+    RTNET_ASSERT(skb->pool != NULL, return;);
+
+    next_skb  = skb;
+    chain_end = skb->chain_end;
+
+    do {
+        skb      = next_skb;
+        next_skb = skb->next;
+
+        /* keep buffers which are still referenced by clones */
+        if ((atomic_read(&skb->data_users) != 1) &&
+            !atomic_dec_and_test(&skb->data_users))
+            continue;
+
+        rtskb_release(skb);
+    } while (chain_end != skb);
 }
 
 EXPORT_SYMBOL(kfree_rtskb);
@@ -266,6 +849,23 @@ EXPORT_SYMBOL(kfree_rtskb);
  */
 unsigned int rtskb_pool_init(struct rtskb_queue *pool,
                              unsigned int initial_size)
+{
+    return rtskb_pool_init_ex(pool, initial_size, 0);
+}
+
+EXPORT_SYMBOL(rtskb_pool_init);
+
+
+/***
+ *  rtskb_pool_init_ex
+ *  @pool: pool to be initialized
+ *  @initial_size: number of rtskbs to allocate
+ *  @flags: RTSKB_POOL_xxx
+ *  return: number of actually allocated rtskbs
+ */
+unsigned int rtskb_pool_init_ex(struct rtskb_queue *pool,
+                                unsigned int initial_size,
+                                unsigned int flags)
 {
     unsigned int i;
 
@@ -273,6 +873,25 @@ unsigned int rtskb_pool_init(struct rtskb_queue *pool,
 #ifdef CONFIG_RTNET_CHECKED
     pool->pool_balance = 0;
 #endif
+    if (flags & RTSKB_POOL_SMALL)
+        pool->size_class = RTSKB_CLASS_SMALL;
+    else if (flags & RTSKB_POOL_JUMBO)
+        pool->size_class = RTSKB_CLASS_JUMBO;
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+    if (flags & RTSKB_POOL_LOCKFREE)
+        /* fall back to the plain pool if this fails */
+        pool->lf_ring = rtskb_lf_ring_alloc(lockfree_slots);
+#endif
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+    if ((flags & RTSKB_POOL_MAGAZINES) && rtskb_pool_queue_only(pool)) {
+        /* fall back to the plain pool if this fails */
+        pool->magazines =
+            kmalloc(NR_CPUS * sizeof(struct rtskb_magazine), GFP_KERNEL);
+        if (pool->magazines != NULL)
+            memset(pool->magazines, 0,
+                   NR_CPUS * sizeof(struct rtskb_magazine));
+    }
+#endif
 
     i = rtskb_pool_extend(pool, initial_size);
 
@@ -283,7 +902,20 @@ unsigned int rtskb_pool_init(struct rtskb_queue *pool,
     return i;
 }
 
-EXPORT_SYMBOL(rtskb_pool_init);
+EXPORT_SYMBOL(rtskb_pool_init_ex);
+
+
+static void rtskb_free_slab(struct rtskb *skb)
+{
+    unsigned int size_class = rtskb_size_class(skb);
+
+
+    rtdev_unmap_rtskb(skb);
+    kmem_cache_free(rtskb_slab_pool[size_class], skb);
+
+    rtskb_amount--;
+    rtskb_memory -= ALIGN_RTSKB_STRUCT_LEN + rtskb_class_size[size_class];
+}
 
 
 /***
@@ -294,11 +926,23 @@ void __rtskb_pool_release(struct rtskb_queue *pool)
 {
     struct rtskb *skb;
 
-    while ((skb = rtskb_dequeue(pool)) != NULL) {
-        rtdev_unmap_rtskb(skb);
-        kmem_cache_free(rtskb_slab_pool, skb);
-        rtskb_amount--;
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+    if (pool->magazines != NULL) {
+        rtskb_mag_flush(pool, -1);
+        kfree(pool->magazines);
+        pool->magazines = NULL;
+    }
+#endif
+
+    while ((skb = rtskb_pool_get(pool)) != NULL)
+        rtskb_free_slab(skb);
+
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+    if (pool->lf_ring != NULL) {
+        kfree(pool->lf_ring);
+        pool->lf_ring = NULL;
     }
+#endif
 
     rtskb_pools--;
 }
@@ -311,13 +955,24 @@ unsigned int rtskb_pool_extend(struct rtskb_queue *pool,
 {
     unsigned int i;
     struct rtskb *skb;
+    unsigned int buf_len = rtskb_class_size[pool->size_class];
 
 
     RTNET_ASSERT(pool != NULL, return -EINVAL;);
 
     for (i = 0; i < add_rtskbs; i++) {
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+        if ((pool->lf_ring != NULL) &&
+            (pool->lf_ring->size > pool->lf_ring->mask)) {
+            printk(KERN_ERR "RTnet: lock-free rtskb pool exhausted "
+                   "lockfree_slots\n");
+            break;
+        }
+#endif
+
         /* get rtskb from slab pool */
-        if (!(skb = kmem_cache_alloc(rtskb_slab_pool, GFP_KERNEL))) {
+        if (!(skb = kmem_cache_alloc(rtskb_slab_pool[pool->size_class],
+                                     GFP_KERNEL))) {
             printk(KERN_ERR "RTnet: rtskb allocation from slab pool failed\n");
             break;
         }
@@ -328,18 +983,32 @@ unsigned int rtskb_pool_extend(struct rtskb_queue *pool,
         skb->chain_end = skb;
         skb->pool = pool;
         skb->buf_start = ((unsigned char *)skb) + ALIGN_RTSKB_STRUCT_LEN;
+        skb->buf_len = buf_len;
 #ifdef CONFIG_RTNET_CHECKED
-        skb->buf_end = skb->buf_start + SKB_DATA_ALIGN(RTSKB_SIZE) - 1;
+        skb->buf_end = skb->buf_start + buf_len - 1;
 #endif
+        skb->data_owner = NULL;
+        atomic_set(&skb->data_users, 1);
+        skb->nr_frags = 0;
+        skb->data_len = 0;
+        skb->zerocopy = NULL;
 
         if (rtdev_map_rtskb(skb) < 0)
             break;
 
-        rtskb_queue_tail(pool, skb);
+        rtskb_pool_put(pool, skb);
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+        if (pool->lf_ring != NULL)
+            pool->lf_ring->size++;
+#endif
 
         rtskb_amount++;
         if (rtskb_amount > rtskb_amount_max)
             rtskb_amount_max = rtskb_amount;
+
+        rtskb_memory += ALIGN_RTSKB_STRUCT_LEN + buf_len;
+        if (rtskb_memory > rtskb_memory_max)
+            rtskb_memory_max = rtskb_memory;
     }
 
     return i;
@@ -353,13 +1022,22 @@ unsigned int rtskb_pool_shrink(struct rtskb_queue *pool,
     struct rtskb    *skb;
 
 
+#ifdef CONFIG_RTNET_RTSKB_MAGAZINES
+    /* Only the local magazine can be flushed safely, rtskbs cached by other
+       CPUs cannot be reclaimed here. */
+    if (pool->magazines != NULL)
+        rtskb_mag_flush(pool, rtos_processor_id());
+#endif
+
     for (i = 0; i < rem_rtskbs; i++) {
-        if ((skb = rtskb_dequeue(pool)) == NULL)
+        if ((skb = rtskb_pool_get(pool)) == NULL)
             break;
+#ifdef CONFIG_RTNET_RTSKB_LOCKFREE
+        if (pool->lf_ring != NULL)
+            pool->lf_ring->size--;
+#endif
 
-        rtdev_unmap_rtskb(skb);
-        kmem_cache_free(rtskb_slab_pool, skb);
-        rtskb_amount--;
+        rtskb_free_slab(skb);
     }
 
     return i;
@@ -371,14 +1049,59 @@ int rtskb_acquire(struct rtskb *rtskb, struct rtskb_queue *comp_pool)
 {
     struct rtskb *comp_rtskb;
     struct rtskb_queue *release_pool;
+    struct rtskb_queue *class_pool;
     rtdm_lockctx_t context;
+    unsigned int size_class = rtskb_size_class(rtskb);
+
+
+    /* The acquired rtskb joins the compensating pool, so both have to be of
+       the same size class. Otherwise, a larger class could hand out the
+       smaller buffer later on. */
+    class_pool = rtskb_pool_class(comp_pool, size_class);
+    if (class_pool != NULL)
+        comp_pool = class_pool;
+    else if (size_class == RTSKB_CLASS_JUMBO)
+        /* jumbo frames of a NIC: the consumer gets it from the shared pool */
+        comp_pool = &global_jumbo_pool;
+    else {
+        rtnet_count_drop(RTNET_DROP_RTSKB_ACQUIRE);
+        return -ENOMEM;
+    }
 
+#if defined(CONFIG_RTNET_RTSKB_MAGAZINES) || defined(CONFIG_RTNET_RTSKB_LOCKFREE)
+    if (!rtskb_pool_queue_only(comp_pool) ||
+        !rtskb_pool_queue_only(rtskb->pool)) {
+        comp_rtskb = rtskb_pool_get(comp_pool);
+        if (!comp_rtskb) {
+            rtnet_count_drop(RTNET_DROP_RTSKB_ACQUIRE);
+            return -ENOMEM;
+        }
+
+#ifdef CONFIG_RTNET_CHECKED
+        comp_pool->pool_balance--;
+#endif
+
+        comp_rtskb->chain_end = comp_rtskb;
+        comp_rtskb->pool = release_pool = rtskb->pool;
+
+#ifdef CONFIG_RTNET_CHECKED
+        comp_rtskb->chain_len = 1;
+        release_pool->pool_balance++;
+#endif
+        rtskb_pool_put(release_pool, comp_rtskb);
+
+        rtskb->pool = comp_pool;
+
+        return 0;
+    }
+#endif /* CONFIG_RTNET_RTSKB_MAGAZINES || CONFIG_RTNET_RTSKB_LOCKFREE */
 
     rtdm_lock_get_irqsave(&comp_pool->lock, context);
 
     comp_rtskb = __rtskb_dequeue(comp_pool);
     if (!comp_rtskb) {
         rtdm_lock_put_irqrestore(&comp_pool->lock, context);
+        rtnet_count_drop(RTNET_DROP_RTSKB_ACQUIRE);
         return -ENOMEM;
     }
 
@@ -409,8 +1132,75 @@ int rtskb_acquire(struct rtskb *rtskb, struct rtskb_queue *comp_pool)
 EXPORT_SYMBOL(rtskb_acquire);
 
 
-/* clone rtskb to another, allocating the new rtskb from pool */
+/***
+ *  rtskb_clone - create an rtskb sharing the data of another one
+ *  @rtskb: rtskb to be cloned (first of a chain only)
+ *  @pool:  pool of the consumer, provides the head of the clone
+ *
+ *  The clone must only be read. If @rtskb is not a clone itself, the
+ *  ownership of its buffer is passed to @pool as well (see rtskb_acquire()),
+ *  so the pool of the original owner does not run dry while clones exist.
+ */
 struct rtskb* rtskb_clone(struct rtskb *rtskb, struct rtskb_queue *pool)
+{
+    struct rtskb    *clone_rtskb;
+    struct rtskb    *owner;
+
+
+    owner = (rtskb->data_owner != NULL) ? rtskb->data_owner : rtskb;
+
+    /* the head does not need any buffer, take the smallest class */
+    clone_rtskb = alloc_rtskb(0, pool);
+    if (clone_rtskb == NULL)
+        return NULL;
+
+    if ((owner == rtskb) && (rtskb_acquire(owner, pool) < 0)) {
+        kfree_rtskb(clone_rtskb);
+        return NULL;
+    }
+
+    atomic_inc(&owner->data_users);
+
+    clone_rtskb->data_owner = owner;
+    clone_rtskb->buf_start  = owner->buf_start;
+#ifdef CONFIG_RTNET_CHECKED
+    clone_rtskb->buf_end    = owner->buf_end;
+#endif
+
+    /* Note: We don't clone
+        - rtskb.sk
+        - rtskb.xmit_stamp
+       until real use cases show up. */
+
+    clone_rtskb->priority   = rtskb->priority;
+    clone_rtskb->rtdev      = rtskb->rtdev;
+    clone_rtskb->time_stamp = rtskb->time_stamp;
+
+    clone_rtskb->data       = rtskb->data;
+    clone_rtskb->tail       = rtskb->tail;
+    clone_rtskb->end        = rtskb->end;
+    clone_rtskb->len        = rtskb->len;
+    clone_rtskb->mac.raw    = rtskb->mac.raw;
+    clone_rtskb->nh.raw     = rtskb->nh.raw;
+    clone_rtskb->h.raw      = rtskb->h.raw;
+
+    clone_rtskb->protocol   = rtskb->protocol;
+    clone_rtskb->pkt_type   = rtskb->pkt_type;
+
+    clone_rtskb->ip_summed  = rtskb->ip_summed;
+    clone_rtskb->csum       = rtskb->csum;
+#ifdef CONFIG_RTNET_VLAN
+    clone_rtskb->vlan_tci   = rtskb->vlan_tci;
+#endif
+
+    return clone_rtskb;
+}
+
+EXPORT_SYMBOL_GPL(rtskb_clone);
+
+
+/* copy rtskb to another, allocating the new rtskb from pool */
+struct rtskb* rtskb_copy(struct rtskb *rtskb, struct rtskb_queue *pool)
 {
     struct rtskb    *clone_rtskb;
     unsigned int    total_len;
@@ -443,6 +1233,9 @@ struct rtskb* rtskb_clone(struct rtskb *rtskb, struct rtskb_queue *pool)
 
     clone_rtskb->ip_summed  = rtskb->ip_summed;
     clone_rtskb->csum       = rtskb->csum;
+#ifdef CONFIG_RTNET_VLAN
+    clone_rtskb->vlan_tci   = rtskb->vlan_tci;
+#endif
 
     total_len = rtskb->len + rtskb->data - rtskb->mac.raw;
     memcpy(clone_rtskb->mac.raw, rtskb->mac.raw, total_len);
@@ -451,31 +1244,67 @@ struct rtskb* rtskb_clone(struct rtskb *rtskb, struct rtskb_queue *pool)
     return clone_rtskb;
 }
 
-EXPORT_SYMBOL_GPL(rtskb_clone);
+EXPORT_SYMBOL_GPL(rtskb_copy);
+
+
+static void rtskb_slabs_destroy(void)
+{
+    int c;
+
+
+    for (c = 0; c < RTSKB_CLASSES; c++)
+        if (rtskb_slab_pool[c] != NULL) {
+            kmem_cache_destroy(rtskb_slab_pool[c]);
+            rtskb_slab_pool[c] = NULL;
+        }
+}
 
 
 int rtskb_pools_init(void)
 {
-    rtskb_slab_pool = kmem_cache_create("rtskb_slab_pool",
-        ALIGN_RTSKB_STRUCT_LEN + SKB_DATA_ALIGN(RTSKB_SIZE),
-        0, SLAB_HWCACHE_ALIGN, NULL
+    int c;
+
+
+    for (c = 0; c < RTSKB_CLASSES; c++) {
+        rtskb_slab_pool[c] = kmem_cache_create(rtskb_slab_name[c],
+            ALIGN_RTSKB_STRUCT_LEN + rtskb_class_size[c],
+            0, SLAB_HWCACHE_ALIGN, NULL
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,23)
-        , NULL
+            , NULL
 #endif
-        );
-    if (rtskb_slab_pool == NULL)
-        return -ENOMEM;
+            );
+        if (rtskb_slab_pool[c] == NULL) {
+            rtskb_slabs_destroy();
+            return -ENOMEM;
+        }
+    }
 
     /* reset the statistics (cache is accounted separately) */
     rtskb_pools      = 0;
     rtskb_pools_max  = 0;
     rtskb_amount     = 0;
     rtskb_amount_max = 0;
+    rtskb_memory     = 0;
+    rtskb_memory_max = 0;
 
     /* create the global rtskb pool */
-    if (rtskb_pool_init(&global_pool, global_rtskbs) < global_rtskbs)
+    if (rtskb_pool_init_ex(&global_pool, global_rtskbs,
+                           RTSKB_POOL_MAGAZINES | RTSKB_POOL_LOCKFREE) <
+        global_rtskbs)
         goto err_out;
 
+    if (global_small_rtskbs > 0) {
+        if (rtskb_pool_init_ex(&global_small_pool, global_small_rtskbs,
+                               RTSKB_POOL_SMALL | RTSKB_POOL_LOCKFREE) <
+            global_small_rtskbs) {
+            rtskb_pool_release(&global_small_pool);
+            goto err_out;
+        }
+        rtskb_pool_attach(&global_pool, &global_small_pool);
+    }
+
+    rtskb_pool_init_ex(&global_jumbo_pool, 0, RTSKB_POOL_JUMBO);
+
 #ifdef CONFIG_RTNET_ADDON_RTCAP
     rtdm_lock_init(&rtcap_lock);
 #endif
@@ -484,7 +1313,7 @@ int rtskb_pools_init(void)
 
 err_out:
     rtskb_pool_release(&global_pool);
-    kmem_cache_destroy(rtskb_slab_pool);
+    rtskb_slabs_destroy();
 
     return -ENOMEM;
 }
@@ -492,6 +1321,9 @@ err_out:
 
 void rtskb_pools_release(void)
 {
+    rtskb_pool_release(&global_jumbo_pool);
+    if (global_small_rtskbs > 0)
+        rtskb_pool_release(&global_small_pool);
     rtskb_pool_release(&global_pool);
-    kmem_cache_destroy(rtskb_slab_pool);
+    rtskb_slabs_destroy();
 }
@@ -0,0 +1,537 @@
+/***
+ *
+ *  stack/rtvlan.c - 802.1Q virtual LAN devices
+ *
+ *  A VLAN device is an Ethernet rtnet_device stacked on a physical one. On
+ *  transmission, it tags the frame with its VLAN ID and a priority code
+ *  point (PCP) derived from the transmission channel and priority of the
+ *  rtskb, then passes it to the real device. The tag is inserted by the
+ *  hardware if the real device announces RTNETIF_F_HW_VLAN_TX, otherwise
+ *  in place. On reception, tags are either stripped by the hardware or by
+ *  rt_eth_type_trans, the stack manager then hands the packet over to the
+ *  VLAN device and sets its priority according to the PCP.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ */
+
+#include <linux/if_arp.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+
+#include <rtdev.h>
+#include <rtnet_internal.h>
+#include <rtnet_port.h>
+#include <rtnet_stats.h>
+#include <rtvlan.h>
+
+/* a VLAN device occupies a device slot as well */
+#define RT_VLAN_DEVICES     MAX_RT_DEVICES
+
+/* consecutive rtskb priorities sharing one PCP */
+#define RT_VLAN_PRIO_GROUP  ((QUEUE_MIN_PRIO + 1) / RT_VLAN_PCPS)
+
+static int vlan_pcp_map[RT_VLAN_PCPS] = { 7, 6, 5, 4, 3, 2, 1, 0 };
+static unsigned int vlan_nrt_pcp = 0;
+
+compat_module_int_param_array(vlan_pcp_map, RT_VLAN_PCPS);
+module_param(vlan_nrt_pcp, uint, 0444);
+MODULE_PARM_DESC(vlan_pcp_map, "PCP of tagged packets per rtskb priority "
+                 "0-3, 4-7, ..., 28-31 (default: 7,6,5,4,3,2,1,0)");
+MODULE_PARM_DESC(vlan_nrt_pcp, "PCP of tagged packets on the non-real-time "
+                 "channel (default: 0)");
+
+struct rt_vlan_priv {
+    struct rtnet_device *real_dev;  /* referenced while the VLAN exists */
+    unsigned int        vid;
+    int                 dead;       /* deletion in progress, no more open */
+
+    /* multicast addresses registered with the real device */
+    unsigned char       mc_list[RTDEV_MC_MAX][ETH_ALEN];
+    unsigned int        mc_count;
+};
+
+/* rtskb priority of received packets per PCP, derived from vlan_pcp_map */
+static unsigned int             vlan_rx_prio[RT_VLAN_PCPS];
+
+static struct rtnet_device      *vlan_devs[RT_VLAN_DEVICES];
+static rtdm_lock_t              vlan_lock = RTDM_LOCK_UNLOCKED;
+static DEFINE_MUTEX(vlan_nrt_lock);
+
+
+
+static inline unsigned int rt_vlan_pcp(unsigned int priority)
+{
+    unsigned int prio = priority & RTSKB_PRIO_MASK;
+
+
+    if (((priority & RTSKB_CHANNEL_MASK) >> RTSKB_CHANNEL_SHIFT) ==
+        RTSKB_DEF_NRT_CHANNEL)
+        return vlan_nrt_pcp;
+
+    if (prio > QUEUE_MIN_PRIO)
+        prio = QUEUE_MIN_PRIO;
+
+    return vlan_pcp_map[prio / RT_VLAN_PRIO_GROUP];
+}
+
+
+
+/***
+ *  rt_vlan_insert_tag - tag a frame in place
+ *
+ *  Frames built for the VLAN device have the headroom, forwarded ones may
+ *  not. Those are moved towards the end of the buffer first.
+ */
+static int rt_vlan_insert_tag(struct rtskb *skb, unsigned short tci)
+{
+    unsigned char   *eth;
+
+
+    /* the data may be shared with other consumers */
+    if (unlikely(rtskb_cloned(skb)))
+        return -ENOBUFS;
+
+    if (unlikely(skb->data - skb->buf_start < RT_VLAN_HLEN)) {
+        if (skb->end - skb->tail < RT_VLAN_HLEN)
+            return -ENOBUFS;
+
+        memmove(skb->data + RT_VLAN_HLEN, skb->data, skb->tail - skb->data);
+        skb->data    += RT_VLAN_HLEN;
+        skb->tail    += RT_VLAN_HLEN;
+        skb->nh.raw  += RT_VLAN_HLEN;
+        skb->h.raw   += RT_VLAN_HLEN;
+    }
+
+    eth = rtskb_push(skb, RT_VLAN_HLEN);
+    memmove(eth, eth + RT_VLAN_HLEN, 2 * ETH_ALEN);
+
+    /* the encapsulated protocol stays in place */
+    *(u16 *)(eth + 2 * ETH_ALEN)     = htons(ETH_P_8021Q);
+    *(u16 *)(eth + 2 * ETH_ALEN + 2) = htons(tci);
+
+    skb->mac.raw = eth;
+
+    return 0;
+}
+
+
+
+static int rt_vlan_xmit(struct rtskb *skb, struct rtnet_device *rtdev)
+{
+    struct rt_vlan_priv *vlan = rtdev->priv;
+    struct rtnet_device *real_dev = vlan->real_dev;
+    unsigned short      tci;
+
+
+    if (unlikely(!(real_dev->flags & IFF_UP)))
+        return -ENETDOWN;
+
+    tci = vlan->vid | (rt_vlan_pcp(skb->priority) << RT_VLAN_PCP_SHIFT);
+
+    if (real_dev->features & RTNETIF_F_HW_VLAN_TX)
+        rt_vlan_put_tag(skb, tci);
+    else if (rt_vlan_insert_tag(skb, tci) < 0)
+        return -ENOBUFS;
+
+    skb->rtdev = real_dev;
+
+    return real_dev->start_xmit(skb, real_dev);
+}
+
+
+
+/***
+ *  rt_vlan_rx - hand a tagged packet over to its VLAN device
+ *  @skb: packet with valid vlan_tci, its device is referenced
+ *
+ *  Called by the stack manager. The reference on the receiving device is
+ *  passed on to the VLAN device. Returns -ENOENT if no VLAN device is up for
+ *  the VID, the packet is dropped then. Priority tagged packets (VID 0) stay
+ *  on the receiving device.
+ */
+int rt_vlan_rx(struct rtskb *skb)
+{
+    struct rtnet_device *real_dev = skb->rtdev;
+    struct rtnet_device *rtdev;
+    struct rt_vlan_priv *vlan;
+    unsigned short      tci = rt_vlan_tag_get(skb);
+    unsigned int        vid = tci & RT_VLAN_VID_MASK;
+    rtdm_lockctx_t      context;
+    int                 i;
+
+
+    skb->vlan_tci = 0;
+    skb->priority = (skb->priority & ~RTSKB_PRIO_MASK) |
+        vlan_rx_prio[tci >> RT_VLAN_PCP_SHIFT];
+
+    if (vid == 0)
+        return 0;
+
+    rtdm_lock_get_irqsave(&vlan_lock, context);
+
+    for (i = 0; i < RT_VLAN_DEVICES; i++) {
+        rtdev = vlan_devs[i];
+        if (rtdev == NULL)
+            continue;
+
+        vlan = rtdev->priv;
+        if ((vlan->real_dev == real_dev) && (vlan->vid == vid) &&
+            (rtdev->flags & IFF_UP)) {
+            rtdev_reference(rtdev);
+            rtdm_lock_put_irqrestore(&vlan_lock, context);
+
+            skb->rtdev = rtdev;
+            rtdev_dereference(real_dev);
+
+            return 0;
+        }
+    }
+
+    rtdm_lock_put_irqrestore(&vlan_lock, context);
+
+    rtnet_count_drop(RTNET_DROP_VLAN_UNKNOWN);
+    kfree_rtskb(skb);
+    rtdev_dereference(real_dev);
+
+    return -ENOENT;
+}
+
+
+
+static int rt_vlan_open(struct rtnet_device *rtdev)
+{
+    struct rt_vlan_priv *vlan = rtdev->priv;
+
+
+    if (vlan->dead)
+        return -ENODEV;
+
+    if (!(vlan->real_dev->flags & IFF_UP))
+        return -ENETDOWN;
+
+    return 0;
+}
+
+
+
+static unsigned int rt_vlan_get_mtu(struct rtnet_device *rtdev,
+                                    unsigned int priority)
+{
+    struct rtnet_device *real_dev =
+        ((struct rt_vlan_priv *)rtdev->priv)->real_dev;
+
+
+    /* like Linux, the tag does not count against the MTU */
+    return real_dev->get_mtu(real_dev, priority);
+}
+
+
+
+static inline int rt_vlan_mc_find(unsigned char list[][ETH_ALEN],
+                                  unsigned int count, unsigned char *addr)
+{
+    unsigned int i;
+
+
+    for (i = 0; i < count; i++)
+        if (memcmp(list[i], addr, ETH_ALEN) == 0)
+            return i;
+
+    return -1;
+}
+
+
+
+/***
+ *  rt_vlan_set_multicast_list - mirror the filter to the real device
+ *
+ *  Called with the nrt_lock of the VLAN device held. Addresses the real
+ *  device cannot filter anymore are skipped.
+ */
+static void rt_vlan_set_multicast_list(struct rtnet_device *rtdev)
+{
+    struct rt_vlan_priv *vlan = rtdev->priv;
+    unsigned int        i;
+
+
+    for (i = 0; i < vlan->mc_count; )
+        if (rt_vlan_mc_find(rtdev->mc_list, rtdev->mc_count,
+                            vlan->mc_list[i]) < 0) {
+            rtdev_mc_del(vlan->real_dev, vlan->mc_list[i]);
+            memcpy(vlan->mc_list[i], vlan->mc_list[--vlan->mc_count],
+                   ETH_ALEN);
+        } else
+            i++;
+
+    for (i = 0; i < rtdev->mc_count; i++)
+        if ((rt_vlan_mc_find(vlan->mc_list, vlan->mc_count,
+                             rtdev->mc_list[i]) < 0) &&
+            (rtdev_mc_add(vlan->real_dev, rtdev->mc_list[i]) == 0))
+            memcpy(vlan->mc_list[vlan->mc_count++], rtdev->mc_list[i],
+                   ETH_ALEN);
+}
+
+
+
+/***
+ *  rt_vlan_add - create a VLAN device on top of a real device
+ *  @real_dev: Ethernet device, referenced by the caller
+ *  @vid:      VLAN ID, 1..4094
+ *
+ *  The VLAN device is named "<real_dev>.<vid>" and keeps a reference on
+ *  the real device until it is deleted again.
+ */
+int rt_vlan_add(struct rtnet_device *real_dev, unsigned int vid)
+{
+    struct rtnet_device *rtdev;
+    struct rt_vlan_priv *vlan;
+    rtdm_lockctx_t      context;
+    int                 slot = -1;
+    int                 i;
+    int                 ret;
+
+
+    if ((vid == 0) || (vid >= RT_VLAN_VID_MASK))
+        return -EINVAL;
+
+    /* no stacked VLANs */
+    if ((real_dev->type != ARPHRD_ETHER) ||
+        (real_dev->flags & IFF_LOOPBACK) ||
+        (real_dev->hard_start_xmit == rt_vlan_xmit))
+        return -EINVAL;
+
+    mutex_lock(&vlan_nrt_lock);
+
+    for (i = 0; i < RT_VLAN_DEVICES; i++) {
+        if (vlan_devs[i] == NULL) {
+            if (slot < 0)
+                slot = i;
+            continue;
+        }
+        vlan = vlan_devs[i]->priv;
+        if ((vlan->real_dev == real_dev) && (vlan->vid == vid)) {
+            ret = -EEXIST;
+            goto out;
+        }
+    }
+    if (slot < 0) {
+        ret = -ENOSPC;
+        goto out;
+    }
+
+    rtdev = rt_alloc_etherdev(sizeof(struct rt_vlan_priv));
+    if (rtdev == NULL) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    vlan = rtdev->priv;
+    vlan->real_dev = real_dev;
+    vlan->vid      = vid;
+
+    rtdev->vers = RTDEV_VERS_2_0;
+    snprintf(rtdev->name, IFNAMSIZ, "%s.%u", real_dev->name, vid);
+    memcpy(rtdev->dev_addr, real_dev->dev_addr, MAX_ADDR_LEN);
+
+    rtdev->mtu             = real_dev->mtu;
+    rtdev->hard_header_len = real_dev->hard_header_len + RT_VLAN_HLEN;
+    rtdev->flags           = real_dev->flags & (IFF_BROADCAST | IFF_MULTICAST);
+    rtdev->features        = NETIF_F_LLTX | (real_dev->features & NETIF_F_SG);
+
+    rtdev->open            = rt_vlan_open;
+    rtdev->hard_start_xmit = rt_vlan_xmit;
+    rtdev->get_mtu         = rt_vlan_get_mtu;
+    if (real_dev->set_multicast_list != NULL)
+        rtdev->set_multicast_list = rt_vlan_set_multicast_list;
+
+    ret = rt_register_rtnetdev(rtdev);
+    if (ret < 0) {
+        rtdev_free(rtdev);
+        goto out;
+    }
+
+    rtdev_reference(real_dev);
+
+    rtdm_lock_get_irqsave(&vlan_lock, context);
+    vlan_devs[slot] = rtdev;
+    rtdm_lock_put_irqrestore(&vlan_lock, context);
+
+  out:
+    mutex_unlock(&vlan_nrt_lock);
+
+    return ret;
+}
+
+
+
+/***
+ *  rt_vlan_del - delete a VLAN device
+ *  @name: name of the VLAN device, it must be down
+ */
+int rt_vlan_del(const char *name)
+{
+    struct rtnet_device *rtdev = NULL;
+    struct rt_vlan_priv *vlan;
+    rtdm_lockctx_t      context;
+    unsigned int        i;
+    int                 ret = 0;
+
+
+    mutex_lock(&vlan_nrt_lock);
+
+    for (i = 0; i < RT_VLAN_DEVICES; i++)
+        if ((vlan_devs[i] != NULL) &&
+            (strncmp(vlan_devs[i]->name, name, IFNAMSIZ) == 0)) {
+            rtdev = vlan_devs[i];
+            break;
+        }
+    if (rtdev == NULL) {
+        ret = -ENODEV;
+        goto out;
+    }
+    vlan = rtdev->priv;
+
+    /* routes and other users go away on IOC_RT_IFDOWN only */
+    mutex_lock(&rtdev->nrt_lock);
+    if (rtdev->flags & IFF_UP) {
+        mutex_unlock(&rtdev->nrt_lock);
+        ret = -EBUSY;
+        goto out;
+    }
+    vlan->dead = 1;
+    mutex_unlock(&rtdev->nrt_lock);
+
+    rtdm_lock_get_irqsave(&vlan_lock, context);
+    vlan_devs[i] = NULL;
+    rtdm_lock_put_irqrestore(&vlan_lock, context);
+
+    rt_unregister_rtnetdev(rtdev);
+
+    for (i = 0; i < vlan->mc_count; i++)
+        rtdev_mc_del(vlan->real_dev, vlan->mc_list[i]);
+
+    rtdev_dereference(vlan->real_dev);
+    rtdev_free(rtdev);
+
+  out:
+    mutex_unlock(&vlan_nrt_lock);
+
+    return ret;
+}
+
+
+
+#ifdef CONFIG_PROC_FS
+static int rtnet_vlan_show(struct seq_file *p, void *data)
+{
+    struct rt_vlan_priv *vlan;
+    unsigned int        i;
+
+
+    seq_printf(p, "PCP by priority group:\t");
+    for (i = 0; i < RT_VLAN_PCPS; i++)
+        seq_printf(p, "%d%c", vlan_pcp_map[i],
+                   (i < RT_VLAN_PCPS - 1) ? ',' : '\n');
+    seq_printf(p, "PCP of non-RT channel:\t%u\n", vlan_nrt_pcp);
+
+    seq_printf(p, "\nDevice\t\tReal device\tVID\tHW tagging\n");
+
+    mutex_lock(&vlan_nrt_lock);
+
+    for (i = 0; i < RT_VLAN_DEVICES; i++) {
+        if (vlan_devs[i] == NULL)
+            continue;
+        vlan = vlan_devs[i]->priv;
+
+        seq_printf(p, "%-15s\t%-15s\t%u\t%s\n", vlan_devs[i]->name,
+                   vlan->real_dev->name, vlan->vid,
+                   (vlan->real_dev->features & RTNETIF_F_HW_VLAN_TX) ?
+                   "yes" : "no");
+    }
+
+    mutex_unlock(&vlan_nrt_lock);
+
+    return 0;
+}
+
+static int rtnet_vlan_open(struct inode *inode, struct file *file)
+{
+    return single_open(file, rtnet_vlan_show, NULL);
+}
+
+static const struct file_operations rtnet_vlan_fops = {
+    .open       = rtnet_vlan_open,
+    .read       = seq_read,
+    .llseek     = seq_lseek,
+    .release    = single_release,
+};
+#endif /* CONFIG_PROC_FS */
+
+
+
+/***
+ *  rt_vlan_init
+ */
+int __init rt_vlan_init(void)
+{
+    int pcp, i;
+
+
+    if (vlan_nrt_pcp >= RT_VLAN_PCPS)
+        goto invalid;
+
+    /* received packets get the highest priority that maps to their PCP,
+     * unmapped PCPs are spread linearly */
+    for (pcp = 0; pcp < RT_VLAN_PCPS; pcp++)
+        vlan_rx_prio[pcp] = (RT_VLAN_PCPS - 1 - pcp) * RT_VLAN_PRIO_GROUP;
+
+    for (i = RT_VLAN_PCPS - 1; i >= 0; i--) {
+        if ((vlan_pcp_map[i] < 0) || (vlan_pcp_map[i] >= RT_VLAN_PCPS))
+            goto invalid;
+        vlan_rx_prio[vlan_pcp_map[i]] = i * RT_VLAN_PRIO_GROUP;
+    }
+
+#ifdef CONFIG_PROC_FS
+    if (!proc_create("vlan", S_IFREG | S_IRUGO, rtnet_proc_root,
+                     &rtnet_vlan_fops)) {
+        /*ERRMSG*/printk("RTnet: unable to initialize /proc entry (vlan)\n");
+        return -ENOMEM;
+    }
+#endif /* CONFIG_PROC_FS */
+
+    return 0;
+
+  invalid:
+    printk("RTnet: invalid VLAN PCP parameters\n");
+    return -EINVAL;
+}
+
+
+
+/***
+ *  rt_vlan_release
+ *
+ *  VLAN devices reference their real device, so no driver can be unloaded
+ *  before its VLANs are deleted, and none are left here.
+ */
+void rt_vlan_release(void)
+{
+#ifdef CONFIG_PROC_FS
+    remove_proc_entry("vlan", rtnet_proc_root);
+#endif /* CONFIG_PROC_FS */
+}
@@ -29,6 +29,9 @@
 #include <linux/in.h>
 #include <linux/ip.h>
 #include <linux/tcp.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
 #include <asm/bitops.h>
 
 #include <rtnet.h>
@@ -54,6 +57,7 @@ int rt_bare_socket_init(struct rtsocket *sock, unsigned short protocol,
 {
     sock->protocol = protocol;
     sock->priority = priority;
+    atomic_set(&sock->frag_count, 0);
 
     return rtskb_pool_init(&sock->skb_pool, pool_size);
 }
@@ -61,6 +65,610 @@ EXPORT_SYMBOL(rt_bare_socket_init);
 
 
 
+/***
+ *  rt_socket_rxring_put - drop a reference on a receive ring
+ */
+static void rt_socket_rxring_put(struct rtsocket_rxring *ring)
+{
+    if (atomic_dec_and_test(&ring->refs)) {
+        vfree(ring->hdr);
+        kfree(ring->ready);
+        kfree(ring);
+    }
+}
+
+
+
+static void rt_socket_rxring_vm_open(struct vm_area_struct *vma)
+{
+    struct rtsocket_rxring *ring = vma->vm_private_data;
+
+    atomic_inc(&ring->refs);
+}
+
+
+
+static void rt_socket_rxring_vm_close(struct vm_area_struct *vma)
+{
+    rt_socket_rxring_put(vma->vm_private_data);
+}
+
+
+
+static struct vm_operations_struct rt_socket_rxring_vm_ops = {
+    .open =     rt_socket_rxring_vm_open,
+    .close =    rt_socket_rxring_vm_close
+};
+
+
+
+/***
+ *  rt_socket_rxring_setup - allocate the receive ring and map it
+ *  @sockctx:   socket context
+ *  @user_info: owner of the mapping, NULL for kernel users which then
+ *              access the ring directly
+ *  @req:       ring geometry, returns the ring address
+ *
+ *  Has to run in non-real-time context (returns -ENOSYS otherwise). The
+ *  frames are mapped for reading and writing.
+ */
+int rt_socket_rxring_setup(struct rtdm_dev_context *sockctx,
+                           rtdm_user_info_t *user_info,
+                           struct rtnet_rxring_req *req)
+{
+    struct rtsocket         *sock = (struct rtsocket *)&sockctx->dev_private;
+    struct rtsocket_rxring  *ring;
+    struct rtnet_rxring_hdr *hdr;
+    unsigned long           size;
+    void                    *addr;
+    int                     ret;
+
+
+    if (rtdm_in_rt_context())
+        return -ENOSYS;
+
+    if (user_info && !rtdm_rw_user_ok(user_info, req, sizeof(*req)))
+        return -EFAULT;
+
+    if ((req->frame_size <= RTNET_RXRING_DESC_SIZE) ||
+        (req->frame_size & 15) || (req->frame_size > 0x10000) ||
+        (req->frame_nr == 0) || (req->frame_nr & (req->frame_nr - 1)) ||
+        (req->frame_nr > 0x10000))
+        return -EINVAL;
+
+    size = PAGE_ALIGN(sizeof(struct rtnet_rxring_hdr) +
+                      (unsigned long)req->frame_size * req->frame_nr);
+
+    ring = kmalloc(sizeof(struct rtsocket_rxring), GFP_KERNEL);
+    if (ring == NULL)
+        return -ENOMEM;
+
+    ring->ready = kmalloc(req->frame_nr, GFP_KERNEL);
+    hdr = vmalloc(size);
+    if ((ring->ready == NULL) || (hdr == NULL)) {
+        if (hdr != NULL)
+            vfree(hdr);
+        kfree(ring->ready);
+        kfree(ring);
+        return -ENOMEM;
+    }
+    memset(ring->ready, 0, req->frame_nr);
+    memset(hdr, 0, size);
+
+    /* only informs the application, the stack uses its own copy */
+    hdr->frame_size = req->frame_size;
+    hdr->frame_nr   = req->frame_nr;
+    hdr->offset     = sizeof(struct rtnet_rxring_hdr);
+
+    ring->hdr        = hdr;
+    ring->frames     = (unsigned char *)hdr + sizeof(struct rtnet_rxring_hdr);
+    ring->frame_size = req->frame_size;
+    ring->frame_nr   = req->frame_nr;
+    ring->data_size  = req->frame_size - RTNET_RXRING_DESC_SIZE;
+    ring->reserve    = 0;
+    ring->head       = 0;
+    ring->dropped    = 0;
+    atomic_set(&ring->refs, 1);
+    atomic_set(&ring->waiting, 0);
+    rtdm_lock_init(&ring->lock);
+
+    if (user_info) {
+        /* the mapping holds its own reference */
+        atomic_inc(&ring->refs);
+
+        ret = rtdm_mmap_to_user(user_info, hdr, size,
+                                PROT_READ | PROT_WRITE, &addr,
+                                &rt_socket_rxring_vm_ops, ring);
+        if (ret < 0) {
+            vfree(hdr);
+            kfree(ring);
+            return ret;
+        }
+    } else
+        addr = hdr;
+
+    mutex_lock(&sock->pool_nrt_lock);
+
+    if (test_bit(SKB_POOL_CLOSED, &sockctx->context_flags))
+        ret = -EBADF;
+    else if (sock->rxring != NULL)
+        ret = -EBUSY;
+    else {
+        /* receivers may pick up the ring from now on */
+        smp_wmb();
+        sock->rxring = ring;
+        ret = 0;
+    }
+
+    mutex_unlock(&sock->pool_nrt_lock);
+
+    if (ret < 0) {
+        if (user_info)
+            rtdm_munmap(user_info, addr, size);
+        rt_socket_rxring_put(ring);
+        return ret;
+    }
+
+    req->ring = addr;
+
+    return 0;
+}
+EXPORT_SYMBOL(rt_socket_rxring_setup);
+
+
+
+/***
+ *  rt_socket_rxring_frame - reserve the next free frame of the receive ring
+ *  @ring:  receive ring
+ *  @index: returns the frame to be passed to rt_socket_rxring_publish
+ *
+ *  Only the tail is taken from the shared header, and it is checked against
+ *  the stack's own indices. The frame is filled without holding any lock.
+ *  Returns NULL and accounts the loss if the ring is full.
+ */
+struct rtnet_rxring_desc *rt_socket_rxring_frame(struct rtsocket_rxring *ring,
+                                                 u32 *index)
+{
+    rtdm_lockctx_t  context;
+    u32             tail;
+
+
+    rtdm_lock_get_irqsave(&ring->lock, context);
+
+    tail = ring->hdr->tail;
+
+    /* a tail beyond the published frames is treated like a full ring */
+    if (unlikely(ring->head - tail > ring->frame_nr) ||
+        unlikely(ring->reserve - tail >= ring->frame_nr)) {
+        ring->hdr->dropped = ++ring->dropped;
+        rtdm_lock_put_irqrestore(&ring->lock, context);
+        rtnet_count_drop(RTNET_DROP_RXRING_FULL);
+        return NULL;
+    }
+
+    *index = ring->reserve++;
+
+    rtdm_lock_put_irqrestore(&ring->lock, context);
+
+    /* don't fill the frame before the application released it */
+    smp_mb();
+
+    return (struct rtnet_rxring_desc *)(ring->frames +
+        (*index & (ring->frame_nr - 1)) * ring->frame_size);
+}
+EXPORT_SYMBOL(rt_socket_rxring_frame);
+
+
+
+/***
+ *  rt_socket_rxring_publish - pass a filled frame to the application
+ *  @sock:  socket
+ *  @index: frame reserved by rt_socket_rxring_frame
+ *
+ *  Frames are passed on in the order they were reserved. If earlier ones
+ *  are still being filled by other producers, the frame is published by the
+ *  last of them.
+ */
+void rt_socket_rxring_publish(struct rtsocket *sock, u32 index)
+{
+    struct rtsocket_rxring  *ring = sock->rxring;
+    u32                     mask = ring->frame_nr - 1;
+    rtdm_lockctx_t          context;
+
+
+    rtdm_lock_get_irqsave(&ring->lock, context);
+
+    ring->ready[index & mask] = 1;
+
+    while ((ring->head != ring->reserve) && ring->ready[ring->head & mask]) {
+        ring->ready[ring->head & mask] = 0;
+        ring->head++;
+    }
+
+    smp_wmb();
+    ring->hdr->head = ring->head;
+
+    rtdm_lock_put_irqrestore(&ring->lock, context);
+
+    /* pairs with the barrier in rt_socket_rxring_wait */
+    smp_mb();
+    if (atomic_read(&ring->waiting) && atomic_xchg(&ring->waiting, 0))
+        rtdm_sem_up(&sock->pending_sem);
+}
+EXPORT_SYMBOL(rt_socket_rxring_publish);
+
+
+
+/***
+ *  rt_socket_rxring_wait - wait until the receive ring is non-empty
+ */
+int rt_socket_rxring_wait(struct rtsocket *sock)
+{
+    struct rtsocket_rxring  *ring = sock->rxring;
+    int                     ret;
+
+
+    if (ring == NULL)
+        return -EINVAL;
+
+    while (1) {
+        atomic_set(&ring->waiting, 1);
+
+        /* pairs with the barrier in rt_socket_rxring_publish */
+        smp_mb();
+        if (ring->head != ring->hdr->tail) {
+            atomic_set(&ring->waiting, 0);
+            return 0;
+        }
+
+        ret = rtdm_sem_timeddown(&sock->pending_sem, sock->timeout, NULL);
+        if (unlikely(ret < 0)) {
+            atomic_set(&ring->waiting, 0);
+
+            switch (ret) {
+                case -EWOULDBLOCK:
+                case -ETIMEDOUT:
+                case -EINTR:
+                    return ret;
+
+                default:
+                    return -EBADF;   /* socket has been closed */
+            }
+        }
+    }
+}
+EXPORT_SYMBOL(rt_socket_rxring_wait);
+
+
+
+/***
+ *  rt_socket_txarea_put - drop a reference on a transmission area
+ */
+static void rt_socket_txarea_put(struct rtsocket_txarea *area)
+{
+    if (atomic_dec_and_test(&area->refs)) {
+        free_pages((unsigned long)area->kaddr, area->order);
+        kfree(area);
+    }
+}
+
+
+
+static void rt_socket_txarea_vm_open(struct vm_area_struct *vma)
+{
+    struct rtsocket_txarea *area = vma->vm_private_data;
+
+    atomic_inc(&area->refs);
+}
+
+
+
+static void rt_socket_txarea_vm_close(struct vm_area_struct *vma)
+{
+    rt_socket_txarea_put(vma->vm_private_data);
+}
+
+
+
+static struct vm_operations_struct rt_socket_txarea_vm_ops = {
+    .open =     rt_socket_txarea_vm_open,
+    .close =    rt_socket_txarea_vm_close
+};
+
+
+
+/***
+ *  rt_socket_txarea_setup - allocate the transmission area and map it
+ *  @sockctx:   socket context
+ *  @user_info: owner of the mapping, NULL for kernel users
+ *  @req:       area size, returns the area address
+ *
+ *  Has to run in non-real-time context (returns -ENOSYS otherwise). The area
+ *  is physically contiguous, so NICs can gather payload from it directly.
+ */
+int rt_socket_txarea_setup(struct rtdm_dev_context *sockctx,
+                           rtdm_user_info_t *user_info,
+                           struct rtnet_txarea_req *req)
+{
+    struct rtsocket         *sock = (struct rtsocket *)&sockctx->dev_private;
+    struct rtsocket_txarea  *area;
+    unsigned long           size;
+    void                    *addr;
+    int                     ret;
+
+
+    if (rtdm_in_rt_context())
+        return -ENOSYS;
+
+    if (user_info && !rtdm_rw_user_ok(user_info, req, sizeof(*req)))
+        return -EFAULT;
+
+    if ((req->size == 0) || (req->size > RTNET_TXAREA_MAX))
+        return -EINVAL;
+
+    size = PAGE_ALIGN(req->size);
+
+    area = kmalloc(sizeof(struct rtsocket_txarea), GFP_KERNEL);
+    if (area == NULL)
+        return -ENOMEM;
+
+    area->order = get_order(size);
+    area->kaddr = (void *)__get_free_pages(GFP_KERNEL, area->order);
+    if (area->kaddr == NULL) {
+        kfree(area);
+        return -ENOMEM;
+    }
+    memset(area->kaddr, 0, size);
+
+    area->size = size;
+    atomic_set(&area->refs, 1);
+
+    if (user_info) {
+        /* the mapping holds its own reference */
+        atomic_inc(&area->refs);
+
+        ret = rtdm_mmap_to_user(user_info, area->kaddr, size,
+                                PROT_READ | PROT_WRITE, &addr,
+                                &rt_socket_txarea_vm_ops, area);
+        if (ret < 0) {
+            free_pages((unsigned long)area->kaddr, area->order);
+            kfree(area);
+            return ret;
+        }
+    } else
+        addr = area->kaddr;
+
+    area->uaddr = (unsigned long)addr;
+
+    mutex_lock(&sock->pool_nrt_lock);
+
+    if (test_bit(SKB_POOL_CLOSED, &sockctx->context_flags))
+        ret = -EBADF;
+    else if (sock->txarea != NULL)
+        ret = -EBUSY;
+    else {
+        /* senders may pick up the area from now on */
+        smp_wmb();
+        sock->txarea = area;
+        ret = 0;
+    }
+
+    mutex_unlock(&sock->pool_nrt_lock);
+
+    if (ret < 0) {
+        if (user_info)
+            rtdm_munmap(user_info, addr, size);
+        rt_socket_txarea_put(area);
+        return ret;
+    }
+
+    req->area = addr;
+
+    return 0;
+}
+EXPORT_SYMBOL(rt_socket_txarea_setup);
+
+
+
+/***
+ *  rt_socket_txarea_iovec - translate a message into the transmission area
+ *  @sock: socket
+ *  @msg:  message of the area owner
+ *  @kiov: receives msg->msg_iovlen kernel iovec entries
+ *
+ *  Returns -EFAULT if the socket has no area, the payload does not lie
+ *  completely inside it, or it is spread over more than RTNET_TXAREA_IOVS
+ *  entries.
+ */
+int rt_socket_txarea_iovec(struct rtsocket *sock, const struct msghdr *msg,
+                           struct iovec *kiov)
+{
+    struct rtsocket_txarea  *area = sock->txarea;
+    unsigned long           offset;
+    size_t                  len;
+    int                     i;
+
+
+    if ((area == NULL) || (msg->msg_iovlen > RTNET_TXAREA_IOVS))
+        return -EFAULT;
+
+    for (i = 0; i < msg->msg_iovlen; i++) {
+        offset = (unsigned long)msg->msg_iov[i].iov_base - area->uaddr;
+        len    = msg->msg_iov[i].iov_len;
+
+        /* offset wraps around for addresses below the area */
+        if ((offset > area->size) || (len > area->size - offset))
+            return -EFAULT;
+
+        kiov[i].iov_base = area->kaddr + offset;
+        kiov[i].iov_len  = len;
+    }
+
+    return 0;
+}
+EXPORT_SYMBOL(rt_socket_txarea_iovec);
+
+
+
+/***
+ *  rt_socket_rxprio_setup - configure priority-ordered reception
+ *  @sockctx:   socket context
+ *  @user_info: caller, NULL for kernel users
+ *  @req:       classification mode, default priority and sender map
+ *
+ *  Has to run in non-real-time context (returns -ENOSYS otherwise). Once
+ *  allocated, the queue stays with the socket until it is closed. Switching
+ *  back to RTNET_RXPRIO_OFF moves pending datagrams to the FIFO in the order
+ *  they would have been received.
+ */
+int rt_socket_rxprio_setup(struct rtdm_dev_context *sockctx,
+                           rtdm_user_info_t *user_info,
+                           struct rtnet_rxprio_req *req)
+{
+    struct rtsocket         *sock = (struct rtsocket *)&sockctx->dev_private;
+    struct rtsocket_rxprio  *rxprio;
+    struct rtskb_queue      *sub_queue;
+    rtdm_lockctx_t          context;
+    unsigned int            i;
+    int                     ret = 0;
+
+
+    if (rtdm_in_rt_context())
+        return -ENOSYS;
+
+    if (user_info && !rtdm_read_user_ok(user_info, req, sizeof(*req)))
+        return -EFAULT;
+
+    if ((req->mode > RTNET_RXPRIO_SENDER) ||
+        (req->def_prio > RTNET_RXPRIO_MIN) ||
+        (req->map_len > RTNET_RXPRIO_MAP_SIZE))
+        return -EINVAL;
+
+    for (i = 0; i < req->map_len; i++)
+        if (req->map[i].prio > RTNET_RXPRIO_MIN)
+            return -EINVAL;
+
+    mutex_lock(&sock->pool_nrt_lock);
+
+    if (test_bit(SKB_POOL_CLOSED, &sockctx->context_flags)) {
+        ret = -EBADF;
+        goto out;
+    }
+
+    rxprio = sock->rxprio;
+    if (rxprio == NULL) {
+        if (req->mode == RTNET_RXPRIO_OFF)
+            goto out;
+
+        rxprio = kmalloc(sizeof(struct rtsocket_rxprio), GFP_KERNEL);
+        if (rxprio == NULL) {
+            ret = -ENOMEM;
+            goto out;
+        }
+
+        rtskb_prio_queue_init(&rxprio->queue);
+        rxprio->mode = RTNET_RXPRIO_OFF;
+
+        /* receivers may pick up the queue from now on */
+        smp_wmb();
+        sock->rxprio = rxprio;
+    }
+
+    rtdm_lock_get_irqsave(&rxprio->queue.lock, context);
+
+    rxprio->def_prio = req->def_prio;
+    rxprio->map_len  = req->map_len;
+    memcpy(rxprio->map, req->map, req->map_len * sizeof(req->map[0]));
+
+    if ((req->mode == RTNET_RXPRIO_OFF) && (rxprio->queue.usage != 0)) {
+        /* the FIFO only holds older or peeked datagrams, append behind */
+        rtdm_lock_get(&sock->incoming.lock);
+
+        for (i = QUEUE_MAX_PRIO; i <= QUEUE_MIN_PRIO; i++) {
+            sub_queue = &rxprio->queue.queue[i];
+            if (sub_queue->first == NULL)
+                continue;
+
+            if (sock->incoming.first == NULL)
+                sock->incoming.first = sub_queue->first;
+            else
+                sock->incoming.last->next = sub_queue->first;
+            sock->incoming.last = sub_queue->last;
+
+            sub_queue->first = NULL;
+            sub_queue->last  = NULL;
+        }
+        rxprio->queue.usage = 0;
+
+        rtdm_lock_put(&sock->incoming.lock);
+    }
+
+    rxprio->mode = req->mode;
+
+    rtdm_lock_put_irqrestore(&rxprio->queue.lock, context);
+
+  out:
+    mutex_unlock(&sock->pool_nrt_lock);
+
+    return ret;
+}
+EXPORT_SYMBOL(rt_socket_rxprio_setup);
+
+
+
+/***
+ *  rt_socket_rxprio_queue - classify a received datagram and queue it
+ *  @iph:   IPv4 header of the datagram, NULL if there is none
+ *  @sport: source port in network order, 0 if unknown
+ */
+void rt_socket_rxprio_queue(struct rtsocket *sock, struct rtskb *skb,
+                            struct iphdr *iph, u16 sport)
+{
+    struct rtsocket_rxprio  *rxprio = sock->rxprio;
+    rtdm_lockctx_t          context;
+    unsigned int            prio;
+    unsigned int            i;
+
+
+    rtdm_lock_get_irqsave(&rxprio->queue.lock, context);
+
+    prio = rxprio->def_prio;
+
+    switch (rxprio->mode) {
+        case RTNET_RXPRIO_OFF:
+            /* disabled meanwhile */
+            rtdm_lock_put_irqrestore(&rxprio->queue.lock, context);
+            rtskb_queue_tail(&sock->incoming, skb);
+            return;
+
+        case RTNET_RXPRIO_TOS:
+            /* two DSCPs per level, the highest maps to RTNET_RXPRIO_MAX */
+            if (iph != NULL)
+                prio = RTNET_RXPRIO_MIN - (iph->tos >> 3);
+            break;
+
+        case RTNET_RXPRIO_SENDER:
+            if (iph == NULL)
+                break;
+            for (i = 0; i < rxprio->map_len; i++)
+                if ((rxprio->map[i].addr == iph->saddr) &&
+                    ((rxprio->map[i].port == 0) ||
+                     (rxprio->map[i].port == sport))) {
+                    prio = rxprio->map[i].prio;
+                    break;
+                }
+            break;
+    }
+
+    skb->priority = (skb->priority & ~RTSKB_PRIO_MASK) | prio;
+    __rtskb_prio_queue_tail(&rxprio->queue, skb);
+
+    rtdm_lock_put_irqrestore(&rxprio->queue.lock, context);
+}
+EXPORT_SYMBOL(rt_socket_rxprio_queue);
+
+
+
 /***
  *  rt_socket_init - initialises a new socket structure
  */
@@ -75,6 +683,10 @@ int rt_socket_init(struct rtdm_dev_context *sockctx, unsigned short protocol)
     rtskb_queue_init(&sock->incoming);
 
     sock->timeout = 0;
+    sock->zerocopy = 0;
+    sock->rxring = NULL;
+    sock->rxprio = NULL;
+    sock->txarea = NULL;
 
     rtdm_lock_init(&sock->param_lock);
     rtdm_sem_init(&sock->pending_sem, 0);
@@ -106,11 +718,30 @@ int rt_socket_init(struct rtdm_dev_context *sockctx, unsigned short protocol)
 int rt_socket_cleanup(struct rtdm_dev_context *sockctx)
 {
     struct rtsocket *sock  = (struct rtsocket *)&sockctx->dev_private;
+    struct rtskb    *skb;
     int ret = 0;
 
 
     rtdm_sem_destroy(&sock->pending_sem);
 
+    /* user mappings may keep the ring alive */
+    if (sock->rxring != NULL) {
+        rt_socket_rxring_put(sock->rxring);
+        sock->rxring = NULL;
+    }
+
+    if (sock->txarea != NULL) {
+        rt_socket_txarea_put(sock->txarea);
+        sock->txarea = NULL;
+    }
+
+    if (sock->rxprio != NULL) {
+        while ((skb = rtskb_prio_dequeue_chain(&sock->rxprio->queue)))
+            kfree_rtskb(skb);
+        kfree(sock->rxprio);
+        sock->rxprio = NULL;
+    }
+
     mutex_lock(&sock->pool_nrt_lock);
 
     set_bit(SKB_POOL_CLOSED, &sockctx->context_flags);
@@ -154,6 +785,14 @@ int rt_socket_common_ioctl(struct rtdm_dev_context *sockctx,
             sock->timeout = *(nanosecs_rel_t *)arg;
             break;
 
+        case RTNET_RTIOC_ZEROCOPY:
+            /* fragments have to refer to kernel memory */
+            if (user_info)
+                return -EACCES;
+
+            sock->zerocopy = (*(unsigned int *)arg != 0);
+            break;
+
         case RTNET_RTIOC_CALLBACK:
             if (user_info)
                 return -EACCES;
@@ -315,6 +954,9 @@ int rt_socket_select_bind(struct rtdm_dev_context *context,
 
     switch (type) {
         case XNSELECT_READ:
+            /* the mapped ring is waited for with RTNET_RTIOC_RXRING_WAIT */
+            if (sock->rxring != NULL)
+                return -EINVAL;
             return rtdm_sem_select_bind(&sock->pending_sem, selector,
                                         XNSELECT_READ, fd_index);
         default:
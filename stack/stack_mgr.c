@@ -23,10 +23,13 @@
  */
 
 #include <linux/moduleparam.h>
+#include <linux/slab.h>
 
 #include <rtdev.h>
 #include <rtnet_internal.h>
+#include <rtnet_stats.h>
 #include <rtskb_fifo.h>
+#include <rtvlan.h>
 #include <stack_mgr.h>
 
 
@@ -34,42 +37,149 @@ static unsigned int stack_mgr_prio = RTNET_DEF_STACK_PRIORITY;
 module_param(stack_mgr_prio, uint, 0444);
 MODULE_PARM_DESC(stack_mgr_prio, "Priority of the stack manager task");
 
+static int stack_mgr_cpu = -1;
+module_param(stack_mgr_cpu, int, 0444);
+MODULE_PARM_DESC(stack_mgr_cpu, "CPU of the stack manager task (-1: any)");
+
 
 #if (CONFIG_RTNET_RX_FIFO_SIZE & (CONFIG_RTNET_RX_FIFO_SIZE-1)) != 0
 #error CONFIG_RTNET_RX_FIFO_SIZE must be power of 2!
 #endif
 static DECLARE_RTSKB_FIFO(rx, CONFIG_RTNET_RX_FIFO_SIZE);
 
+/* maximum number of rtskbs the stack manager dequeues at once */
+#define RTNET_STACK_BURST_SIZE  16
+
+/* dedicated per-device stack manager, see rt_stack_mgr_dev_setup() */
+struct rtnet_dev_stack_mgr {
+    struct rtnet_mgr    mgr;
+    char                name[IFNAMSIZ + 12];
+    DECLARE_RTSKB_FIFO(rx, CONFIG_RTNET_RX_FIFO_SIZE);
+};
+
+/*
+ * Protocol dispatch table
+ *
+ * The RX path walks the handler lists without taking rt_packets_lock. Each
+ * delivery is accounted in a per-CPU reader slot instead, selected by the
+ * parity of rt_packets_epoch. Writers serialise on rt_packets_lock, unlink
+ * entries so that concurrent readers can still walk past them, and only
+ * advance the epoch when all readers of the previous slot have left. An
+ * entry unlinked at epoch E is unreferenced once the epoch reached E + 2.
+ */
 struct list_head    rt_packets[RTPACKET_HASH_TBL_SIZE];
 #ifdef CONFIG_RTNET_ETH_P_ALL
 struct list_head    rt_packets_all;
 #endif /* CONFIG_RTNET_ETH_P_ALL */
 rtdm_lock_t         rt_packets_lock = RTDM_LOCK_UNLOCKED;
 
+static volatile unsigned long rt_packets_epoch;
+
+static struct {
+    atomic_t        active[2];
+} ____cacheline_aligned_in_smp rt_packets_readers[NR_CPUS];
+
+
+/***
+ *  rt_packets_enter - start a lockless walk of the dispatch table
+ *
+ *  Returns the reader slot to pass to rt_packets_leave(). Sections may nest
+ *  (e.g. loopback transmissions from a handler).
+ */
+static inline unsigned int rt_packets_enter(void)
+{
+    unsigned int    slot;
+
+
+    slot = rtos_processor_id() * 2 + (rt_packets_epoch & 1);
+    atomic_inc(&rt_packets_readers[slot / 2].active[slot & 1]);
+
+    /* pairs with the barrier in rt_packets_advance() */
+    smp_mb();
+
+    return slot;
+}
+
+
+static inline void rt_packets_leave(unsigned int slot)
+{
+    smp_mb__before_atomic_dec();
+    atomic_dec(&rt_packets_readers[slot / 2].active[slot & 1]);
+}
+
+
+/***
+ *  rt_packets_advance - start a new reader epoch if the previous one is over
+ *
+ *  Must be called with rt_packets_lock held. Returns 1 if the epoch was
+ *  advanced, 0 if readers of the previous epoch are still active.
+ */
+static int rt_packets_advance(void)
+{
+    unsigned int    prev = (rt_packets_epoch + 1) & 1;
+    int             cpu;
+
+
+    /* order preceding unlinks before sampling the readers */
+    smp_mb();
+
+    for (cpu = 0; cpu < NR_CPUS; cpu++)
+        if (atomic_read(&rt_packets_readers[cpu].active[prev]) != 0)
+            return 0;
+
+    smp_mb();
+    rt_packets_epoch++;
+
+    return 1;
+}
+
+
+static inline void rt_packets_link(struct list_head *new,
+                                   struct list_head *head)
+{
+    new->next = head;
+    new->prev = head->prev;
+
+    /* publish the entry only after it is fully set up */
+    smp_wmb();
+
+    head->prev->next = new;
+    head->prev       = new;
+}
+
+
+static inline void rt_packets_unlink(struct list_head *entry)
+{
+    /* keep entry->next intact for readers currently standing on it */
+    entry->next->prev = entry->prev;
+    entry->prev->next = entry->next;
+}
+
 
 /***
  *  rtdev_add_pack:         add protocol (Layer 3)
  *  @pt:                    the new protocol
+ *
+ *  An entry must not be added again before rtdev_remove_pack() succeeded.
  */
 int rtdev_add_pack(struct rtpacket_type *pt)
 {
     int                     ret = 0;
     rtdm_lockctx_t          context;
 
-    INIT_LIST_HEAD(&pt->list_entry);
-    pt->refcount = 0;
+    pt->removing = 0;
 
     rtdm_lock_get_irqsave(&rt_packets_lock, context);
 
     if (pt->type == htons(ETH_P_ALL))
 #ifdef CONFIG_RTNET_ETH_P_ALL
-        list_add_tail(&pt->list_entry, &rt_packets_all);
+        rt_packets_link(&pt->list_entry, &rt_packets_all);
 #else /* !CONFIG_RTNET_ETH_P_ALL */
         ret = -EINVAL;
 #endif /* CONFIG_RTNET_ETH_P_ALL */
     else
-        list_add_tail(&pt->list_entry,
-                      &rt_packets[ntohs(pt->type) & RTPACKET_HASH_KEY_MASK]);
+        rt_packets_link(&pt->list_entry,
+                        &rt_packets[ntohs(pt->type) & RTPACKET_HASH_KEY_MASK]);
 
     rtdm_lock_put_irqrestore(&rt_packets_lock, context);
 
@@ -82,6 +192,10 @@ EXPORT_SYMBOL(rtdev_add_pack);
 /***
  *  rtdev_remove_pack:  remove protocol (Layer 3)
  *  @pt:                protocol
+ *
+ *  The protocol no longer receives new packets after the first call. As long
+ *  as deliveries that may still reference it are in flight, -EAGAIN is
+ *  returned and the caller has to retry before releasing @pt. Never blocks.
  */
 int rtdev_remove_pack(struct rtpacket_type *pt)
 {
@@ -93,10 +207,16 @@ int rtdev_remove_pack(struct rtpacket_type *pt)
 
     rtdm_lock_get_irqsave(&rt_packets_lock, context);
 
-    if (pt->refcount > 0)
+    if (!pt->removing) {
+        rt_packets_unlink(&pt->list_entry);
+        pt->removing = 1;
+        pt->epoch    = rt_packets_epoch;
+    }
+
+    while ((rt_packets_epoch - pt->epoch < 2) && rt_packets_advance());
+
+    if (rt_packets_epoch - pt->epoch < 2)
         ret = -EAGAIN;
-    else
-        list_del(&pt->list_entry);
 
     rtdm_lock_put_irqrestore(&rt_packets_lock, context);
 
@@ -119,12 +239,17 @@ void rtnetif_rx(struct rtskb *skb)
 
     RTNET_ASSERT(skb != NULL, return;);
     RTNET_ASSERT(skb->rtdev != NULL, return;);
+    RTNET_ASSERT(skb->rtdev->stack_mgr != NULL, kfree_rtskb(skb); return;);
 
     rtdev = skb->rtdev;
     rtdev_reference(rtdev);
 
-    if (unlikely(rtskb_fifo_insert_inirq(&rx.fifo, skb) < 0)) {
-        rtdm_printk("RTnet: dropping packet in %s()\n", __FUNCTION__);
+    rtnet_trace_start(skb, skb->time_stamp);
+    rtnet_trace(skb, RTNET_LAT_RX_IRQ);
+
+    if (unlikely(rtskb_fifo_insert_inirq(rtdev->stack_mgr->rx_fifo,
+                                         skb) < 0)) {
+        rtnet_count_drop(RTNET_DROP_RX_FIFO);
         kfree_rtskb(skb);
         rtdev_dereference(rtdev);
     }
@@ -133,72 +258,145 @@ void rtnetif_rx(struct rtskb *skb)
 EXPORT_SYMBOL(rtnetif_rx);
 
 
-#ifdef CONFIG_RTNET_DRV_LOOPBACK
-#define __DELIVER_PREFIX
-#else /* !CONFIG_RTNET_DRV_LOOPBACK */
-#define __DELIVER_PREFIX static inline
-#endif /* CONFIG_RTNET_DRV_LOOPBACK */
+/***
+ *  rtnetif_rx_bulk: like rtnetif_rx, but queues a burst of packets that
+ *  were received by the same device with a single FIFO update
+ *
+ *  @skbs  - the packets
+ *  @count - number of packets
+ */
+void rtnetif_rx_bulk(struct rtskb **skbs, unsigned int count)
+{
+    struct rtnet_device *rtdev;
+    unsigned int        queued;
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+    unsigned int        i;
+#endif
 
-__DELIVER_PREFIX void rt_stack_deliver(struct rtskb *rtskb)
+
+    RTNET_ASSERT(skbs != NULL, return;);
+
+    if (unlikely(count == 0))
+        return;
+
+    rtdev = skbs[0]->rtdev;
+
+    RTNET_ASSERT(rtdev != NULL, return;);
+    RTNET_ASSERT(rtdev->stack_mgr != NULL, return;);
+
+    atomic_add(count, &rtdev->refcount);
+
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+    for (i = 0; i < count; i++) {
+        rtnet_trace_start(skbs[i], skbs[i]->time_stamp);
+        rtnet_trace(skbs[i], RTNET_LAT_RX_IRQ);
+    }
+#endif
+
+    queued = rtskb_fifo_insert_bulk_inirq(rtdev->stack_mgr->rx_fifo,
+                                          skbs, count);
+    if (unlikely(queued < count)) {
+        do {
+            rtnet_count_drop(RTNET_DROP_RX_FIFO);
+            kfree_rtskb(skbs[queued]);
+            rtdev_dereference(rtdev);
+        } while (++queued < count);
+    }
+}
+
+EXPORT_SYMBOL(rtnetif_rx_bulk);
+
+
+/***
+ *  __rt_stack_deliver_l3 - pass rtskb to the registered layer 3 handlers
+ *  @rtskb:     the packet
+ *  @pt_entry:  handler to continue after, NULL to start with the first one
+ *
+ *  Must be called inside a rt_packets_enter/leave section.
+ *  Returns 0 if a handler accepted the packet, -ENOENT otherwise.
+ */
+static inline int __rt_stack_deliver_l3(struct rtskb *rtskb,
+                                        struct rtpacket_type *pt_entry)
+{
+    struct list_head        *head;
+
+
+    head = &rt_packets[ntohs(rtskb->protocol) & RTPACKET_HASH_KEY_MASK];
+
+    if (pt_entry == NULL)
+        pt_entry = list_entry(head, struct rtpacket_type, list_entry);
+
+    list_for_each_entry_continue(pt_entry, head, list_entry)
+        if ((pt_entry->type == rtskb->protocol) &&
+            (pt_entry->handler(rtskb, pt_entry) == 0))
+            return 0;
+
+    return -ENOENT;
+}
+
+
+static void rt_stack_drop(struct rtskb *rtskb, int eth_p_all_hit)
 {
-    unsigned short          hash;
-    struct rtpacket_type    *pt_entry;
-    rtdm_lockctx_t          context;
     struct rtnet_device     *rtdev = rtskb->rtdev;
-    int                     err;
+
+
+    /* Don't account if ETH_P_ALL listener were present or when running in
+       promiscuous mode (RTcap). */
+    if (unlikely(!eth_p_all_hit && !(rtdev->flags & IFF_PROMISC)))
+        rtnet_count_drop(RTNET_DROP_NO_HANDLER);
+
+    kfree_rtskb(rtskb);
+}
+
+
+/* must be called inside a rt_packets_enter/leave section */
+static inline void __rt_stack_deliver(struct rtskb *rtskb)
+{
+#ifdef CONFIG_RTNET_ETH_P_ALL
+    struct rtpacket_type    *pt_entry;
+#endif /* CONFIG_RTNET_ETH_P_ALL */
+    struct rtnet_device     *rtdev;
     int                     eth_p_all_hit = 0;
 
 
     rtcap_report_incoming(rtskb);
 
-    rtskb->nh.raw = rtskb->data;
+#ifdef CONFIG_RTNET_VLAN
+    if (unlikely(rtskb->vlan_tci != 0) && (rt_vlan_rx(rtskb) < 0))
+        return;
+#endif
+    rtdev = rtskb->rtdev;
 
-    rtdm_lock_get_irqsave(&rt_packets_lock, context);
+    rtskb->nh.raw = rtskb->data;
 
 #ifdef CONFIG_RTNET_ETH_P_ALL
-    eth_p_all_hit = 0;
     list_for_each_entry(pt_entry, &rt_packets_all, list_entry) {
-        pt_entry->refcount++;
-        rtdm_lock_put_irqrestore(&rt_packets_lock, context);
-
         pt_entry->handler(rtskb, pt_entry);
-
-        rtdm_lock_get_irqsave(&rt_packets_lock, context);
-        pt_entry->refcount--;
         eth_p_all_hit = 1;
     }
 #endif /* CONFIG_RTNET_ETH_P_ALL */
 
-    hash = ntohs(rtskb->protocol) & RTPACKET_HASH_KEY_MASK;
+    if (unlikely(__rt_stack_deliver_l3(rtskb, NULL) != 0))
+        rt_stack_drop(rtskb, eth_p_all_hit);
 
-    list_for_each_entry(pt_entry, &rt_packets[hash], list_entry)
-        if (pt_entry->type == rtskb->protocol) {
-            pt_entry->refcount++;
-            rtdm_lock_put_irqrestore(&rt_packets_lock, context);
-
-            err = pt_entry->handler(rtskb, pt_entry);
-
-            rtdm_lock_get_irqsave(&rt_packets_lock, context);
-            pt_entry->refcount--;
+    rtdev_dereference(rtdev);
+}
 
-            rtdev_dereference(rtdev);
 
-            if (likely(!err)) {
-                rtdm_lock_put_irqrestore(&rt_packets_lock, context);
-                return;
-            }
-        }
+#ifdef CONFIG_RTNET_DRV_LOOPBACK
+#define __DELIVER_PREFIX
+#else /* !CONFIG_RTNET_DRV_LOOPBACK */
+#define __DELIVER_PREFIX static inline
+#endif /* CONFIG_RTNET_DRV_LOOPBACK */
 
-    rtdm_lock_put_irqrestore(&rt_packets_lock, context);
+__DELIVER_PREFIX void rt_stack_deliver(struct rtskb *rtskb)
+{
+    unsigned int            slot;
 
-    /* Don't warn if ETH_P_ALL listener were present or when running in
-       promiscuous mode (RTcap). */
-    if (unlikely(!eth_p_all_hit && !(rtdev->flags & IFF_PROMISC)))
-        rtdm_printk("RTnet: no one cared for packet with layer 3 "
-                    "protocol type 0x%04x\n", ntohs(rtskb->protocol));
 
-    kfree_rtskb(rtskb);
-    rtdev_dereference(rtdev);
+    slot = rt_packets_enter();
+    __rt_stack_deliver(rtskb);
+    rt_packets_leave(slot);
 }
 
 #ifdef CONFIG_RTNET_DRV_LOOPBACK
@@ -206,25 +404,114 @@ EXPORT_SYMBOL_GPL(rt_stack_deliver);
 #endif /* CONFIG_RTNET_DRV_LOOPBACK */
 
 
-static void rt_stack_mgr_task(void *arg)
+/***
+ *  rt_stack_deliver_batch - deliver a burst of received packets
+ *  @rtskbs: the packets, array content is consumed
+ *  @count:  number of packets
+ *
+ *  Packets are delivered in arrival order, also across protocols. The
+ *  handler is only looked up again when the protocol changes, so a run of
+ *  packets of the same type costs a single lookup. The whole burst is
+ *  delivered inside a single lockless reader section. ETH_P_ALL listeners
+ *  fall back to per-packet delivery.
+ */
+static void rt_stack_deliver_batch(struct rtskb **rtskbs, unsigned int count)
 {
-    rtdm_event_t            *mgr_event = &((struct rtnet_mgr *)arg)->event;
+    struct rtpacket_type    *pt_entry = NULL;
+    struct list_head        *head = NULL;
     struct rtskb            *rtskb;
+    struct rtnet_device     *rtdev;
+    unsigned short          protocol = 0;
+    unsigned int            i;
+    unsigned int            slot;
+
+
+    slot = rt_packets_enter();
+
+#ifdef CONFIG_RTNET_ETH_P_ALL
+    if (unlikely(!list_empty(&rt_packets_all))) {
+        for (i = 0; i < count; i++)
+            __rt_stack_deliver(rtskbs[i]);
+        rt_packets_leave(slot);
+        return;
+    }
+#endif /* CONFIG_RTNET_ETH_P_ALL */
+
+    for (i = 0; i < count; i++) {
+        rtskb = rtskbs[i];
+
+        rtcap_report_incoming(rtskb);
+#ifdef CONFIG_RTNET_VLAN
+        /* tagged packets are demultiplexed to their VLAN device first */
+        if (unlikely(rtskb->vlan_tci != 0) && (rt_vlan_rx(rtskb) < 0))
+            continue;
+#endif
+        rtskb->nh.raw = rtskb->data;
+        rtdev = rtskb->rtdev;
+
+        /* look up the first matching handler at the start of each run */
+        if ((head == NULL) || (rtskb->protocol != protocol)) {
+            protocol = rtskb->protocol;
+            head = &rt_packets[ntohs(protocol) & RTPACKET_HASH_KEY_MASK];
+            list_for_each_entry(pt_entry, head, list_entry)
+                if (pt_entry->type == protocol)
+                    break;
+        }
+
+        if (&pt_entry->list_entry == head)
+            rt_stack_drop(rtskb, 0);
+        /* on error, try the remaining handlers of this protocol */
+        else if (unlikely(pt_entry->handler(rtskb, pt_entry) != 0) &&
+                 (__rt_stack_deliver_l3(rtskb, pt_entry) != 0))
+            rt_stack_drop(rtskb, 0);
 
+        rtdev_dereference(rtdev);
+    }
+
+    rt_packets_leave(slot);
+}
+
+
+static void rt_stack_mgr_task(void *arg)
+{
+    struct rtnet_mgr        *mgr = (struct rtnet_mgr *)arg;
+    struct rtskb            *burst[RTNET_STACK_BURST_SIZE];
+    unsigned int            count;
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+    unsigned int            i;
+#endif
 
-    while (rtdm_event_wait(mgr_event) == 0) {
+
+    if ((mgr->cpu >= 0) && (rtos_task_migrate(mgr->cpu) < 0))
+        rtdm_printk("RTnet: unable to move stack manager to CPU %d\n",
+                    mgr->cpu);
+
+    while (rtdm_event_wait(&mgr->event) == 0) {
         /* we are the only reader => no locking required */
-        while ((rtskb = __rtskb_fifo_remove(&rx.fifo)))
-            rt_stack_deliver(rtskb);
+        while ((count = __rtskb_fifo_remove_bulk(mgr->rx_fifo, burst,
+                                                 RTNET_STACK_BURST_SIZE))) {
+#ifdef CONFIG_RTNET_LATENCY_TRACE
+            for (i = 0; i < count; i++)
+                rtnet_trace(burst[i], RTNET_LAT_RX_FIFO);
+#endif
+            rt_stack_deliver_batch(burst, count);
+        }
     }
 }
 
 
 /***
  *  rt_stack_connect
+ *
+ *  If a dedicated stack manager was set up for the device, it takes
+ *  precedence over the manager passed by the driver.
  */
 void rt_stack_connect (struct rtnet_device *rtdev, struct rtnet_mgr *mgr)
 {
+    if (rtdev->own_stack_mgr != NULL)
+        mgr = rtdev->own_stack_mgr;
+
+    rtdev->stack_mgr   = mgr;
     rtdev->stack_event = &mgr->event;
 }
 
@@ -237,11 +524,95 @@ EXPORT_SYMBOL(rt_stack_connect);
 void rt_stack_disconnect (struct rtnet_device *rtdev)
 {
     rtdev->stack_event = NULL;
+    rtdev->stack_mgr   = NULL;
 }
 
 EXPORT_SYMBOL(rt_stack_disconnect);
 
 
+/***
+ *  rt_stack_mgr_dev_setup - create a dedicated stack manager for a device
+ *  @rtdev: the device, must be down
+ *  @prio:  priority of the manager task
+ *  @cpu:   CPU the manager task shall run on, -1 for any
+ *
+ *  The new manager owns a private RX FIFO. Drivers which connect on open
+ *  pick it up via rt_stack_connect(), those which connected once on probe
+ *  are switched over here.
+ */
+int rt_stack_mgr_dev_setup(struct rtnet_device *rtdev, unsigned int prio,
+                           int cpu)
+{
+    struct rtnet_dev_stack_mgr  *dev_mgr;
+    int                         ret;
+
+
+    if ((cpu >= NR_CPUS) || ((cpu >= 0) && !cpu_online(cpu)))
+        return -EINVAL;
+
+    rt_stack_mgr_dev_release(rtdev);
+
+    dev_mgr = kmalloc(sizeof(struct rtnet_dev_stack_mgr), GFP_KERNEL);
+    if (dev_mgr == NULL)
+        return -ENOMEM;
+
+    snprintf(dev_mgr->name, sizeof(dev_mgr->name), "rtnet-stack-%s",
+             rtdev->name);
+
+    rtskb_fifo_init(&dev_mgr->rx.fifo, CONFIG_RTNET_RX_FIFO_SIZE);
+    dev_mgr->mgr.rx_fifo = &dev_mgr->rx.fifo;
+    dev_mgr->mgr.cpu     = (cpu < 0) ? -1 : cpu;
+
+    rtdm_event_init(&dev_mgr->mgr.event, 0);
+
+    ret = rtdm_task_init(&dev_mgr->mgr.task, dev_mgr->name,
+                         rt_stack_mgr_task, &dev_mgr->mgr, prio, 0);
+    if (ret < 0) {
+        rtdm_event_destroy(&dev_mgr->mgr.event);
+        kfree(dev_mgr);
+        return ret;
+    }
+
+    rtdev->own_stack_mgr = &dev_mgr->mgr;
+
+    if (rtdev->stack_mgr != NULL)
+        rt_stack_connect(rtdev, rtdev->own_stack_mgr);
+
+    return 0;
+}
+
+
+/***
+ *  rt_stack_mgr_dev_release - drop the dedicated stack manager of a device
+ *  @rtdev: the device, must be down
+ */
+void rt_stack_mgr_dev_release(struct rtnet_device *rtdev)
+{
+    struct rtnet_mgr    *mgr = rtdev->own_stack_mgr;
+    struct rtskb        *rtskb;
+
+
+    if (mgr == NULL)
+        return;
+
+    rtdev->own_stack_mgr = NULL;
+
+    /* still connected if the driver only connects on probe */
+    if (rtdev->stack_mgr == mgr)
+        rt_stack_connect(rtdev, &STACK_manager);
+
+    rt_stack_mgr_delete(mgr);
+
+    /* drop what the task did not deliver anymore */
+    while ((rtskb = __rtskb_fifo_remove(mgr->rx_fifo)) != NULL) {
+        rtdev_dereference(rtskb->rtdev);
+        kfree_rtskb(rtskb);
+    }
+
+    kfree(container_of(mgr, struct rtnet_dev_stack_mgr, mgr));
+}
+
+
 /***
  *  rt_stack_mgr_init
  */
@@ -251,6 +622,8 @@ int rt_stack_mgr_init (struct rtnet_mgr *mgr)
 
 
     rtskb_fifo_init(&rx.fifo, CONFIG_RTNET_RX_FIFO_SIZE);
+    mgr->rx_fifo = &rx.fifo;
+    mgr->cpu     = stack_mgr_cpu;
 
     for (i = 0; i < RTPACKET_HASH_TBL_SIZE; i++)
         INIT_LIST_HEAD(&rt_packets[i]);
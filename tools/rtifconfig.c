@@ -168,6 +168,11 @@ void help(void)
         "\trtifconfig <dev> up [<addr> [netmask <mask>]] "
             "[hw <HW> <address>] [[-]promisc]\n"
         "\trtifconfig <dev> down\n"
+        "\trtifconfig <dev> stackmgr (<prio> [cpu <cpu>] | shared)\n"
+        "\trtifconfig <dev> vlan add <vid>\n"
+        "\trtifconfig <vlan-dev> vlan del\n"
+        "\trtifconfig -d\n"
+        "\trtifconfig -L\n"
         );
 
     exit(1);
@@ -373,6 +378,7 @@ void do_up(int argc, char *argv[])
             help();
     }
 
+    cmd.args.up.netmask      = ip_mask;
     cmd.args.up.broadcast_ip = cmd.args.up.ip_addr | (~ip_mask);
 
     ret = ioctl(f, IOC_RT_IFUP, &cmd);
@@ -402,6 +408,111 @@ void do_down(int argc,char *argv[])
 
 
 
+void do_stackmgr(int argc, char *argv[])
+{
+    char    *end;
+    int     r;
+
+
+    if (argc < 4)
+        help();
+
+    if (strcmp(argv[3], "shared") == 0) {
+        if (argc > 4)
+            help();
+        cmd.args.stack_mgr.dedicated = 0;
+    } else {
+        cmd.args.stack_mgr.dedicated = 1;
+        cmd.args.stack_mgr.priority  = strtoul(argv[3], &end, 0);
+        cmd.args.stack_mgr.cpu       = -1;
+        if (*end != 0)
+            help();
+
+        if (argc > 4) {
+            if ((argc != 6) || (strcmp(argv[4], "cpu") != 0))
+                help();
+            cmd.args.stack_mgr.cpu = strtol(argv[5], &end, 0);
+            if ((*end != 0) || (cmd.args.stack_mgr.cpu < 0))
+                help();
+        }
+    }
+
+    r = ioctl(f, IOC_RT_IFSTACKMGR, &cmd);
+    if (r < 0) {
+        perror("ioctl");
+        exit(1);
+    }
+    exit(0);
+}
+
+
+
+void do_vlan(int argc, char *argv[])
+{
+    char    *end;
+    int     r;
+
+
+    if ((argc == 5) && (strcmp(argv[3], "add") == 0)) {
+        cmd.args.vlan.vid = strtoul(argv[4], &end, 0);
+        if ((*end != 0) || (cmd.args.vlan.vid == 0) ||
+            (cmd.args.vlan.vid > 4094))
+            help();
+        r = ioctl(f, IOC_RT_VLAN_ADD, &cmd);
+    } else if ((argc == 4) && (strcmp(argv[3], "del") == 0))
+        r = ioctl(f, IOC_RT_VLAN_DEL, &cmd);
+    else
+        help();
+
+    if (r < 0) {
+        perror("ioctl");
+        exit(1);
+    }
+    exit(0);
+}
+
+
+
+void do_drops(void)
+{
+    static const char           *names[] = RTNET_DROP_REASON_NAMES;
+    struct rtnet_drop_stats_cmd drops;
+    unsigned int                i;
+    int                         r;
+
+
+    memset(&drops, 0, sizeof(drops));
+
+    r = ioctl(f, IOC_RT_DROPSTATS, &drops);
+    if (r < 0) {
+        perror("ioctl");
+        exit(1);
+    }
+
+    for (i = 0; i < drops.count; i++)
+        if (i < sizeof(names) / sizeof(names[0]))
+            printf("%-24s %llu\n", names[i],
+                   (unsigned long long)drops.counter[i]);
+        else
+            printf("reason %-17u %llu\n", i,
+                   (unsigned long long)drops.counter[i]);
+
+    exit(0);
+}
+
+
+
+void do_latency_reset(void)
+{
+    if (ioctl(f, IOC_RT_LATENCY_RESET, &cmd) < 0) {
+        perror("ioctl");
+        exit(1);
+    }
+    exit(0);
+}
+
+
+
 int main(int argc, char *argv[])
 {
     if ((argc > 1) && (strcmp(argv[1], "--help") == 0))
@@ -417,6 +528,11 @@ int main(int argc, char *argv[])
     if (argc == 1)
         do_display(PRINT_FLAG_ALL);
 
+    if (strcmp(argv[1], "-d") == 0)
+        do_drops();
+    if (strcmp(argv[1], "-L") == 0)
+        do_latency_reset();
+
     if (strcmp(argv[1], "-a") == 0) {
         if (argc == 3) {
             strncpy(cmd.head.if_name, argv[2], IFNAMSIZ);
@@ -433,6 +549,10 @@ int main(int argc, char *argv[])
         do_up(argc,argv);
     if (strcmp(argv[2], "down") == 0)
         do_down(argc,argv);
+    if (strcmp(argv[2], "stackmgr") == 0)
+        do_stackmgr(argc,argv);
+    if (strcmp(argv[2], "vlan") == 0)
+        do_vlan(argc,argv);
 
     help();
 
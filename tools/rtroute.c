@@ -50,6 +50,7 @@ void help(void)
     fprintf(stderr, "Usage:\n"
         "\trtroute\n"
         "\trtroute solicit <addr> dev <dev>\n"
+        "\trtroute resolve <addr> [<addr> ...] dev <dev> [timeout <ms>]\n"
         "\trtroute add <addr> <hwaddr> dev <dev>\n"
         "\trtroute add <addr> netmask <mask> gw <gw-addr>\n"
         "\trtroute del <addr> [dev <dev>]\n"
@@ -124,6 +125,52 @@ void route_solicit(int argc, char *argv[])
 
 
 
+void route_resolve(int argc, char *argv[])
+{
+    struct in_addr  ip_addr;
+    unsigned int    i;
+    int             n;
+    int             ret;
+
+
+    /* addresses up to "dev" */
+    for (n = 2; (n < argc) && (strcmp(argv[n], "dev") != 0); n++) {
+        if ((n - 2 >= IPV4_RESOLVE_MAX) || !inet_aton(argv[n], &ip_addr))
+            help();
+        cmd.args.resolve.ip_addr[n - 2] = ip_addr.s_addr;
+    }
+    cmd.args.resolve.count = n - 2;
+
+    if (n + 1 >= argc)
+        help();
+    strncpy(cmd.head.if_name, argv[n + 1], IFNAMSIZ);
+
+    cmd.args.resolve.timeout = 1000;
+    if (argc == n + 4) {
+        if (strcmp(argv[n + 2], "timeout") != 0)
+            help();
+        cmd.args.resolve.timeout = strtoul(argv[n + 3], NULL, 0);
+    } else if (argc != n + 2)
+        help();
+
+    ret = ioctl(f, IOC_RT_HOST_ROUTE_RESOLVE, &cmd);
+    if ((ret < 0) && (errno != ETIMEDOUT)) {
+        perror("ioctl");
+        exit(1);
+    }
+
+    if (cmd.args.resolve.timeout == 0)
+        exit(0);
+
+    for (i = 0; i < cmd.args.resolve.count; i++)
+        if (!(cmd.args.resolve.resolved & (1 << i)))
+            fprintf(stderr, "%s: not resolved\n", argv[i + 2]);
+
+    exit((ret < 0) ? 1 : 0);
+}
+
+
+
 void route_add(int argc, char *argv[])
 {
     struct ether_addr   dev_addr;
@@ -380,6 +427,8 @@ int main(int argc, char *argv[])
 
     if (strcmp(argv[1], "solicit") == 0)
         route_solicit(argc, argv);
+    if (strcmp(argv[1], "resolve") == 0)
+        route_resolve(argc, argv);
     if (strcmp(argv[1], "add") == 0)
         route_add(argc, argv);
     if (strcmp(argv[1], "del") == 0)